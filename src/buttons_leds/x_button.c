@@ -270,15 +270,8 @@ void xButtonActionThread(void){
                 continue;
             }
 
-            // if cell is enabled, disable it before enabling wifi
-            if( xSensorAggregationGetMode() == xSensAggModeCell ){
-                xSensorAggregationStopCell();
-                do{
-                    k_sleep(K_MSEC(1000));
-                }while( xSensorAggregationIsLocked() );
-            }   
-
-            // enable sensor aggregation application over wifi
+            // enable sensor aggregation application over wifi (cell,
+            // if enabled, is disabled first)
             xSensorAggregationStartWifi();
             continue;
         }
@@ -295,15 +288,8 @@ void xButtonActionThread(void){
                 continue;
             }
 
-            // if wifi is enabled, disable it before enabling cell
-            if( xSensorAggregationGetMode() == xSensAggModeWifi ){
-                xSensorAggregationStopWifi();
-                do{
-                    k_sleep(K_MSEC(1000));
-                }while( xSensorAggregationIsLocked() );
-            }
-
-            // enable sensor aggregation application over cell
+            // enable sensor aggregation application over cell (wifi,
+            // if enabled, is disabled first)
             xSensorAggregationStartCell();
             continue;
         }
@@ -24,13 +24,18 @@
 #include "x_data_handle.h"
 
 #include <stdio.h>         //snprintf
+#include <stdlib.h>        //atoi
+#include <string.h>        //strcmp, memset
+#include <zephyr.h>
 #include <logging/log.h>
 
 #include "x_base64.h"
 #include "x_wifi_mqtt.h"
+#include "x_wifi_conn.h"
 #include "x_cell_mqttsn.h"
 #include "x_sensor_aggregation_function.h"
 #include "x_logging.h"
+#include "x_system_conf.h"
 
 #include "x_errno.h"
 
@@ -43,6 +48,36 @@
  *  to send */
 #define TEMP_STRBUF_SIZE    100
 
+
+/* ----------------------------------------------------------------
+ * TYPE DEFINITIONS
+ * -------------------------------------------------------------- */
+
+/** A message in the publish queue (xDataPublishBuf_t handle) */
+typedef struct xDataPublishBuf_s{
+    xDataTopic_t topic;
+    uint16_t id;            /**< Message id, used in the chunk headers if the message is fragmented */
+    char message[ DATA_MSG_MAX_LEN ];
+    uint8_t qos;
+    int64_t queuedTime;     /**< Uptime (ms) the message was put in the queue */
+    bool isAsync;           /**< Published as is to asyncDest (xDataPublishAsync) */
+    size_t len;             /**< Payload length (asynchronous publish) */
+    xClientType_t asyncClient;
+    char asyncTopic[ DATA_ASYNC_TOPIC_MAXLEN ];
+    uMqttSnTopicName_t asyncSnTopic;
+    xDataPublishCb_t pCb;   /**< Completion callback (asynchronous publish) */
+    void *pCbParam;
+}dataPublishMsg_t;
+
+/** An entry of the topic registry */
+typedef struct{
+    const char *pName;              /**< Topic name (MQTT, MQTT-SN normal topic) */
+    const char *pAlias;             /**< Predefined MQTT-SN topic ID */
+    uMqttSnTopicName_t snTopic;     /**< MQTT-SN topic, prepared for snSession */
+    uint32_t snSession;             /**< MQTT-SN session snTopic is valid for (0: not prepared) */
+    uint32_t registrations;         /**< Normal topic registrations with the broker */
+}dataTopicEntry_t;
+
 /* ----------------------------------------------------------------
  * STATIC FUNCTION DECLARATION
  * -------------------------------------------------------------- */
@@ -59,11 +94,11 @@
 static err_code xDataGetErrStr(xDataError_t err, char *string, uint8_t string_maxlen);
 
 
-/** Function that prepares the message (in that case a JSON string encoded in Base64)
+/** Function that prepares the message (in that case a JSON string)
  * that will be sent via MQTT(SN) in Thingstream portal. This function handles single
  * sensor messages, meaning each sensor has a separate message. The message itself is
  * stored in global string variable pMessage.
- * Also sets the topic to which the message should be published in gpTopicNameStr global
+ * Also sets the topic to which the message should be published in gTopic global
  *
  * @param sensor_data_packet   [Input] Data to be prepared in a xDataPacket_t structure
  * @return                     zero on success (X_ERR_SUCCESS) else negative error code.
@@ -72,30 +107,158 @@ static err_code xDataPrepareSingleSensorMsg(xDataPacket_t sensor_data_packet);
 
 
 
-/** Function that prepares the message (in that case a JSON string encoded in Base64)
+/** Function that prepares the message (in that case a JSON string)
  * that will be sent via MQTT(SN) in Thingstream portal. This function accumulates
  * all sensors data in one message, and the message itself is stored in global string
  * variable pMessage.
- * Also sets the topic to which the message should be published in gpTopicNameStr global
+ * Also sets the topic to which the message should be published in gTopic global
  *
  * @param sensor_data_packet   [Input] Data to be prepared in a xDataPacket_t structure
  * 
+ * The message of an epoch is complete when all sensors due in this epoch (see
+ * xSensorAggregationGetRateDivisor) have been acquired.
+ * 
  * @return                     negative error code when error happens. 
- *                             zero when data are accumulated successfully in the message,
+ *                             one when data are accumulated successfully in the message,
  *                             but more sensors need to be sampled.
- *                             one when data accumulated succesfully and all sensors have been
- *                             acquired to complete a full sensor data packet. If one is returned
+ *                             zero when data accumulated succesfully and all sensors have been
+ *                             acquired to complete a full sensor data packet. If zero is returned
  *                             the message is ready to be sent. 
  */
 int32_t xDataPrepareSensorAggregationMsg(xDataPacket_t sensor_data_packet);
 
 
+/** Is a sensor due in the current sensor aggregation epoch (sampled with a
+ * rate divisor, see xSensorAggregationGetRateDivisor) */
+static bool xDataAggregateIsDue(xSensType_t sensorType);
+
+
+/** Clears the sensor aggregation message, the next sensor received opens a new one */
+static void xDataAggregateNext(void);
+
+
+/** Sensor aggregation epoch at this time: the update periods elapsed since the
+ * function (or the epochs) started. Shared by all sensors, so a sensor sampled
+ * late belongs to the same epoch as the others sampled in this period */
+static uint32_t xDataAggregateTick(void);
+
+
+/** Has the sensor aggregation message of the current epoch received any sensor */
+static bool xDataAggregateIsOpen(void);
+
+
+/** Thread publishing the messages of the publish queue, in order.
+ */
+void xDataPublishThread(void);
+
+
+/** Publishes a message of the publish queue via the connected client
+ * (MQTT or MQTT-SN) and updates the publish statistics.
+ *
+ * @param pMsg   The message.
+ */
+static void xDataPublish(dataPublishMsg_t *pMsg);
+
+
+/** Puts a message at the end of the batch. If the batch is full the oldest
+ * message is dropped.
+ *
+ * @param topic    Topic to publish the message to.
+ * @param pMsgStr  The message (JSON string).
+ * @param qos      Quality of service to publish the message with.
+ */
+static void xDataBatchPut(xDataTopic_t topic, const char *pMsgStr, uint8_t qos);
+
+
+/** Puts a message in the publish queue, or in the batch in duty-cycled
+ * transport mode. If the queue is full the message is dropped.
+ *
+ * @param topic    Topic to publish the message to.
+ * @param pMsgStr  The message (JSON string).
+ * @param qos      Quality of service to publish the message with.
+ */
+static void xDataQueue(xDataTopic_t topic, const char *pMsgStr, uint8_t qos);
+
+
+/** Puts a copy of a message at the end of the batch. If the batch is full
+ * the oldest message is dropped.
+ *
+ * @param pMsg   The message.
+ * @return       Messages in the batch.
+ */
+static uint32_t xDataBatchAppend(const dataPublishMsg_t *pMsg);
+
+
+/** Gets the MQTT-SN topic of a topic from the registry. The topic is prepared
+ * (predefined ID set or normal topic registered with the broker) only the first
+ * time it is used in an MQTT-SN session.
+ *
+ * @param topic        The topic.
+ * @param ppTopicName  [Output] The MQTT-SN topic to publish to.
+ * @return             zero on success else negative error code.
+ */
+static err_code xDataMqttSnTopicGet(xDataTopic_t topic, const uMqttSnTopicName_t **ppTopicName);
+
+
+/** Publishes a message of the publish queue via a client type, encoded as set
+ * for the client type (see xDataSetEncoding). If the (encoded) message is longer
+ * than the chunk length of the client type and encoding, it is published in chunks,
+ * each one starting with a DATA_CHUNK_HEADER_FORMAT header.
+ *
+ * @param type         MqttClient or MqttSNClient.
+ * @param pMsg         The message.
+ * @param pTopicName   The MQTT-SN topic (MqttSNClient only).
+ * @param pSentLen     [Output] Bytes published (including chunk headers).
+ * @return             zero on success (all chunks published) else negative error code.
+ */
+static err_code xDataPublishChunks(xClientType_t type, dataPublishMsg_t *pMsg,
+                                   const uMqttSnTopicName_t *pTopicName, size_t *pSentLen);
+
+
+/** Publishes a message given to xDataPublishAsync as is, via its client,
+ * and calls its completion callback.
+ *
+ * @param pMsg   The message.
+ */
+static void xDataPublishAsyncMsg(dataPublishMsg_t *pMsg);
+
+
+/** Updates the publish statistics of a client type and QoS with the result
+ * of a publish.
+ *
+ * @param type     MqttClient or MqttSNClient.
+ * @param pMsg     The message.
+ * @param err      The publish result.
+ * @param start    Uptime (ms) the publish started.
+ * @param sentLen  Bytes published.
+ */
+static void xDataPublishStatsUpdate(xClientType_t type, const dataPublishMsg_t *pMsg,
+                                    err_code err, int64_t start, size_t sentLen);
+
+
 /* ----------------------------------------------------------------
  * ZEPHYR RELATED DEFINITIONS
  * -------------------------------------------------------------- */
 
 LOG_MODULE_REGISTER(LOGMOD_NAME_DATA_HANDLE, LOG_LEVEL_DBG);
 
+// Publish queue: messages accepted by xDataSend and not yet published
+K_MEM_SLAB_DEFINE(xDataPublishSlab, sizeof(dataPublishMsg_t), DATA_PUBLISH_QUEUE_LEN, 4);
+K_MSGQ_DEFINE(xDataPublishMsgq, sizeof(dataPublishMsg_t *), DATA_PUBLISH_QUEUE_LEN, 4);
+
+// Given when all messages of the queue have been published
+K_SEM_DEFINE(xDataQueueEmpty_semaphore, 0, 1);
+
+// Protects the batch
+K_MUTEX_DEFINE(xDataBatch_mutex);
+
+// Protects the publish, publish queue and encoding statistics, updated by
+// the publish thread and by the callers putting messages in the queue
+K_MUTEX_DEFINE(xDataStats_mutex);
+
+K_THREAD_DEFINE(xDataPublishThreadID, DATA_PUBLISH_STACK_SIZE, xDataPublishThread, NULL, NULL, NULL,
+		DATA_PUBLISH_PRIORITY, 0, 0);
+
 
 /* ----------------------------------------------------------------
  * GLOBALS
@@ -103,17 +266,117 @@ LOG_MODULE_REGISTER(LOGMOD_NAME_DATA_HANDLE, LOG_LEVEL_DBG);
 
 
 /** Topic to which the message should be published*/
-static char gpTopicNameStr[MQTT_MAX_TOPIC_LEN];
+static xDataTopic_t gTopic;
 
 /** The message to be published. Created by functions xDataPrepareSingleSensorMsg
  * and xDataPrepareSensorAggregationMsg and reset by function 
  * xDataResetSensorAggregationMsg
 */
-static char pMessage[MQTT_MAX_MSG_LEN];
+static char pMessage[DATA_MSG_MAX_LEN];
+
+/** The message being published, encoded in Base64. Only used by xDataPublishThread */
+static char gEncodedMessage[ DATA_BASE64_LEN( DATA_MSG_MAX_LEN ) ];
+
+/** Id given to the next message */
+static uint16_t gMsgId = 0;
+
+/** A chunk of a fragmented message. Only used by xDataPublishThread */
+static char gChunk[ MAX( DATA_CHUNK_LEN_MQTT, DATA_CHUNK_LEN_MQTTSN ) ];
+
+/** Max payload published at once, per client type (MqttClient, MqttSNClient) and encoding */
+static const size_t gChunkLen[ 2 ][ dataEncodingNum ] = {
+    [MqttClient] = {
+        [dataEncodingBase64] = DATA_CHUNK_LEN_MQTT,
+        [dataEncodingRaw] = DATA_CHUNK_LEN_MQTT
+    },
+    [MqttSNClient] = {
+        [dataEncodingBase64] = DATA_CHUNK_LEN_MQTTSN,
+        [dataEncodingRaw] = DATA_CHUNK_LEN_MQTTSN_BINARY
+    }
+};
+
+/** Encoding of the published messages, per client type */
+static xDataEncoding_t gEncoding[ 2 ] = {
+    [MqttClient] = DATA_DEFAULT_ENCODING_MQTT,
+    [MqttSNClient] = DATA_DEFAULT_ENCODING_MQTTSN
+};
+
+/** Encoding names used by the shell commands */
+const char *const gpEncodingStrings[]={
+    [dataEncodingBase64] = "base64",
+    [dataEncodingRaw] = "raw"
+};
+
+/** Published messages and bytes per client type and encoding */
+static xDataEncodingStats_t gEncodingStats[ 2 ][ dataEncodingNum ];
+
+
+/** Topic registry: topic names and aliases, and the MQTT-SN topics prepared
+ * in the current session. Only used by xDataPublishThread (and shell commands) */
+static dataTopicEntry_t gTopics[ dataTopicNum ] = {
+    [dataTopicBme280]     = { .pName = TOPIC_NAME_BME280,      .pAlias = TOPIC_ALIAS_BME280 },
+    [dataTopicBattery]    = { .pName = TOPIC_NAME_BQ27520,     .pAlias = TOPIC_ALIAS_BQ27520 },
+    [dataTopicLis2dh12]   = { .pName = TOPIC_NAME_LIS2DH12,    .pAlias = TOPIC_ALIAS_LIS2DH12 },
+    [dataTopicLis3mdl]    = { .pName = TOPIC_NAME_LIS3MDL,     .pAlias = TOPIC_ALIAS_LIS3MDL },
+    [dataTopicLtr303]     = { .pName = TOPIC_NAME_LTR303,      .pAlias = TOPIC_ALIAS_LTR303 },
+    [dataTopicIcg20330]   = { .pName = TOPIC_NAME_ICG20330,    .pAlias = TOPIC_ALIAS_ICG20330 },
+    [dataTopicMaxm10s]    = { .pName = TOPIC_NAME_MAXM10S,     .pAlias = TOPIC_ALIAS_MAXM10S },
+    [dataTopicAllSensors] = { .pName = TOPIC_NAME_ALL_SENSORS, .pAlias = TOPIC_ALIAS_ALL_SENSORS },
+    [dataTopicLinkQuality] = { .pName = TOPIC_NAME_LINK_QUALITY, .pAlias = TOPIC_ALIAS_LINK_QUALITY },
+    [dataTopicConfigRsp]  = { .pName = TOPIC_NAME_CONFIG_RSP,  .pAlias = TOPIC_ALIAS_CONFIG_RSP }
+};
+
+/** How topics are addressed via MQTT-SN */
+static xDataMqttSnTopicType_t gMqttSnTopicType = DATA_DEFAULT_MQTTSN_TOPIC_TYPE;
+
+/** MQTT-SN topic type names used by the shell commands */
+const char *const gpMqttSnTopicTypeStrings[]={
+    [dataMqttSnTopicPredefined] = "pre",
+    [dataMqttSnTopicNormal] = "normal"
+};
+
+
+/** Quality of Service per topic class */
+static uint8_t gTopicQos[ dataTopicClassNum ] = {
+    [dataTopicSensor] = DATA_DEFAULT_QOS_SENSOR,
+    [dataTopicPosition] = DATA_DEFAULT_QOS_POSITION,
+    [dataTopicAggregate] = DATA_DEFAULT_QOS_AGGREGATE,
+    [dataTopicDiagnostics] = DATA_DEFAULT_QOS_DIAGNOSTICS,
+    [dataTopicConfig] = DATA_DEFAULT_QOS_CONFIG
+};
+
+/** Topic class names used by the shell commands */
+const char *const gpTopicClassStrings[]={
+    [dataTopicSensor] = "sensor",
+    [dataTopicPosition] = "position",
+    [dataTopicAggregate] = "aggregate",
+    [dataTopicDiagnostics] = "diagnostics",
+    [dataTopicConfig] = "config"
+};
+
+
+/** Publish statistics per client type (MqttClient, MqttSNClient) and QoS */
+static xDataPublishStats_t gPublishStats[ 2 ][ DATA_QOS_MAX + 1 ];
 
+/** Publish queue usage */
+static struct{
+    uint32_t peak;       /**< Max messages in the queue at the same time */
+    uint32_t dropped;    /**< Messages dropped because the queue was full */
+    uint32_t fragmented; /**< Messages published in chunks */
+    uint32_t chunks;     /**< Chunks published */
+}gQueueStats = {0};
 
-/** Topic alias to which the message should be published (used with MQTT-SN)*/
-static char gpTopicAliasStr[10];
+/** Messages kept while the link is down in duty-cycled transport mode
+ * (circular buffer, oldest at head) */
+static struct{
+    dataPublishMsg_t msgs[ DATA_BATCH_MAX_MSGS ];
+    uint8_t head;
+    uint8_t count;
+    bool isEnabled;
+    bool holdOnFailure;  /**< Messages that cannot be published are held */
+    uint32_t held;       /**< Messages held because they could not be published */
+    uint32_t dropped;    /**< Messages dropped (batch full or discarded) */
+}gBatch = { .head = 0, .count = 0, .isEnabled = false, .holdOnFailure = false, .held = 0, .dropped = 0 };
 
 
 /** Used to Flag which sensor's data has been received in order to fill the
@@ -123,6 +386,15 @@ static char gpTopicAliasStr[10];
 static bool gSensorsReceivedFlags[max_sensors_num_t] = {0};
 
 
+/** Sensor aggregation epoch (sampling period) of the message being prepared.
+ * Sensors with rate divisor N are included every N epochs. */
+static uint32_t gAggregateEpoch = 0;
+
+
+/** Uptime (ms) epoch zero started, see xDataAggregateTick */
+static int64_t gAggregateStart = 0;
+
+
 /** Contains the string representation of Data Error types. Used by 
  * xDataGetErrStr
  */
@@ -131,6 +403,7 @@ const char *const gpSensorErrorStrings[]={
 	[dataErrNotInit]= "init",
 	[dataErrFetchFail] = "fetch",
 	[dataErrFetchTimeout]="timeout",
+	[dataErrLowAccuracy]="accuracy",
 };
 
 
@@ -205,6 +478,16 @@ static int32_t xDataPrepareSingleSensorMsg( xDataPacket_t sensor_data_packet ){
                     sensor_data_packet.meas[ meas_num ].data.doubleVal);
             }
 
+            // if measurement is a string, it may not fit in the temporary buffer
+            // so add it directly to the message
+            else if( sensor_data_packet.meas[ meas_num ].dataType == isString ){
+                snprintf(pMessage + strlen(pMessage), sizeof(pMessage) - strlen(pMessage), "{\"%s\":\"%s\",\"%s\":\"%s\"}",
+                    JSON_KEYNAME_SENSOR_CHAN_ID,
+                    sensor_data_packet.meas[ meas_num ].name,
+                    JSON_KEYNAME_SENSOR_CHAN_VALUE,
+                    sensor_data_packet.meas[ meas_num ].data.strVal);
+            }
+
             // if measurement is integer
             else{
                 snprintf(str_buf, sizeof(str_buf), "{\"%s\":\"%s\",\"%s\":%d}", 
@@ -228,54 +511,33 @@ static int32_t xDataPrepareSingleSensorMsg( xDataPacket_t sensor_data_packet ){
         }
     }
 
-    // encode string to Base64 (this resolves some issues when sending characters via cell)
-    // characters like double quotes ", used in JSON strings may be affected. Encoding the string
-    // resolves this issue
+    // the message is encoded (if needed by the transport) when published
 
     //LOG_DBG("%s\r\n",pMessage);
 
-    char str[ sizeof( pMessage )];
-    strcpy( str, pMessage );
-    err_code ret = xBase64Encode( str, pMessage, sizeof(pMessage) );
-    if( ret < 0 ){
-        LOG_ERR( "Message too big to send via MQTT(SN)\r\n" );
-        return ret;
-    }
-    
     // define topic
     switch(sensor_data_packet.sensorType){
 
-        case bme280_t:  strcpy(gpTopicNameStr,TOPIC_NAME_BME280);
-                        strcpy(gpTopicAliasStr,TOPIC_ALIAS_BME280);
-                        break;
-                        
-        
-        case battery_gauge_t: strcpy(gpTopicNameStr,TOPIC_NAME_BQ27520);
-                        strcpy(gpTopicAliasStr,TOPIC_ALIAS_BQ27520);
-                        break;
-        
-         
-        case lis2dh12_t:strcpy(gpTopicNameStr,TOPIC_NAME_LIS2DH12);
-                        strcpy(gpTopicAliasStr,TOPIC_ALIAS_LIS2DH12);
-                        break;
-        
-        case lis3mdl_t: strcpy(gpTopicNameStr,TOPIC_NAME_LIS3MDL);
-                        strcpy(gpTopicAliasStr,TOPIC_ALIAS_LIS3MDL);
-                        break;
-        
-        
-        case ltr303_t: strcpy(gpTopicNameStr,TOPIC_NAME_LTR303);
-                       strcpy(gpTopicAliasStr,TOPIC_ALIAS_LTR303);
-                       break;
-        
-        
-        case icg20330_t: strcpy(gpTopicNameStr,TOPIC_NAME_ICG20330);
-                          strcpy(gpTopicAliasStr,TOPIC_ALIAS_ICG20330);
-                          break;
-        
-        case maxm10_t: strcpy(gpTopicNameStr,TOPIC_NAME_MAXM10S);
-                       strcpy(gpTopicAliasStr, TOPIC_ALIAS_MAXM10S);
-                       break;
+        case bme280_t:          gTopic = dataTopicBme280;
+                                break;
+
+        case battery_gauge_t:   gTopic = dataTopicBattery;
+                                break;
+
+        case lis2dh12_t:        gTopic = dataTopicLis2dh12;
+                                break;
+
+        case lis3mdl_t:         gTopic = dataTopicLis3mdl;
+                                break;
+
+        case ltr303_t:          gTopic = dataTopicLtr303;
+                                break;
+
+        case icg20330_t:        gTopic = dataTopicIcg20330;
+                                break;
+
+        case maxm10_t:          gTopic = dataTopicMaxm10s;
+                                break;
         
         default: return X_ERR_INVALID_PARAMETER; //invalid parameters
         break;
@@ -364,6 +626,16 @@ int32_t xDataPrepareSensorAggregationMsg(xDataPacket_t sensor_data_packet){
                     sensor_data_packet.meas[ meas_num ].data.doubleVal);
             }
 
+            // if measurement is a string, it may not fit in the temporary buffer
+            // so add it directly to the message
+            else if( sensor_data_packet.meas[ meas_num ].dataType == isString ){
+                snprintf(pMessage + strlen(pMessage), sizeof(pMessage) - strlen(pMessage), "{\"%s\":\"%s\",\"%s\":\"%s\"}",
+                    JSON_KEYNAME_SENSOR_CHAN_ID,
+                    sensor_data_packet.meas[ meas_num ].name,
+                    JSON_KEYNAME_SENSOR_CHAN_VALUE,
+                    sensor_data_packet.meas[ meas_num ].data.strVal);
+            }
+
             // if measurement is integer
             else{
                 snprintf(str_buf, sizeof(str_buf), "{\"%s\":\"%s\",\"%s\":%d}",
@@ -411,11 +683,11 @@ int32_t xDataPrepareSensorAggregationMsg(xDataPacket_t sensor_data_packet){
         strcat (pMessage,str_buf);
     }
 
-    // flag sensor received and check if all needed sensors have been received
+    // flag sensor received and check if all sensors due in this epoch have been received
     gSensorsReceivedFlags[ sensor_data_packet.sensorType ] = true;
 
-    for( x=0; x < sizeof( gSensorsReceivedFlags ); x++ ){
-        if( !gSensorsReceivedFlags[x] ){
+    for( x=0; x < max_sensors_num_t; x++ ){
+        if( !gSensorsReceivedFlags[x] && xDataAggregateIsDue( x ) ){
             break;
         }
     }
@@ -424,19 +696,7 @@ int32_t xDataPrepareSensorAggregationMsg(xDataPacket_t sensor_data_packet){
     if( x == max_sensors_num_t ){
         // close sensors list and JSON packet
         strcat(pMessage,"]}");
-        strcpy(gpTopicAliasStr,TOPIC_ALIAS_ALL_SENSORS);
-        strcpy(gpTopicNameStr,TOPIC_NAME_ALL_SENSORS);
-        
-        // encode string to Base64 (this resolves some issues when sending characters via cell)
-        // characters like double quotes ", used in JSON strings may be affected. Encoding the string
-        // resolves this issue
-        char str[ sizeof( pMessage )];
-        strcpy(str,pMessage);
-        int32_t ret = xBase64Encode( str, pMessage, sizeof(pMessage) );
-        if( ret < 0 ){
-            LOG_ERR("Message too big to send via MQTT(SN)\r\n");
-            return ret;
-        }
+        gTopic = dataTopicAllSensors;
 
         return 0; //signal json packet complete
     }
@@ -448,6 +708,50 @@ int32_t xDataPrepareSensorAggregationMsg(xDataPacket_t sensor_data_packet){
 
 
 
+static bool xDataAggregateIsDue(xSensType_t sensorType){
+
+    return ( ( gAggregateEpoch % xSensorAggregationGetRateDivisor( sensorType ) ) == 0 );
+}
+
+
+
+static void xDataAggregateNext(void){
+
+    memset(gSensorsReceivedFlags, 0, sizeof(gSensorsReceivedFlags));
+    memset(pMessage, 0, sizeof(pMessage));
+}
+
+
+
+static uint32_t xDataAggregateTick(void){
+
+    int64_t elapsed = k_uptime_get() - gAggregateStart;
+    int32_t period = xSensorAggregationGetUpdatePeriod();
+
+    if( ( elapsed <= 0 ) || ( period <= 0 ) ){
+        return 0;
+    }
+
+    // a sample is taken when its period expires and received after the
+    // sensor fetch time, so it falls in the period it was sampled in
+    return (uint32_t)( elapsed / period );
+}
+
+
+
+static bool xDataAggregateIsOpen(void){
+
+    for( uint8_t x=0; x < max_sensors_num_t; x++ ){
+        if( gSensorsReceivedFlags[x] ){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+
 err_code xDataGetErrStr(xDataError_t err, char *string, uint8_t string_maxlen){
     
     if( string_maxlen < JSON_SENSOR_ERROR_STRING_MAXLEN ){
@@ -465,88 +769,1042 @@ err_code xDataGetErrStr(xDataError_t err, char *string, uint8_t string_maxlen){
 
 
 
-/* ----------------------------------------------------------------
- * PUBLIC FUNCTION IMPLEMENTATION
- * -------------------------------------------------------------- */
+void xDataPublishThread(void){
 
+    dataPublishMsg_t *pMsg;
 
-void xDataResetSensorAggregationMsg(void){
+    // needed to avoid thread overflows when using ubxlib functions within a thread
+    k_thread_system_pool_assign(k_current_get());
 
-    memset(gSensorsReceivedFlags, 0, sizeof(gSensorsReceivedFlags));
-    memset(pMessage, 0, sizeof(pMessage));
+    while(1){
+
+        // Messages put by xDataSend()
+        k_msgq_get( &xDataPublishMsgq, &pMsg, K_FOREVER );
+
+        if( pMsg->isAsync ){
+            xDataPublishAsyncMsg( pMsg );
+        }
+        else{
+            xDataPublish( pMsg );
+        }
+
+        // free a place in the queue
+        k_mem_slab_free( &xDataPublishSlab, (void **)&pMsg );
+
+        if( k_mem_slab_num_used_get( &xDataPublishSlab ) == 0 ){
+            k_sem_give( &xDataQueueEmpty_semaphore );
+        }
+    }
 }
 
 
 
-void xDataSend(xDataPacket_t sensor_data_packet){
+static uint32_t xDataBatchAppend(const dataPublishMsg_t *pMsg){
 
-    xSensorAggregationMode_t mode = xSensorAggregationGetMode();
+    uint32_t count;
 
-    // if sensor aggregation mode is not enabled, sensors
-    // are sent in separate messages
-    if( mode == xSensAggModeDisabled){
-        if( xDataPrepareSingleSensorMsg(sensor_data_packet) < 0 ){
-            xDataResetSensorAggregationMsg();
-            return;
-        }
+    k_mutex_lock( &xDataBatch_mutex, K_FOREVER );
+
+    // batch full, drop the oldest message
+    if( gBatch.count == DATA_BATCH_MAX_MSGS ){
+        gBatch.head = ( gBatch.head + 1 ) % DATA_BATCH_MAX_MSGS;
+        gBatch.count--;
+        gBatch.dropped++;
+        LOG_WRN("Batch full, oldest message dropped\r\n");
     }
 
-    // sensor aggregation mode enabled, send one message containing data 
-    // from all sensors
-    else{
-        int32_t ret;
-        ret = xDataPrepareSensorAggregationMsg(sensor_data_packet);
-        if( ret < 0 ){
-            // some processing error happened, reset message
-            xDataResetSensorAggregationMsg();
-            return;
-        }
-        else if( ret == 1 ){
-            //json packet not ready, wait for all sensors to be sampled   
-            return;
-        }
+    gBatch.msgs[ ( gBatch.head + gBatch.count ) % DATA_BATCH_MAX_MSGS ] = *pMsg;
+    count = ++gBatch.count;
 
-        //else -> all sensors sampled, message is ready to send
+    k_mutex_unlock( &xDataBatch_mutex );
+
+    return count;
+}
+
+
+
+static void xDataBatchPut(xDataTopic_t topic, const char *pMsgStr, uint8_t qos){
+
+    uint32_t count;
+
+    k_mutex_lock( &xDataBatch_mutex, K_FOREVER );
+
+    // batch full, drop the oldest message
+    if( gBatch.count == DATA_BATCH_MAX_MSGS ){
+        gBatch.head = ( gBatch.head + 1 ) % DATA_BATCH_MAX_MSGS;
+        gBatch.count--;
+        gBatch.dropped++;
+        LOG_WRN("Batch full, oldest message dropped\r\n");
     }
 
-    //LOG_DBG("%s\r\n",pMessage);
-    LOG_DBG("Send Message\r\n");
+    dataPublishMsg_t *pMsg = &gBatch.msgs[ ( gBatch.head + gBatch.count ) % DATA_BATCH_MAX_MSGS ];
+    pMsg->topic = topic;
+    pMsg->id = gMsgId++;
+    strcpy( pMsg->message, pMsgStr );
+    pMsg->qos = qos;
+    pMsg->queuedTime = k_uptime_get();
+    pMsg->isAsync = false;
+    pMsg->pCb = NULL;
+
+    count = ++gBatch.count;
+
+    k_mutex_unlock( &xDataBatch_mutex );
+
+    // let the duty-cycled transport decide whether to bring the link up
+    xSensorAggregationBatchNotify( count );
+}
+
+
+
+static void xDataQueue(xDataTopic_t topic, const char *pMsgStr, uint8_t qos){
+
+    // duty-cycled transport: keep the message until the link is up
+    if( gBatch.isEnabled ){
+        xDataBatchPut( topic, pMsgStr, qos );
+        return;
+    }
+
+    // put the message in the publish queue, it is published by xDataPublishThread
+    dataPublishMsg_t *pMsg;
+    if( k_mem_slab_alloc( &xDataPublishSlab, (void **)&pMsg, K_NO_WAIT ) != 0 ){
+        LOG_WRN("Publish queue full, message dropped\r\n");
+        k_mutex_lock( &xDataStats_mutex, K_FOREVER );
+        gQueueStats.dropped++;
+        k_mutex_unlock( &xDataStats_mutex );
+        return;
+    }
+
+    pMsg->topic = topic;
+    pMsg->id = gMsgId++;
+    strcpy( pMsg->message, pMsgStr );
+    pMsg->qos = qos;
+    pMsg->queuedTime = k_uptime_get();
+    pMsg->isAsync = false;
+    pMsg->pCb = NULL;
+
+    uint32_t used = k_mem_slab_num_used_get( &xDataPublishSlab );
+    k_mutex_lock( &xDataStats_mutex, K_FOREVER );
+    if( used > gQueueStats.peak ){
+        gQueueStats.peak = used;
+    }
+    k_mutex_unlock( &xDataStats_mutex );
+
+    // the message queue holds as many pointers as there are buffers, cannot be full
+    k_msgq_put( &xDataPublishMsgq, &pMsg, K_NO_WAIT );
+}
+
+
+
+static void xDataPublish(dataPublishMsg_t *pMsg){
 
     err_code err = X_ERR_SUCCESS;
-    //Set quality of service and retain
-    uint8_t qos = 0;
-    bool retain = false;
+    xClientType_t type;
+    const uMqttSnTopicName_t *pTopicName = NULL;
+    bool hold = gBatch.holdOnFailure;
+    size_t len = strlen( pMsg->message );
+    size_t sentLen = 0;
 
     // Check if mqtt or mqttsn are connected and publish
     xClientStatusStruct_t mqtt_status = xWifiMqttClientGetStatus();
     xClientStatus_t mqttsn_status = xCellMqttSnClientGetStatus();
 
-    if( mqtt_status.status == ClientConnected ){ 
-        err = xWifiMqttClientPublish(gpTopicNameStr, pMessage, strlen(pMessage), qos, retain);
-    }
-    else if(mqttsn_status == ClientConnected){
+    int64_t start = k_uptime_get();
 
-        uMqttSnTopicName_t topicName;
-        uint16_t alias = atoi(gpTopicAliasStr);
-        if ( ( err =  uMqttClientSnSetTopicIdPredefined(alias, &topicName) ) != U_ERROR_COMMON_SUCCESS ){
-            LOG_ERR("Error in uMqttClientSnSetTopicIdPredefined: %d\r\n", err);
-            return;    
-        }
+    // while reconnecting to the broker, the message is kept in the MQTT backlog,
+    // unless held here so that it is not lost if the transport changes: then
+    // only a client that can publish right now is used
+    bool useMqtt = hold ? xWifiMqttClientIsConnected() :
+                   ( ( mqtt_status.status == ClientConnected ) || xWifiConnIsReconnecting() );
 
-        err = xCellMqttSnClientPublish( &topicName, pMessage, 
-                                        strlen(pMessage), qos, retain);
+    if( useMqtt ){ 
+        type = MqttClient;
+    }
+    else if(mqttsn_status == ClientConnected){
+        type = MqttSNClient;
+        err = xDataMqttSnTopicGet( pMsg->topic, &pTopicName );
     }
     // no client is connected, cannot send data
     else{
+        if( hold ){
+            LOG_WRN("No connection, message held\r\n");
+            xDataBatchAppend( pMsg );
+            k_mutex_lock( &xDataBatch_mutex, K_FOREVER );
+            gBatch.held++;
+            k_mutex_unlock( &xDataBatch_mutex );
+            xSensorAggregationPublishResult( false );
+            return;
+        }
         LOG_ERR("Could not send data: mqtt(sn) connection issue\r\n");
+        return;
+    }
+
+    if( err == X_ERR_SUCCESS ){
+        err = xDataPublishChunks( type, pMsg, pTopicName, &sentLen );
+    }
+
+    if( hold ){
+        xSensorAggregationPublishResult( err == X_ERR_SUCCESS );
+    }
+
+    xDataPublishStatsUpdate( type, pMsg, err, start, sentLen );
+
+    // kept in the MQTT backlog, published after the reconnection
+    if( err == X_ERR_QUEUED ){
+        LOG_WRN("Message kept in MQTT backlog\r\n");
+        return;
+    }
+
+    // check publish errors
+    if( err != X_ERR_SUCCESS ){
+        LOG_ERR("Publish error %d \r\n", err);
+        if( hold ){
+            xDataBatchAppend( pMsg );
+            k_mutex_lock( &xDataBatch_mutex, K_FOREVER );
+            gBatch.held++;
+            k_mutex_unlock( &xDataBatch_mutex );
+        }
+        return;
+    }
+
+    k_mutex_lock( &xDataStats_mutex, K_FOREVER );
+    xDataEncodingStats_t *pEncStats = &gEncodingStats[ type ][ gEncoding[ type ] ];
+    pEncStats->messages++;
+    pEncStats->plainBytes += len;
+    pEncStats->sentBytes += sentLen;
+    k_mutex_unlock( &xDataStats_mutex );
+}
+
+
+
+static void xDataPublishStatsUpdate(xClientType_t type, const dataPublishMsg_t *pMsg,
+                                    err_code err, int64_t start, size_t sentLen){
+
+    // MQTT-SN send and forget (QoS 3) not counted
+    if( pMsg->qos > DATA_QOS_MAX ){
+        return;
+    }
+
+    uint32_t latency = (uint32_t)( k_uptime_get() - start );
+    xDataPublishStats_t *pStats = &gPublishStats[ type ][ pMsg->qos ];
+
+    k_mutex_lock( &xDataStats_mutex, K_FOREVER );
+
+    // not published yet, but not lost either
+    if( err == X_ERR_QUEUED ){
+        pStats->queued++;
+        k_mutex_unlock( &xDataStats_mutex );
+        return;
     }
 
-    // check publish errors from xCellMqttSnClientPublish
     if( err != X_ERR_SUCCESS ){
+        pStats->failed++;
+        k_mutex_unlock( &xDataStats_mutex );
+        return;
+    }
+
+    if( ( pStats->published == 0 ) || ( latency < pStats->latencyMinMs ) ){
+        pStats->latencyMinMs = latency;
+    }
+    if( latency > pStats->latencyMaxMs ){
+        pStats->latencyMaxMs = latency;
+    }
+    pStats->published++;
+    pStats->bytes += sentLen;
+    pStats->latencySumMs += latency;
+    pStats->waitSumMs += ( start - pMsg->queuedTime );
+    pStats->busySumMs += latency;
+
+    k_mutex_unlock( &xDataStats_mutex );
+}
+
+
+
+static void xDataPublishAsyncMsg(dataPublishMsg_t *pMsg){
+
+    err_code err;
+    int64_t start = k_uptime_get();
+
+    if( pMsg->asyncClient == MqttClient ){
+        err = xWifiMqttClientPublish( pMsg->asyncTopic, pMsg->message, pMsg->len, pMsg->qos, false );
+    }
+    else{
+        err = xCellMqttSnClientPublish( &pMsg->asyncSnTopic, pMsg->message, pMsg->len, pMsg->qos, false );
+    }
+
+    if( err == X_ERR_QUEUED ){
+        LOG_WRN("Message kept in MQTT backlog\r\n");
+    }
+    else if( err != X_ERR_SUCCESS ){
         LOG_ERR("Publish error %d \r\n", err);
     }
 
-    xDataResetSensorAggregationMsg();
+    xDataPublishStatsUpdate( pMsg->asyncClient, pMsg, err, start, pMsg->len );
+
+    if( pMsg->pCb != NULL ){
+        pMsg->pCb( err, (uint32_t)( k_uptime_get() - pMsg->queuedTime ), pMsg->pCbParam );
+    }
 }
 
 
+
+static err_code xDataPublishChunks(xClientType_t type, dataPublishMsg_t *pMsg,
+                                   const uMqttSnTopicName_t *pTopicName, size_t *pSentLen){
+
+    err_code err;
+    bool retain = false;
+    xDataEncoding_t encoding = gEncoding[ type ];
+    const char *pData = pMsg->message;
+    size_t len = strlen( pMsg->message );
+
+    // Base64 encoding: characters like double quotes ", used in JSON strings, may
+    // not pass through the AT interface of the module as plain text.
+    // Raw: via MQTT-SN the JSON string is passed as is to ubxlib, which sends
+    // messages that cannot be sent as plain text in SARA-R5 hex mode
+    if( encoding == dataEncodingBase64 ){
+        err = xBase64Encode( pMsg->message, gEncodedMessage, sizeof(gEncodedMessage) );
+        if( err < 0 ){
+            LOG_ERR( "Message too big to encode\r\n" );
+            return err;
+        }
+        pData = gEncodedMessage;
+        len = strlen( gEncodedMessage );
+    }
+
+    size_t chunkLen = gChunkLen[ type ][ encoding ];
+
+    // fits the transport, publish as is
+    if( len <= chunkLen ){
+        *pSentLen = len;
+        if( type == MqttClient ){
+            return xWifiMqttClientPublish( gTopics[ pMsg->topic ].pName, pData, len, pMsg->qos, retain );
+        }
+        return xCellMqttSnClientPublish( pTopicName, pData, len, pMsg->qos, retain );
+    }
+
+    size_t payloadLen = chunkLen - DATA_CHUNK_HEADER_MAXLEN;
+    uint32_t chunks = ( len + payloadLen - 1 ) / payloadLen;
+
+    LOG_DBG("Message %d: %d bytes, published in %d chunks\r\n", pMsg->id, len, chunks);
+
+    err_code result = X_ERR_SUCCESS;
+
+    *pSentLen = 0;
+    for( uint32_t chunk = 0; chunk < chunks; chunk++ ){
+
+        size_t offset = chunk * payloadLen;
+        size_t size = MIN( payloadLen, len - offset );
+
+        int hdrLen = snprintf( gChunk, sizeof(gChunk), DATA_CHUNK_HEADER_FORMAT, pMsg->id, chunk + 1, chunks );
+        memcpy( &gChunk[ hdrLen ], &pData[ offset ], size );
+
+        if( type == MqttClient ){
+            err = xWifiMqttClientPublish( gTopics[ pMsg->topic ].pName, gChunk, hdrLen + size, pMsg->qos, retain );
+        }
+        else{
+            err = xCellMqttSnClientPublish( pTopicName, gChunk, hdrLen + size, pMsg->qos, retain );
+        }
+
+        // the rest of the chunks follow the first one in the MQTT backlog
+        if( err == X_ERR_QUEUED ){
+            result = X_ERR_QUEUED;
+        }
+        // the whole message is published again if held (same id), the receiver
+        // restarts the reassembly when it gets chunk 1 again
+        else if( err != X_ERR_SUCCESS ){
+            return err;
+        }
+        *pSentLen += hdrLen + size;
+    }
+
+    k_mutex_lock( &xDataStats_mutex, K_FOREVER );
+    gQueueStats.fragmented++;
+    gQueueStats.chunks += chunks;
+    k_mutex_unlock( &xDataStats_mutex );
+    return result;
+}
+
+
+
+static err_code xDataMqttSnTopicGet(xDataTopic_t topic, const uMqttSnTopicName_t **ppTopicName){
+
+    err_code err;
+    dataTopicEntry_t *pEntry = &gTopics[ topic ];
+    uint32_t session = xCellMqttSnGetSession();
+
+    // already prepared in this session
+    if( pEntry->snSession == session ){
+        *ppTopicName = &pEntry->snTopic;
+        return X_ERR_SUCCESS;
+    }
+
+    if( gMqttSnTopicType == dataMqttSnTopicNormal ){
+        err = xCellMqttSnRegisterNormalTopic( pEntry->pName, &pEntry->snTopic );
+        if( err != X_ERR_SUCCESS ){
+            LOG_ERR("Could not register topic %s: %d\r\n", pEntry->pName, err);
+            return err;
+        }
+        pEntry->registrations++;
+        LOG_INF("Topic %s registered, ID: %d\r\n", pEntry->pName, pEntry->snTopic.name.id);
+    }
+    else{
+        err = uMqttClientSnSetTopicIdPredefined( (uint16_t)atoi( pEntry->pAlias ), &pEntry->snTopic );
+        if( err != X_ERR_SUCCESS ){
+            LOG_ERR("Error in uMqttClientSnSetTopicIdPredefined: %d\r\n", err);
+            return err;
+        }
+    }
+
+    pEntry->snSession = session;
+    *ppTopicName = &pEntry->snTopic;
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTION IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+
+void xDataResetSensorAggregationMsg(void){
+
+    memset(gSensorsReceivedFlags, 0, sizeof(gSensorsReceivedFlags));
+    memset(pMessage, 0, sizeof(pMessage));
+    gAggregateEpoch = 0;
+    gAggregateStart = k_uptime_get();
+}
+
+
+
+void xDataSend(xDataPacket_t sensor_data_packet){
+
+    xSensorAggregationMode_t mode = xSensorAggregationGetMode();
+
+    // if sensor aggregation mode is not enabled, sensors
+    // are sent in separate messages
+    if( mode == xSensAggModeDisabled){
+        if( xDataPrepareSingleSensorMsg(sensor_data_packet) < 0 ){
+            xDataResetSensorAggregationMsg();
+            return;
+        }
+    }
+
+    // sensor aggregation mode enabled, send one message containing data 
+    // from all sensors
+    else{
+        int32_t ret;
+        uint32_t tick = xDataAggregateTick();
+
+        // the epoch elapsed before all sensors due have been received (a sensor
+        // not responding), or a sensor is sampled twice in it: the message is
+        // published without the missing sensors
+        if( xDataAggregateIsOpen() &&
+            ( ( tick != gAggregateEpoch ) ||
+              ( ( sensor_data_packet.sensorType < max_sensors_num_t ) &&
+                gSensorsReceivedFlags[ sensor_data_packet.sensorType ] ) ) ){
+            LOG_WRN("Sensor Aggregation epoch %d closed, sensors due missing\r\n", gAggregateEpoch);
+            strcat(pMessage,"]}");
+            gTopic = dataTopicAllSensors;
+            xDataQueue( gTopic, pMessage, gTopicQos[ dataTopicAggregate ] );
+            xDataAggregateNext();
+        }
+
+        // the first sensor of a message sets its epoch, from the shared tick
+        // and not from the messages completed, so sensors due are known even
+        // after a message closed incomplete
+        if( !xDataAggregateIsOpen() ){
+            gAggregateEpoch = tick;
+        }
+
+        ret = xDataPrepareSensorAggregationMsg(sensor_data_packet);
+        if( ret < 0 ){
+            // some processing error happened, reset message
+            xDataAggregateNext();
+            return;
+        }
+        else if( ret == 1 ){
+            //json packet not ready, wait for all sensors to be sampled   
+            return;
+        }
+
+        //else -> all sensors sampled, message is ready to send
+    }
+
+    //LOG_DBG("%s\r\n",pMessage);
+    LOG_DBG("Send Message\r\n");
+
+    // Set quality of service from the topic class
+    xDataTopicClass_t topicClass;
+    if( mode != xSensAggModeDisabled ){
+        topicClass = dataTopicAggregate;
+    }
+    else if( sensor_data_packet.sensorType == maxm10_t ){
+        topicClass = dataTopicPosition;
+    }
+    else{
+        topicClass = dataTopicSensor;
+    }
+
+    xDataQueue( gTopic, pMessage, gTopicQos[ topicClass ] );
+
+    xDataAggregateNext();
+}
+
+
+
+void xDataSendDiagnostics(xDataPacket_t diag_packet){
+
+    char message[ DATA_DIAG_MSG_MAX_LEN ];
+    char str_buf[ TEMP_STRBUF_SIZE ];
+
+    if( ( diag_packet.measurementsNum == 0 ) || ( diag_packet.measurementsNum > JSON_SENSOR_MAX_MEASUREMENTS ) ){
+        return;
+    }
+
+    // same structure as a single sensor message, eg:
+    // {"ID":"LINK","mes":[{"nm":"Rsrp","vl":-95},{"nm":"Rsrq","vl":-11}]}
+    snprintf( message, sizeof(message), "{\"%s\":\"%s\",\"%s\":[",
+        JSON_KEYNAME_SENSOR_ID,
+        diag_packet.name,
+        JSON_KEYNAME_SENSOR_MEASUREMENTS);
+
+    for( uint8_t meas_num = 0; meas_num < diag_packet.measurementsNum; meas_num++ ){
+
+        if( diag_packet.meas[ meas_num ].dataType == isDouble ){
+            snprintf(str_buf, sizeof(str_buf), "{\"%s\":\"%s\",\"%s\":%.3f}",
+                JSON_KEYNAME_SENSOR_CHAN_ID,
+                diag_packet.meas[ meas_num ].name,
+                JSON_KEYNAME_SENSOR_CHAN_VALUE,
+                diag_packet.meas[ meas_num ].data.doubleVal);
+        }
+        else{
+            snprintf(str_buf, sizeof(str_buf), "{\"%s\":\"%s\",\"%s\":%d}",
+                JSON_KEYNAME_SENSOR_CHAN_ID,
+                diag_packet.meas[ meas_num ].name,
+                JSON_KEYNAME_SENSOR_CHAN_VALUE,
+                diag_packet.meas[ meas_num ].data.int32Val);
+        }
+
+        strncat( message, str_buf, sizeof(message) - strlen(message) - 1 );
+        strncat( message, ( meas_num < diag_packet.measurementsNum - 1 ) ? "," : "]}",
+                 sizeof(message) - strlen(message) - 1 );
+    }
+
+    xDataQueue( dataTopicLinkQuality, message, gTopicQos[ dataTopicDiagnostics ] );
+}
+
+
+
+void xDataSendConfigResponse(uint32_t reqId, err_code result){
+
+    char message[ DATA_CONFIG_RSP_MAX_LEN ];
+
+    snprintf( message, sizeof(message), "{\"%s\":\"%s\",\"%s\":%u,\"%s\":%d}",
+        JSON_KEYNAME_SENSOR_ID,
+        JSON_ID_CONFIG_RSP,
+        JSON_KEYNAME_CONFIG_REQ,
+        reqId,
+        JSON_KEYNAME_CONFIG_RES,
+        result);
+
+    xDataQueue( dataTopicConfigRsp, message, gTopicQos[ dataTopicConfig ] );
+}
+
+
+
+err_code xDataSetQos(xDataTopicClass_t topicClass, uint8_t qos){
+
+    if( ( topicClass >= dataTopicClassNum ) || ( qos > DATA_QOS_MAX ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    gTopicQos[ topicClass ] = qos;
+    return X_ERR_SUCCESS;
+}
+
+
+
+uint8_t xDataGetQos(xDataTopicClass_t topicClass){
+
+    if( topicClass >= dataTopicClassNum ){
+        return 0;
+    }
+    return gTopicQos[ topicClass ];
+}
+
+
+
+xDataTopicClass_t xDataGetTopicClassByName(const char *pName){
+
+    xDataTopicClass_t topicClass;
+
+    for( topicClass = 0; topicClass < dataTopicClassNum; topicClass++ ){
+        if( strcmp( pName, gpTopicClassStrings[ topicClass ] ) == 0 ){
+            break;
+        }
+    }
+    return topicClass;
+}
+
+
+
+xDataPublishStats_t xDataGetPublishStats(xClientType_t type, uint8_t qos){
+
+    xDataPublishStats_t stats = {0};
+
+    if( ( type > MqttSNClient ) || ( qos > DATA_QOS_MAX ) ){
+        return stats;
+    }
+
+    k_mutex_lock( &xDataStats_mutex, K_FOREVER );
+    stats = gPublishStats[ type ][ qos ];
+    k_mutex_unlock( &xDataStats_mutex );
+    return stats;
+}
+
+
+
+void xDataResetPublishStats(void){
+
+    k_mutex_lock( &xDataStats_mutex, K_FOREVER );
+    memset( gPublishStats, 0, sizeof( gPublishStats ) );
+    gQueueStats.peak = 0;
+    gQueueStats.dropped = 0;
+    gQueueStats.fragmented = 0;
+    gQueueStats.chunks = 0;
+    memset( gEncodingStats, 0, sizeof( gEncodingStats ) );
+    k_mutex_unlock( &xDataStats_mutex );
+
+    k_mutex_lock( &xDataBatch_mutex, K_FOREVER );
+    gBatch.held = 0;
+    gBatch.dropped = 0;
+    k_mutex_unlock( &xDataBatch_mutex );
+}
+
+
+
+err_code xDataSetMqttSnTopicType(xDataMqttSnTopicType_t type){
+
+    if( type >= dataMqttSnTopicTypeNum ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    gMqttSnTopicType = type;
+
+    // prepare all topics again on next publish
+    for( xDataTopic_t topic = 0; topic < dataTopicNum; topic++ ){
+        gTopics[ topic ].snSession = 0;
+    }
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+err_code xDataSetEncoding(xClientType_t type, xDataEncoding_t encoding){
+
+    if( ( type > MqttSNClient ) || ( encoding >= dataEncodingNum ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    gEncoding[ type ] = encoding;
+    return X_ERR_SUCCESS;
+}
+
+
+
+xDataEncodingStats_t xDataGetEncodingStats(xClientType_t type, xDataEncoding_t encoding){
+
+    xDataEncodingStats_t stats = {0};
+
+    if( ( type > MqttSNClient ) || ( encoding >= dataEncodingNum ) ){
+        return stats;
+    }
+
+    k_mutex_lock( &xDataStats_mutex, K_FOREVER );
+    stats = gEncodingStats[ type ][ encoding ];
+    k_mutex_unlock( &xDataStats_mutex );
+    return stats;
+}
+
+
+
+xDataEncoding_t xDataGetEncodingByName(const char *pName){
+
+    xDataEncoding_t encoding;
+
+    for( encoding = 0; encoding < dataEncodingNum; encoding++ ){
+        if( strcmp( pName, gpEncodingStrings[ encoding ] ) == 0 ){
+            break;
+        }
+    }
+    return encoding;
+}
+
+
+
+void xDataBatchEnable(bool enable){
+
+    k_mutex_lock( &xDataBatch_mutex, K_FOREVER );
+
+    if( gBatch.count > 0 ){
+        LOG_WRN("%d batched messages discarded\r\n", gBatch.count);
+        gBatch.dropped += gBatch.count;
+    }
+    gBatch.head = 0;
+    gBatch.count = 0;
+    gBatch.isEnabled = enable;
+
+    k_mutex_unlock( &xDataBatch_mutex );
+}
+
+
+
+void xDataHoldOnFailure(bool enable){
+
+    // held messages are kept here, not in the MQTT backlog which is discarded
+    // when the WiFi link goes down
+    xWifiMqttBacklogEnable( !enable );
+
+    k_mutex_lock( &xDataBatch_mutex, K_FOREVER );
+
+    if( !enable && !gBatch.isEnabled ){
+        if( gBatch.count > 0 ){
+            LOG_WRN("%d held messages discarded\r\n", gBatch.count);
+            gBatch.dropped += gBatch.count;
+        }
+        gBatch.head = 0;
+        gBatch.count = 0;
+    }
+    gBatch.holdOnFailure = enable;
+
+    k_mutex_unlock( &xDataBatch_mutex );
+}
+
+
+
+uint32_t xDataBatchGetCount(void){
+
+    return gBatch.count;
+}
+
+
+
+err_code xDataBatchFlush(k_timeout_t timeout){
+
+    dataPublishMsg_t *pMsg;
+
+    // messages held again while flushing are left for the next flush
+    uint32_t toFlush = gBatch.count;
+
+    k_sem_reset( &xDataQueueEmpty_semaphore );
+
+    while( toFlush-- > 0 ){
+
+        // wait for a place in the publish queue
+        if( k_mem_slab_alloc( &xDataPublishSlab, (void **)&pMsg, timeout ) != 0 ){
+            LOG_ERR("Batch flush: publish queue timeout\r\n");
+            return U_ERROR_COMMON_TIMEOUT;
+        }
+
+        // move the oldest message of the batch in the queue
+        k_mutex_lock( &xDataBatch_mutex, K_FOREVER );
+        if( gBatch.count == 0 ){
+            k_mutex_unlock( &xDataBatch_mutex );
+            k_mem_slab_free( &xDataPublishSlab, (void **)&pMsg );
+            break;
+        }
+        *pMsg = gBatch.msgs[ gBatch.head ];
+        gBatch.head = ( gBatch.head + 1 ) % DATA_BATCH_MAX_MSGS;
+        gBatch.count--;
+        k_mutex_unlock( &xDataBatch_mutex );
+
+        // wait in the queue is measured from now on
+        pMsg->queuedTime = k_uptime_get();
+        k_msgq_put( &xDataPublishMsgq, &pMsg, K_NO_WAIT );
+    }
+
+    // wait for all messages to be published
+    if( k_mem_slab_num_used_get( &xDataPublishSlab ) > 0 ){
+        if( k_sem_take( &xDataQueueEmpty_semaphore, timeout ) != 0 ){
+            LOG_ERR("Batch flush: publish timeout\r\n");
+            return U_ERROR_COMMON_TIMEOUT;
+        }
+    }
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+xDataPublishBuf_t *xDataPublishBufAlloc(k_timeout_t timeout){
+
+    dataPublishMsg_t *pMsg;
+
+    if( k_mem_slab_alloc( &xDataPublishSlab, (void **)&pMsg, timeout ) != 0 ){
+        k_mutex_lock( &xDataStats_mutex, K_FOREVER );
+        gQueueStats.dropped++;
+        k_mutex_unlock( &xDataStats_mutex );
+        return NULL;
+    }
+
+    uint32_t used = k_mem_slab_num_used_get( &xDataPublishSlab );
+    k_mutex_lock( &xDataStats_mutex, K_FOREVER );
+    if( used > gQueueStats.peak ){
+        gQueueStats.peak = used;
+    }
+    k_mutex_unlock( &xDataStats_mutex );
+
+    return pMsg;
+}
+
+
+
+char *xDataPublishBufGetData(xDataPublishBuf_t *pBuf){
+
+    return pBuf->message;
+}
+
+
+
+void xDataPublishBufFree(xDataPublishBuf_t *pBuf){
+
+    k_mem_slab_free( &xDataPublishSlab, (void **)&pBuf );
+
+    if( k_mem_slab_num_used_get( &xDataPublishSlab ) == 0 ){
+        k_sem_give( &xDataQueueEmpty_semaphore );
+    }
+}
+
+
+
+err_code xDataPublishAsync(xDataPublishBuf_t *pBuf, size_t len, const xDataPublishDest_t *pDest,
+                           uint8_t qos, xDataPublishCb_t pCb, void *pParam){
+
+    if( ( pBuf == NULL ) || ( pDest == NULL ) || ( len > DATA_MSG_MAX_LEN ) ||
+        ( ( pDest->client == MqttClient ) && ( ( pDest->pTopicNameStr == NULL ) ||
+          ( strlen( pDest->pTopicNameStr ) >= DATA_ASYNC_TOPIC_MAXLEN ) ) ) ){
+        if( pBuf != NULL ){
+            xDataPublishBufFree( pBuf );
+        }
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    pBuf->isAsync = true;
+    pBuf->id = gMsgId++;
+    pBuf->len = len;
+    pBuf->qos = qos;
+    pBuf->asyncClient = pDest->client;
+    if( pDest->client == MqttClient ){
+        strcpy( pBuf->asyncTopic, pDest->pTopicNameStr );
+    }
+    else{
+        pBuf->asyncSnTopic = pDest->snTopic;
+    }
+    pBuf->pCb = pCb;
+    pBuf->pCbParam = pParam;
+    pBuf->queuedTime = k_uptime_get();
+
+    // the message queue holds as many pointers as there are buffers, cannot be full
+    k_msgq_put( &xDataPublishMsgq, &pBuf, K_NO_WAIT );
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+/* ----------------------------------------------------------------
+ * SHELL COMMANDS IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+void xDataSetQosCmd(const struct shell *shell, size_t argc, char **argv){
+
+    if( argc != 3 ){
+        shell_print(shell, "Please provide <class> <QoS>   class: sensor/position/aggregate/diagnostics/config  QoS: 0-%d\r\n", DATA_QOS_MAX);
+        return;
+    }
+
+    xDataTopicClass_t topicClass = xDataGetTopicClassByName( argv[1] );
+    if( topicClass == dataTopicClassNum ){
+        shell_error(shell, "Class should be: sensor/position/aggregate/diagnostics/config\r\n");
+        return;
+    }
+
+    int qos = atoi( argv[2] );
+    if( ( qos < 0 ) || ( qos > DATA_QOS_MAX ) || ( strlen( argv[2] ) != 1 ) ){
+        shell_error(shell, "QoS should be 0-%d\r\n", DATA_QOS_MAX);
+        return;
+    }
+
+    xDataSetQos( topicClass, (uint8_t)qos );
+    shell_print(shell, "%s messages published with QoS %d\r\n", gpTopicClassStrings[ topicClass ], qos);
+}
+
+
+
+void xDataPublishStatsCmd(const struct shell *shell, size_t argc, char **argv){
+
+    const char *const typeStr[]={
+        [MqttClient] = "MQTT",
+        [MqttSNClient] = "MQTT-SN"
+    };
+
+    if( argc == 2 ){
+        if( strcmp( argv[1], "reset" ) == 0 ){
+            xDataResetPublishStats();
+            shell_print(shell, "Publish statistics reset\r\n");
+        }
+        else{
+            shell_error(shell, "Unknown parameter, use: reset\r\n");
+        }
+        return;
+    }
+
+    shell_print(shell, "\r\nQoS: sensor %d, position %d, aggregate %d\r\n",
+                gTopicQos[ dataTopicSensor ], gTopicQos[ dataTopicPosition ], gTopicQos[ dataTopicAggregate ]);
+
+    k_mutex_lock( &xDataStats_mutex, K_FOREVER );
+    uint32_t peak = gQueueStats.peak;
+    uint32_t dropped = gQueueStats.dropped;
+    uint32_t fragmented = gQueueStats.fragmented;
+    uint32_t chunks = gQueueStats.chunks;
+    k_mutex_unlock( &xDataStats_mutex );
+
+    shell_print(shell, "Publish queue: %d messages, in use: %d, peak: %d, dropped (full): %d\r\n",
+                DATA_PUBLISH_QUEUE_LEN, k_mem_slab_num_used_get( &xDataPublishSlab ),
+                peak, dropped);
+    if( fragmented > 0 ){
+        shell_print(shell, "Fragmented messages: %d, chunks: %d\r\n",
+                    fragmented, chunks);
+    }
+
+    // bytes per message (one message per sample, or per sampling period in aggregation mode)
+    for( uint8_t type = MqttClient; type <= MqttSNClient; type++ ){
+        for( xDataEncoding_t encoding = 0; encoding < dataEncodingNum; encoding++ ){
+
+            xDataEncodingStats_t encStats = xDataGetEncodingStats( type, encoding );
+            xDataEncodingStats_t *pEncStats = &encStats;
+            if( pEncStats->messages == 0 ){
+                continue;
+            }
+
+            shell_print(shell, "%s %s%s: %d messages, avg %d bytes sent per message (JSON %d bytes)\r\n",
+                        typeStr[ type ], gpEncodingStrings[ encoding ],
+                        ( gEncoding[ type ] == encoding ) ? " (active)" : "",
+                        pEncStats->messages,
+                        (uint32_t)( pEncStats->sentBytes / pEncStats->messages ),
+                        (uint32_t)( pEncStats->plainBytes / pEncStats->messages ));
+        }
+    }
+    if( gBatch.isEnabled || gBatch.holdOnFailure ){
+        shell_print(shell, "Batch: %d of %d messages, held (publish failed): %d, dropped: %d\r\n",
+                    gBatch.count, DATA_BATCH_MAX_MSGS, gBatch.held, gBatch.dropped);
+    }
+
+    for( uint8_t type = MqttClient; type <= MqttSNClient; type++ ){
+        for( uint8_t qos = 0; qos <= DATA_QOS_MAX; qos++ ){
+
+            xDataPublishStats_t stats = xDataGetPublishStats( type, qos );
+            xDataPublishStats_t *pStats = &stats;
+            if( ( pStats->published == 0 ) && ( pStats->queued == 0 ) && ( pStats->failed == 0 ) ){
+                continue;
+            }
+
+            uint32_t avg = 0, wait = 0, rate = 0;
+            if( pStats->published > 0 ){
+                avg = (uint32_t)( pStats->latencySumMs / pStats->published );
+                wait = (uint32_t)( pStats->waitSumMs / pStats->published );
+            }
+            // bytes per second while publishing
+            if( pStats->busySumMs > 0 ){
+                rate = (uint32_t)( ( (uint64_t)pStats->bytes * 1000 ) / pStats->busySumMs );
+            }
+
+            shell_print(shell, "%s QoS %d ------------------------\r\n\
+        - Published: %d  Queued: %d  Failed: %d\r\n\
+        - Latency (ms): min %d  avg %d  max %d\r\n\
+        - Avg wait in queue (ms): %d\r\n\
+        - Throughput: %d bytes/s\r\n",
+                        typeStr[ type ], qos,
+                        pStats->published, pStats->queued, pStats->failed,
+                        pStats->latencyMinMs, avg, pStats->latencyMaxMs,
+                        wait, rate);
+        }
+    }
+}
+
+
+
+void xDataTopicsCmd(const struct shell *shell, size_t argc, char **argv){
+
+    if( argc == 2 ){
+        xDataMqttSnTopicType_t type;
+        for( type = 0; type < dataMqttSnTopicTypeNum; type++ ){
+            if( strcmp( argv[1], gpMqttSnTopicTypeStrings[ type ] ) == 0 ){
+                break;
+            }
+        }
+
+        if( type == dataMqttSnTopicTypeNum ){
+            shell_error(shell, "Unknown parameter, use: pre/normal\r\n");
+            return;
+        }
+
+        xDataSetMqttSnTopicType( type );
+        shell_print(shell, "MQTT-SN topics: %s\r\n", gpMqttSnTopicTypeStrings[ type ]);
+        return;
+    }
+
+    uint32_t session = xCellMqttSnGetSession();
+
+    shell_print(shell, "\r\nMQTT-SN topics: %s, session: %d\r\n",
+                gpMqttSnTopicTypeStrings[ gMqttSnTopicType ], session);
+
+    for( xDataTopic_t topic = 0; topic < dataTopicNum; topic++ ){
+
+        dataTopicEntry_t *pEntry = &gTopics[ topic ];
+
+        if( ( session > 0 ) && ( pEntry->snSession == session ) ){
+            shell_print(shell, "%s (%s) - ID: %d, registrations: %d\r\n",
+                        pEntry->pName, pEntry->pAlias, pEntry->snTopic.name.id, pEntry->registrations);
+        }
+        else{
+            shell_print(shell, "%s (%s) - not prepared, registrations: %d\r\n",
+                        pEntry->pName, pEntry->pAlias, pEntry->registrations);
+        }
+    }
+}
+
+
+
+void xDataSetEncodingCmd(const struct shell *shell, size_t argc, char **argv){
+
+    xClientType_t type;
+    xDataEncoding_t encoding;
+
+    if( argc != 3 ){
+        shell_print(shell, "Please provide <client> <encoding>   client: mqtt/mqttsn  encoding: base64/raw\r\n");
+        return;
+    }
+
+    if( strcmp( argv[1], "mqtt" ) == 0 ){
+        type = MqttClient;
+    }
+    else if( strcmp( argv[1], "mqttsn" ) == 0 ){
+        type = MqttSNClient;
+    }
+    else{
+        shell_error(shell, "Client should be: mqtt/mqttsn\r\n");
+        return;
+    }
+
+    encoding = xDataGetEncodingByName( argv[2] );
+    if( encoding == dataEncodingNum ){
+        shell_error(shell, "Encoding should be: base64/raw\r\n");
+        return;
+    }
+
+    xDataSetEncoding( type, encoding );
+    shell_print(shell, "%s messages published %s\r\n", argv[1], gpEncodingStrings[ encoding ]);
+}
@@ -42,8 +42,10 @@
  * Copying and pasting this example message in a JSON parser will reveal its structure in
  * a more readable format.
  * 
- * The above string is sent encoded as a Base64 string. Using the message as an example the exact message
- * sent is: 
+ * Via MQTT (WiFi) the above string is sent encoded as a Base64 string, since double quotes may
+ * not pass through the AT interface of the module as plain text. Via MQTT-SN (cellular) the string
+ * is sent as is by default, ubxlib publishing it in SARA-R5 hex mode (see xDataSetEncoding).
+ * Using the message as an example the exact Base64 message sent is: 
  * 
  * eyJEZXYiOiJDMjEwIiwiU2Vuc29ycyI6W3siSUQiOiJCUTI3NDIxIiwiZXJyIjoiZmV0Y2gifSx7IklEIjoiQk1FMjgwIiwibWVz
  * IjpbeyJubSI6IlRtIiwidmwiOjMyLjI1MH0seyJubSI6IkhtIiwidmwiOjM3Ljk5M30seyJubSI6IlByIiwidmwiOjk4LjkwNX1df
@@ -63,12 +65,51 @@
  * The topic names (where the messages should be published) are also defined in this file. For the 
  * dashboard to work these topic names (and aliases) should also not change.
  * 
+ * Messages are published by a dedicated thread: xDataSend puts the prepared message
+ * in a publish queue of DATA_PUBLISH_QUEUE_LEN messages and returns, so that sampling and message
+ * preparation go on while previous messages are published (and acknowledged, for QoS 1).
+ * The queue only decouples the callers from publishing: the thread publishes one
+ * message at a time and ubxlib publish calls block until completion, so with QoS 1
+ * the next message is sent only after the previous one has been acknowledged.
+ * Each topic class (single sensor, position, sensor aggregation) is published with its
+ * own Quality of Service (see xDataSetQos). Publish latency is measured per client type
+ * and QoS (see xDataGetPublishStats).
+ * 
+ * Other modules (and the shell send commands) publish through the same queue with
+ * xDataPublishAsync: the caller writes the payload directly in a publish queue buffer
+ * (xDataPublishBufAlloc), hands it over and returns immediately. The publish thread
+ * publishes it as is via the requested client and calls back with the result and
+ * the latency, then releases the buffer.
+ * 
+ * In duty-cycled transport mode (see x_sensor_aggregation_function.h) messages are kept
+ * in a batch of up to DATA_BATCH_MAX_MSGS messages instead, until the link is brought up
+ * and xDataBatchFlush publishes them.
+ * 
+ * Messages longer than the transport allows (once encoded, e.g. a sensor aggregation
+ * message with all sensors) are split when published, in chunks that fit the transport of the
+ * connected client. Each chunk starts with a header (DATA_CHUNK_HEADER_FORMAT) so that the
+ * receiver can rebuild the message. Messages that fit are published unchanged.
+ * 
+ * When the Sensor Aggregation function fails over between WiFi and cellular
+ * (see xDataHoldOnFailure), messages that cannot be published are held in the same
+ * batch and published after the switch, instead of being lost.
+ * 
+ * Via MQTT-SN, messages are published to predefined topic IDs (the aliases below) or to
+ * normal topics registered with the broker (see xDataSetMqttSnTopicType). The MQTT-SN
+ * topic of each xDataTopic_t is prepared once per MQTT-SN session and reused for every
+ * message; normal topics are registered again only after a reconnection.
  * 
  */
 
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <zephyr.h>             // k_timeout_t
+#include <shell/shell.h>        // for shell command functions
 #include "x_sens_common_types.h"
+#include "x_module_common.h"    // xClientType_t
+#include "x_errno.h"
+#include "ubxlib.h"             // uMqttSnTopicName_t
 #include <drivers/sensor.h>     // includes sensor_channel enum
 
 
@@ -83,6 +124,27 @@
 if <hex_mode>=0 or 512 octets if <hex_mode>=1. [ UBX-19047455 - R09 page.415 ] */
 #define MQTT_MAX_MSG_LEN      1024
 
+/** Max length of a message (JSON string) prepared by xDataSend. Messages longer
+ * (once encoded) than the chunk length of the transport (DATA_CHUNK_LEN_MQTT,
+ * DATA_CHUNK_LEN_MQTTSN, DATA_CHUNK_LEN_MQTTSN_BINARY) are published in chunks
+ * (see DATA_CHUNK_HEADER_FORMAT) */
+#define DATA_MSG_MAX_LEN      2048
+
+/** Length of the Base64 encoding of len bytes (including the termination char) */
+#define DATA_BASE64_LEN(len)  ( ( ( (len) + 2 ) / 3 ) * 4 + 1 )
+
+/** Header prepended to each chunk of a fragmented message: "#<message id>/<chunk>/<chunks>#".
+ * Chunks are numbered from 1. Messages (Base64 strings or JSON objects) never start with
+ * '#', so a payload starting with '#' is a chunk, and the message is rebuilt by
+ * concatenating the payloads of chunks 1 to <chunks> after the header */
+#define DATA_CHUNK_HEADER_FORMAT   "#%d/%d/%d#"
+
+/** Max length of the chunk header ("#65535/99/99#") */
+#define DATA_CHUNK_HEADER_MAXLEN   13
+
+/** Max MQTT topic name length of an asynchronous publish (xDataPublishAsync) */
+#define DATA_ASYNC_TOPIC_MAXLEN    64
+
 // The TOPIC names and aliases can be changed, however this will stop dashboard from working 
 // properly
 
@@ -95,6 +157,11 @@ if <hex_mode>=0 or 512 octets if <hex_mode>=1. [ UBX-19047455 - R09 page.415 ] *
 #define TOPIC_NAME_ICG20330     "c210/sensor/gyroscope"
 #define TOPIC_NAME_MAXM10S       "c210/position/nmea"
 #define TOPIC_NAME_ALL_SENSORS   "c210/all"
+#define TOPIC_NAME_LINK_QUALITY  "c210/diagnostics/link"
+#define TOPIC_NAME_CONFIG_RSP    "c210/config/rsp"
+
+// Remote configuration commands topic (subscribed, see x_remote_config.h)
+#define TOPIC_NAME_CONFIG_CMD    "c210/config/cmd"
 
 // define topic aliases per sensor (should also be defined in thingstream -
 // should be done upon entering the redemption code)
@@ -106,6 +173,34 @@ if <hex_mode>=0 or 512 octets if <hex_mode>=1. [ UBX-19047455 - R09 page.415 ] *
 #define TOPIC_ALIAS_ICG20330    "507"    
 #define TOPIC_ALIAS_MAXM10S     "508"
 #define TOPIC_ALIAS_ALL_SENSORS "500"
+#define TOPIC_ALIAS_LINK_QUALITY "509"
+#define TOPIC_ALIAS_CONFIG_RSP   "510"
+
+
+/** Topics the messages are published to (one per sensor, plus the sensor
+ * aggregation, the diagnostics and the remote configuration response topics) */
+typedef enum{
+    dataTopicBme280,       /**< TOPIC_NAME_BME280 / TOPIC_ALIAS_BME280 */
+    dataTopicBattery,      /**< TOPIC_NAME_BQ27520 / TOPIC_ALIAS_BQ27520 */
+    dataTopicLis2dh12,     /**< TOPIC_NAME_LIS2DH12 / TOPIC_ALIAS_LIS2DH12 */
+    dataTopicLis3mdl,      /**< TOPIC_NAME_LIS3MDL / TOPIC_ALIAS_LIS3MDL */
+    dataTopicLtr303,       /**< TOPIC_NAME_LTR303 / TOPIC_ALIAS_LTR303 */
+    dataTopicIcg20330,     /**< TOPIC_NAME_ICG20330 / TOPIC_ALIAS_ICG20330 */
+    dataTopicMaxm10s,      /**< TOPIC_NAME_MAXM10S / TOPIC_ALIAS_MAXM10S */
+    dataTopicAllSensors,   /**< TOPIC_NAME_ALL_SENSORS / TOPIC_ALIAS_ALL_SENSORS */
+    dataTopicLinkQuality,  /**< TOPIC_NAME_LINK_QUALITY / TOPIC_ALIAS_LINK_QUALITY */
+    dataTopicConfigRsp,    /**< TOPIC_NAME_CONFIG_RSP / TOPIC_ALIAS_CONFIG_RSP */
+    dataTopicNum           /**< Always at the end of this enum list, only used for sanity checks */
+}xDataTopic_t;
+
+
+/** How topics are addressed when publishing via MQTT-SN
+*/
+typedef enum{
+    dataMqttSnTopicPredefined,  /**< Predefined topic IDs (aliases), should be defined in the broker */
+    dataMqttSnTopicNormal,      /**< Topic names, registered with the broker once per session */
+    dataMqttSnTopicTypeNum      /**< Always at the end of this enum list, only used for sanity checks */
+}xDataMqttSnTopicType_t;
 
 
 
@@ -119,9 +214,10 @@ if <hex_mode>=0 or 512 octets if <hex_mode>=1. [ UBX-19047455 - R09 page.415 ] *
 */
 
 /** Maximum number of measurements per sensor, per reading 
- * in a JSON packet (e.g. for Acceleromenter: Ax,Ay,Az) 
+ * in a JSON packet (e.g. for Acceleromenter: Ax,Ay,Az). 
+ * MAXM10 uses the most measurements (full navigation solution)
  */
-#define JSON_SENSOR_MAX_MEASUREMENTS  3 
+#define JSON_SENSOR_MAX_MEASUREMENTS  10 
 
 /** Maximum Length of measurement (channel) name in a JSON string
  * e.g. Temperature measurement(channel) name = "Tm"
@@ -174,8 +270,35 @@ if <hex_mode>=0 or 512 octets if <hex_mode>=1. [ UBX-19047455 - R09 page.415 ] *
 #define JSON_ID_SENSOR_CHAN_MAGN_Y   "My"
 #define JSON_ID_SENSOR_CHAN_MAGN_Z   "Mz"
 
-#define JSON_ID_SENSOR_CHAN_POS_DX   "Px" 
-#define JSON_ID_SENSOR_CHAN_POS_DY   "Py"
+#define JSON_ID_SENSOR_CHAN_POS_DX   "Px"    /**< Latitude in degrees */
+#define JSON_ID_SENSOR_CHAN_POS_DY   "Py"    /**< Longitude in degrees */
+#define JSON_ID_SENSOR_CHAN_POS_LAT  "Lat"   /**< Latitude in degrees x1e7 */
+#define JSON_ID_SENSOR_CHAN_POS_LON  "Lon"   /**< Longitude in degrees x1e7 */
+#define JSON_ID_SENSOR_CHAN_POS_ALT  "Alt"   /**< Altitude above mean sea level in mm */
+#define JSON_ID_SENSOR_CHAN_POS_HACC "Hac"   /**< Horizontal accuracy estimate in mm */
+#define JSON_ID_SENSOR_CHAN_POS_SPD  "Spd"   /**< Ground speed in mm/s */
+#define JSON_ID_SENSOR_CHAN_POS_HDG  "Hdg"   /**< Heading of motion in degrees x1e5 */
+#define JSON_ID_SENSOR_CHAN_POS_FIX  "Fix"   /**< Fix type: 2 = 2D, 3 = 3D, 4 = GNSS + dead reckoning */
+#define JSON_ID_SENSOR_CHAN_POS_SV   "Sv"    /**< Number of satellites used in the solution */
+#define JSON_ID_SENSOR_CHAN_POS_GF   "Gf"    /**< Geofence id of a geofence event */
+#define JSON_ID_SENSOR_CHAN_POS_EV   "Ev"    /**< Geofence event: 1 = enter, 2 = exit, 3 = dwell */
+#define JSON_ID_SENSOR_CHAN_POS_TRK  "Trk"   /**< Track: encoded polyline (precision 1e-5 deg) */
+#define JSON_ID_SENSOR_CHAN_POS_NP   "Np"    /**< Number of points in a track */
+#define JSON_ID_SENSOR_CHAN_POS_DUR  "Dur"   /**< Time span of a track in seconds */
+
+// Position measurement types not defined in zephyr's sensor_channel enum
+#define X_SENSOR_CHAN_POS_HACC       ( SENSOR_CHAN_PRIV_START )
+#define X_SENSOR_CHAN_POS_SPD        ( SENSOR_CHAN_PRIV_START + 1 )
+#define X_SENSOR_CHAN_POS_FIX        ( SENSOR_CHAN_PRIV_START + 2 )
+#define X_SENSOR_CHAN_POS_SV         ( SENSOR_CHAN_PRIV_START + 3 )
+#define X_SENSOR_CHAN_POS_HDG        ( SENSOR_CHAN_PRIV_START + 4 )
+#define X_SENSOR_CHAN_POS_GF         ( SENSOR_CHAN_PRIV_START + 5 )
+#define X_SENSOR_CHAN_POS_EV         ( SENSOR_CHAN_PRIV_START + 6 )
+#define X_SENSOR_CHAN_POS_TRK        ( SENSOR_CHAN_PRIV_START + 7 )
+#define X_SENSOR_CHAN_POS_NP         ( SENSOR_CHAN_PRIV_START + 8 )
+#define X_SENSOR_CHAN_POS_DUR        ( SENSOR_CHAN_PRIV_START + 9 )
+#define X_SENSOR_CHAN_POS_LAT        ( SENSOR_CHAN_PRIV_START + 10 )
+#define X_SENSOR_CHAN_POS_LON        ( SENSOR_CHAN_PRIV_START + 11 )
 
 #define JSON_ID_SENSOR_CHAN_AMBIENT_TEMP "Tm"
 #define JSON_ID_SENSOR_CHAN_PRESS        "Pr"
@@ -186,6 +309,25 @@ if <hex_mode>=0 or 512 octets if <hex_mode>=1. [ UBX-19047455 - R09 page.415 ] *
 
 #define JSON_ID_SENSOR_CHAN_LIGHT    "Lt"
 
+// Link quality diagnostics (see xDataSendDiagnostics)
+#define JSON_ID_DIAG_LINK              "LINK"
+#define JSON_ID_DIAG_CHAN_TRANSPORT    "Tr"     /**< 1 = WiFi, 2 = cellular */
+#define JSON_ID_DIAG_CHAN_RSSI         "Rssi"   /**< dBm */
+#define JSON_ID_DIAG_CHAN_RSRP         "Rsrp"   /**< dBm */
+#define JSON_ID_DIAG_CHAN_RSRQ         "Rsrq"   /**< dB */
+#define JSON_ID_DIAG_CHAN_SINR         "Sinr"   /**< dB */
+
+/** Max length of a diagnostics message */
+#define DATA_DIAG_MSG_MAX_LEN    256
+
+// Remote configuration response (see xDataSendConfigResponse)
+#define JSON_ID_CONFIG_RSP             "CFG"
+#define JSON_KEYNAME_CONFIG_REQ        "req"    /**< Request id, as given in the command */
+#define JSON_KEYNAME_CONFIG_RES        "res"    /**< Result: zero on success else negative error code */
+
+/** Max length of a remote configuration response message */
+#define DATA_CONFIG_RSP_MAX_LEN  64
+
 
 
 /* ----------------------------------------------------------------
@@ -198,7 +340,8 @@ if <hex_mode>=0 or 512 octets if <hex_mode>=1. [ UBX-19047455 - R09 page.415 ] *
 typedef enum{
     isDouble,
     isPosition,
-    isInt
+    isInt,
+    isString      /**< Null terminated string, already escaped for JSON */
 }xDataType_t;
 
 
@@ -211,6 +354,7 @@ typedef enum{
     dataErrNotInit,        /**< Sensor not initialized properly */
     dataErrFetchFail,      /**< Fethcing data from sensor failed (sensor_sample_fetch function fail) */
     dataErrFetchTimeout,   /**< Timeout error */
+    dataErrLowAccuracy,    /**< Data obtained but their accuracy is not acceptable (e.g. position accuracy) */
     dataErrMaxNum          /**< Always at the end of this enum list, only used for sanity checks */
 }xDataError_t;
 
@@ -225,6 +369,7 @@ struct xDataMeasurement_t{
     union{
         double doubleVal;
         int32_t int32Val;
+        const char *strVal;    /**< Should remain valid until xDataSend returns */
     }data;                                         /**< Union holding the actual measurement */
 };
 
@@ -242,6 +387,85 @@ typedef struct{
 
 
 
+/** Topic classes. Each class is published with its own Quality of Service
+*/
+typedef enum{
+    dataTopicSensor,       /**< Single sensor messages (environmental, motion, light, battery) */
+    dataTopicPosition,     /**< MAXM10S messages (position, geofence events, tracks) */
+    dataTopicAggregate,    /**< Sensor aggregation messages (all sensors in one message) */
+    dataTopicDiagnostics,  /**< Device diagnostics messages (link quality) */
+    dataTopicConfig,       /**< Remote configuration responses */
+    dataTopicClassNum      /**< Always at the end of this enum list, only used for sanity checks */
+}xDataTopicClass_t;
+
+
+/** Max Quality of Service that can be set for a topic class */
+#define DATA_QOS_MAX    2
+
+
+/** Encoding of the published messages
+*/
+typedef enum{
+    dataEncodingBase64,    /**< JSON string encoded in Base64 */
+    dataEncodingRaw,       /**< JSON string as is (binary-safe publish, SARA-R5 hex mode via MQTT-SN) */
+    dataEncodingNum        /**< Always at the end of this enum list, only used for sanity checks */
+}xDataEncoding_t;
+
+
+/** Published messages and bytes of a client type (MQTT/MQTT-SN) and encoding
+*/
+typedef struct{
+    uint32_t messages;       /**< Messages published successfully */
+    uint64_t plainBytes;     /**< Bytes of the JSON strings */
+    uint64_t sentBytes;      /**< Bytes published (encoded, including chunk headers) */
+}xDataEncodingStats_t;
+
+
+/** Publish statistics of a client type (MQTT/MQTT-SN) and Quality of Service.
+ * Latency is the duration of the publish operation: for QoS 1 the publish completes
+ * when the module reports the PUBACK from the broker.
+*/
+typedef struct{
+    uint32_t published;      /**< Messages published successfully */
+    uint32_t queued;         /**< Messages kept in the MQTT backlog, published after the reconnection */
+    uint32_t failed;         /**< Publish errors */
+    uint32_t bytes;          /**< Bytes published successfully */
+    uint32_t latencyMinMs;   /**< Min publish latency */
+    uint32_t latencyMaxMs;   /**< Max publish latency */
+    uint64_t latencySumMs;   /**< Sum of publish latencies (for the average) */
+    uint64_t waitSumMs;      /**< Sum of the time messages waited in the queue before being published */
+    uint64_t busySumMs;      /**< Time spent publishing, to compute throughput */
+}xDataPublishStats_t;
+
+
+/** Handle of a publish queue buffer (see xDataPublishBufAlloc)
+*/
+typedef struct xDataPublishBuf_s xDataPublishBuf_t;
+
+
+/** Completion callback of an asynchronous publish, called by the publish thread.
+ * The buffer is released when the callback returns.
+ * 
+ * @param result     zero on success, X_ERR_QUEUED if kept in the MQTT backlog (not
+ *                   an error: published after the reconnection, without a further
+ *                   callback) else negative error code.
+ * @param latencyMs  Time from xDataPublishAsync to the completion (wait in the
+ *                   queue included).
+ * @param pParam     The parameter given to xDataPublishAsync.
+*/
+typedef void (*xDataPublishCb_t)(err_code result, uint32_t latencyMs, void *pParam);
+
+
+/** Destination of an asynchronous publish
+*/
+typedef struct{
+    xClientType_t client;          /**< Client to publish with, it should be connected */
+    const char *pTopicNameStr;     /**< MQTT topic name (MqttClient), copied by xDataPublishAsync */
+    uMqttSnTopicName_t snTopic;    /**< MQTT-SN topic, already prepared (MqttSNClient) */
+}xDataPublishDest_t;
+
+
+
 /* ----------------------------------------------------------------
  * FUNCTIONS
  * -------------------------------------------------------------- */
@@ -265,7 +489,12 @@ void xDataSend(xDataPacket_t sensor_data_packet);
 
 /** This function is to be used when sensor aggregation mode is active (all sensor
  * data sent over one message). When xDataSend is used in this mode the data are
- * accumulated and then sent when all sensors are sampled. 
+ * accumulated and then sent when all sensors due in the current epoch (sampling
+ * period) are sampled. Sensors sampled with a rate divisor N (see
+ * xSensorAggregationGetRateDivisor) are due every N epochs. Epochs are counted
+ * in update periods elapsed, so a message closed incomplete does not shift the
+ * epochs of the next ones. Also restarts the epochs (epoch zero starts now, all
+ * sensors due in the next message), called when the function starts.
  * 
  * If something goes wrong in the meantime and the message should/could not be sent, this
  * function should be called to erase all previous data from the buffer used by xDataSend
@@ -275,6 +504,246 @@ void xDataSend(xDataPacket_t sensor_data_packet);
 void xDataResetSensorAggregationMsg(void);
 
 
+/** Publishes a diagnostics message (e.g. link quality) to TOPIC_NAME_LINK_QUALITY,
+ * with the diagnostics topic class Quality of Service. The message has the
+ * same structure as a single sensor message and is queued like any other
+ * message (publish queue or batch), in any mode. Only integer and double
+ * measurements are supported.
+ * 
+ * @param diag_packet  The diagnostics in a xDataPacket_t structure (sensorType
+ *                     not used).
+ */
+void xDataSendDiagnostics(xDataPacket_t diag_packet);
+
+
+/** Publishes the response to a remote configuration command (x_remote_config.h)
+ * to TOPIC_NAME_CONFIG_RSP, with the config topic class Quality of Service, eg:
+ * {"ID":"CFG","req":17,"res":0}. Queued like any other message (publish queue
+ * or batch).
+ * 
+ * @param reqId   The request id given in the command.
+ * @param result  The result of the command (zero on success else negative error code).
+ */
+void xDataSendConfigResponse(uint32_t reqId, err_code result);
+
+
+/** Sets the Quality of Service used to publish the messages of a topic class
+ * (both via MQTT and MQTT-SN).
+ * 
+ * @param topicClass  The topic class.
+ * @param qos         Quality of Service (0 up to DATA_QOS_MAX).
+ * @return            zero on success else negative error code.
+ */
+err_code xDataSetQos(xDataTopicClass_t topicClass, uint8_t qos);
+
+
+/** Gets the Quality of Service used to publish the messages of a topic class.
+ * 
+ * @param topicClass  The topic class.
+ * @return            The Quality of Service (0 if invalid class).
+ */
+uint8_t xDataGetQos(xDataTopicClass_t topicClass);
+
+
+/** Gets a topic class from its name, as used by the shell commands
+ * (sensor/position/aggregate/diagnostics/config).
+ * 
+ * @param pName   The topic class name.
+ * @return        The topic class (dataTopicClassNum if invalid name).
+ */
+xDataTopicClass_t xDataGetTopicClassByName(const char *pName);
+
+
+/** Gets the publish statistics of a client type and Quality of Service.
+ * 
+ * @param type   MqttClient (WiFi) or MqttSNClient (cellular).
+ * @param qos    Quality of Service (0 up to DATA_QOS_MAX).
+ * @return       The statistics (all zero if invalid parameters).
+ */
+xDataPublishStats_t xDataGetPublishStats(xClientType_t type, uint8_t qos);
+
+
+/** Resets all publish statistics.
+ */
+void xDataResetPublishStats(void);
+
+
+/** Sets the encoding of the messages published via a client type. Defaults
+ * are DATA_DEFAULT_ENCODING_MQTT and DATA_DEFAULT_ENCODING_MQTTSN. The receiver
+ * can tell the encoding from the first character of a (rebuilt) message: '{'
+ * for a raw JSON string, a Base64 character otherwise.
+ * 
+ * @param type      MqttClient (WiFi) or MqttSNClient (cellular).
+ * @param encoding  Base64 or raw.
+ * @return          zero on success else negative error code.
+ */
+err_code xDataSetEncoding(xClientType_t type, xDataEncoding_t encoding);
+
+
+/** Gets an encoding from its name, as used by the shell commands (base64/raw).
+ * 
+ * @param pName   The encoding name.
+ * @return        The encoding (dataEncodingNum if invalid name).
+ */
+xDataEncoding_t xDataGetEncodingByName(const char *pName);
+
+
+/** Gets the published messages and bytes of a client type and encoding.
+ * 
+ * @param type      MqttClient (WiFi) or MqttSNClient (cellular).
+ * @param encoding  Base64 or raw.
+ * @return          The statistics (all zero if invalid parameters).
+ */
+xDataEncodingStats_t xDataGetEncodingStats(xClientType_t type, xDataEncoding_t encoding);
+
+
+/** Sets how topics are addressed when publishing via MQTT-SN. The prepared
+ * MQTT-SN topics are discarded and prepared again on next publish.
+ * 
+ * @param type    Predefined topic IDs or registered normal topics.
+ * @return        zero on success else negative error code.
+ */
+err_code xDataSetMqttSnTopicType(xDataMqttSnTopicType_t type);
+
+
+/** Enables/disables batching. While enabled, xDataSend keeps the messages in
+ * the batch instead of publishing them (when the batch is full the oldest
+ * message is dropped) and reports the number of batched messages to
+ * xSensorAggregationBatchNotify(). Disabling discards the batched messages.
+ * 
+ * @param enable  True to keep messages in the batch.
+ */
+void xDataBatchEnable(bool enable);
+
+
+/** Enables/disables holding of messages that cannot be published. While enabled,
+ * a message of the publish queue that fails to publish (or finds no client
+ * connected, or the WiFi client reconnecting) is put at the end of the batch instead
+ * of being dropped, to be published later by xDataBatchFlush. Every publish
+ * result is reported to xSensorAggregationPublishResult(), a message kept in the
+ * MQTT backlog counts as failed. The MQTT backlog is disabled meanwhile (see
+ * xWifiMqttBacklogEnable). Disabling discards the held messages (unless batching
+ * is enabled).
+ * 
+ * @param enable  True to hold messages that cannot be published.
+ */
+void xDataHoldOnFailure(bool enable);
+
+
+/** Get the number of messages in the batch.
+ * 
+ * @return        Messages in the batch.
+ */
+uint32_t xDataBatchGetCount(void);
+
+
+/** Publishes all messages of the batch, in order, and waits until they have
+ * all been published. The link (MQTT or MQTT-SN) should be connected. Messages
+ * held again while flushing (see xDataHoldOnFailure) are left in the batch.
+ * 
+ * @param timeout  Max time to wait for a place in the publish queue and for
+ *                 the queue to be published.
+ * @return         zero on success else negative error code.
+ */
+err_code xDataBatchFlush(k_timeout_t timeout);
+
+
+/** Allocates a buffer of the publish queue for xDataPublishAsync. The payload
+ * (up to DATA_MSG_MAX_LEN bytes) is written directly in the buffer, see
+ * xDataPublishBufGetData.
+ * 
+ * @param timeout  Max time to wait for a place in the publish queue.
+ * @return         The buffer handle, or NULL if the queue is full.
+ */
+xDataPublishBuf_t *xDataPublishBufAlloc(k_timeout_t timeout);
+
+
+/** Get the payload area of a buffer allocated by xDataPublishBufAlloc.
+ * 
+ * @param pBuf  The buffer handle.
+ * @return      The payload area (DATA_MSG_MAX_LEN bytes).
+ */
+char *xDataPublishBufGetData(xDataPublishBuf_t *pBuf);
+
+
+/** Releases a buffer allocated by xDataPublishBufAlloc that has not been
+ * given to xDataPublishAsync.
+ * 
+ * @param pBuf  The buffer handle.
+ */
+void xDataPublishBufFree(xDataPublishBuf_t *pBuf);
+
+
+/** Publishes the payload of a buffer asynchronously: the buffer is put in the
+ * publish queue and the function returns immediately. The publish thread
+ * publishes the payload as is (not encoded or fragmented) via the client of
+ * the destination, calls pCb with the result and then releases the buffer.
+ * On error the buffer is released and pCb is not called.
+ * 
+ * @param pBuf    The buffer handle (from xDataPublishBufAlloc).
+ * @param len     Payload length in bytes (up to DATA_MSG_MAX_LEN).
+ * @param pDest   Client and topic to publish to.
+ * @param qos     Quality of service (0,1,2, 3 = MQTT-SN send and forget).
+ * @param pCb     Completion callback, can be NULL.
+ * @param pParam  Parameter passed to pCb.
+ * @return        zero on success else negative error code.
+ */
+err_code xDataPublishAsync(xDataPublishBuf_t *pBuf, size_t len, const xDataPublishDest_t *pDest,
+                           uint8_t qos, xDataPublishCb_t pCb, void *pParam);
+
+
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS IMPLEMENTING SHELL-COMMANDS
+ * -------------------------------------------------------------- */
+
+/** This function is intented only to be used as a command executed by the shell.
+ * Sets the Quality of Service of a topic class.
+ * Shell Command Example: functions set_qos aggregate 1
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command (should be 2).
+ * @param argv   the array including the parameters themselves (class: sensor/position/aggregate, QoS).
+ */
+void xDataSetQosCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * Types the QoS of each topic class, the publish queue usage, the publish
+ * statistics (latency, throughput) per client type and QoS and the bytes sent
+ * per message per client type and encoding.
+ * Shell Command Example: functions publish_stats  (functions publish_stats reset)
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command (0 or 1).
+ * @param argv   the array including the parameters themselves (optional: reset).
+ */
+void xDataPublishStatsCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * Sets the encoding of the messages published via a client type.
+ * Shell Command Example: functions encoding mqttsn raw
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command (should be 2).
+ * @param argv   the array including the parameters themselves (client: mqtt/mqttsn, encoding: base64/raw).
+ */
+void xDataSetEncodingCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * Types the MQTT-SN topic registry (topic IDs prepared in the current session), or
+ * sets how topics are addressed via MQTT-SN.
+ * Shell Command Example: functions topics  (functions topics normal)
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command (0 or 1).
+ * @param argv   the array including the parameters themselves (optional: pre/normal).
+ */
+void xDataTopicsCmd(const struct shell *shell, size_t argc, char **argv);
+
+
 
 
 #endif    //X_DATA_HANDLE_H__
\ No newline at end of file
@@ -89,6 +89,22 @@ err_code xSensSetUpdatePeriodAll(uint32_t milliseconds){
 
 
 
+err_code xSensSetUpdatePeriod(xSensType_t sensorType, uint32_t milliseconds){
+
+    switch( sensorType ){
+        case bme280_t:        return xSensBme280SetUpdatePeriod( milliseconds );
+        case battery_gauge_t: return xSensBatGaugeSetUpdatePeriod( milliseconds );
+        case lis2dh12_t:      return xSensLis2dh12SetUpdatePeriod( milliseconds );
+        case lis3mdl_t:       return xSensLis3mdlSetUpdatePeriod( milliseconds );
+        case ltr303_t:        return xSensLtr303SetUpdatePeriod( milliseconds );
+        case icg20330_t:      return xSensIcg20330SetUpdatePeriod( milliseconds );
+        case maxm10_t:        return xPosMaxM10SetUpdatePeriod( milliseconds );
+        default:              return X_ERR_INVALID_PARAMETER;
+    }
+}
+
+
+
 void xSensPublishAll(void){
         
         xSensBme280EnablePublish(true);
@@ -115,6 +131,28 @@ void xSensPublishNone(void){
 
 
 
+err_code xSensEnablePublish(xSensType_t sensorType, bool enable){
+
+    switch( sensorType ){
+        case bme280_t:        return xSensBme280EnablePublish( enable );
+        case battery_gauge_t: return xSensBatGaugeEnablePublish( enable );
+        case lis2dh12_t:      return xSensLis2dh12EnablePublish( enable );
+        case lis3mdl_t:       return xSensLis3mdlEnablePublish( enable );
+        case ltr303_t:        return xSensLtr303EnablePublish( enable );
+        case icg20330_t:      return xSensIcg20330EnablePublish( enable );
+        case maxm10_t:
+            // MAXM10S publish enable does not check the system status
+            if( !xSensIsChangeAllowed() ){
+                return X_ERR_INVALID_STATE;
+            }
+            xPosMaxM10EnablePublish( enable );
+            return X_ERR_SUCCESS;
+        default:              return X_ERR_INVALID_PARAMETER;
+    }
+}
+
+
+
 bool xSensIsChangeAllowed(void){
 	// if sensor aggragation mode is enabled do not allow changes
 	if( xSensorAggregationGetMode() != xSensAggModeDisabled ){
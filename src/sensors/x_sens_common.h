@@ -26,6 +26,7 @@
 
 #include <drivers/sensor.h>
 #include "x_errno.h"
+#include "x_sens_common_types.h"
 
 /* ----------------------------------------------------------------
  * FUNCTIONS
@@ -73,6 +74,28 @@ err_code xSensSetUpdatePeriodAll(uint32_t milliseconds);
 
 
 
+/** Set the update period of a sensor given by its type.
+ * Similar to calling xSensXXXXSetUpdatePeriod(milliseconds) for this sensor
+ *
+ * @param sensorType    The sensor (including MAXM10S, maxm10_t)
+ * @param milliseconds  The update period to set 
+ * @return              zero on success (X_ERROR_CODE) else negative error code.
+ */
+err_code xSensSetUpdatePeriod(xSensType_t sensorType, uint32_t milliseconds);
+
+
+
+/** Enable/disable publish for the measurements of a sensor given by its type.
+ * Similar to calling xSensXXXXEnablePublish(enable) for this sensor
+ *
+ * @param sensorType    The sensor (including MAXM10S, maxm10_t)
+ * @param enable        true to publish the measurements, false otherwise
+ * @return              zero on success (X_ERROR_CODE) else negative error code.
+ */
+err_code xSensEnablePublish(xSensType_t sensorType, bool enable);
+
+
+
 /** Checks if changes to sampling period, enable/disable, publish enable/disable of 
  * a sensor is allowed, based on the system's current status
  *
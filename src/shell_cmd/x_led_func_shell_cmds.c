@@ -24,6 +24,8 @@
 
 #include <shell/shell.h>
 #include "x_sensor_aggregation_function.h"
+#include "x_data_handle.h"
+#include "x_remote_config.h"
 #include "x_led.h"
 #include "x_system_conf.h"
 #include "mobile_app_ble_protocol.h"
@@ -68,6 +70,16 @@ SHELL_STATIC_SUBCMD_SET_CREATE(sub_functions,
        SHELL_CMD(cell_stop, NULL, "Stop Sensor Aggregation via cellular", xSensorAggregationStopCell),
        SHELL_CMD(status, NULL, "Get the status of Sensor Aggregation Function", xSensorAggregationTypeStatusCmd),
        SHELL_CMD(set_period, NULL, "Set the sampling period of Sensor Aggregation Function", xSensorAggregationSetUpdatePeriodCmd),
+       SHELL_CMD(profile, NULL, "Type or set the aggregation profile (rate divisor per sensor): profile [uniform/multirate/custom] [sensor] [divisor]", xSensorAggregationProfileCmd),
+       SHELL_CMD(set_qos, NULL, "Set QoS of a topic class: set_qos <class> <QoS>  class: sensor/position/aggregate/diagnostics/config", xDataSetQosCmd),
+       SHELL_CMD(publish_stats, NULL, "Type publish queue and latency statistics per QoS (publish_stats reset to clear)", xDataPublishStatsCmd),
+       SHELL_CMD(encoding, NULL, "Set message encoding per client: encoding <client> <encoding>  client: mqtt/mqttsn  encoding: base64/raw", xDataSetEncodingCmd),
+       SHELL_CMD(topics, NULL, "Type MQTT-SN topic registry, or set MQTT-SN topic type: topics <pre/normal>", xDataTopicsCmd),
+       SHELL_CMD(duty_cycle, NULL, "Duty-cycled transport: duty_cycle <on/off> [batch size] [latency bound in seconds]", xSensorAggregationDutyCycleCmd),
+       SHELL_CMD(cell_power_saving, NULL, "Request SARA-R5 PSM/eDRX timers from the sampling period: cell_power_saving <on/off>", xSensorAggregationCellPowerSavingCmd),
+       SHELL_CMD(failover, NULL, "Fail over automatically between WiFi and cellular: failover <on/off>", xSensorAggregationFailoverCmd),
+       SHELL_CMD(link_quality, NULL, "Type link quality, or defer batch flushes on a poor link: link_quality [on/off] [max deferral in seconds]", xSensorAggregationLinkQualityCmd),
+       SHELL_CMD(remote_config, NULL, "Type remote configuration statistics, or enable/disable remote configuration: remote_config [on/off]", xRemoteConfigCmd),
        //SHELL_CMD(NINAW156, &NINAW156, "NINAW156 control", NULL),
        SHELL_SUBCMD_SET_END
 );
@@ -26,9 +26,11 @@
 #include <shell/shell.h>
 
 #include "x_pos_maxm10s.h"
+#include "x_pos_geofence.h"
 #include "x_wifi_ninaW156.h"
 #include "x_cell_saraR5.h"
 #include "x_wifi_mqtt.h"
+#include "x_wifi_conn.h"
 #include "x_cell_mqttsn.h"
 #include "x_ble.h"
 #include "x_nfc.h"
@@ -50,6 +52,8 @@ static void xModulesCmdTypeStatus(const struct shell *shell, size_t argc, char *
         char *initialized_str[2] = {"Not Iniatialized", "Initialized"};
         char *ubxlibStatus_str[4] = {"Not Initialized", "Initialized", "Device API Initialized", "Device Opened"};
         char *yesNoBoolStr[2] = {"No","Yes"};
+        char *maxModeStr[2] = {"Request per sample", "NAV-PVT stream"};
+        char *maxPowerModeStr[4] = {"Full power", "Cyclic tracking", "On/Off", "Auto"};
         
         // Ble status string descriptions
         const char *const xBleStatusStr[]={
@@ -76,12 +80,17 @@ MAXM10S --------------------------------\r\n\
         - Init status: %s \r\n\
         - Thread_status %s \r\n\
         - Update Period Setting: %d ms \r\n\
-        - Timeout Setting: %d ms\r\n",
+        - Timeout Setting: %d ms\r\n\
+        - Mode: %s\r\n\
+        - Accuracy Threshold: %d mm\r\n\
+        - Power Mode Setting: %s\r\n",
         powered_str[ (int)maxstatus.isPowered ],\
         comm_str[ (int)maxstatus.com ],\
         initialized_str[ (int)maxstatus.isUbxInit ],\
         thread_status_str[ (int)maxstatus.isEnabled ],\
-        maxstatus.updatePeriod, maxstatus.timeoutPeriod);
+        maxstatus.updatePeriod, maxstatus.timeoutPeriod,\
+        maxModeStr[ (int)maxstatus.mode ], maxstatus.accuracyThreshold,\
+        maxPowerModeStr[ (int)maxstatus.powerMode ]);
 
         xWifiNinaStatus_t ninastatus = xWifiNinaGetModuleStatus();
 
@@ -112,6 +121,7 @@ SARAR5 --------------------------------\r\n\
 
         xWifiMqttClientStatusCmd(shell, argc, argv);
         xCellMqttSnClientStatusCmd(shell, argc, argv);
+        xCommonUPortStatusCmd(shell, argc, argv);
 
         // Type BLE status
         xBleStatus_t bleStatus = xBleGetStatus();
@@ -139,6 +149,38 @@ NORA-B1 NFC --------------------------------\r\n\
  * DEFINE MODULES SHELL COMMAND MENU
  * -------------------------------------------------------------- */
 
+SHELL_STATIC_SUBCMD_SET_CREATE(geofence,
+        SHELL_CMD(add_circle, NULL, "Add circular geofence: add_circle <id> <lat> <lon> <radius m>", xPosGeofenceAddCircleCmd),
+        SHELL_CMD(add_polygon, NULL, "Add polygon geofence: add_polygon <id> <lat1> <lon1> <lat2> <lon2> <lat3> <lon3>...", xPosGeofenceAddPolygonCmd),
+        SHELL_CMD(remove, NULL, "Remove geofence: remove <id>", xPosGeofenceRemoveCmd),
+        SHELL_CMD(clear, NULL, "Remove all geofences", xPosGeofenceClearCmd),
+        SHELL_CMD(list, NULL, "Type geofences and geofencing settings", xPosGeofenceListCmd),
+        SHELL_CMD(enable, NULL, "Publish only geofence events and heartbeat position: parameters on/off", xPosGeofenceEnableCmd),
+        SHELL_CMD(set_heartbeat, NULL, "Set heartbeat position period in ms while geofencing (0 = off)", xPosGeofenceSetHeartbeatCmd),
+        SHELL_CMD(set_dwell, NULL, "Set time in ms inside a geofence before a dwell event (0 = off)", xPosGeofenceSetDwellCmd),
+        SHELL_SUBCMD_SET_END
+);
+
+
+SHELL_STATIC_SUBCMD_SET_CREATE(track,
+        SHELL_CMD(enable, NULL, "Publish position as simplified tracks: parameters on/off", xPosMaxM10TrackEnableCmd),
+        SHELL_CMD(set_tolerance, NULL, "Set track simplification tolerance in m", xPosMaxM10TrackToleranceCmd),
+        SHELL_CMD(set_period, NULL, "Set track publish period in ms", xPosMaxM10TrackPeriodCmd),
+        SHELL_CMD(flush, NULL, "Publish buffered track now", xPosMaxM10TrackFlushCmd),
+        SHELL_CMD(stats, NULL, "Type track settings and point reduction", xPosMaxM10TrackStatsCmd),
+        SHELL_SUBCMD_SET_END
+);
+
+
+SHELL_STATIC_SUBCMD_SET_CREATE(replay,
+        SHELL_CMD(record, NULL, "Record MAXM10S output in flash for <s> seconds (stream mode)", xPosMaxM10ReplayRecordCmd),
+        SHELL_CMD(start, NULL, "Replay recorded output (stream mode): start <speed> (1 = real time, 0 = max)", xPosMaxM10ReplayStartCmd),
+        SHELL_CMD(stop, NULL, "Stop replay", xPosMaxM10ReplayStopCmd),
+        SHELL_CMD(stats, NULL, "Type replay statistics and parser throughput", xPosMaxM10ReplayStatsCmd),
+        SHELL_SUBCMD_SET_END
+);
+
+
 SHELL_STATIC_SUBCMD_SET_CREATE(MAXM10S,
         SHELL_CMD(power_on, NULL, "Only Powers On MAXM10S module", xPosMaxM10PowerOn),
         SHELL_CMD(power_off, NULL, "Powers Off MAXM10S module", xPosMaxM10PowerOff),
@@ -146,6 +188,14 @@ SHELL_STATIC_SUBCMD_SET_CREATE(MAXM10S,
         SHELL_CMD(disable,NULL, "Disable MAXM10S measurements", xPosMaxM10Disable),
         SHELL_CMD(set_period,NULL, "Set MAXM10S period in ms", xPosMaxM10UpdatePeriodCmd),
         SHELL_CMD(set_timeout,NULL, "Set MAXM10S timeout period in ms", xPosMaxM10TimeoutPeriodCmd),
+        SHELL_CMD(set_accuracy,NULL, "Set MAXM10S horizontal accuracy threshold in mm (0 = off)", xPosMaxM10AccuracyThresholdCmd),
+        SHELL_CMD(set_power_mode,NULL, "Set MAXM10S power mode: parameters full/cyclic/onoff/auto", xPosMaxM10SetPowerModeCmd),
+        SHELL_CMD(fix_stats,NULL, "Type MAXM10S time to fix statistics", xPosMaxM10FixStatsCmd),
+        SHELL_CMD(assist,NULL, "MAXM10S assistance data in flash: parameters save/clear", xPosMaxM10AssistCmd),
+        SHELL_CMD(set_mode,NULL, "Set MAXM10S position mode: parameters request/stream. Eg: set_mode stream", xPosMaxM10SetModeCmd),
+        SHELL_CMD(geofence, &geofence, "MAXM10S geofencing", NULL),
+        SHELL_CMD(track, &track, "MAXM10S track buffer", NULL),
+        SHELL_CMD(replay, &replay, "MAXM10S output record/replay", NULL),
         SHELL_CMD(comm=nora,NULL, "Set MAXM10S serial comm: nora", xPosMaxM10EnableNoraCom),
         SHELL_CMD(comm=usb,NULL, "Set MAXM10S serial comm: usb", xPosMaxM10DisableNoraCom),
         SHELL_CMD(publish,NULL, "Publish MaxM10S measurements: parameters on/off. Eg: publish on ", xPosMaxM10EnablePublishCmd),
@@ -164,6 +214,7 @@ SHELL_STATIC_SUBCMD_SET_CREATE(NINAW156,
         SHELL_CMD(disconnect,NULL, "Disconnect from WiFi network", xWifiNinaDisconnect),
         SHELL_CMD(provision,NULL, "Provide WiFi network credentials: provision <SSID> <Password> : if open network do not provide <Password>", xWifiNinaProvisionCmd),
         SHELL_CMD(type_cred,NULL, "Type WiFi Network credentials (active/saved/provided for next setup)", xWifiNinaTypeNetworkParamsCmd),
+        SHELL_CMD(fast_conn,NULL, "WiFi fast reconnection (cached access point): no parameter types the cache and statistics, or on/off/ip/clear", xWifiNinaFastConnCmd),
         SHELL_CMD(comm=nora,NULL, "Set NINAW156 serial comm: nora", xWifiNinaEnableNoraCom),
         SHELL_CMD(comm=usb,NULL, "Set NINAW156 serial comm: usb", xWifiNinaDisableNoraCom),
         SHELL_SUBCMD_SET_END
@@ -181,6 +232,7 @@ SHELL_STATIC_SUBCMD_SET_CREATE(MQTT,
         SHELL_CMD(type, NULL, "Type Saved/Active MQTT credentials", xWifiMqttTypeConfigCmd),
         SHELL_CMD(status, NULL, "Get MQTT client status", xWifiMqttClientStatusCmd),
         SHELL_CMD(send, NULL, "Send MQTT Message: send <topic> <message> <QOS>   QOS values:0,1,2", xWifiMqttSendCmd),
+        SHELL_CMD(conn_stats, NULL, "Type WiFi/MQTT bring-up timing (time to first publish)", xWifiConnStatsCmd),
         SHELL_SUBCMD_SET_END
 );
 
@@ -193,6 +245,7 @@ SHELL_STATIC_SUBCMD_SET_CREATE(MQTTSN,
         SHELL_CMD(type, NULL, "Type Saved MQTT-SN Settings", xCellMqttSnTypeConfigCmd),
         SHELL_CMD(status, NULL, "Get MQTT-SN client status", xCellMqttSnClientStatusCmd),
         SHELL_CMD(send, NULL, "Send MQTT-SN Message: send <type> <topic> <message> <QOS>   type: <normal/short/pre>  QOS:0/1/2/3", xCellMqttSnSendCmd),
+        SHELL_CMD(tls_cache, NULL, "MQTT Flex TLS credential cache: parameters on/off/clear", xCellMqttSnTlsCacheCmd),
         SHELL_SUBCMD_SET_END
 );
 
@@ -210,6 +263,7 @@ SHELL_STATIC_SUBCMD_SET_CREATE(SARAR5,
         SHELL_CMD(init, NULL, "config", xCellSaraInit),
         SHELL_CMD(deinit, NULL, "disconnect, deinit and power down", xCellSaraDeinit),
         SHELL_CMD(connect, NULL, "connect", xCellSaraConnect),
+        SHELL_CMD(power_saving, NULL, "Type requested and granted PSM/eDRX timers", xCellSaraPowerSavingCmd),
         //this command is not used at the moment, use deinit instead
         //SHELL_CMD(disconnect, NULL, "disconnect", saraR5_disconnect),   
         SHELL_SUBCMD_SET_END
@@ -222,6 +276,12 @@ SHELL_STATIC_SUBCMD_SET_CREATE(BLE,
         SHELL_SUBCMD_SET_END
 );
 
+SHELL_STATIC_SUBCMD_SET_CREATE(uport,
+        SHELL_CMD(keep_alive, NULL, "Keep ubxlib port initialized on module deinit: keep_alive <on/off>", xCommonUPortKeepAliveCmd),
+        SHELL_CMD(status, NULL, "Type ubxlib port status and release times", xCommonUPortStatusCmd),
+        SHELL_SUBCMD_SET_END
+);
+
 SHELL_STATIC_SUBCMD_SET_CREATE(NFC,
         SHELL_CMD(on, NULL, "Enable NFC", xNfcInit),
         SHELL_CMD(off, NULL, "Disable NFC", xNfcDeinit),
@@ -238,6 +298,7 @@ SHELL_STATIC_SUBCMD_SET_CREATE(sub_modules,
        SHELL_CMD(MQTTSN, &MQTTSN, "MQTTSN control", NULL),
        SHELL_CMD(BLE, &BLE, "BLE control", NULL),
        SHELL_CMD(NFC, &NFC, "NFC control", NULL),
+       SHELL_CMD(uport, &uport, "ubxlib port control", NULL),
        SHELL_CMD(status,   NULL, "Type u-blox modules status", xModulesCmdTypeStatus),
        SHELL_SUBCMD_SET_END
 );
@@ -62,6 +62,8 @@ typedef int32_t err_code;
 #define X_ERR_AT_CMD               ( X_ERR_BASE -8 )
 #define X_ERR_MQTTSN_CON           ( X_ERR_BASE -9 )
 #define X_ERR_NOT_FOUND            ( X_ERR_BASE -10 )
+#define X_ERR_QUEUED               ( X_ERR_BASE -11 )  /**< Not sent yet, kept to be sent later */
+#define X_ERR_TIMEOUT              ( X_ERR_BASE -12 )  /**< Operation did not complete in time */
 
 
 // Special error code definitions -- these are error codes
@@ -56,9 +56,11 @@
 // Logging module names for the ublox module apps
 #define LOGMOD_NAME_UBLMOD_COMMON   ubloxMod_common
 #define LOGMOD_NAME_MAXM10S         maxm10s_app
+#define LOGMOD_NAME_GEOFENCE        geofence_app
 #define LOGMOD_NAME_NINAW156        ninaW156_app
 #define LOGMOD_NAME_SARAR5          saraR5_app
 #define LOGMOD_NAME_WIFI_MQTT       mqtt_app
+#define LOGMOD_NAME_WIFI_CONN       wifiConn_app
 #define LOGMOD_NAME_CELL_MQTTSN     mqttSN_app
 #define LOGMOD_NAME_BLE             ble_app
 #define LOGMOD_NAME_NFC             nfc_app
@@ -68,6 +70,7 @@
 //Logging module names of other modules
 #define LOGMOD_NAME_STORAGE         storage_app
 #define LOGMOD_NAME_DATA_HANDLE     mqtt_handle_app
+#define LOGMOD_NAME_REMOTE_CONFIG   remoteConfig_app
 #define LOGMOD_NAME_BUTTON          button_app
 #define LOGMOD_NAME_LED             led_app
 
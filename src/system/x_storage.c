@@ -175,6 +175,24 @@ err_code xStorageReadFile(void *data, char *filename, uint32_t max_size){
 }
 
 
+bool xStorageFileExists( char *filename ){
+
+	struct fs_dirent entry;
+	char fname[MAX_PATH_LEN];
+
+	if( !gIsMounted ){
+		if( xStorageInit() < 0 ){
+			return false;
+		}
+	}
+
+	snprintf(fname, sizeof(fname), "%s/%s", mp->mnt_point, filename);
+
+	// fs_stat returns -ENOENT when the file does not exist
+	return ( fs_stat( fname, &entry ) == 0 );
+}
+
+
 err_code xStorageDeleteFile( char *filename ){
 
 	int rc;
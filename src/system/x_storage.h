@@ -48,6 +48,7 @@
 #define  wifi_cred_ssid_fname  		"ssid"
 #define  wifi_cred_psw_fname 		"pass"
 #define  wifi_cred_sec_type_fname  	"sec_type"
+#define  wifi_fast_conn_fname  		"wifi_fast_conn"
 
 // Filenames for MQTT configuration
 #define  mqtt_deviceID_fname  		"mqtt_device"
@@ -58,6 +59,15 @@
 #define mqttsn_flex_deviceID_fname		"mqttsn_flex_device"
 #define mqttsn_anywhere_deviceID_fname	"mqttsn_anywhere_device"
 #define mqttsn_duration_fname			"mqttsn_duration"
+#define mqttsn_tls_cache_fname			"mqttsn_tls_cache"
+
+// Filenames for MAXM10S assistance data
+#define maxm10s_dbd_fname               "max_dbd"
+#define maxm10s_lastpos_fname           "max_pos"
+#define maxm10s_replay_fname            "max_replay"
+
+// Filename for geofences
+#define geofence_fname                  "geofences"
 
 // Thingstream Domain filename (only used in BLE mobile app commands)
 #define thingstream_domain_fname        "thingstr_domain"
@@ -104,6 +114,14 @@ err_code xStorageReadFile(void *data, char *filename, uint32_t max_size);
 err_code xStorageSaveFile(void *data, char *filename, uint32_t data_size);
 
 
+/** Check whether a file exists in memory
+ *
+ * @param filename  Filename string of the file to be checked
+ * @return          true if the file exists else false.
+ */
+bool xStorageFileExists( char *filename );
+
+
 /** Delete a file from memory
  *
  * @param filename  Filename string of the file to be deleted
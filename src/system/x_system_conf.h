@@ -69,19 +69,51 @@ ALWAYS be 0 in released/public versions*/
 // Ublox Modules Threads
 #define C210_UPORT_PRIORITY        7
 #define C210_UPORT_STACK_SIZE     1024
+#define C210_UPORT_KEEP_ALIVE_DEFAULT   false   /**< Keep ubxlib port initialized when a module is
+                                                     deinitialized, only the device handles are closed */
 
 #define NINAW156_CONFIG_PRIORITY     7
 #define NINAW156_CONNECT_PRIORITY    7
 #define NINAW156_STACK_SIZE   2048
+#define WIFI_FAST_CONN_DEFAULT           true    /**< Reconnect using the cached access point channel */
+#define WIFI_FAST_CONN_REUSE_IP_DEFAULT  false   /**< Also reuse the cached IP configuration (no DHCP) */
+#define WIFI_FAST_CONN_IP_MAX_AGE_MS     1800000 /**< Max age of the DHCP lease reused as a static IP,
+                                                       older leases are renewed with DHCP */
+#define WIFI_FAST_CONN_MAX_FAILURES      3       /**< Consecutive fast connections failed before the
+                                                       cached access point parameters are deleted */
+#define WIFI_CHANNEL_LIST_MAX_NUM        48      /**< Max channels of the NINA-W156 channel list (AT+UWCL)
+                                                       saved before a fast connection and restored after it */
 
 #define SARAR5_PRIORITY     7
 #define SARAR5_STACK_SIZE   1024
+#define SARA_PSM_ACTIVE_TIME_S      20      /**< Requested PSM active time (T3324): module reachable
+                                                 after each publish before entering deep sleep */
+#define SARA_PSM_TAU_MIN_S          3600    /**< Min requested PSM periodic wake-up (T3412) */
+#define SARA_PSM_MIN_PERIOD_MS      60000   /**< Sampling periods from this value and above use PSM,
+                                                 shorter ones use eDRX */
+#define SARA_EDRX_PAGING_WINDOW_S   2       /**< Requested eDRX paging time window */
 
 #define MQTT_PRIORITY        7
 #define MQTT_STACK_SIZE     1024
+#define MQTT_CONNECT_POLL_MS        100     /**< Broker connection check interval (no ubxlib callback) */
+#define MQTT_CONNECT_TIMEOUT_MS     30000   /**< Max time to wait for the broker connection */
+#define MQTT_RECONNECT_BACKOFF_MIN_MS   1000    /**< Reconnection delay after a broker drop, doubled
+                                                     after each failed attempt (randomized by up to -50%) */
+#define MQTT_RECONNECT_BACKOFF_MAX_MS   60000   /**< Max reconnection delay */
+#define MQTT_BACKLOG_MSG_NUM        8       /**< Messages kept in RAM while reconnecting (oldest dropped) */
+#define MQTT_BACKLOG_MSG_MAXLEN     1024    /**< Max message length kept in the backlog */
+#define MQTT_BACKLOG_TOPIC_MAXLEN   64      /**< Max topic length kept in the backlog */
+
+#define WIFI_CONN_PRIORITY      7
+#define WIFI_CONN_STACK_SIZE    2048
+#define WIFI_CONN_QUEUE_SIZE    8       /**< Events queued to the WiFi connection state machine */
+#define WIFI_CONN_REQUEST_TIMEOUT_MS    60000   /**< Max time to wait for a WiFi connection state
+                                                     machine request (e.g. BLE commands) */
 
 #define MQTTSN_PRIORITY        7
 #define MQTTSN_STACK_SIZE     2048
+#define MQTTSN_FLEX_TLS_CACHE_DEFAULT  true    /**< Use the Flex TLS credential cache saved in flash */
+#define MQTTSN_FLEX_FILE_READ_CHUNK    64      /**< Bytes read at a time when the certificate/key files are checked */
 
 #define MAXM10S_PRIORITY                       7
 #define MAXM10S_COMPLETE_POS_PRIORITY          7 
@@ -90,6 +122,46 @@ ALWAYS be 0 in released/public versions*/
 #define MAXM10S_DEFAULT_TIMEOUT_PERIOD_MS      7000 /**< set to 0 to disable timeout.
                                                          Should be lower than
                                                          MAXM10S_DEFAULT_UPDATE_PERIOD_MS */
+#define MAXM10S_DEFAULT_ACCURACY_THRESHOLD_MM   0   /**< Horizontal accuracy threshold for 
+                                                         publishing a fix. 0 disables the check */
+#define MAXM10S_DEFAULT_POWER_MODE             MAXM10S_PM_FULL
+#define MAXM10S_PM_ONOFF_MIN_PERIOD_MS         10000 /**< In auto power mode, update periods from this
+                                                          value and above use On/Off operation, shorter
+                                                          ones use cyclic tracking */
+#define MAXM10S_ASSIST_BUF_SIZE                4096  /**< Max navigation database size saved in flash */
+#define MAXM10S_ASSIST_POS_ACC_M               100000 /**< Accuracy (m) given with the last position
+                                                           fed to MAXM10S at power up */
+#define MAXM10S_ASSIST_SAVE_INTERVAL_MS        1800000 /**< Min time between navigation database
+                                                            dumps to flash at power off */
+#define MAXM10S_ASSIST_DUMP_MAX_MS             3000  /**< Max time the navigation database dump
+                                                          may delay power off */
+#define MAXM10S_STREAM_PRIORITY                7
+#define MAXM10S_STREAM_STACK_SIZE              2048
+#define MAXM10S_STREAM_CB_STACK_SIZE           1024 /**< ubxlib UART event callback task */
+#define MAXM10S_STREAM_NAV_RATE_MS             1000 /**< Navigation solution (UBX-NAV-PVT) output
+                                                         rate when MAXM10S is in streaming mode */
+#define MAXM10S_TRACK_BUF_SIZE                 64    /**< Max position fixes held in the track buffer */
+#define MAXM10S_TRACK_POLYLINE_MAXLEN          600   /**< Max encoded polyline length in a track message,
+                                                          should fit in an MQTT(SN) message after Base64 encoding */
+#define MAXM10S_TRACK_DEFAULT_TOLERANCE_M      5     /**< Track simplification tolerance */
+#define MAXM10S_TRACK_DEFAULT_FLUSH_PERIOD_MS  600000 /**< Track upload period */
+#define MAXM10S_REPLAY_PRIORITY                7
+#define MAXM10S_REPLAY_STACK_SIZE              2048
+#define MAXM10S_REPLAY_BUF_SIZE                8192  /**< Max size of a MAXM10S output recording kept in flash
+                                                          (about 80 s of UBX-NAV-PVT at 1 Hz) */
+#define MAXM10S_REPLAY_CHUNK_SIZE              64    /**< Bytes given to the parser at a time when replaying,
+                                                          as if read from the UART */
+
+// Geofencing of MAXM10S position
+#define GEOFENCE_MAX_NUM                       8     /**< Max number of fences held */
+#define GEOFENCE_MAX_VERTICES                  8     /**< Max number of vertices of a polygon fence */
+#define GEOFENCE_MAX_RADIUS_M                  1000000 /**< Max radius of a circular fence */
+#define GEOFENCE_CIRCLE_HYSTERESIS_M           20    /**< A circular fence is exited only when the position
+                                                          is this much outside its radius (avoids event bursts
+                                                          caused by position noise at the border) */
+#define GEOFENCE_DEFAULT_DWELL_TIME_MS         300000  /**< Time inside a fence before a dwell event */
+#define GEOFENCE_DEFAULT_HEARTBEAT_PERIOD_MS   3600000 /**< While geofencing, the full position is only
+                                                            published with this period */
 
 
 // Button and Led Threads
@@ -103,9 +175,77 @@ ALWAYS be 0 in released/public versions*/
 // Sensor Aggregation Thread
 #define SENS_AGG_PRIORITY      7
 #define SENS_AGG_STACK_SIZE    1024
+#define SENS_AGG_QUEUE_SIZE    4      /**< Start/stop requests queued to the sensor aggregation state machine */
 #define SENS_AGG_DEFAULT_UPDATE_PERIOD_MS    20000 /**< Refers to sensor aggregation,
                                                         all sensors sampled with the same
                                                         period */
+#define SENS_AGG_MIN_UPDATE_PERIOD_MS        1000   /**< Shortest sampling period accepted */
+#define SENS_AGG_MAX_UPDATE_PERIOD_MS        3600000 /**< Longest sampling period accepted (times
+                                                        SENS_AGG_RATE_DIVISOR_MAX fits in 32 bits) */
+#define SENS_AGG_RATE_DIVISOR_MAX            60     /**< Max rate divisor of a sensor (sampled every
+                                                        divisor sampling periods) */
+#define SENS_AGG_CONFIG_TIMEOUT_MS           5000   /**< Max wait for a start/stop transition to end before
+                                                        a configuration change is applied */
+#define SENS_AGG_MULTIRATE_DIV_BME280        4      /**< Multi-rate profile: temperature/humidity/pressure */
+#define SENS_AGG_MULTIRATE_DIV_BATTERY       10     /**< Multi-rate profile: battery voltage/state of charge */
+#define SENS_AGG_MULTIRATE_DIV_LTR303        2      /**< Multi-rate profile: light */
+#define SENS_AGG_MULTIRATE_DIV_MAXM10        2      /**< Multi-rate profile: position */
+#define SENS_AGG_DUTY_DEFAULT_BATCH          6      /**< Duty-cycled transport: messages kept before
+                                                         the link is brought up (up to DATA_BATCH_MAX_MSGS) */
+#define SENS_AGG_DUTY_DEFAULT_LATENCY_MS     300000 /**< Duty-cycled transport: max time a message is kept
+                                                         before the link is brought up */
+#define SENS_AGG_LINK_TIMEOUT_MS             120000 /**< Max time to bring the link up and to publish the
+                                                         batch (duty-cycled transport, failover) */
+#define SENS_AGG_LINK_POLL_MS                100    /**< Module status poll interval while a link goes down */
+#define SENS_AGG_DUTY_STACK_SIZE             2048
+#define SENS_AGG_FAILOVER_MAX_FAILURES       3      /**< Consecutive failed publishes before failing
+                                                         over to the other transport */
+#define SENS_AGG_FAILOVER_CHECK_MS           5000   /**< Link health check interval */
+#define SENS_AGG_FAILBACK_PERIOD_MS          600000 /**< Time on the fallback transport before trying
+                                                         the preferred one again */
+#define SENS_AGG_FAILOVER_STACK_SIZE         2048
+#define SENS_AGG_LINK_SAMPLE_PERIOD_MS       60000  /**< Link quality sampling (and diagnostics message)
+                                                         period while the link is up */
+#define SENS_AGG_LINK_MIN_RSSI_DBM           -80    /**< WiFi RSSI below which batch flushes are deferred */
+#define SENS_AGG_LINK_MIN_RSRP_DBM           -115   /**< Cellular RSRP below which batch flushes are deferred */
+#define SENS_AGG_LINK_MIN_RSRQ_DB            -15    /**< Cellular RSRQ below which batch flushes are deferred */
+#define SENS_AGG_LINK_RETRY_MS               60000  /**< Time before a deferred batch flush is retried */
+#define SENS_AGG_LINK_MAX_DEFER_MS           900000 /**< Max time a batch flush is deferred, then it is
+                                                         published regardless of link quality */
+#define SENS_AGG_LINK_STACK_SIZE             2048
+
+// Remote configuration (commands received via MQTT/MQTT-SN subscription)
+#define REMOTE_CONFIG_PRIORITY      7
+#define REMOTE_CONFIG_STACK_SIZE    2048
+#define REMOTE_CONFIG_MSG_MAXLEN    288     /**< Max command length, fits the longest command (request id,
+                                                 "fence" and a GEOFENCE_DEF_STR_MAXLEN definition).
+                                                 Longer commands are rejected */
+#define REMOTE_CONFIG_DEFAULT       true    /**< Execute the commands received */
+
+// Data Publish Thread
+#define DATA_PUBLISH_PRIORITY        7
+#define DATA_PUBLISH_STACK_SIZE      2048
+#define DATA_PUBLISH_QUEUE_LEN       4    /**< Max messages accepted by xDataSend and not yet
+                                               published (acknowledged for QoS 1). Published
+                                               one at a time. When full, new messages are
+                                               dropped */
+#define DATA_DEFAULT_QOS_SENSOR      0    /**< QoS of single sensor messages */
+#define DATA_DEFAULT_QOS_POSITION    0    /**< QoS of position/geofence/track messages */
+#define DATA_DEFAULT_QOS_AGGREGATE   0    /**< QoS of sensor aggregation messages */
+#define DATA_DEFAULT_QOS_DIAGNOSTICS 0    /**< QoS of diagnostics (link quality) messages */
+#define DATA_DEFAULT_QOS_CONFIG      1    /**< QoS of remote configuration responses */
+#define DATA_DEFAULT_MQTTSN_TOPIC_TYPE  dataMqttSnTopicPredefined  /**< MQTT-SN topics: predefined IDs or
+                                                                     registered normal topics */
+#define DATA_BATCH_MAX_MSGS          8    /**< Max messages kept while the link is down in duty-cycled
+                                               transport mode (oldest dropped) */
+#define DATA_CHUNK_LEN_MQTT          1024 /**< Max payload published at once via MQTT (WiFi), longer
+                                               messages are fragmented */
+#define DATA_CHUNK_LEN_MQTTSN        1024 /**< Max payload published at once via MQTT-SN (SARA-R5
+                                               limit, MQTT_MAX_MSG_LEN) */
+#define DATA_CHUNK_LEN_MQTTSN_BINARY 512  /**< Max payload published at once via MQTT-SN in hex
+                                               mode (SARA-R5 limit, 512 octets) */
+#define DATA_DEFAULT_ENCODING_MQTT   dataEncodingBase64  /**< Encoding of messages published via MQTT */
+#define DATA_DEFAULT_ENCODING_MQTTSN dataEncodingRaw     /**< Encoding of messages published via MQTT-SN */
 
 // BLE Command Execution Threads
 #define BLE_CMD_EXEC_PRIORITY    7
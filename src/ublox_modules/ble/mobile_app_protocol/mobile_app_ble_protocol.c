@@ -132,6 +132,7 @@ const char *const gpCommandStr[]={
     [ WRITE_IP_THING_USERNAME  ]  = M_BLE_PROT_CMD_STR_WRITE_IP_THING_USERNAME,
     [ WRITE_IP_THING_PSW       ]  = M_BLE_PROT_CMD_STR_WRITE_IP_THING_PSW,
     [ WRITE_SIM_THING_DEVICE_ID ] = M_BLE_PROT_CMD_STR_WRITE_SIM_THING_DEVICE_ID,
+    [ WRITE_GEOFENCE ]            = M_BLE_PROT_CMD_STR_WRITE_GEOFENCE,
 	[ UNKNOWN_COMMAND ]           = M_BLE_PROT_CMD_STR_UNKNOWN_COMMAND
 };
 
@@ -158,6 +159,7 @@ const uint32_t gpCommandCodes[]={
     [ WRITE_IP_THING_USERNAME  ]  = M_BLE_PROT_CMD_CODE_WRITE_IP_THING_USERNAME,
     [ WRITE_IP_THING_PSW       ]  = M_BLE_PROT_CMD_CODE_WRITE_IP_THING_PSW,
     [ WRITE_SIM_THING_DEVICE_ID ] = M_BLE_PROT_CMD_CODE_WRITE_SIM_THING_DEVICE_ID,
+    [ WRITE_GEOFENCE ]            = M_BLE_PROT_CMD_CODE_WRITE_GEOFENCE,
 	[ UNKNOWN_COMMAND ]           = M_BLE_PROT_RSP_UNKNOWN_CMD
 };
 
@@ -268,6 +270,9 @@ void mBleProtocolParseCmd( uint8_t *inBuffer, uint16_t inBufferLen,
             case M_BLE_PROT_CMD_CODE_WRITE_SIM_THING_DEVICE_ID: *command = WRITE_SIM_THING_DEVICE_ID;
             break;
 
+            case M_BLE_PROT_CMD_CODE_WRITE_GEOFENCE: *command = WRITE_GEOFENCE;
+            break;
+
             default: *command = UNKNOWN_COMMAND;         
         }   
 
@@ -175,6 +175,7 @@ typedef enum{
     WRITE_IP_THING_USERNAME,     /**< Write Thingstream IP Thing Username */
     WRITE_IP_THING_PSW,          /**< Write Thingstream IP Thing Password */
     WRITE_SIM_THING_DEVICE_ID,   /**< Write Thingstream SIM Thing Device ID */
+    WRITE_GEOFENCE,              /**< Write (add/remove) a MAXM10S geofence definition */
     UNKNOWN_COMMAND              /**< Unknown Command */
 }mBleProtocolCmd_t;
 
@@ -307,6 +308,10 @@ typedef enum{
 #define M_BLE_PROT_CMD_CODE_WRITE_IP_THING_PSW        (0x00000207)   /**< Write Thingstream IP Thing Password */
 #define M_BLE_PROT_CMD_CODE_WRITE_SIM_THING_DEVICE_ID (0x00000208)   /**< Write Thingstream SIM Thing Device ID */
 
+// -- Positioning Commands -- //
+
+#define M_BLE_PROT_CMD_CODE_WRITE_GEOFENCE            (0x00000300)   /**< Write (add/remove) Geofence */
+
 
 // -- Readable String Representation of commands -- //
 
@@ -334,6 +339,7 @@ typedef enum{
 #define M_BLE_PROT_CMD_STR_WRITE_IP_THING_USERNAME    "Write Thingstream IP Thing Username"
 #define M_BLE_PROT_CMD_STR_WRITE_IP_THING_PSW         "Write Thingstream IP Thing Password" 
 #define M_BLE_PROT_CMD_STR_WRITE_SIM_THING_DEVICE_ID  "Write Thingstream SIM Thing Device ID"
+#define M_BLE_PROT_CMD_STR_WRITE_GEOFENCE             "Write Geofence"
 
 
 /* ----------------------------------------------------------------
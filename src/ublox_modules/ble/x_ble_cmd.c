@@ -47,6 +47,7 @@
 #include "x_system_conf.h"
 #include "num_array.h"
 #include "x_storage.h"
+#include "x_wifi_conn.h"
 
 
 /* ----------------------------------------------------------------
@@ -378,6 +379,21 @@ static err_code xBleCmdWriteThingstreamIpThingPassword( commandWithPayload_t *cm
 static err_code xBleCmdWriteThingstreamSimThingDevId( commandWithPayload_t *cmdItem );
 
 
+/* ----------------------------------------------------------------
+ * STATIC FUNCTION DECLARATION -- POSITIONING COMMANDS
+ * -------------------------------------------------------------- */
+
+/** Adds/removes a MAXM10S geofence. The payload is a geofence definition
+ * string as described in xPosGeofenceDefine (e.g. "c,1,47.2850000,8.5650000,200").
+ * 
+ * @param cmdItem  Commands which send data to the firmware (in this case the
+ *                 geofence definition), use this structure to get the
+ *                 payload of the incoming command.
+ * @return         zero on success else negative error code.
+ */
+static err_code xBleCmdWriteGeofence( commandWithPayload_t *cmdItem );
+
+
 /* ----------------------------------------------------------------
  * ZEPHYR RELATED DEFINITIONS/DECLARATIONS
  * -------------------------------------------------------------- */
@@ -549,6 +565,9 @@ static void xBleCmdExecThread(void){
             
             case WRITE_SIM_THING_DEVICE_ID: xBleCmdWriteThingstreamSimThingDevId( cmdItem );
             break; 
+
+            case WRITE_GEOFENCE:            xBleCmdWriteGeofence( cmdItem );
+            break; 
                                            
             case UNKNOWN_COMMAND: xBleCmdUnknownCommand( cmdItem );
                                   break;
@@ -1093,13 +1112,9 @@ static err_code xBleCmdScanWiFi( void ){
     if( nina_status.uStatus < uDeviceOpened ){
         LOG_WRN("WiFi device closed, trying to open now\r\n");
         ninaInitLocally = true;
-        xWifiNinaInit();
         // wait until initialized or error while trying to initialize happens
-        while( ( nina_status.uStatus < uDeviceOpened ) && ( ninaLastOperationResult == X_ERR_SUCCESS ) ){
-                k_sleep(K_MSEC(1000));
-                nina_status = xWifiNinaGetModuleStatus();
-                ninaLastOperationResult = xWifiNinaGetLastOperationResult();
-        }
+        xWifiConnRequest( WIFI_CONN_STATE_INITIALIZED );
+        ninaLastOperationResult = xWifiConnWait( K_MSEC( WIFI_CONN_REQUEST_TIMEOUT_MS ) );
         //if error while initializing NINA happens
         if( ninaLastOperationResult != X_ERR_SUCCESS ){
             LOG_ERR("Error Code from WiFi Init Request: %d", ninaLastOperationResult);
@@ -1175,7 +1190,7 @@ static err_code xBleCmdScanWiFi( void ){
 static err_code xBleCmdGetNextScanWiFiResult( void ){
 
     err_code ret;
-    uWifiScanResult_t result;
+    xWifiNinaScanResult_t result;
     // Response length, will be obtained by mBleProtocolPrepareResponse
     uint16_t responseLen;
     mBleProtocolPayload_t payload;
@@ -1625,3 +1640,46 @@ static err_code xBleCmdWriteThingstreamSimThingDevId( commandWithPayload_t *cmdI
     return (err_code) bt_nus_send( NULL, gpResponseBuf, responseLen);
 
 }
+
+
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTION IMPLEMENTATION -- POSITIONING COMMANDS
+ * -------------------------------------------------------------- */
+
+
+static err_code xBleCmdWriteGeofence( commandWithPayload_t *cmdItem ){
+
+    if( cmdItem->command != WRITE_GEOFENCE ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    err_code ret;
+    // Response length, will be obtained by mBleProtocolPrepareResponse
+    uint16_t responseLen;
+    mBleProtocolPayload_t responsePayload;
+    mBleProtocolResponseCode_t responseCode;
+
+    // add string termination to data received
+    if( cmdItem->cmdPayloadLen >= sizeof( cmdItem->cmdPayload ) ){
+        cmdItem->cmdPayloadLen = sizeof( cmdItem->cmdPayload ) - 1;
+    }
+    cmdItem->cmdPayload[cmdItem->cmdPayloadLen]='\0';
+
+    // type received string
+    LOG_INF( "Geofence Received: %s \r\n", cmdItem->cmdPayload );
+
+    if( ( ret = xPosGeofenceDefine( (char*) cmdItem->cmdPayload ) ) < 0 ){
+        responseCode = M_CMD_RSP_ERROR;  
+        responsePayload.data.errorCode = (int32_t) ret;
+    }
+    else{
+        responseCode = M_CMD_RSP_OK;
+        responsePayload.length = 0;
+    }
+
+    mBleProtocolPrepareResponse( cmdItem->command, responseCode, responsePayload, gpResponseBuf, 
+                                sizeof(gpResponseBuf), &responseLen );
+
+    return (err_code) bt_nus_send( NULL, gpResponseBuf, responseLen);
+}
@@ -44,6 +44,7 @@
 #include "x_wifi_ninaW156.h"          // WIFI_MAX_SSID_LEN
 #include "x_wifi_mqtt.h"              // MQTT_DEVICE_ID_MAXLEN etc...
 #include "x_cell_mqttsn.h"            // MQTTSN_CLIENT_ID_MAXLEN
+#include "x_pos_geofence.h"           // GEOFENCE_DEF_STR_MAXLEN
 
 
 
@@ -81,6 +82,7 @@ typedef union {
     uint8_t mqttPassword[ MQTT_PASSWORD_MAXLEN ];            /**< MQTT (IP Thing) Password. Incoming only*/
     uint8_t mqttSnClientId[ MQTTSN_CLIENT_ID_MAXLEN ];       /**< MQTTSN (SIM Thing) Client Id. In/Out(Reponse)*/
     uint8_t ThingstreamDomain[ THINGSTREAM_DOMAIN_MAX_LEN ]; /**< Thingstream Domain. In/Out(Reponse)*/
+    char geofenceDef[ GEOFENCE_DEF_STR_MAXLEN ];             /**< Geofence definition string. Incoming only*/
 }xBleCmdPayloads_t;
 
 
@@ -28,6 +28,7 @@
 #include <ctype.h>
 #include <stdlib.h> //atoi
 #include <stdio.h> //sprintf
+#include <sys/crc.h>
 
 //Ubxlib related
 #include "ubxlib.h"
@@ -39,6 +40,8 @@
 #include "x_led.h"
 #include "x_storage.h"
 #include "x_module_common.h"
+#include "x_data_handle.h"  // asynchronous publish
+#include "x_remote_config.h"
 
 
 
@@ -94,6 +97,61 @@ static err_code mqttSnConfigFlexTLSSecurity( void );
 static err_code mqttSnImportCertKeyFiles(void);
 
 
+/** Used only for MQTT Flex.
+ *  Scan all credentials saved in SARA module memory and keep the names of the
+ *  client certificate and private key found in the credential cache (RAM copy).
+ *  In case more than one appropriate certificate/key are found the last ones are used.
+ *
+ * @return     zero on success, negative error code otherwise
+*/
+static err_code mqttSnScanCredentials(void);
+
+
+/** Used only for MQTT Flex.
+ *  Verify the credential cache saved in flash against the credentials stored in
+ *  SARA module: the MD5 hashes of the cached certificate and key names are read
+ *  from the module and compared with the cached ones, and the CRCs of the
+ *  certificate and key files (mqttSnTlsFilesCrc) are compared with the ones of
+ *  the files imported. If they match, the RAM copy of the cache holds the names to use.
+ *
+ * @return     true if the cache is valid, false otherwise
+*/
+static bool mqttSnTlsCacheVerify(void);
+
+
+/** Used only for MQTT Flex.
+ *  Read the MD5 hashes of the certificate and key found by mqttSnScanCredentials()
+ *  and save them, along with the names and the CRCs of the files imported, in
+ *  the flash credential cache.
+ *
+ * @return     zero on success, negative error code otherwise
+*/
+static err_code mqttSnTlsCacheSave(void);
+
+
+/** Used only for MQTT Flex.
+ *  Read a file from the cellular module file system and calculate its CRC32,
+ *  so that new certificate/key files are detected and imported.
+ *
+ * @param pFileName  [Input] Name of the file in the module file system
+ * @param pCrc       [Output] CRC32 of the file contents
+ * @return           zero on success, negative error code otherwise
+*/
+static err_code mqttSnFileCrc(const char *pFileName, uint32_t *pCrc);
+
+
+/** Completion callback of messages published by xCellMqttSnSendCmd
+*/
+static void mqttSnSendCmdCb(err_code result, uint32_t latencyMs, void *pParam);
+
+
+/** Called when messages are received in the remote configuration topic
+ * (the only one subscribed), which are read and executed by the remote
+ * configuration thread (x_remote_config.h)
+*/
+static void mqttSnMessageCb(int32_t unreadMsgCount, void *pParam);
+
+
 /* ----------------------------------------------------------------
  * ZEPHYR RELATED DEFINITIONS/DECLARATIONS
  * -------------------------------------------------------------- */
@@ -143,6 +201,29 @@ const char *uMqttSNTopicType_strings[]={
 /** A copy of the active (open) MQTT-SN client configuration */
 static xCellMqttSnConfig_t gMqttSnActiveConfigCopy;
 
+/** Flex TLS credentials resolved in SARA module, as saved in the flash cache.
+ *  tlsSettings point to the names held here */
+typedef struct{
+    char certName[ U_SECURITY_CREDENTIAL_NAME_MAX_LENGTH_BYTES + 1 ];
+    char keyName[ U_SECURITY_CREDENTIAL_NAME_MAX_LENGTH_BYTES + 1 ];
+    char certHash[ U_SECURITY_CREDENTIAL_MD5_LENGTH_BYTES ];
+    char keyHash[ U_SECURITY_CREDENTIAL_MD5_LENGTH_BYTES ];
+    uint32_t certFileCrc;   /**< CRC32 of MQTTSN_FLEX_CERTIFICATE_FILENAME imported */
+    uint32_t keyFileCrc;    /**< CRC32 of MQTTSN_FLEX_KEY_FILENAME imported */
+}mqttSnTlsCache_t;
+
+static mqttSnTlsCache_t gTlsCache;
+
+/** Client bring-up timing and credential cache statistics */
+static xCellMqttSnTlsStats_t gTlsStats = { .cacheEnabled = MQTTSN_FLEX_TLS_CACHE_DEFAULT };
+
+/** The last Flex TLS setup used the cached credentials */
+static bool gTlsUsedCache = false;
+
+/** Successful connections to the broker since boot. Registered topic IDs
+ *  are valid only within the session they were registered in */
+static uint32_t gMqttSnSession = 0;
+
 
 /* ----------------------------------------------------------------
  * CALLBACKS
@@ -156,6 +237,31 @@ static void disconnectCallback(int32_t errorCode, void *pParam)
 }
 
 
+
+static void mqttSnMessageCb(int32_t unreadMsgCount, void *pParam){
+    // called by ubxlib, do not use ubxlib from here
+    if( unreadMsgCount > 0 ){
+        xRemoteConfigNotify( MqttSNClient );
+    }
+}
+
+
+
+static void mqttSnSendCmdCb(err_code result, uint32_t latencyMs, void *pParam){
+
+    // not reported by MQTT-SN today, which has no backlog, handled as by the MQTT client
+    if( result == X_ERR_QUEUED ){
+        LOG_WRN("Kept in backlog: published after the reconnection\r\n");
+        return;
+    }
+    if( result != X_ERR_SUCCESS ){
+        LOG_ERR("MQTT-SN publish failed: %d\r\n", result );
+        return;
+    }
+    LOG_INF("Published in %d ms\r\n", latencyMs );
+}
+
+
 /* ----------------------------------------------------------------
  * STATIC FUNCTION IMPLEMENTATION
  * -------------------------------------------------------------- */
@@ -220,22 +326,13 @@ static err_code mqttSnImportCertKeyFiles(void){
     return X_ERR_SUCCESS;
 }
 
-static err_code mqttSnConfigFlexTLSSecurity( void ){
+static err_code mqttSnScanCredentials(void){
 
-    err_code ret;
-    
     uSecurityCredential_t buffer;
-    static char ClientCertificateName[ sizeof buffer.name ];
-    static char ClientPrivateKeyName[ sizeof buffer.name ];
-
-    memset( ClientCertificateName, 0, sizeof(ClientCertificateName) );
-    memset( ClientPrivateKeyName, 0, sizeof(ClientPrivateKeyName) );
 
-    // Import certificate and Key from files saved in Cellular File system
-    ret = mqttSnImportCertKeyFiles();
-    if( ret < X_ERR_SUCCESS ){
-        return ret;
-    }
+    memset( gTlsCache.certName, 0, sizeof(gTlsCache.certName) );
+    memset( gTlsCache.keyName, 0, sizeof(gTlsCache.keyName) );
+    memset( &buffer , 0, sizeof(buffer) );
 
     // Cycle through all credentials saved in SARA module memory.
     // Find appropriate certificate and key saved in SARA module memory to use with Flex plan.
@@ -243,21 +340,20 @@ static err_code mqttSnConfigFlexTLSSecurity( void ){
     // and then use function mqttSnImportCertKeyFiles, or send the commands before this works properly:
     // - AT+USECMNG=1,1,"Some_name","cert.pem" 
     // - AT+USECMNG=1,2,"Some_other_name", "cert.key"
-    // In case more than one appropriate certificate/Key are found the first ones are used
     for (int32_t x = uSecurityCredentialListFirst( xCellSaraGetHandle(), &buffer);
          x >= 0;
          x = uSecurityCredentialListNext(xCellSaraGetHandle(), &buffer)) {
         
         // found Client Certificate -> use it
         if( buffer.type == U_SECURITY_CREDENTIAL_CLIENT_X509 ){
-            memcpy( ClientCertificateName, buffer.name, sizeof(ClientCertificateName) );
-            LOG_INF("Client Certificate Found: %s\r\n", ClientCertificateName);    
+            strncpy( gTlsCache.certName, buffer.name, sizeof(gTlsCache.certName) - 1 );
+            LOG_INF("Client Certificate Found: %s\r\n", gTlsCache.certName);    
         }
 
         // found Private Key -> use it
         else if( buffer.type == U_SECURITY_CREDENTIAL_CLIENT_KEY_PRIVATE ){
-            memcpy( ClientPrivateKeyName, buffer.name, sizeof(ClientPrivateKeyName) );
-            LOG_INF("Client Private Key Found: %s\r\n", ClientPrivateKeyName);    
+            strncpy( gTlsCache.keyName, buffer.name, sizeof(gTlsCache.keyName) - 1 );
+            LOG_INF("Client Private Key Found: %s\r\n", gTlsCache.keyName);    
         }
 
         // clear buffer before next search
@@ -265,16 +361,196 @@ static err_code mqttSnConfigFlexTLSSecurity( void ){
     }
 
     // Both Client Certificate and Private key need to be found before proceeding 
-    if( ( strlen( ClientCertificateName ) == 0 ) || ( strlen(ClientPrivateKeyName) == 0 ) ){
+    if( ( strlen( gTlsCache.certName ) == 0 ) || ( strlen( gTlsCache.keyName ) == 0 ) ){
         LOG_INF("Did not find both Client Certificate and Private Key \r\n");
         return X_ERR_NOT_FOUND;
     }
 
+    return X_ERR_SUCCESS;
+}
+
+
+static err_code mqttSnFileCrc(const char *pFileName, uint32_t *pCrc){
+
+    uAtClientHandle_t pAtHandle;
+    char chunk[ MQTTSN_FLEX_FILE_READ_CHUNK ];
+    int32_t size;
+    int32_t len;
+    err_code ret;
+
+    ret = uCellAtClientHandleGet( xCellSaraGetHandle(), &pAtHandle );
+    if( ret < U_ERROR_COMMON_SUCCESS){
+        return ret;
+    }
+
+    *pCrc = 0;
+
+    // AT+URDFILE="cert.pem" -> +URDFILE: "cert.pem",<size>,"<data>"
+    // the data are read in chunks, as they come, so the file is not buffered
+    uAtClientLock(pAtHandle);
+    uAtClientCommandStart(pAtHandle, "AT+URDFILE=");
+    uAtClientWriteString(pAtHandle, pFileName, true);
+    uAtClientCommandStop(pAtHandle);
+    uAtClientResponseStart(pAtHandle, "+URDFILE:");
+    uAtClientReadString(pAtHandle, NULL, U_SECURITY_CREDENTIAL_NAME_MAX_LENGTH_BYTES + 1, false);
+    size = uAtClientReadInt(pAtHandle);
+    if( size > 0 ){
+        // the file may contain any character, including delimiters
+        uAtClientIgnoreStopTag(pAtHandle);
+        // leading quote
+        uAtClientReadBytes(pAtHandle, NULL, 1, true);
+        while( size > 0 ){
+            len = ( size < (int32_t)sizeof(chunk) ) ? size : (int32_t)sizeof(chunk);
+            if( uAtClientReadBytes(pAtHandle, chunk, len, true) != len ){
+                break;
+            }
+            *pCrc = crc32_ieee_update( *pCrc, (uint8_t*)chunk, len );
+            size -= len;
+        }
+        uAtClientRestoreStopTag(pAtHandle);
+    }
+    uAtClientResponseStop(pAtHandle);
+    if( ( uAtClientUnlock(pAtHandle) != 0 ) || ( size != 0 ) ){
+        LOG_WRN("Could not read %s \r\n", pFileName);
+        return X_ERR_AT_CMD;
+    }
+
+    return X_ERR_SUCCESS;
+}
+
+
+static bool mqttSnTlsCacheVerify(void){
+
+    mqttSnTlsCache_t saved;
+    char hash[ U_SECURITY_CREDENTIAL_MD5_LENGTH_BYTES ];
+    uint32_t crc;
+    err_code ret;
+
+    memset( &saved, 0, sizeof(saved) );
+    ret = xStorageReadFile( &saved, mqttsn_tls_cache_fname, sizeof(saved) );
+    gTlsStats.cacheSaved = ( ret == sizeof(saved) );
+    if( !gTlsStats.cacheSaved ){
+        return false;
+    }
+
+    // make sure names are terminated, whatever was read from flash
+    saved.certName[ sizeof(saved.certName) - 1 ] = 0;
+    saved.keyName[ sizeof(saved.keyName) - 1 ] = 0;
+
+    // one AT command per credential, instead of the import and the whole list scan.
+    // Fails if the credential has been removed from the module (or the module replaced)
+    ret = uSecurityCredentialGetHash( xCellSaraGetHandle(), U_SECURITY_CREDENTIAL_CLIENT_X509,
+                                      saved.certName, hash );
+    if( ( ret < 0 ) || ( memcmp( hash, saved.certHash, sizeof(hash) ) != 0 ) ){
+        LOG_WRN("Cached Client Certificate not verified: %d \r\n", ret);
+        return false;
+    }
+
+    ret = uSecurityCredentialGetHash( xCellSaraGetHandle(), U_SECURITY_CREDENTIAL_CLIENT_KEY_PRIVATE,
+                                      saved.keyName, hash );
+    if( ( ret < 0 ) || ( memcmp( hash, saved.keyHash, sizeof(hash) ) != 0 ) ){
+        LOG_WRN("Cached Client Private Key not verified: %d \r\n", ret);
+        return false;
+    }
+
+    // the credentials in the module are the ones cached, but new files may have
+    // been saved in the module since they were imported
+    ret = mqttSnFileCrc( MQTTSN_FLEX_CERTIFICATE_FILENAME, &crc );
+    if( ( ret < 0 ) || ( crc != saved.certFileCrc ) ){
+        LOG_INF("%s changed since cached, import again \r\n", MQTTSN_FLEX_CERTIFICATE_FILENAME);
+        return false;
+    }
+
+    ret = mqttSnFileCrc( MQTTSN_FLEX_KEY_FILENAME, &crc );
+    if( ( ret < 0 ) || ( crc != saved.keyFileCrc ) ){
+        LOG_INF("%s changed since cached, import again \r\n", MQTTSN_FLEX_KEY_FILENAME);
+        return false;
+    }
+
+    memcpy( &gTlsCache, &saved, sizeof(gTlsCache) );
+    LOG_INF("Cached Client Certificate: %s, Private Key: %s \r\n", gTlsCache.certName, gTlsCache.keyName);
+
+    return true;
+}
+
+
+static err_code mqttSnTlsCacheSave(void){
+
+    err_code ret;
+
+    ret = uSecurityCredentialGetHash( xCellSaraGetHandle(), U_SECURITY_CREDENTIAL_CLIENT_X509,
+                                      gTlsCache.certName, gTlsCache.certHash );
+    if( ret < 0 ){
+        return ret;
+    }
+
+    ret = uSecurityCredentialGetHash( xCellSaraGetHandle(), U_SECURITY_CREDENTIAL_CLIENT_KEY_PRIVATE,
+                                      gTlsCache.keyName, gTlsCache.keyHash );
+    if( ret < 0 ){
+        return ret;
+    }
+
+    ret = mqttSnFileCrc( MQTTSN_FLEX_CERTIFICATE_FILENAME, &gTlsCache.certFileCrc );
+    if( ret < 0 ){
+        return ret;
+    }
+
+    ret = mqttSnFileCrc( MQTTSN_FLEX_KEY_FILENAME, &gTlsCache.keyFileCrc );
+    if( ret < 0 ){
+        return ret;
+    }
+
+    ret = xStorageSaveFile( &gTlsCache, mqttsn_tls_cache_fname, sizeof(gTlsCache) );
+    if( ret < 0 ){
+        return ret;
+    }
+
+    gTlsStats.cacheSaved = true;
+    return X_ERR_SUCCESS;
+}
+
+
+static err_code mqttSnConfigFlexTLSSecurity( void ){
+
+    err_code ret;
+    int64_t start = k_uptime_get();
+
+    gTlsUsedCache = gTlsStats.cacheEnabled && mqttSnTlsCacheVerify();
+
+    if( gTlsUsedCache ){
+        gTlsStats.cacheHits++;
+        gTlsStats.lastCachedMs = (int32_t)( k_uptime_get() - start );
+    }
+    else{
+        // Import certificate and Key from files saved in Cellular File system
+        ret = mqttSnImportCertKeyFiles();
+        if( ret < X_ERR_SUCCESS ){
+            return ret;
+        }
+
+        ret = mqttSnScanCredentials();
+        if( ret < X_ERR_SUCCESS ){
+            return ret;
+        }
+
+        // not critical, the next open will import and scan again
+        ret = mqttSnTlsCacheSave();
+        if( ret < X_ERR_SUCCESS ){
+            LOG_WRN("Could not save TLS credential cache: %d \r\n", ret);
+        }
+
+        gTlsStats.cacheMisses++;
+        gTlsStats.lastFullMs = (int32_t)( k_uptime_get() - start );
+    }
+
+    LOG_INF("Flex TLS setup took %d ms (%s) \r\n", (int32_t)( k_uptime_get() - start ),
+            gTlsUsedCache ? "cached" : "import and scan");
+
     // Set up the tls Settings structure
     tlsSettings.tlsVersionMin = U_SECURITY_TLS_VERSION_1_2;
     tlsSettings.pRootCaCertificateName = NULL;
-    tlsSettings.pClientCertificateName = ClientCertificateName;
-    tlsSettings.pClientPrivateKeyName = ClientPrivateKeyName;
+    tlsSettings.pClientCertificateName = gTlsCache.certName;
+    tlsSettings.pClientPrivateKeyName = gTlsCache.keyName;
     tlsSettings.certificateCheck = U_SECURITY_TLS_CERTIFICATE_CHECK_NONE;
     tlsSettings.pClientPrivateKeyPassword = NULL;
     tlsSettings.cipherSuites.num = 1;
@@ -300,6 +576,7 @@ void xCellMqttSnClientOpenThread(void){
         k_sem_take( &xCellMqttSnClientOpen_semaphore, K_FOREVER );
 
         LOG_DBG("MQTT-SN Open Client Request\r\n");
+        int64_t openStart = k_uptime_get();
         
         // Check if client already open
         if( gMqttSnStatus.status >= ClientOpen ){
@@ -362,7 +639,8 @@ void xCellMqttSnClientOpenThread(void){
             continue;
         }
 
-        LOG_INF("Client opened \r\n");
+        gTlsStats.lastOpenMs = (int32_t)( k_uptime_get() - openStart );
+        LOG_INF("Client opened in %d ms \r\n", gTlsStats.lastOpenMs);
         gMqttSnStatus.status = ClientOpen;
         xLedOff();
     }
@@ -382,6 +660,7 @@ void xCellMqttSnClientConnectThread(void){
         k_sem_take( &xCellMqttSnClientConnect_semaphore, K_FOREVER );
 
         LOG_DBG("MQTT-SN Connect Request\r\n");
+        int64_t connectStart = k_uptime_get();
 
         if( gMqttSnStatus.status == ClientConnected ){
             LOG_INF("MQTT-SN status already Connected\r\n");
@@ -453,12 +732,32 @@ void xCellMqttSnClientConnectThread(void){
 
         if( gLastOperationResult != X_ERR_SUCCESS ){
             LOG_ERR("uMqttSnClientConnect failed: %d\r\n", gLastOperationResult );
+            // the TLS handshake may have failed with the cached credentials
+            // (e.g. new files saved in the module): import and scan on next open
+            if( ( activePlan == FLEX ) && gTlsUsedCache ){
+                xCellMqttSnTlsCacheClear();
+            }
             mqttSnErrorHandle( gLastOperationResult );
             continue;
         } 
 
-        LOG_INF("MQTTSN Connected \r\n"); 
+        gTlsStats.lastConnectMs = (int32_t)( k_uptime_get() - connectStart );
+        LOG_INF("MQTTSN Connected in %d ms \r\n", gTlsStats.lastConnectMs); 
+        gMqttSnSession++;
         gMqttSnStatus.status = ClientConnected;
+
+        // subscribe to the remote configuration commands (MQTT Anywhere cannot
+        // subscribe). The client can still publish if this fails
+        if( activePlan == FLEX ){
+            uMqttSnTopicName_t configTopic;
+            int32_t qos;
+            uMqttClientSetMessageCallback( gMqttSnClientCtx, mqttSnMessageCb, NULL );
+            qos = uMqttClientSnSubscribeNormalTopic( gMqttSnClientCtx, TOPIC_NAME_CONFIG_CMD,
+                                                     U_MQTT_QOS_AT_LEAST_ONCE, &configTopic );
+            if( qos < 0 ){
+                LOG_WRN("Could not subscribe to %s: %d\r\n", TOPIC_NAME_CONFIG_CMD, qos);
+            }
+        }
         
         xLedOff();
     }
@@ -572,6 +871,73 @@ err_code xCellMqttSnClientPublish( const uMqttSnTopicName_t *pTopicName,
 }
 
 
+err_code xCellMqttSnRegisterNormalTopic( const char *pTopicNameStr, uMqttSnTopicName_t *pTopicName ){
+
+    if( gMqttSnStatus.status < ClientConnected ){
+        return X_ERR_INVALID_STATE;
+    }
+
+    return uMqttClientSnRegisterNormalTopic( gMqttSnClientCtx, pTopicNameStr, pTopicName );
+}
+
+
+
+err_code xCellMqttSnMessageRead( char *pMessage, size_t *pMessageSizeBytes ){
+
+    uMqttSnTopicName_t topicName;
+    uMqttQos_t qos;
+
+    if( gMqttSnStatus.status != ClientConnected ){
+        return X_ERR_INVALID_STATE;
+    }
+
+    if( uMqttClientGetUnread( gMqttSnClientCtx ) <= 0 ){
+        return X_ERR_NOT_FOUND;
+    }
+
+    // only the remote configuration topic is subscribed, the topic is not needed
+    return uMqttClientSnMessageRead( gMqttSnClientCtx, &topicName, pMessage, pMessageSizeBytes, &qos );
+}
+
+
+
+uint32_t xCellMqttSnGetSession( void ){
+    return gMqttSnSession;
+}
+
+
+
+void xCellMqttSnTlsCacheEnable( bool enable ){
+    gTlsStats.cacheEnabled = enable;
+    LOG_INF("Flex TLS credential cache %s \r\n", enable ? "enabled" : "disabled");
+}
+
+
+
+err_code xCellMqttSnTlsCacheClear( void ){
+
+    err_code ret;
+
+    memset( &gTlsCache, 0, sizeof(gTlsCache) );
+    gTlsStats.cacheSaved = false;
+
+    ret = xStorageDeleteFile( mqttsn_tls_cache_fname );
+    // not an error if nothing has been cached yet
+    if( ret == ERR_STORAGE_FILE_NOT_FOUND ){
+        ret = X_ERR_SUCCESS;
+    }
+
+    LOG_INF("Flex TLS credential cache cleared \r\n");
+    return ret;
+}
+
+
+
+xCellMqttSnTlsStats_t xCellMqttSnGetTlsStats( void ){
+    return gTlsStats;
+}
+
+
 /* ----------------------------------------------------------------
  * SHELL COMMANDS IMPLEMENTATION
  * -------------------------------------------------------------- */
@@ -734,6 +1100,22 @@ void xCellMqttSnClientStatusCmd(const struct shell *shell, size_t argc, char **a
     else if(gMqttSnStatus.status == ClientClosed){
         shell_print(shell, "Client is closed\r\n");
     }
+
+    shell_print(shell, "\r\n\
+Bring-up timing (ms) -------------------\r\n\
+        - Last open: %d\r\n\
+        - Last connect: %d\r\n\
+Flex TLS credential cache --------------\r\n\
+        - Enabled: %s\r\n\
+        - Saved: %s\r\n\
+        - Setups cached/full: %d/%d\r\n\
+        - Last cached setup (ms): %d\r\n\
+        - Last full setup (ms): %d\r\n",
+        gTlsStats.lastOpenMs, gTlsStats.lastConnectMs,
+        gTlsStats.cacheEnabled ? "yes" : "no",
+        gTlsStats.cacheSaved ? "yes" : "no",
+        gTlsStats.cacheHits, gTlsStats.cacheMisses,
+        gTlsStats.lastCachedMs, gTlsStats.lastFullMs);
     
     return;
 }
@@ -805,7 +1187,7 @@ void xCellMqttSnSendCmd(const struct shell *shell, size_t argc, char **argv){
                 case U_MQTT_SN_TOPIC_NAME_TYPE_ID_NORMAL: 
 
                     shell_print(shell, "Registering Topic name: %s\r\n", argv[2] );      
-                    if( ( ret = uMqttClientSnRegisterNormalTopic( gMqttSnClientCtx, argv[2], &pTopicName) ) < X_ERR_SUCCESS ){
+                    if( ( ret = xCellMqttSnRegisterNormalTopic( argv[2], &pTopicName) ) < X_ERR_SUCCESS ){
                         shell_warn(shell, "Error while registering topic name: %d\r\n", ret);  
                         return;
                     }
@@ -839,12 +1221,27 @@ void xCellMqttSnSendCmd(const struct shell *shell, size_t argc, char **argv){
             }
 
 
-            ret = xCellMqttSnClientPublish( &pTopicName, argv[3], strlen(argv[3]), qos, 0);  //0 is the retain
+            size_t len = strlen( argv[3] );
+            if( len > DATA_MSG_MAX_LEN ){
+                shell_warn(shell, "Message too long\r\n" );
+                return;
+            }
+
+            xDataPublishBuf_t *pBuf = xDataPublishBufAlloc( K_NO_WAIT );
+            if( pBuf == NULL ){
+                shell_warn(shell, "Publish queue full, try again\r\n" );
+                return;
+            }
+            memcpy( xDataPublishBufGetData( pBuf ), argv[3], len );
+
+            // the result is logged when published (no retain)
+            xDataPublishDest_t dest = { .client = MqttSNClient, .snTopic = pTopicName };
+            ret = xDataPublishAsync( pBuf, len, &dest, (uint8_t)qos, mqttSnSendCmdCb, NULL );
             if(ret != 0){
-                shell_warn(shell, "xCellMqttSnClientPublish failed: %d\r\n", ret );
+                shell_warn(shell, "Publish failed: %d\r\n", ret );
             }
             else{
-                shell_print(shell, "Published\r\n" );
+                shell_print(shell, "Queued\r\n" );
             }
         }
 
@@ -863,4 +1260,37 @@ err_code xCellMqttSnDeleteAnywhereConfig( void ){
 
     ret = xStorageDeleteFile( mqttsn_anywhere_deviceID_fname );
     return ret;
+}
+
+
+
+void xCellMqttSnTlsCacheCmd(const struct shell *shell, size_t argc, char **argv){
+
+        err_code err;
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");  
+            return;
+        }
+
+		if( strcmp(argv[1], "on") == 0 ){
+			xCellMqttSnTlsCacheEnable(true);
+		}
+		
+		else if( strcmp(argv[1], "off") == 0 ){
+			xCellMqttSnTlsCacheEnable(false);
+        }
+
+		else if( strcmp(argv[1], "clear") == 0 ){
+			err = xCellMqttSnTlsCacheClear();
+            if( err != X_ERR_SUCCESS ){
+                shell_print(shell, "%sCould not clear TLS credential cache: %d %s\r\n",LOG_CLRCODE_RED, err, LOG_CLRCODE_DEFAULT );
+            }
+        }
+
+        else{
+            shell_print(shell, "Invalid parameter (on/off/clear)\r\n");  
+		}
+
+		return;
 }
\ No newline at end of file
@@ -52,6 +52,15 @@
  * xCellMqttSnClientDisconnect() or
  * xCellMqttSnClientClose() function
  * 
+ * For MQTT Flex, the certificate and key names found in SARA-R5 (and their
+ * MD5 hashes) are cached in NORA-B1 flash. On the next client open only the
+ * hashes are verified; the import and scan of the credentials are repeated
+ * only if this verification fails (see xCellMqttSnTlsCacheEnable()).
+ * 
+ * With MQTT Flex, when connected the client subscribes to the remote
+ * configuration topic (TOPIC_NAME_CONFIG_CMD), see x_remote_config.h.
+ * Commands are received only while SARA-R5 is awake (not in PSM deep sleep).
+ * 
  */
 
 
@@ -137,6 +146,20 @@ typedef struct{
 }xCellMqttSnConfig_t;
 
 
+/** Timing of the MQTT-SN client bring-up and use of the Flex TLS
+ * credential cache. Counted since boot, durations are in ms */
+typedef struct{
+    bool     cacheEnabled;  /**< The credential cache is used on client open */
+    bool     cacheSaved;    /**< Credentials are saved in the cache */
+    uint32_t cacheHits;     /**< Flex TLS setups that used the cached credentials */
+    uint32_t cacheMisses;   /**< Flex TLS setups that imported and scanned the credentials */
+    int32_t  lastCachedMs;  /**< Last Flex TLS setup using the cache */
+    int32_t  lastFullMs;    /**< Last Flex TLS setup with import and scan */
+    int32_t  lastOpenMs;    /**< Last client open */
+    int32_t  lastConnectMs; /**< Last connect request until connected (includes open if needed) */
+}xCellMqttSnTlsStats_t;
+
+
 
 /* ----------------------------------------------------------------
  * FUNCTIONS
@@ -218,6 +241,10 @@ err_code xCellMqttSnGetLastOperationResult(void);
  * Prerequisites: Need to Connect the Client to the Broker. Won't
  * be done automatically with internal calls.
  * 
+ * Blocks until ubxlib completes the publish (for QoS 1 until the module
+ * reports the broker acknowledgement), so publishes are not pipelined:
+ * a single message is in flight at a time (stop-and-wait).
+ * 
  * @param topic_type       topic type according to MQTT-SN protocol(see also xCellMqttSnSendCmd).
  * @param pTopicNameStr    String that contains the Topic to which the
  *                         message will be published (see also xCellMqttSnSendCmd).
@@ -234,6 +261,38 @@ err_code xCellMqttSnClientPublish( const uMqttSnTopicName_t *pTopicName,
                                    size_t messageSizeBytes,
                                    uMqttQos_t qos, bool retain);
 
+/** Register a normal topic name with the connected broker and get its topic ID.
+ * The topic ID is valid only for the connection it was registered in (see
+ * xCellMqttSnGetSession()), so it can be reused until the next connection.
+ * 
+ * @param pTopicNameStr    The topic name.
+ * @param pTopicName       [Output] The topic, to be used with xCellMqttSnClientPublish().
+ * 
+ * @return        zero on success else negative error code.
+ */
+err_code xCellMqttSnRegisterNormalTopic( const char *pTopicNameStr, uMqttSnTopicName_t *pTopicName );
+
+
+/** Read a message received in a subscribed topic (the remote configuration
+ * topic, MQTT Flex only). Used by the remote configuration thread (x_remote_config.h).
+ * 
+ * @param pMessage                 Buffer for the message (not terminated).
+ * @param[in,out] pMessageSizeBytes Size of the buffer, then the message size.
+ * 
+ * @return        zero on success, X_ERR_NOT_FOUND if no message is unread,
+ *                else negative error code.
+ */
+err_code xCellMqttSnMessageRead( char *pMessage, size_t *pMessageSizeBytes );
+
+
+/** Get the current MQTT-SN session: the number of successful connections
+ * to the broker since boot. Changes on every (re)connection.
+ * 
+ * @return        The session number (0 = never connected).
+ */
+uint32_t xCellMqttSnGetSession( void );
+
+
 /** Delete any MQTT-Anywhere Configuration (MqttSn)
  *
  * @return        zero on success else negative error code.
@@ -241,6 +300,32 @@ err_code xCellMqttSnClientPublish( const uMqttSnTopicName_t *pTopicName,
 err_code xCellMqttSnDeleteAnywhereConfig( void );
 
 
+/** Enable/disable the use of the Flex TLS credential cache on client open.
+ * When disabled, the certificate and key are imported and the credential list
+ * is scanned on every open (the cache is still updated). Enabled by default
+ * (MQTTSN_FLEX_TLS_CACHE_DEFAULT).
+ *
+ * @param enable  true to use the cache, false to always import and scan.
+ */
+void xCellMqttSnTlsCacheEnable( bool enable );
+
+
+/** Delete the cached Flex TLS credentials. The next client open imports
+ * and scans the credentials again. Should be used when new certificate/key
+ * files are saved in SARA-R5 while the old credentials are still stored.
+ *
+ * @return        zero on success else negative error code.
+ */
+err_code xCellMqttSnTlsCacheClear( void );
+
+
+/** Get the client bring-up timing and the credential cache statistics.
+ * 
+ * @return        The statistics in xCellMqttSnTlsStats_t.
+ */
+xCellMqttSnTlsStats_t xCellMqttSnGetTlsStats( void );
+
+
 /* ----------------------------------------------------------------
  * FUNCTIONS IMPLEMENTING SHELL-COMMANDS
  * -------------------------------------------------------------- */
@@ -265,7 +350,8 @@ void xCellMqttSnSaveConfigCmd(const struct shell *shell, size_t argc, char **arg
 void xCellMqttSnTypeConfigCmd(const struct shell *shell, size_t argc, char **argv);
 
 /** This function is intented only to be used as a command executed by the shell.
- * Types the MQTT-SN Client Status (Open, Closed, Connected)
+ * Types the MQTT-SN Client Status (Open, Closed, Connected), the client bring-up
+ * timing and the Flex TLS credential cache statistics
  *
  * @param shell  the shell instance from which the command is given.
  * @param argc   Not used
@@ -274,7 +360,8 @@ void xCellMqttSnTypeConfigCmd(const struct shell *shell, size_t argc, char **arg
 void xCellMqttSnClientStatusCmd(const struct shell *shell, size_t argc, char **argv);
 
 /** This function is intented only to be used as a command executed by the shell.
- * Sends a message to MQTT-SN broker, utilizing xCellMqttSnClientPublish(). 
+ * Sends a message to MQTT-SN broker asynchronously, utilizing xDataPublishAsync()
+ * (x_data_handle.h): the result is logged when published. 
  * 
  * Command parameters are <topic_type> <topic> <message> <QOS>  
  * Where <topic_type> can be: 
@@ -294,6 +381,16 @@ void xCellMqttSnClientStatusCmd(const struct shell *shell, size_t argc, char **a
 void xCellMqttSnSendCmd(const struct shell *shell, size_t argc, char **argv);
 
 
+/** This function is intented only to be used as a command executed by the shell.
+ * Controls the Flex TLS credential cache. Parameters: on/off/clear
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command (should be 1).
+ * @param argv   the array including the parameters themselves.
+ */
+void xCellMqttSnTlsCacheCmd(const struct shell *shell, size_t argc, char **argv);
+
+
 
 
 #endif    //X_CELL_MQTTSN_H__
\ No newline at end of file
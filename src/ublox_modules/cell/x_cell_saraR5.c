@@ -69,6 +69,21 @@ void xCellSaraDeinitThread(void);
 static int32_t xCellSaraRegistrationConfig(void);
 
 
+/** Requests the PSM/eDRX timers of gPowerSavingReq for the active RAT.
+ *  Called prior to registration, reboots the module if needed.
+ *
+ * @return        zero on success else negative error code.
+ */
+static int32_t saraPowerSavingConfig(void);
+
+/** Reads the PSM/eDRX timers granted by the network in gPowerSavingGranted
+*/
+static void saraPowerSavingRead(void);
+
+/** Checks if an eDRX cycle (seconds, as requested to ubxlib) is one of gEDrxCyclesMs
+*/
+static bool saraEDrxIsSupported(int32_t eDrxS);
+
 /** Handle error happening in a thread
 */
 static void saraErrorHandle(err_code err_code);
@@ -142,6 +157,19 @@ xCellMqttSnPlan_t gMqttSnActivePlan = MQTTSN_DEFAULT_PLAN;
 static uDeviceHandle_t gDevHandle = NULL;
 
 
+/** PSM/eDRX timers requested (applied on next connection) and granted
+ * by the network */
+static xCellSaraPowerSaving_t gPowerSavingReq = { .psmOn = false, .eDrxOn = false };
+static xCellSaraPowerSaving_t gPowerSavingGranted = { .psmOn = false, .eDrxOn = false };
+
+
+/** eDRX cycles defined for LTE-M (3GPP TS 24.008, table 10.5.5.32), in ms */
+static const uint32_t gEDrxCyclesMs[] = {
+    5120, 10240, 20480, 40960, 61440, 81920, 102400, 122880,
+    143360, 163840, 327680, 655360, 1310720, 2621440
+};
+
+
 /* ----------------------------------------------------------------
  * CALLBACKS
  * -------------------------------------------------------------- */
@@ -263,8 +291,93 @@ static int32_t xCellSaraRegistrationConfig(void){
         }
     }
 
+    // power saving only lowers consumption, registration goes on without it
+    // (the request is also sent when off, to clear one saved in the module)
+    ret = saraPowerSavingConfig();
+    if( ret < 0 ){
+        LOG_WRN("Power saving not configured, registering without it: %d \r\n", ret);
+    }
+
+    return 0;
+
+}
+
+
+
+static int32_t saraPowerSavingConfig(void){
+
+    int32_t ret;
+    uCellNetRat_t rat = uCellCfgGetRat(gDevHandle, 0);
+
+    if( rat < 0 ){
+        return rat;
+    }
+
+    ret = uCellPwrSetRequested3gppPowerSaving( gDevHandle, rat, gPowerSavingReq.psmOn,
+                                               gPowerSavingReq.activeTimeS, gPowerSavingReq.periodicWakeupS );
+    if( ret < 0 ){
+        LOG_ERR("Could not request PSM: %d \r\n", ret);
+        return ret;
+    }
+
+    ret = uCellPwrSetRequestedEDrx( gDevHandle, rat, gPowerSavingReq.eDrxOn,
+                                    gPowerSavingReq.eDrxS, gPowerSavingReq.pagingWindowS );
+    if( ret < 0 ){
+        LOG_ERR("Could not request eDRX: %d \r\n", ret);
+        return ret;
+    }
+
+    LOG_INF("Requested PSM: %s (active: %d s, periodic: %d s), eDRX: %s (%d s) \r\n",
+            gPowerSavingReq.psmOn ? "on" : "off", gPowerSavingReq.activeTimeS, gPowerSavingReq.periodicWakeupS,
+            gPowerSavingReq.eDrxOn ? "on" : "off", gPowerSavingReq.eDrxS);
+
+    if( uCellPwrRebootIsRequired( gDevHandle ) ){
+        LOG_INF("Rebooting module \r\n");
+        ret = uCellPwrReboot( gDevHandle, NULL );
+        if(ret<0){
+            return ret;
+        }
+        LOG_INF("Module restarted\r\n");
+    }
+
     return 0;
+}
+
+
+
+static bool saraEDrxIsSupported(int32_t eDrxS){
+
+    for( size_t x = 0; x < ARRAY_SIZE(gEDrxCyclesMs); x++ ){
+        if( eDrxS == (int32_t)( gEDrxCyclesMs[x] / 1000 ) ){
+            return true;
+        }
+    }
+    return false;
+}
 
+
+
+static void saraPowerSavingRead(void){
+
+    bool onNotOff;
+    int32_t activeTime, periodicWakeup, eDrx, pagingWindow;
+
+    gPowerSavingGranted.psmOn = false;
+    gPowerSavingGranted.eDrxOn = false;
+
+    if( uCellPwrGet3gppPowerSaving( gDevHandle, &onNotOff, &activeTime, &periodicWakeup ) == 0 ){
+        gPowerSavingGranted.psmOn = onNotOff;
+        gPowerSavingGranted.activeTimeS = activeTime;
+        gPowerSavingGranted.periodicWakeupS = periodicWakeup;
+    }
+
+    uCellNetRat_t rat = uCellCfgGetRat(gDevHandle, 0);
+    if( ( rat >= 0 ) && 
+        ( uCellPwrGetEDrx( gDevHandle, rat, &onNotOff, &eDrx, &pagingWindow ) == 0 ) ){
+        gPowerSavingGranted.eDrxOn = onNotOff;
+        gPowerSavingGranted.eDrxS = eDrx;
+        gPowerSavingGranted.pagingWindowS = pagingWindow;
+    }
 }
 
 
@@ -278,7 +391,14 @@ void xCellSaraInitThread(void){
         .deviceType = U_DEVICE_TYPE_CELL,
         .deviceCfg = {
             .cfgSho = {
-                .moduleType = U_CELL_MODULE_TYPE_SARA_R5
+                .moduleType = U_CELL_MODULE_TYPE_SARA_R5,
+                .pinEnablePower = -1,
+                // ubxlib wakes the module from PSM deep sleep (reported by
+                // +UUPSMR) with POWER_ON before sending AT commands. The pin
+                // drives POWER_ON through an inverter
+                .pinPwrOn = SARA_PWR_ON_PIN | U_CELL_PIN_INVERTED,
+                .pinVInt = SARA_V_INT_PIN,
+                .pinDtrPowerSaving = -1
             }
         },
         .transportType = U_DEVICE_TRANSPORT_TYPE_UART,
@@ -387,12 +507,8 @@ void xCellSaraDeinitThread(void){
 
         LOG_INF("SARA deinit request\r\n");
 
-        xCommonUPortDeinit();
-        
-        // Wait for deinitialization to complete
-        while( xCommonUPortIsInit() ){
-            k_sleep(K_MSEC(500));
-        }
+        // closes the device (and deinitializes ubxlib port unless kept alive)
+        xCommonUPortRelease();
 
         LOG_INF("Module Deinitialized\r\n");            
         gSaraStatus.uStatus = uPortNotInitialized;
@@ -478,6 +594,20 @@ void xCellSaraConnectThread(void){
         LOG_INF("Connected to network \r\n");
         gSaraStatus.isReadyForMqttSN = true;
 
+        if( gPowerSavingReq.psmOn || gPowerSavingReq.eDrxOn ){
+            saraPowerSavingRead();
+            LOG_INF("Granted PSM: %s (active: %d s, periodic: %d s), eDRX: %s (%d s) \r\n",
+                    gPowerSavingGranted.psmOn ? "on" : "off", gPowerSavingGranted.activeTimeS,
+                    gPowerSavingGranted.periodicWakeupS, gPowerSavingGranted.eDrxOn ? "on" : "off",
+                    gPowerSavingGranted.eDrxS);
+
+            // the network may grant another cycle (or none)
+            if( gPowerSavingReq.eDrxOn &&
+                ( !gPowerSavingGranted.eDrxOn || ( gPowerSavingGranted.eDrxS != gPowerSavingReq.eDrxS ) ) ){
+                LOG_WRN("eDRX granted differs from the requested %d s cycle \r\n", gPowerSavingReq.eDrxS);
+            }
+        }
+
         xLedOff();
     }
 }
@@ -497,6 +627,8 @@ static void saraDisconnect(void){
     }
 
     LOG_INF("Cell Network Down\r\n" );
+    gPowerSavingGranted.psmOn = false;
+    gPowerSavingGranted.eDrxOn = false;
     gSaraStatus.isConnected = false;
     gSaraStatus.isRegistered = false;
     gSaraStatus.isReadyForMqttSN = false;
@@ -700,6 +832,92 @@ err_code xCellSaraGetLastOperationResult( void ){
 
 
 
+err_code xCellSaraSetPowerSaving(const xCellSaraPowerSaving_t *pRequest){
+
+    if( pRequest == NULL ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    if( ( pRequest->psmOn && ( ( pRequest->activeTimeS < 0 ) || ( pRequest->periodicWakeupS <= 0 ) ) ) ||
+        ( pRequest->eDrxOn && ( !saraEDrxIsSupported( pRequest->eDrxS ) || ( pRequest->pagingWindowS < 0 ) ) ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    gPowerSavingReq = *pRequest;
+
+    if( gSaraStatus.isRegistered ){
+        LOG_WRN("Power saving request applied on next connection\r\n");
+    }
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+err_code xCellSaraGetPowerSaving(xCellSaraPowerSaving_t *pRequested, xCellSaraPowerSaving_t *pGranted){
+
+    if( pRequested != NULL ){
+        *pRequested = gPowerSavingReq;
+    }
+
+    if( pGranted != NULL ){
+        if( gSaraStatus.isRegistered && ( gSaraStatus.uStatus == uDeviceOpened ) ){
+            saraPowerSavingRead();
+        }
+        *pGranted = gPowerSavingGranted;
+    }
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+uint32_t xCellSaraGetEDrxCycleMs(uint32_t maxMs){
+
+    uint32_t cycleMs = 0;
+
+    for( size_t x = 0; x < ARRAY_SIZE(gEDrxCyclesMs); x++ ){
+        if( gEDrxCyclesMs[x] <= maxMs ){
+            cycleMs = gEDrxCyclesMs[x];
+        }
+    }
+    return cycleMs;
+}
+
+
+
+err_code xCellSaraGetLinkQuality(xCellSaraLinkQuality_t *pQuality){
+
+    int32_t ret;
+
+    if( pQuality == NULL ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    if( !gSaraStatus.isRegistered || ( gSaraStatus.uStatus < uDeviceOpened ) ){
+        return X_ERR_INVALID_STATE;
+    }
+
+    ret = uCellInfoRefreshRadioParameters( gDevHandle );
+    if( ret < 0 ){
+        LOG_WRN("Could not read radio parameters: %d \r\n", ret);
+        return ret;
+    }
+
+    pQuality->rssiDbm = uCellInfoGetRssiDbm( gDevHandle );
+    pQuality->rsrpDbm = uCellInfoGetRsrpDbm( gDevHandle );
+    pQuality->rsrqDb = uCellInfoGetRsrqDb( gDevHandle );
+    
+    // SNR reported by the module is the SINR of the serving cell
+    if( uCellInfoGetSnrDb( gDevHandle, &pQuality->sinrDb ) < 0 ){
+        pQuality->sinrDb = 0;
+    }
+
+    return X_ERR_SUCCESS;
+}
+
+
+
 /* ----------------------------------------------------------------
  * SHELL COMMANDS IMPLEMENTATION
  * -------------------------------------------------------------- */
@@ -715,4 +933,26 @@ void xCellSaraGetActiveMqttPlanCmd( const struct shell *shell, size_t argc, char
     else{
         shell_error( shell, "Active Plan error \r\n" );
     }
-}
\ No newline at end of file
+}
+
+
+
+void xCellSaraPowerSavingCmd( const struct shell *shell, size_t argc, char **argv ){
+
+    xCellSaraPowerSaving_t requested, granted;
+
+    xCellSaraGetPowerSaving( &requested, &granted );
+
+    shell_print(shell, "\r\n\
+Requested:\r\n\
+        - PSM: %s (active time: %d s, periodic wake-up: %d s)\r\n\
+        - eDRX: %s (cycle: %d s, paging window: %d s)\r\n\
+Granted%s:\r\n\
+        - PSM: %s (active time: %d s, periodic wake-up: %d s)\r\n\
+        - eDRX: %s (cycle: %d s, paging window: %d s)\r\n",
+        requested.psmOn ? "on" : "off", requested.activeTimeS, requested.periodicWakeupS,
+        requested.eDrxOn ? "on" : "off", requested.eDrxS, requested.pagingWindowS,
+        gSaraStatus.isRegistered ? "" : " (not registered)",
+        granted.psmOn ? "on" : "off", granted.activeTimeS, granted.periodicWakeupS,
+        granted.eDrxOn ? "on" : "off", granted.eDrxS, granted.pagingWindowS);
+}
@@ -29,6 +29,14 @@
  *  from a new location. This is especially true when MQTT Flex is used 
  *  (see xCellSaraInit)
  * 
+ *  Power Saving Mode (PSM) and eDRX timers can be requested with 
+ *  xCellSaraSetPowerSaving(). They are applied before registration, the next
+ *  time the module connects to the network. The network may grant different
+ *  timers (or none), the granted ones are reported by xCellSaraGetPowerSaving().
+ *  When PSM is granted the module enters deep sleep once the active time
+ *  expires; ubxlib wakes it with POWER_ON before it is used again (only if
+ *  it has reported entering deep sleep).
+ * 
  */
 
 
@@ -81,6 +89,28 @@ typedef struct{
 }xCellSaraStatus_t;
 
 
+/** Struct type that describes PSM/eDRX timers (requested or granted).
+ */
+typedef struct{
+    bool psmOn;               /**< Power Saving Mode on */
+    int32_t activeTimeS;      /**< PSM active time (T3324) in seconds */
+    int32_t periodicWakeupS;  /**< PSM periodic wake-up/TAU (T3412) in seconds */
+    bool eDrxOn;              /**< eDRX on */
+    int32_t eDrxS;            /**< eDRX cycle in seconds */
+    int32_t pagingWindowS;    /**< eDRX paging time window in seconds */
+}xCellSaraPowerSaving_t;
+
+
+/** Struct type that describes the radio link quality of the serving cell.
+ */
+typedef struct{
+    int32_t rssiDbm;   /**< Received signal strength in dBm */
+    int32_t rsrpDbm;   /**< Reference signal received power in dBm */
+    int32_t rsrqDb;    /**< Reference signal received quality in dB */
+    int32_t sinrDb;    /**< Signal to interference plus noise ratio in dB */
+}xCellSaraLinkQuality_t;
+
+
 /** Enum with supported THingstream data plans for cellular.
  * Default is anywhere
  */
@@ -201,6 +231,46 @@ void xCellSaraActivateMqttAnywherePlan(void);
 xCellMqttSnPlan_t xCellSaraGetActiveMqttPlan(void);
 
 
+/** Request PSM/eDRX timers. The request is applied before registration, the
+ *  next time the module connects to the network (xCellSaraConnect). Request both
+ *  off to disable power saving. The network decides the granted timers.
+ * 
+ * @param pRequest  the requested timers (copied).
+ * @return          zero on success else negative error code.
+ */
+err_code xCellSaraSetPowerSaving(const xCellSaraPowerSaving_t *pRequest);
+
+
+/** Get the requested PSM/eDRX timers and the ones granted by the network. 
+ *  Granted timers are read from the module when it is registered, else they
+ *  are reported as off.
+ * 
+ * @param pRequested  [Output] the requested timers (can be NULL).
+ * @param pGranted    [Output] the granted timers (can be NULL).
+ * @return            zero on success else negative error code.
+ */
+err_code xCellSaraGetPowerSaving(xCellSaraPowerSaving_t *pRequested, xCellSaraPowerSaving_t *pGranted);
+
+
+/** Get the longest eDRX cycle defined for LTE-M (5.12 s up to 2621.44 s)
+ *  that is not longer than the given time. Requested eDRX cycles (in seconds,
+ *  truncated) should be one of these.
+ * 
+ * @param maxMs   the longest acceptable cycle in ms.
+ * @return        the cycle in ms, 0 if shorter than any cycle.
+ */
+uint32_t xCellSaraGetEDrxCycleMs(uint32_t maxMs);
+
+
+/** Reads the radio link quality of the serving cell (RSSI, RSRP, RSRQ, SINR).
+ *  The module should be registered.
+ * 
+ * @param pQuality  [Output] the link quality.
+ * @return          zero on success else negative error code.
+ */
+err_code xCellSaraGetLinkQuality(xCellSaraLinkQuality_t *pQuality);
+
+
 /** Used by the application to deinitialize/close the cellular device in ubxlib library.
  *  Also deinitializes Device API in ubxlib
  *  Normally not to be used by the user.
@@ -223,5 +293,15 @@ void xCellSaraDeviceClose(void);
 void xCellSaraGetActiveMqttPlanCmd(const struct shell *shell, size_t argc, char **argv);
 
 
+/** This function is intented only to be used as a command executed by the shell.
+ *  Types the requested PSM/eDRX timers and the ones granted by the network
+ * 
+ * @param shell  the shell instance from which the command is given (and to which the command types).
+ * @param argc   Not used
+ * @param argv   Not used
+ */
+void xCellSaraPowerSavingCmd(const struct shell *shell, size_t argc, char **argv);
+
+
 
 #endif   //X_CELL_SARAR5_H__
\ No newline at end of file
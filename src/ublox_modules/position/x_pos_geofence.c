@@ -0,0 +1,1077 @@
+/*
+ * Copyright 2022 u-blox Ltd
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ * @brief This file contains the implementation of the geofencing engine applied
+ * on MAXM10S positions (XPLR-IOT-1).
+ *
+ *  -- Fence evaluation --
+ *
+ *  Every fix is evaluated against each fence using the x1e7 integer coordinates:
+ *
+ *  - Circles: The distance from the center is approximated on a local flat
+ *    projection (1e-7 deg of latitude ~ 11.132 mm, longitude scaled by the cosine
+ *    of the center latitude, computed once when the fence is loaded). Squared
+ *    distances are compared, after a cheap rejection on each axis. A fence is exited
+ *    only when the position is GEOFENCE_CIRCLE_HYSTERESIS_M outside its radius.
+ *
+ *  - Polygons: Bounding box rejection, then ray casting with 64-bit cross products.
+ *    Polygons crossing the antimeridian are not supported.
+ *
+ *  -- Events --
+ *
+ *  Enter/exit events are reported when the inside/outside state of a fence changes.
+ *  The first evaluation of a fence only reports enter (if inside). A dwell event is
+ *  reported once per entry, when the position stays inside for the dwell time.
+ *  Each event is published as a MAXM10 message holding the position, the fence id
+ *  and the event.
+ */
+
+
+#include "x_pos_geofence.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Zephyr related includes
+#include <zephyr.h>
+
+// Sensor Aggegation specific includes
+#include "x_logging.h"
+#include "x_sens_common.h"
+#include "x_data_handle.h" //xDataSend
+#include "x_storage.h"
+
+
+/* ----------------------------------------------------------------
+ * DEFINITIONS
+ * -------------------------------------------------------------- */
+
+// Length in mm of 1e-7 degrees of latitude, x1000
+#define GEOFENCE_MM_PER_1E7DEG_X1000    11132
+
+// Fixed point scale of the cosine of the circle center latitude (Q15)
+#define GEOFENCE_COS_SCALE              32768
+
+#define GEOFENCE_PI                     3.14159265358979323846
+
+// Longitude range in degrees x1e7
+#define GEOFENCE_LON_SPAN_X1E7          3600000000LL
+
+
+/* ----------------------------------------------------------------
+ * TYPE DEFINITIONS
+ * -------------------------------------------------------------- */
+
+/** A fence along with the values precomputed when loaded and its runtime state
+ */
+typedef struct{
+    xPosGeofence_t def;      /**< Fence definition (as saved in flash) */
+    int32_t cosLatQ15;       /**< Circle: cosine of center latitude (Q15) */
+    int32_t minLat, maxLat;  /**< Polygon: bounding box */
+    int32_t minLon, maxLon;
+    bool stateKnown;         /**< The fence has been evaluated at least once */
+    bool isInside;           /**< The last position was inside the fence */
+    bool dwellReported;      /**< Dwell event reported since the last entry */
+    int64_t enterTime;       /**< Uptime (ms) of the last entry */
+}geofenceEntry_t;
+
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTION DECLARATION
+ * -------------------------------------------------------------- */
+
+/** Loads the fences saved in flash, the first time it is called
+ */
+static void geofenceLoad(void);
+
+
+/** Saves the fences definitions in flash
+ */
+static err_code geofenceSave(void);
+
+
+/** Adds/replaces a fence in the fence table and precomputes the values
+ * needed for its evaluation. Does not save the table.
+ */
+static err_code geofenceAdd(const xPosGeofence_t *pDef);
+
+
+/** Returns the index of the fence with the given id, or negative if not found
+ */
+static int32_t geofenceFind(uint8_t id);
+
+
+/** Returns whether the given position is within a circular fence
+ */
+static bool geofenceCircleIsInside(const geofenceEntry_t *pFence, int32_t latX1e7, int32_t lonX1e7);
+
+
+/** Returns whether the given position is within a polygon fence
+ */
+static bool geofencePolygonIsInside(const geofenceEntry_t *pFence, int32_t latX1e7, int32_t lonX1e7);
+
+
+/** Publishes a geofence event
+ */
+static void geofencePublishEvent(uint8_t id, xPosGeofenceEvent_t event, const xPosMaxM10Fix_t *pFix);
+
+
+/** Parses a coordinate in decimal degrees (e.g. "-37.8136276") into degrees x1e7,
+ * without using floating point. Coordinates should be within +-limitDeg.
+ */
+static err_code geofenceParseCoord(const char *pStr, int32_t limitDeg, int32_t *pValX1e7);
+
+
+/** Parses a fence id
+ */
+static err_code geofenceParseId(const char *pStr, uint8_t *pId);
+
+
+/** Parses a circle radius in metres (digits only, no sign)
+ */
+static err_code geofenceParseRadius(const char *pStr, uint32_t *pRadius);
+
+
+/** Deletes the fences file from flash, if it exists
+ */
+static err_code geofenceDeleteFile(void);
+
+
+/* ----------------------------------------------------------------
+ * ZEPHYR RELATED DEFINITIONS/DECLARATIONS
+ * -------------------------------------------------------------- */
+
+LOG_MODULE_REGISTER(LOGMOD_NAME_GEOFENCE, LOG_LEVEL_DBG);
+
+// Controls access to the fence table (shell/BLE/MQTT vs MAXM10S threads)
+K_SEM_DEFINE(geofenceAccessSemaphore, 1, 1);
+
+
+/* ----------------------------------------------------------------
+ * GLOBALS
+ * -------------------------------------------------------------- */
+
+/** Fence table
+ */
+static geofenceEntry_t gFences[ GEOFENCE_MAX_NUM ];
+static uint8_t gFencesNum = 0;
+
+/** Fence definitions as saved in flash
+ */
+static xPosGeofence_t gFencesStore[ GEOFENCE_MAX_NUM ];
+
+/** Fences have been loaded from flash
+ */
+static bool gFencesLoaded = false;
+
+/** Geofencing settings
+ */
+static bool gGeofenceEnabled = false;
+static uint32_t gHeartbeatPeriod = GEOFENCE_DEFAULT_HEARTBEAT_PERIOD_MS;
+static uint32_t gDwellTime = GEOFENCE_DEFAULT_DWELL_TIME_MS;
+
+/** Uptime (ms) when the heartbeat position was last published (negative: never)
+ */
+static int64_t gLastHeartbeat = -1;
+
+/** String representation of events
+ */
+static const char *const gEventStr[]={
+    [GEOFENCE_EVENT_NONE] = "none",
+    [GEOFENCE_EVENT_ENTER] = "enter",
+    [GEOFENCE_EVENT_EXIT] = "exit",
+    [GEOFENCE_EVENT_DWELL] = "dwell"
+};
+
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTION IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+
+err_code xPosGeofenceAddCircle(uint8_t id, int32_t latX1e7, int32_t lonX1e7, uint32_t radiusMetres){
+
+    xPosGeofence_t def = {
+        .id = id,
+        .shape = GEOFENCE_SHAPE_CIRCLE,
+        .verticesNum = 1,
+        .radiusMetres = radiusMetres
+    };
+    err_code err;
+
+    if( ( radiusMetres == 0 ) || ( radiusMetres > GEOFENCE_MAX_RADIUS_M ) ||
+        ( latX1e7 > 900000000 ) || ( latX1e7 < -900000000 ) ||
+        ( lonX1e7 > 1800000000 ) || ( lonX1e7 < -1800000000 ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    def.latX1e7[0] = latX1e7;
+    def.lonX1e7[0] = lonX1e7;
+
+    geofenceLoad();
+
+    k_sem_take( &geofenceAccessSemaphore, K_FOREVER );
+    err = geofenceAdd( &def );
+    if( err == X_ERR_SUCCESS ){
+        err = geofenceSave();
+    }
+    k_sem_give( &geofenceAccessSemaphore );
+
+    if( err == X_ERR_SUCCESS ){
+        LOG_INF("Geofence %d added: circle, radius %d m\r\n", id, radiusMetres);
+    }
+    return err;
+}
+
+
+
+err_code xPosGeofenceAddPolygon(uint8_t id, const int32_t *pLatX1e7, const int32_t *pLonX1e7, uint8_t verticesNum){
+
+    xPosGeofence_t def = {
+        .id = id,
+        .shape = GEOFENCE_SHAPE_POLYGON,
+        .verticesNum = verticesNum,
+        .radiusMetres = 0
+    };
+    err_code err;
+
+    if( ( verticesNum < 3 ) || ( verticesNum > GEOFENCE_MAX_VERTICES ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    for( uint8_t i = 0; i < verticesNum; i++ ){
+        if( ( pLatX1e7[i] > 900000000 ) || ( pLatX1e7[i] < -900000000 ) ||
+            ( pLonX1e7[i] > 1800000000 ) || ( pLonX1e7[i] < -1800000000 ) ){
+            return X_ERR_INVALID_PARAMETER;
+        }
+        def.latX1e7[i] = pLatX1e7[i];
+        def.lonX1e7[i] = pLonX1e7[i];
+    }
+
+    geofenceLoad();
+
+    k_sem_take( &geofenceAccessSemaphore, K_FOREVER );
+    err = geofenceAdd( &def );
+    if( err == X_ERR_SUCCESS ){
+        err = geofenceSave();
+    }
+    k_sem_give( &geofenceAccessSemaphore );
+
+    if( err == X_ERR_SUCCESS ){
+        LOG_INF("Geofence %d added: polygon, %d vertices\r\n", id, verticesNum);
+    }
+    return err;
+}
+
+
+
+err_code xPosGeofenceRemove(uint8_t id){
+
+    int32_t index;
+    err_code err;
+
+    geofenceLoad();
+
+    k_sem_take( &geofenceAccessSemaphore, K_FOREVER );
+
+    index = geofenceFind( id );
+    if( index < 0 ){
+        k_sem_give( &geofenceAccessSemaphore );
+        return X_ERR_NOT_FOUND;
+    }
+
+    for( uint8_t i = index; i + 1 < gFencesNum; i++ ){
+        gFences[i] = gFences[i+1];
+    }
+    gFencesNum--;
+    err = geofenceSave();
+
+    k_sem_give( &geofenceAccessSemaphore );
+
+    if( err == X_ERR_SUCCESS ){
+        LOG_INF("Geofence %d removed\r\n", id);
+    }
+    return err;
+}
+
+
+
+err_code xPosGeofenceClear(void){
+
+    err_code err;
+
+    k_sem_take( &geofenceAccessSemaphore, K_FOREVER );
+    gFencesNum = 0;
+    gFencesLoaded = true;
+    err = geofenceDeleteFile();
+    k_sem_give( &geofenceAccessSemaphore );
+
+    if( err == X_ERR_SUCCESS ){
+        LOG_INF("All geofences removed\r\n");
+    }
+    return err;
+}
+
+
+
+err_code xPosGeofenceDefine(const char *pDef){
+
+    char buf[ GEOFENCE_DEF_STR_MAXLEN ];
+    char *pField[ 2 + 2*GEOFENCE_MAX_VERTICES + 1 ];
+    char *pSave;
+    int32_t lat[ GEOFENCE_MAX_VERTICES ];
+    int32_t lon[ GEOFENCE_MAX_VERTICES ];
+    uint8_t fieldsNum = 0;
+    uint8_t verticesNum;
+    uint8_t id;
+    uint32_t radius;
+
+    if( strlen( pDef ) >= sizeof(buf) ){
+        return X_ERR_BUFFER_OVERFLOW;
+    }
+    strcpy( buf, pDef );
+
+    // split comma separated fields
+    for( char *pTok = strtok_r( buf, ",", &pSave ); pTok != NULL; pTok = strtok_r( NULL, ",", &pSave ) ){
+        if( fieldsNum >= ARRAY_SIZE(pField) ){
+            return X_ERR_INVALID_PARAMETER;
+        }
+        pField[ fieldsNum++ ] = pTok;
+    }
+
+    if( fieldsNum == 0 ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    // clear all
+    if( strcmp( pField[0], "x" ) == 0 ){
+        return xPosGeofenceClear();
+    }
+
+    if( ( fieldsNum < 2 ) || ( geofenceParseId( pField[1], &id ) != X_ERR_SUCCESS ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    // remove
+    if( strcmp( pField[0], "r" ) == 0 ){
+        return xPosGeofenceRemove( id );
+    }
+
+    // circle
+    if( strcmp( pField[0], "c" ) == 0 ){
+        if( ( fieldsNum != 5 ) ||
+            ( geofenceParseCoord( pField[2], 90, &lat[0] ) != X_ERR_SUCCESS ) ||
+            ( geofenceParseCoord( pField[3], 180, &lon[0] ) != X_ERR_SUCCESS ) ||
+            ( geofenceParseRadius( pField[4], &radius ) != X_ERR_SUCCESS ) ){
+            return X_ERR_INVALID_PARAMETER;
+        }
+        return xPosGeofenceAddCircle( id, lat[0], lon[0], radius );
+    }
+
+    // polygon
+    if( strcmp( pField[0], "p" ) == 0 ){
+        if( ( fieldsNum % 2 ) != 0 ){
+            return X_ERR_INVALID_PARAMETER;
+        }
+        verticesNum = ( fieldsNum - 2 ) / 2;
+        if( ( verticesNum < 3 ) || ( verticesNum > GEOFENCE_MAX_VERTICES ) ){
+            return X_ERR_INVALID_PARAMETER;
+        }
+        for( uint8_t i = 0; i < verticesNum; i++ ){
+            if( ( geofenceParseCoord( pField[ 2 + 2*i ], 90, &lat[i] ) != X_ERR_SUCCESS ) ||
+                ( geofenceParseCoord( pField[ 3 + 2*i ], 180, &lon[i] ) != X_ERR_SUCCESS ) ){
+                return X_ERR_INVALID_PARAMETER;
+            }
+        }
+        return xPosGeofenceAddPolygon( id, lat, lon, verticesNum );
+    }
+
+    return X_ERR_INVALID_PARAMETER;
+}
+
+
+
+uint8_t xPosGeofenceGetFences(xPosGeofence_t *pFences){
+
+    uint8_t num;
+
+    geofenceLoad();
+
+    k_sem_take( &geofenceAccessSemaphore, K_FOREVER );
+    for( uint8_t i = 0; i < gFencesNum; i++ ){
+        pFences[i] = gFences[i].def;
+    }
+    num = gFencesNum;
+    k_sem_give( &geofenceAccessSemaphore );
+
+    return num;
+}
+
+
+
+err_code xPosGeofenceEnable(bool enable){
+
+    if( !xSensIsChangeAllowed() ){
+        LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+        return X_ERR_INVALID_STATE;
+    }
+
+    geofenceLoad();
+
+    k_sem_take( &geofenceAccessSemaphore, K_FOREVER );
+    // start over: fences state is not known and heartbeat is sent with the first fix
+    for( uint8_t i = 0; i < gFencesNum; i++ ){
+        gFences[i].stateKnown = false;
+    }
+    gLastHeartbeat = -1;
+    gGeofenceEnabled = enable;
+    k_sem_give( &geofenceAccessSemaphore );
+
+    if( enable ){
+        LOG_INF("%sGeofencing enabled: %d fences%s \r\n",LOG_CLRCODE_GREEN, gFencesNum, LOG_CLRCODE_DEFAULT);
+    }
+    else{
+        LOG_INF("%sGeofencing disabled%s \r\n",LOG_CLRCODE_RED, LOG_CLRCODE_DEFAULT);
+    }
+    return X_ERR_SUCCESS;
+}
+
+
+
+bool xPosGeofenceIsEnabled(void){
+    return gGeofenceEnabled;
+}
+
+
+
+err_code xPosGeofenceSetHeartbeatPeriod(uint32_t periodMs){
+
+    if( !xSensIsChangeAllowed() ){
+        LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+        return X_ERR_INVALID_STATE;
+    }
+
+    gHeartbeatPeriod = periodMs;
+    return X_ERR_SUCCESS;
+}
+
+
+
+err_code xPosGeofenceSetDwellTime(uint32_t dwellMs){
+
+    if( !xSensIsChangeAllowed() ){
+        LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+        return X_ERR_INVALID_STATE;
+    }
+
+    gDwellTime = dwellMs;
+    return X_ERR_SUCCESS;
+}
+
+
+
+void xPosGeofenceProcessFix(const xPosMaxM10Fix_t *pFix){
+
+    struct{
+        uint8_t id;
+        xPosGeofenceEvent_t event;
+    }events[ GEOFENCE_MAX_NUM ];
+    uint8_t eventsNum = 0;
+    int64_t now = k_uptime_get();
+    geofenceEntry_t *pFence;
+    bool inside;
+
+    if( !pFix->isValid ){
+        return;
+    }
+
+    k_sem_take( &geofenceAccessSemaphore, K_FOREVER );
+
+    for( uint8_t i = 0; i < gFencesNum; i++ ){
+
+        pFence = &gFences[i];
+
+        if( pFence->def.shape == GEOFENCE_SHAPE_CIRCLE ){
+            inside = geofenceCircleIsInside( pFence, pFix->latitudeX1e7, pFix->longitudeX1e7 );
+        }
+        else{
+            inside = geofencePolygonIsInside( pFence, pFix->latitudeX1e7, pFix->longitudeX1e7 );
+        }
+
+        if( !pFence->stateKnown || ( inside != pFence->isInside ) ){
+
+            // the first evaluation does not report an exit, the position was never known to be inside
+            if( inside || pFence->stateKnown ){
+                events[ eventsNum ].id = pFence->def.id;
+                events[ eventsNum++ ].event = inside ? GEOFENCE_EVENT_ENTER : GEOFENCE_EVENT_EXIT;
+            }
+            pFence->stateKnown = true;
+            pFence->isInside = inside;
+            pFence->enterTime = now;
+            pFence->dwellReported = false;
+        }
+
+        else if( inside && !pFence->dwellReported && ( gDwellTime > 0 ) &&
+                 ( now - pFence->enterTime >= gDwellTime ) ){
+            events[ eventsNum ].id = pFence->def.id;
+            events[ eventsNum++ ].event = GEOFENCE_EVENT_DWELL;
+            pFence->dwellReported = true;
+        }
+    }
+
+    k_sem_give( &geofenceAccessSemaphore );
+
+    // publish outside the critical section, sending may take some time
+    for( uint8_t i = 0; i < eventsNum; i++ ){
+        geofencePublishEvent( events[i].id, events[i].event, pFix );
+    }
+}
+
+
+
+bool xPosGeofenceHeartbeatDue(void){
+
+    int64_t now = k_uptime_get();
+
+    if( gHeartbeatPeriod == 0 ){
+        return false;
+    }
+
+    if( ( gLastHeartbeat < 0 ) || ( now - gLastHeartbeat >= gHeartbeatPeriod ) ){
+        gLastHeartbeat = now;
+        return true;
+    }
+
+    return false;
+}
+
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTION IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+
+static void geofenceLoad(void){
+
+    int32_t ret;
+
+    if( gFencesLoaded ){
+        return;
+    }
+
+    k_sem_take( &geofenceAccessSemaphore, K_FOREVER );
+
+    gFencesLoaded = true;
+    gFencesNum = 0;
+
+    ret = xStorageReadFile( gFencesStore, geofence_fname, sizeof(gFencesStore) );
+    if( ret > 0 ){
+        for( uint8_t i = 0; i < ret / sizeof(xPosGeofence_t); i++ ){
+            geofenceAdd( &gFencesStore[i] );
+        }
+        LOG_INF("%d geofences loaded\r\n", gFencesNum);
+    }
+
+    k_sem_give( &geofenceAccessSemaphore );
+}
+
+
+
+static err_code geofenceSave(void){
+
+    err_code err;
+
+    for( uint8_t i = 0; i < gFencesNum; i++ ){
+        gFencesStore[i] = gFences[i].def;
+    }
+
+    // littlefs does not truncate when writing a smaller file, so remove the old one first
+    err = geofenceDeleteFile();
+    if( ( err != X_ERR_SUCCESS ) || ( gFencesNum == 0 ) ){
+        return err;
+    }
+
+    err = xStorageSaveFile( gFencesStore, geofence_fname, gFencesNum * sizeof(xPosGeofence_t) );
+    if( err < 0 ){
+        LOG_ERR("Could not save geofences: %d\r\n", err);
+        return err;
+    }
+    return X_ERR_SUCCESS;
+}
+
+
+
+static err_code geofenceAdd(const xPosGeofence_t *pDef){
+
+    int32_t index = geofenceFind( pDef->id );
+    geofenceEntry_t *pFence;
+
+    if( index < 0 ){
+        if( gFencesNum >= GEOFENCE_MAX_NUM ){
+            LOG_ERR("Max number of geofences reached\r\n");
+            return X_ERR_BUFFER_OVERFLOW;
+        }
+        index = gFencesNum++;
+    }
+
+    pFence = &gFences[index];
+    memset( pFence, 0, sizeof(geofenceEntry_t) );
+    pFence->def = *pDef;
+
+    if( pDef->shape == GEOFENCE_SHAPE_CIRCLE ){
+        pFence->cosLatQ15 = (int32_t)( cos( ( (double) pDef->latX1e7 / 10000000 ) * GEOFENCE_PI / 180 ) * GEOFENCE_COS_SCALE );
+    }
+    else{
+        pFence->minLat = pFence->maxLat = pDef->latX1e7[0];
+        pFence->minLon = pFence->maxLon = pDef->lonX1e7[0];
+        for( uint8_t i = 1; i < pDef->verticesNum; i++ ){
+            pFence->minLat = MIN( pFence->minLat, pDef->latX1e7[i] );
+            pFence->maxLat = MAX( pFence->maxLat, pDef->latX1e7[i] );
+            pFence->minLon = MIN( pFence->minLon, pDef->lonX1e7[i] );
+            pFence->maxLon = MAX( pFence->maxLon, pDef->lonX1e7[i] );
+        }
+    }
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+static int32_t geofenceFind(uint8_t id){
+
+    for( uint8_t i = 0; i < gFencesNum; i++ ){
+        if( gFences[i].def.id == id ){
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+
+static bool geofenceCircleIsInside(const geofenceEntry_t *pFence, int32_t latX1e7, int32_t lonX1e7){
+
+    int64_t dLon = (int64_t) lonX1e7 - pFence->def.lonX1e7[0];
+    int64_t dyMm, dxMm, rMm;
+
+    // take the short way around the antimeridian
+    if( dLon > GEOFENCE_LON_SPAN_X1E7 / 2 ){
+        dLon -= GEOFENCE_LON_SPAN_X1E7;
+    }
+    else if( dLon < -GEOFENCE_LON_SPAN_X1E7 / 2 ){
+        dLon += GEOFENCE_LON_SPAN_X1E7;
+    }
+
+    dyMm = ( (int64_t) latX1e7 - pFence->def.latX1e7[0] ) * GEOFENCE_MM_PER_1E7DEG_X1000 / 1000;
+    dxMm = ( dLon * GEOFENCE_MM_PER_1E7DEG_X1000 / 1000 ) * pFence->cosLatQ15 / GEOFENCE_COS_SCALE;
+
+    rMm = (int64_t) pFence->def.radiusMetres * 1000;
+    if( pFence->stateKnown && pFence->isInside ){
+        rMm += GEOFENCE_CIRCLE_HYSTERESIS_M * 1000;
+    }
+
+    // cheap rejection, also keeps the squares below in range
+    if( ( dyMm > rMm ) || ( dyMm < -rMm ) || ( dxMm > rMm ) || ( dxMm < -rMm ) ){
+        return false;
+    }
+
+    return ( dxMm * dxMm + dyMm * dyMm ) <= ( rMm * rMm );
+}
+
+
+
+static bool geofencePolygonIsInside(const geofenceEntry_t *pFence, int32_t latX1e7, int32_t lonX1e7){
+
+    const int32_t *pLat = pFence->def.latX1e7;
+    const int32_t *pLon = pFence->def.lonX1e7;
+    bool inside = false;
+    int64_t lhs, rhs;
+
+    if( ( latX1e7 < pFence->minLat ) || ( latX1e7 > pFence->maxLat ) ||
+        ( lonX1e7 < pFence->minLon ) || ( lonX1e7 > pFence->maxLon ) ){
+        return false;
+    }
+
+    // ray casting towards increasing longitude: count the edges crossed
+    for( uint8_t i = 0, j = pFence->def.verticesNum - 1; i < pFence->def.verticesNum; j = i++ ){
+
+        if( ( pLat[i] > latX1e7 ) != ( pLat[j] > latX1e7 ) ){
+            // lon < lon[i] + (lon[j]-lon[i]) * (lat-lat[i]) / (lat[j]-lat[i]), without the division
+            lhs = ( (int64_t) lonX1e7 - pLon[i] ) * ( (int64_t) pLat[j] - pLat[i] );
+            rhs = ( (int64_t) pLon[j] - pLon[i] ) * ( (int64_t) latX1e7 - pLat[i] );
+            if( ( pLat[j] > pLat[i] ) ? ( lhs < rhs ) : ( lhs > rhs ) ){
+                inside = !inside;
+            }
+        }
+    }
+
+    return inside;
+}
+
+
+
+static void geofencePublishEvent(uint8_t id, xPosGeofenceEvent_t event, const xPosMaxM10Fix_t *pFix){
+
+    xDataPacket_t eventPack = {
+        .error = dataErrOk,
+        .sensorType = maxm10_t,
+        .name = JSON_ID_SENSOR_MAXM10,
+        .measurementsNum = 6,
+        //measurements
+        .meas ={
+            // Position x
+            [0].name = JSON_ID_SENSOR_CHAN_POS_DX,
+            [0].type = SENSOR_CHAN_POS_DX,
+            [0].dataType = isPosition,
+            [0].data.doubleVal = ((double) pFix->latitudeX1e7) / 10000000,
+            // Position y
+            [1].name = JSON_ID_SENSOR_CHAN_POS_DY,
+            [1].type = SENSOR_CHAN_POS_DY,
+            [1].dataType = isPosition,
+            [1].data.doubleVal = ((double) pFix->longitudeX1e7) / 10000000,
+            // Latitude (deg x1e7)
+            [2].name = JSON_ID_SENSOR_CHAN_POS_LAT,
+            [2].type = X_SENSOR_CHAN_POS_LAT,
+            [2].dataType = isInt,
+            [2].data.int32Val = pFix->latitudeX1e7,
+            // Longitude (deg x1e7)
+            [3].name = JSON_ID_SENSOR_CHAN_POS_LON,
+            [3].type = X_SENSOR_CHAN_POS_LON,
+            [3].dataType = isInt,
+            [3].data.int32Val = pFix->longitudeX1e7,
+            // Fence id
+            [4].name = JSON_ID_SENSOR_CHAN_POS_GF,
+            [4].type = X_SENSOR_CHAN_POS_GF,
+            [4].dataType = isInt,
+            [4].data.int32Val = id,
+            // Event
+            [5].name = JSON_ID_SENSOR_CHAN_POS_EV,
+            [5].type = X_SENSOR_CHAN_POS_EV,
+            [5].dataType = isInt,
+            [5].data.int32Val = event
+        }
+    };
+
+    LOG_INF("Geofence %d: %s\r\n", id, gEventStr[event]);
+    xDataSend( eventPack );
+}
+
+
+
+static err_code geofenceParseCoord(const char *pStr, int32_t limitDeg, int32_t *pValX1e7){
+
+    const char *p = pStr;
+    bool negative = false;
+    int64_t degrees = 0;
+    int64_t fraction = 0;
+    int32_t fractionDigits = 0;
+    bool digitFound = false;
+
+    if( ( *p == '-' ) || ( *p == '+' ) ){
+        negative = ( *p == '-' );
+        p++;
+    }
+
+    for( ; ( *p >= '0' ) && ( *p <= '9' ); p++ ){
+        degrees = degrees * 10 + ( *p - '0' );
+        digitFound = true;
+        if( degrees > limitDeg ){
+            return X_ERR_INVALID_PARAMETER;
+        }
+    }
+
+    if( *p == '.' ){
+        // digits beyond the 7th decimal are ignored
+        for( p++; ( *p >= '0' ) && ( *p <= '9' ); p++ ){
+            if( fractionDigits < 7 ){
+                fraction = fraction * 10 + ( *p - '0' );
+                fractionDigits++;
+            }
+            digitFound = true;
+        }
+    }
+
+    if( !digitFound || ( *p != '\0' ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    for( ; fractionDigits < 7; fractionDigits++ ){
+        fraction *= 10;
+    }
+
+    degrees = degrees * 10000000 + fraction;
+    if( degrees > (int64_t) limitDeg * 10000000 ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    *pValX1e7 = (int32_t)( negative ? -degrees : degrees );
+    return X_ERR_SUCCESS;
+}
+
+
+
+static err_code geofenceParseId(const char *pStr, uint8_t *pId){
+
+    char *pEnd;
+    unsigned long id = strtoul( pStr, &pEnd, 10 );
+
+    if( ( pEnd == pStr ) || ( *pEnd != '\0' ) || ( id > UINT8_MAX ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    *pId = (uint8_t) id;
+    return X_ERR_SUCCESS;
+}
+
+
+
+static err_code geofenceParseRadius(const char *pStr, uint32_t *pRadius){
+
+    char *pEnd;
+    unsigned long radius;
+
+    // strtoul accepts a sign, the radius should be digits only
+    if( ( *pStr < '0' ) || ( *pStr > '9' ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    radius = strtoul( pStr, &pEnd, 10 );
+    if( ( *pEnd != '\0' ) || ( radius > GEOFENCE_MAX_RADIUS_M ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    *pRadius = (uint32_t) radius;
+    return X_ERR_SUCCESS;
+}
+
+
+
+static err_code geofenceDeleteFile(void){
+
+    err_code err;
+
+    if( !xStorageFileExists( geofence_fname ) ){
+        return X_ERR_SUCCESS;
+    }
+
+    err = xStorageDeleteFile( geofence_fname );
+    if( err < 0 ){
+        LOG_ERR("Could not delete geofences file: %d\r\n", err);
+        return err;
+    }
+    return X_ERR_SUCCESS;
+}
+
+
+/* ----------------------------------------------------------------
+ * SHELL COMMANDS IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+
+void xPosGeofenceAddCircleCmd(const struct shell *shell, size_t argc, char **argv){
+
+        int32_t lat, lon;
+        uint32_t radius;
+        uint8_t id;
+        err_code err;
+
+        if(argc!=5){
+            shell_print(shell, "Invalid number of parameters\r\n");
+            return;
+        }
+
+        if( ( geofenceParseId( argv[1], &id ) != X_ERR_SUCCESS ) ||
+            ( geofenceParseCoord( argv[2], 90, &lat ) != X_ERR_SUCCESS ) ||
+            ( geofenceParseCoord( argv[3], 180, &lon ) != X_ERR_SUCCESS ) ||
+            ( geofenceParseRadius( argv[4], &radius ) != X_ERR_SUCCESS ) ){
+            shell_print(shell, "Invalid parameter\r\n");
+            return;
+        }
+
+        err = xPosGeofenceAddCircle( id, lat, lon, radius );
+        if( err != X_ERR_SUCCESS ){
+            shell_print(shell, "%sCould not add geofence: %d %s\r\n",LOG_CLRCODE_RED, err, LOG_CLRCODE_DEFAULT );
+        }
+}
+
+
+
+void xPosGeofenceAddPolygonCmd(const struct shell *shell, size_t argc, char **argv){
+
+        int32_t lat[ GEOFENCE_MAX_VERTICES ];
+        int32_t lon[ GEOFENCE_MAX_VERTICES ];
+        uint8_t verticesNum;
+        uint8_t id;
+        err_code err;
+
+        if( ( argc % 2 ) != 0 ){
+            shell_print(shell, "Invalid number of parameters\r\n");
+            return;
+        }
+
+        verticesNum = ( argc - 2 ) / 2;
+        if( ( verticesNum < 3 ) || ( verticesNum > GEOFENCE_MAX_VERTICES ) ){
+            shell_print(shell, "A polygon should have 3 up to %d vertices\r\n", GEOFENCE_MAX_VERTICES);
+            return;
+        }
+
+        if( geofenceParseId( argv[1], &id ) != X_ERR_SUCCESS ){
+            shell_print(shell, "Invalid parameter\r\n");
+            return;
+        }
+
+        for( uint8_t i = 0; i < verticesNum; i++ ){
+            if( ( geofenceParseCoord( argv[ 2 + 2*i ], 90, &lat[i] ) != X_ERR_SUCCESS ) ||
+                ( geofenceParseCoord( argv[ 3 + 2*i ], 180, &lon[i] ) != X_ERR_SUCCESS ) ){
+                shell_print(shell, "Invalid parameter\r\n");
+                return;
+            }
+        }
+
+        err = xPosGeofenceAddPolygon( id, lat, lon, verticesNum );
+        if( err != X_ERR_SUCCESS ){
+            shell_print(shell, "%sCould not add geofence: %d %s\r\n",LOG_CLRCODE_RED, err, LOG_CLRCODE_DEFAULT );
+        }
+}
+
+
+
+void xPosGeofenceRemoveCmd(const struct shell *shell, size_t argc, char **argv){
+
+        uint8_t id;
+        err_code err;
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");
+            return;
+        }
+
+        if( geofenceParseId( argv[1], &id ) != X_ERR_SUCCESS ){
+            shell_print(shell, "Invalid parameter\r\n");
+            return;
+        }
+
+        err = xPosGeofenceRemove( id );
+        if( err == X_ERR_NOT_FOUND ){
+            shell_print(shell, "Geofence %d not found\r\n", id);
+        }
+        else if( err != X_ERR_SUCCESS ){
+            shell_print(shell, "%sCould not remove geofence: %d %s\r\n",LOG_CLRCODE_RED, err, LOG_CLRCODE_DEFAULT );
+        }
+}
+
+
+
+void xPosGeofenceClearCmd(const struct shell *shell, size_t argc, char **argv){
+
+        err_code err = xPosGeofenceClear();
+
+        if( err != X_ERR_SUCCESS ){
+            shell_print(shell, "%sCould not remove geofences: %d %s\r\n",LOG_CLRCODE_RED, err, LOG_CLRCODE_DEFAULT );
+        }
+}
+
+
+
+void xPosGeofenceListCmd(const struct shell *shell, size_t argc, char **argv){
+
+        geofenceEntry_t fence;
+        uint8_t num;
+
+        geofenceLoad();
+
+        shell_print(shell, "Geofencing: %s, heartbeat: %d ms, dwell: %d ms\r\n",
+                    gGeofenceEnabled ? "enabled" : "disabled", gHeartbeatPeriod, gDwellTime);
+
+        k_sem_take( &geofenceAccessSemaphore, K_FOREVER );
+        num = gFencesNum;
+        k_sem_give( &geofenceAccessSemaphore );
+
+        for( uint8_t i = 0; i < num; i++ ){
+
+            k_sem_take( &geofenceAccessSemaphore, K_FOREVER );
+            fence = gFences[i];
+            k_sem_give( &geofenceAccessSemaphore );
+
+            if( fence.def.shape == GEOFENCE_SHAPE_CIRCLE ){
+                shell_print(shell, "%d: circle %3.7f,%3.7f radius %d m  state: %s", fence.def.id,
+                            ((double) fence.def.latX1e7[0]) / 10000000, ((double) fence.def.lonX1e7[0]) / 10000000,
+                            fence.def.radiusMetres, fence.stateKnown ? ( fence.isInside ? "inside" : "outside" ) : "unknown");
+            }
+            else{
+                shell_print(shell, "%d: polygon %d vertices  state: %s", fence.def.id, fence.def.verticesNum,
+                            fence.stateKnown ? ( fence.isInside ? "inside" : "outside" ) : "unknown");
+                for( uint8_t v = 0; v < fence.def.verticesNum; v++ ){
+                    shell_print(shell, "    %3.7f,%3.7f", ((double) fence.def.latX1e7[v]) / 10000000,
+                                ((double) fence.def.lonX1e7[v]) / 10000000);
+                }
+            }
+        }
+}
+
+
+
+void xPosGeofenceEnableCmd(const struct shell *shell, size_t argc, char **argv){
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");
+            return;
+        }
+
+		if( strcmp(argv[1], "on") == 0 ){
+			xPosGeofenceEnable(true);
+		}
+
+		else if( strcmp(argv[1], "off") == 0 ){
+			xPosGeofenceEnable(false);
+        }
+
+        else{
+            shell_print(shell, "Invalid parameter (on/off)\r\n");
+		}
+}
+
+
+
+void xPosGeofenceSetHeartbeatCmd(const struct shell *shell, size_t argc, char **argv){
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");
+            return;
+        }
+
+        if( xPosGeofenceSetHeartbeatPeriod( strtoul( argv[1], NULL, 10 ) ) == X_ERR_SUCCESS ){
+            shell_print(shell, "Geofence heartbeat period set to %d ms", gHeartbeatPeriod);
+        }
+}
+
+
+
+void xPosGeofenceSetDwellCmd(const struct shell *shell, size_t argc, char **argv){
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");
+            return;
+        }
+
+        if( xPosGeofenceSetDwellTime( strtoul( argv[1], NULL, 10 ) ) == X_ERR_SUCCESS ){
+            shell_print(shell, "Geofence dwell time set to %d ms", gDwellTime);
+        }
+}
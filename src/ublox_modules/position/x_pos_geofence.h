@@ -0,0 +1,222 @@
+/*
+ * Copyright 2022 u-blox Ltd
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef X_POS_GEOFENCE_H__
+#define  X_POS_GEOFENCE_H__
+
+
+/** @file
+ * @brief This file contains the API of the geofencing engine applied on
+ * MAXM10S positions in XPLR-IOT-1 device.
+ *
+ * Up to GEOFENCE_MAX_NUM circular or polygon fences can be defined (shell,
+ * BLE or string definitions received e.g. via MQTT). They are kept in NORA-B1
+ * flash. When geofencing is enabled, every MAXM10S fix is evaluated against
+ * the fences and only enter/exit/dwell events are published, along with the
+ * full position at a low rate (heartbeat).
+ *
+ * Fences are evaluated with integer math on the x1e7 coordinates reported by
+ * MAXM10S.
+ */
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <shell/shell.h>          // needed for shell commands
+#include "x_errno.h"
+#include "x_system_conf.h"
+#include "x_pos_maxm10s.h"        // for xPosMaxM10Fix_t
+
+
+/* ----------------------------------------------------------------
+ * DEFINITIONS
+ * -------------------------------------------------------------- */
+
+/** Max length of a fence definition string (see xPosGeofenceDefine) */
+#define GEOFENCE_DEF_STR_MAXLEN     256
+
+
+/* ----------------------------------------------------------------
+ * TYPE DEFINITIONS
+ * -------------------------------------------------------------- */
+
+/** Fence shapes */
+typedef enum{
+    GEOFENCE_SHAPE_CIRCLE = 0,
+    GEOFENCE_SHAPE_POLYGON
+}xPosGeofenceShape_t;
+
+
+/** Geofence events, as reported in the published event messages */
+typedef enum{
+    GEOFENCE_EVENT_NONE = 0,
+    GEOFENCE_EVENT_ENTER,     /**< Position moved inside the fence */
+    GEOFENCE_EVENT_EXIT,      /**< Position moved outside the fence */
+    GEOFENCE_EVENT_DWELL      /**< Position stayed inside the fence for the dwell time (once per entry) */
+}xPosGeofenceEvent_t;
+
+
+/** Definition of a fence */
+typedef struct{
+    uint8_t id;                                 /**< User defined fence id */
+    xPosGeofenceShape_t shape;                  /**< Circle or polygon */
+    uint8_t verticesNum;                        /**< Polygon: number of vertices. Circle: 1 (center) */
+    int32_t latX1e7[ GEOFENCE_MAX_VERTICES ];   /**< Latitude of center/vertices in degrees x1e7 */
+    int32_t lonX1e7[ GEOFENCE_MAX_VERTICES ];   /**< Longitude of center/vertices in degrees x1e7 */
+    uint32_t radiusMetres;                      /**< Circle radius (not used in polygons) */
+}xPosGeofence_t;
+
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+/** Adds (or replaces if the id exists) a circular fence. The fence is saved in flash.
+ *
+ * @param id            Fence id.
+ * @param latX1e7       Latitude of the center in degrees x1e7.
+ * @param lonX1e7       Longitude of the center in degrees x1e7.
+ * @param radiusMetres  Radius of the fence (up to GEOFENCE_MAX_RADIUS_M).
+ * @return              zero on success else negative error code.
+ */
+err_code xPosGeofenceAddCircle(uint8_t id, int32_t latX1e7, int32_t lonX1e7, uint32_t radiusMetres);
+
+
+/** Adds (or replaces if the id exists) a polygon fence. The fence is saved in flash.
+ *
+ * @param id            Fence id.
+ * @param pLatX1e7      Latitudes of the vertices in degrees x1e7.
+ * @param pLonX1e7      Longitudes of the vertices in degrees x1e7.
+ * @param verticesNum   Number of vertices (3 up to GEOFENCE_MAX_VERTICES).
+ * @return              zero on success else negative error code.
+ */
+err_code xPosGeofenceAddPolygon(uint8_t id, const int32_t *pLatX1e7, const int32_t *pLonX1e7, uint8_t verticesNum);
+
+
+/** Removes a fence.
+ *
+ * @param id   Fence id.
+ * @return     zero on success else negative error code (X_ERR_NOT_FOUND if no such fence).
+ */
+err_code xPosGeofenceRemove(uint8_t id);
+
+
+/** Removes all fences (also from flash).
+ *
+ * @return     zero on success else negative error code.
+ */
+err_code xPosGeofenceClear(void);
+
+
+/** Applies a fence definition given as a string. Used to load fences from
+ * remote sources (BLE, MQTT). Comma separated formats, coordinates in decimal degrees:
+ *
+ * - Circle:   "c,<id>,<lat>,<lon>,<radius m>"
+ * - Polygon:  "p,<id>,<lat1>,<lon1>,<lat2>,<lon2>,<lat3>,<lon3>..."
+ * - Remove:   "r,<id>"
+ * - Clear all:"x"
+ *
+ * @param pDef  Null terminated definition string.
+ * @return      zero on success else negative error code.
+ */
+err_code xPosGeofenceDefine(const char *pDef);
+
+
+/** Gets the fences currently defined.
+ *
+ * @param pFences   Array to receive the fences (GEOFENCE_MAX_NUM elements).
+ * @return          Number of fences returned.
+ */
+uint8_t xPosGeofenceGetFences(xPosGeofence_t *pFences);
+
+
+/** Enables/disables geofencing of MAXM10S positions. When enabled, only
+ * geofence events and a heartbeat position are published.
+ * Cannot be changed while the Main Sensor Aggregation Function is active.
+ *
+ * @param enable   true: enable, false: disable.
+ * @return         zero on success else negative error code.
+ */
+err_code xPosGeofenceEnable(bool enable);
+
+
+/** Returns whether geofencing is enabled.
+ */
+bool xPosGeofenceIsEnabled(void);
+
+
+/** Sets the period in which the full position is published while geofencing.
+ *
+ * @param periodMs   Heartbeat period in ms (0: never publish the full position).
+ * @return           zero on success else negative error code.
+ */
+err_code xPosGeofenceSetHeartbeatPeriod(uint32_t periodMs);
+
+
+/** Sets the time the position should stay within a fence before a dwell event
+ * is published.
+ *
+ * @param dwellMs   Dwell time in ms (0: no dwell events).
+ * @return          zero on success else negative error code.
+ */
+err_code xPosGeofenceSetDwellTime(uint32_t dwellMs);
+
+
+/** Evaluates a position fix against all fences and publishes any resulting
+ * events. Called by MAXM10S module for every valid fix, while geofencing is enabled.
+ *
+ * @param pFix   Position fix.
+ */
+void xPosGeofenceProcessFix(const xPosMaxM10Fix_t *pFix);
+
+
+/** Returns true when the heartbeat position should be published (and restarts
+ * the heartbeat period). Called by MAXM10S module while geofencing is enabled.
+ */
+bool xPosGeofenceHeartbeatDue(void);
+
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS - SHELL COMMANDS
+ * -------------------------------------------------------------- */
+
+/** Add circular fence. Command: add_circle <id> <lat> <lon> <radius m> */
+void xPosGeofenceAddCircleCmd(const struct shell *shell, size_t argc, char **argv);
+
+/** Add polygon fence. Command: add_polygon <id> <lat1> <lon1> <lat2> <lon2> <lat3> <lon3>... */
+void xPosGeofenceAddPolygonCmd(const struct shell *shell, size_t argc, char **argv);
+
+/** Remove fence. Command: remove <id> */
+void xPosGeofenceRemoveCmd(const struct shell *shell, size_t argc, char **argv);
+
+/** Remove all fences. */
+void xPosGeofenceClearCmd(const struct shell *shell, size_t argc, char **argv);
+
+/** Type fences, their state and geofencing settings. */
+void xPosGeofenceListCmd(const struct shell *shell, size_t argc, char **argv);
+
+/** Enable/disable geofencing. Command: enable on/off */
+void xPosGeofenceEnableCmd(const struct shell *shell, size_t argc, char **argv);
+
+/** Set heartbeat period. Command: set_heartbeat <ms> */
+void xPosGeofenceSetHeartbeatCmd(const struct shell *shell, size_t argc, char **argv);
+
+/** Set dwell time. Command: set_dwell <ms> */
+void xPosGeofenceSetDwellCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+#endif    //X_POS_GEOFENCE_H__
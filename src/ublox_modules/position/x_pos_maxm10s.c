@@ -59,6 +59,13 @@
  *  before the previous request completes. The request completes, either when the callback is triggered or the 
  *  timeout expires.
  * 
+ *  Streaming Mode (MAXM10S_MODE_STREAM):
+ *  Instead of starting/stopping a request for every sample, the module is configured (UBX-CFG-VALSET)
+ *  to output UBX-NAV-PVT periodically on its UART. A UART event callback notifies the stream thread
+ *  (maxM10StreamThread) which parses the incoming messages and keeps the latest fix. The start request
+ *  thread then just publishes the latest fix every update period. If the latest fix is older than the
+ *  timeout period, a timeout error is reported instead.
+ * 
  */
 
 
@@ -66,12 +73,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 
 // Zephyr related includes
 #include <zephyr.h>
 #include <sys/printk.h>
 #include <drivers/uart.h>
 #include <drivers/sensor.h> // for channel names
+#include <sys/crc.h>
 #include <hal/nrf_gpio.h>
 
 // ubxlib related includes
@@ -85,6 +95,9 @@
 #include "x_data_handle.h" //xDataSend
 #include "x_module_common.h"
 #include "x_system_conf.h"
+#include "x_storage.h"
+#include "x_pos_geofence.h"
+#include "x_sensor_aggregation_function.h"
 
 
 /* ----------------------------------------------------------------
@@ -102,6 +115,81 @@
 #endif
 
 
+/* ----------------------------------------------------------------
+ * DEFINITIONS
+ * -------------------------------------------------------------- */
+
+// Size of buffer holding the raw bytes received in streaming mode
+#define MAXM10S_STREAM_BUF_SIZE         256
+
+// UBX messages class/id used in streaming mode
+#define UBX_CLASS_NAV                   0x01
+#define UBX_ID_NAV_PVT                  0x07
+#define UBX_CLASS_CFG                   0x06
+#define UBX_ID_CFG_VALSET               0x8A
+#define UBX_CLASS_MGA                   0x13
+#define UBX_ID_MGA_DBD                  0x80
+#define UBX_ID_MGA_INI                  0x40
+
+#define UBX_MGA_INI_POS_LLH_BODY_LEN    20
+#define UBX_MGA_INI_POS_LLH_TYPE        0x01
+
+// Max time given to the receiver to boot after power up, before feeding it assistance data
+#define MAXM10S_BOOT_TIME_MS            1000
+// Response timeout of each poll while waiting for the receiver to boot
+#define MAXM10S_BOOT_POLL_TIMEOUT_MS    100
+// Time given to the receiver to start the navigation database dump
+#define MAXM10S_DBD_FIRST_MS            1000
+// The navigation database dump is considered complete when no UBX-MGA-DBD
+// message is received for this time
+#define MAXM10S_DBD_IDLE_MS             300
+// Delay between UBX-MGA-DBD messages fed to the receiver
+#define MAXM10S_DBD_FRAME_DELAY_MS      10
+
+#define UBX_NAV_PVT_BODY_LEN            92
+
+// Index of each measurement in the MaxM10 data packet
+// Optional measurements are placed at the end, so they can be left out by
+// reducing measurementsNum
+#define MAXM10S_MEAS_LAT        0   // degrees (float), as before the full solution was published
+#define MAXM10S_MEAS_LON        1   // degrees (float)
+#define MAXM10S_MEAS_LAT_X1E7   2
+#define MAXM10S_MEAS_LON_X1E7   3
+#define MAXM10S_MEAS_HACC       4
+#define MAXM10S_MEAS_SPD        5
+#define MAXM10S_MEAS_FIX        6
+#define MAXM10S_MEAS_SV         7
+#define MAXM10S_MEAS_ALT        8   // only included when altitude is available
+#define MAXM10S_MEAS_HDG        9   // only included when altitude and heading are available
+
+// UBX-CFG-VALSET configuration keys used in streaming mode
+#define UBX_CFG_KEY_RATE_MEAS                   0x30210001  // U2 (ms)
+#define UBX_CFG_KEY_MSGOUT_UBX_NAV_PVT_UART1    0x20910007  // U1 (output every N solutions)
+#define UBX_CFG_KEY_UART1OUTPROT_NMEA           0x10740002  // L  (bool)
+
+// UBX-CFG-VALSET power management keys (UBX-CFG-PM)
+#define UBX_CFG_KEY_PM_OPERATEMODE              0x20d00001  // E1
+#define UBX_CFG_KEY_PM_POSUPDATEPERIOD          0x40d00002  // U4 (ms)
+#define UBX_CFG_KEY_PM_ONTIME                   0x30d00005  // U2 (s)
+#define UBX_CFG_KEY_PM_MAXACQTIME               0x20d00007  // U1 (s)
+#define UBX_CFG_KEY_PM_WAITTIMEFIX              0x10d00009  // L  (bool)
+#define UBX_CFG_KEY_PM_UPDATEEPH                0x10d0000a  // L  (bool)
+
+#define UBX_PM_OPERATEMODE_FULL                 0
+#define UBX_PM_OPERATEMODE_PSMOO                1
+#define UBX_PM_OPERATEMODE_PSMCT                2
+
+// UBX-CFG-VALSET AssistNow Autonomous key
+#define UBX_CFG_KEY_ANA_USE_ANA                 0x10230001  // L  (bool)
+
+// Max length of key/value pairs in a single UBX-CFG-VALSET sent by this module
+#define MAXM10S_CFG_VALSET_MAX_LEN              64
+
+// Length in metres of 1e-7 degrees of latitude (track simplification)
+#define MAXM10S_TRACK_M_PER_1E7DEG              0.011132f
+#define MAXM10S_DEG_TO_RAD                      0.017453293f
+
+
 /* ----------------------------------------------------------------
  * STATIC FUNCTION DECLARATION
  * -------------------------------------------------------------- */
@@ -145,6 +233,181 @@ void maxM10PositionTimeoutHandler(struct k_timer *dummy);
 static void maxM10ErrorHandle(void);
 
 
+/** Prepares the MaxM10 data packet with the given position fix and types
+ * the position in the log. If the fix does not meet the accuracy threshold
+ * an accuracy error is set in the packet instead.
+*/
+static void maxM10PreparePositionPacket(const xPosMaxM10Fix_t *pFix);
+
+
+/** Publishes the MaxM10 data packet (if publish is enabled). When geofencing is
+ * enabled, the latest fix is evaluated against the fences instead and the packet
+ * is only published as a heartbeat.
+*/
+static void maxM10Publish(void);
+
+
+/** In streaming mode, this thread parses the UBX-NAV-PVT messages received
+ * from MaxM10 and holds the latest position fix.
+*/
+void maxM10StreamThread(void);
+
+
+/** Callback controlled by ubxlib port. Triggered when data are received from
+ * MaxM10 UART in streaming mode. Just notifies maxM10StreamThread.
+*/
+static void maxM10UartEventCallback(int32_t uartHandle, uint32_t eventBitmask, void *pParameters);
+
+
+/** Configures MaxM10 to output UBX-NAV-PVT periodically and starts parsing its output.
+*/
+static err_code maxM10StreamStart(void);
+
+
+/** Stops the periodic output of UBX-NAV-PVT and the parsing of MaxM10 output.
+*/
+static void maxM10StreamStop(void);
+
+
+/** Appends a key/value pair of a UBX-CFG-VALSET message to the given buffer (little endian).
+ * Returns the number of bytes appended.
+*/
+static size_t maxM10CfgValAppend(char *pBuf, uint32_t key, uint32_t value, size_t valueSize);
+
+
+/** Sends a UBX-CFG-VALSET message to MaxM10 (RAM layer) containing the given
+ * key/value pairs and checks that it is not rejected.
+*/
+static err_code maxM10CfgValSet(const char *pKeyValues, size_t len);
+
+
+/** Sends a UBX-CFG-VALSET message to MaxM10 (RAM layer) to configure the periodic
+ * output of UBX-NAV-PVT. 
+*/
+static err_code maxM10StreamConfig(bool enable);
+
+
+/** Returns the power mode to be applied to MaxM10. Resolves MAXM10S_PM_AUTO
+ * based on the update period.
+*/
+static xPosMaxM10PowerMode_t maxM10ResolvePowerMode(void);
+
+
+/** Configures the MaxM10 power management (UBX-CFG-PM keys) according to the power
+ * mode setting, update period and timeout period.
+*/
+static err_code maxM10PowerModeConfig(void);
+
+
+/** Reconfigures the power mode of an enabled MaxM10 after a change of the
+ * update or timeout period (the cyclic tracking/on-off duty cycle and the
+ * resolved MAXM10S_PM_AUTO mode depend on them)
+*/
+static void maxM10PowerModeReapply(void);
+
+
+/** Records the time to fix of a valid fix obtained at the given uptime
+*/
+static void maxM10FixTimingUpdate(int64_t now);
+
+
+/** Replaces the latest position fix (gLatestFix) as a whole, so readers
+ * never see a fix partially updated
+*/
+static void maxM10LatestFixSet(const xPosMaxM10Fix_t *pFix);
+
+
+/** Copies the latest position fix (gLatestFix)
+*/
+static void maxM10LatestFixGet(xPosMaxM10Fix_t *pFix);
+
+
+/** Finds the complete UBX messages contained in the given buffer and passes each
+ * of them to the given handler. Keeps any incomplete message at the start of the buffer.
+*/
+static void maxM10UbxParse( char *pBuf, size_t *pBufLen, size_t bufSize,
+                            void (*pFrameHandler)(const char *pFrame, size_t frameLen) );
+
+
+/** Handles a UBX message received in streaming mode. Keeps the fix from UBX-NAV-PVT
+*/
+static void maxM10NavPvtFrameHandler(const char *pFrame, size_t frameLen);
+
+
+/** Keeps the fix from a UBX-NAV-PVT message as the latest fix. Returns false if
+ * the message is not a UBX-NAV-PVT or it does not contain a valid fix.
+*/
+static bool maxM10NavPvtDecode(const char *pFrame, size_t frameLen);
+
+
+/** Paces a replay by the time of week of the UBX-NAV-PVT messages replayed
+*/
+static void maxM10ReplayPace(const char *pFrame, size_t frameLen);
+
+
+/** Feeds the recording to the stream parser instead of the UART data, until the
+ * replay completes or is stopped. Called by the stream thread
+*/
+static void maxM10StreamReplay(void);
+
+
+/** Saves the MaxM10 output recorded by the stream thread once the recording
+ * is complete, so that recording does not block the caller
+*/
+void maxM10RecordThread(void);
+
+
+/** Handles a UBX message received while dumping the navigation database. Keeps the
+ * UBX-MGA-DBD messages in the assistance buffer
+*/
+static void maxM10DbdFrameHandler(const char *pFrame, size_t frameLen);
+
+
+/** Adds a position fix to the track buffer, unless it is within the tolerance of
+ * the previous one. Publishes the track first if the buffer is full.
+*/
+static void maxM10TrackAppend(const xPosMaxM10Fix_t *pFix);
+
+
+/** Simplifies the track buffer and publishes it as an encoded polyline.
+ * TrackAccessSemaphore should be held.
+*/
+static err_code maxM10TrackFlushLocked(void);
+
+
+/** Marks the points of the track buffer to be kept after Douglas-Peucker
+ * simplification (gTrackKeep). Returns the number of points kept.
+*/
+static uint16_t maxM10TrackSimplify(void);
+
+
+/** Appends a value to an encoded polyline (JSON escaped). Returns the new length
+ * of the polyline or zero if the value does not fit.
+*/
+static size_t maxM10PolylineAppend(char *pBuf, size_t len, size_t maxLen, int32_t value);
+
+
+/** Dumps the MaxM10 navigation database (UBX-MGA-DBD) and the last position fix
+ * to NORA-B1 flash. MaxM10 sampling should be disabled.
+*/
+static err_code maxM10AssistSave(void);
+
+
+/** Checks whether the assistance data kept in flash are stale compared to
+ * what MaxM10 currently holds, so that a power off does not dump and write
+ * them every time.
+ *
+ * @return        true if maxM10AssistSave() should be called.
+*/
+static bool maxM10AssistSaveNeeded(void);
+
+
+/** Feeds the navigation database and last position saved in NORA-B1 flash back
+ * to MaxM10 (if any). Should be used right after power up.
+*/
+static err_code maxM10AssistRestore(void);
+
+
 /* ----------------------------------------------------------------
  * ZEPHYR RELATED DEFINITIONS/DECLARATIONS
  * -------------------------------------------------------------- */
@@ -165,6 +428,26 @@ K_THREAD_DEFINE(maxM10PositionRequestStartThread_id, MAXM10S_STACK_SIZE, maxM10P
 K_THREAD_DEFINE(maxM10PositionRequestCompleteThread_id, MAXM10S_STACK_SIZE, maxM10PositionRequestCompleteThread, NULL, NULL, NULL,
 		MAXM10S_COMPLETE_POS_PRIORITY, 0, 0);
 
+// Semaphore which notifies the stream thread that data are available from MaxM10 UART
+K_SEM_DEFINE(StreamDataSemaphore, 0, 1);
+
+// Controls access to the track buffer
+K_SEM_DEFINE(TrackAccessSemaphore, 1, 1);
+
+// Controls access to the latest position fix
+K_SEM_DEFINE(LatestFixAccessSemaphore, 1, 1);
+
+// Parse UBX-NAV-PVT stream thread
+K_THREAD_DEFINE(maxM10StreamThread_id, MAXM10S_STREAM_STACK_SIZE, maxM10StreamThread, NULL, NULL, NULL,
+		MAXM10S_STREAM_PRIORITY, 0, 0);
+
+// Semaphore which starts the record thread
+K_SEM_DEFINE(RecordStartSemaphore, 0, 1);
+
+// Record MaxM10 output thread
+K_THREAD_DEFINE(maxM10RecordThread_id, MAXM10S_REPLAY_STACK_SIZE, maxM10RecordThread, NULL, NULL, NULL,
+		MAXM10S_REPLAY_PRIORITY, 0, 0);
+
 
 /* ----------------------------------------------------------------
  * GLOBALS
@@ -190,7 +473,10 @@ static xPosMaxM10Status_t gMaxStatus = {
     .isPublishEnabled = false,
     .updatePeriod = MAXM10S_DEFAULT_UPDATE_PERIOD_MS,
     .timeoutPeriod = MAXM10S_DEFAULT_TIMEOUT_PERIOD_MS,
-    .com = SERIAL_COMM_USB2UART
+    .com = SERIAL_COMM_USB2UART,
+    .mode = MAXM10S_MODE_REQUEST,
+    .accuracyThreshold = MAXM10S_DEFAULT_ACCURACY_THRESHOLD_MM,
+    .powerMode = MAXM10S_DEFAULT_POWER_MODE
 };
 
 
@@ -202,33 +488,204 @@ int32_t gUartHandle;
  */
 uDeviceHandle_t gGnssHandle = NULL;
 
-/** Hold gnss Latitude, Longitude results from MaxMax10 
- */
-int32_t gLatitudeX1e7, gLongitudeX1e7;
-
 /** Flag to indicate whether a gnss position request is active via ubxlib
  */
 static bool gubxlibGnssRequestActive = false;
 
+/** Flag to indicate whether MaxM10 is configured to stream UBX-NAV-PVT and
+ * the stream is being parsed
+ */
+static bool gStreamActive = false;
+
+/** Buffer holding the raw bytes received from MaxM10 in streaming mode,
+ * until they are parsed 
+ */
+static char gStreamBuf[MAXM10S_STREAM_BUF_SIZE];
+static size_t gStreamBufLen = 0;
+
+/** Latest position fix obtained from MaxM10 (request or streaming mode)
+ */
+static xPosMaxM10Fix_t gLatestFix = { .isValid = false };
+
+/** Power mode actually configured in MaxM10 (MAXM10S_PM_AUTO resolved)
+ */
+static xPosMaxM10PowerMode_t gActivePowerMode = MAXM10S_PM_FULL;
+
+/** String representation of power modes
+ */
+static const char *const gPowerModeStr[]={
+    [MAXM10S_PM_FULL] = "full",
+    [MAXM10S_PM_CYCLIC] = "cyclic",
+    [MAXM10S_PM_ONOFF] = "onoff",
+    [MAXM10S_PM_AUTO] = "auto"
+};
+
+/** Holds the navigation database (UBX-MGA-DBD messages) while it is 
+ * dumped/restored
+ */
+static char gAssistBuf[MAXM10S_ASSIST_BUF_SIZE];
+static size_t gAssistBufLen = 0;
+
+/** Uptime (ms) when the last UBX-MGA-DBD message was received during a dump
+ */
+static int64_t gAssistLastFrameTime;
+
+/** MaxM10 has been powered up and assistance data have not been fed yet
+ */
+static bool gAssistPending = false;
+
+/** Assistance data were fed to MaxM10 at the last power up
+ */
+static bool gAssistApplied = false;
+
+/** Uptime (ms) of the last navigation database dump (0: none since boot)
+ */
+static int64_t gAssistSaveTime = 0;
+
+/** CRC of the navigation database currently saved in flash (0: none)
+ */
+static uint32_t gAssistSavedCrc = 0;
+
+/** Last position currently saved in flash
+ */
+static xPosMaxM10Fix_t gAssistSavedFix = { .isValid = false };
+
+/** Time MaxM10 was powered up, the receiver is given up to MAXM10S_BOOT_TIME_MS from
+ * then to boot */
+static int64_t gPowerOnTime = 0;
+
+/** Time to fix measurements
+ */
+static struct{
+    int64_t searchStart;     /**< Uptime (ms) when the module was enabled */
+    int64_t requestStart;    /**< Uptime (ms) when the last position request was started */
+    bool firstFixObtained;   /**< First fix since the module was enabled has been obtained */
+    uint32_t ttffMs;         /**< Time to first fix since the module was enabled */
+    uint32_t lastTtfMs;      /**< Time to fix of the last position request */
+    uint64_t sumTtfMs;       /**< Sum of time to fix of all position requests (for average) */
+    uint32_t fixNum;         /**< Number of position requests that obtained a fix */
+    bool afterPowerUp;       /**< The next first fix is the first since power up */
+    uint32_t assistedTtffMs;    /**< Time to first fix after the last power up with assistance data */
+    uint32_t unassistedTtffMs;  /**< Time to first fix after the last power up without assistance data */
+}gFixTiming = { .firstFixObtained = false };
+
+
+/** A point of the track buffer
+ */
+typedef struct{
+    int32_t latX1e7;
+    int32_t lonX1e7;
+    int64_t timestamp;
+}maxM10TrackPoint_t;
+
+/** Track buffer (ring) and the flags of the points kept after simplification
+ */
+static maxM10TrackPoint_t gTrackBuf[MAXM10S_TRACK_BUF_SIZE];
+static uint16_t gTrackHead = 0;   // oldest point
+static uint16_t gTrackNum = 0;
+static bool gTrackKeep[MAXM10S_TRACK_BUF_SIZE];
+
+/** Encoded polyline of the track being published
+ */
+static char gTrackPolyline[MAXM10S_TRACK_POLYLINE_MAXLEN + 1];
+
+/** Track settings and statistics
+ */
+static struct{
+    bool isEnabled;
+    uint32_t toleranceMetres;
+    uint32_t flushPeriod;
+    int64_t lastFlush;      /**< Uptime (ms) of the last track flush */
+    uint32_t fixesIn;
+    uint32_t pointsSent;
+    float maxDeviation2;    /**< Square of the max deviation (m) of a dropped fix from the track */
+}gTrack = {
+    .isEnabled = false,
+    .toleranceMetres = MAXM10S_TRACK_DEFAULT_TOLERANCE_M,
+    .flushPeriod = MAXM10S_TRACK_DEFAULT_FLUSH_PERIOD_MS
+};
+
+
+/** Recording of MaxM10 output (raw UART bytes) being recorded or replayed
+ */
+static char gReplayBuf[MAXM10S_REPLAY_BUF_SIZE];
+static size_t gReplayBufLen = 0;
+
+/** Replay status and statistics
+ */
+static struct{
+    bool isActive;
+    bool isRecording;
+    int64_t recordEnd;      /**< Time the recording ends */
+    uint32_t speed;
+    bool iTowValid;
+    uint32_t lastITow;      /**< Time of week (ms) of the last UBX-NAV-PVT replayed, for pacing */
+    int64_t pausedTicks;    /**< Time spent waiting for pacing, not counted as parse time */
+    uint32_t bytesNum;
+    uint32_t framesNum;
+    uint32_t fixesNum;
+    uint32_t parseTimeUs;
+}gReplay = { .isActive = false, .isRecording = false };
+
 
 // Packet that holds gnss position request results
 xDataPacket_t MaxM10Pack = {
     .error = dataErrOk,
 	.sensorType = maxm10_t,
 	.name = JSON_ID_SENSOR_MAXM10,
-	.measurementsNum = 2,
+	.measurementsNum = MAXM10S_MEAS_HDG + 1,
 	//measurements
 	.meas ={
 		// Position x
-		[0].name = JSON_ID_SENSOR_CHAN_POS_DX, 
-		[0].type = SENSOR_CHAN_POS_DX,
-		[0].dataType = isPosition,
-		[0].data.doubleVal = 0,
+		[MAXM10S_MEAS_LAT].name = JSON_ID_SENSOR_CHAN_POS_DX, 
+		[MAXM10S_MEAS_LAT].type = SENSOR_CHAN_POS_DX,
+		[MAXM10S_MEAS_LAT].dataType = isPosition,
+		[MAXM10S_MEAS_LAT].data.doubleVal = 0,
         // Position y
-		[1].name = JSON_ID_SENSOR_CHAN_POS_DY, 
-		[1].type = SENSOR_CHAN_POS_DY,
-		[1].dataType = isPosition,
-		[1].data.int32Val = 0
+		[MAXM10S_MEAS_LON].name = JSON_ID_SENSOR_CHAN_POS_DY, 
+		[MAXM10S_MEAS_LON].type = SENSOR_CHAN_POS_DY,
+		[MAXM10S_MEAS_LON].dataType = isPosition,
+		[MAXM10S_MEAS_LON].data.doubleVal = 0,
+        // Latitude (deg x1e7)
+		[MAXM10S_MEAS_LAT_X1E7].name = JSON_ID_SENSOR_CHAN_POS_LAT, 
+		[MAXM10S_MEAS_LAT_X1E7].type = X_SENSOR_CHAN_POS_LAT,
+		[MAXM10S_MEAS_LAT_X1E7].dataType = isInt,
+		[MAXM10S_MEAS_LAT_X1E7].data.int32Val = 0,
+        // Longitude (deg x1e7)
+		[MAXM10S_MEAS_LON_X1E7].name = JSON_ID_SENSOR_CHAN_POS_LON, 
+		[MAXM10S_MEAS_LON_X1E7].type = X_SENSOR_CHAN_POS_LON,
+		[MAXM10S_MEAS_LON_X1E7].dataType = isInt,
+		[MAXM10S_MEAS_LON_X1E7].data.int32Val = 0,
+        // Altitude (mm)
+		[MAXM10S_MEAS_ALT].name = JSON_ID_SENSOR_CHAN_POS_ALT, 
+		[MAXM10S_MEAS_ALT].type = SENSOR_CHAN_ALTITUDE,
+		[MAXM10S_MEAS_ALT].dataType = isInt,
+		[MAXM10S_MEAS_ALT].data.int32Val = 0,
+        // Horizontal accuracy (mm)
+		[MAXM10S_MEAS_HACC].name = JSON_ID_SENSOR_CHAN_POS_HACC, 
+		[MAXM10S_MEAS_HACC].type = X_SENSOR_CHAN_POS_HACC,
+		[MAXM10S_MEAS_HACC].dataType = isInt,
+		[MAXM10S_MEAS_HACC].data.int32Val = 0,
+        // Ground speed (mm/s)
+		[MAXM10S_MEAS_SPD].name = JSON_ID_SENSOR_CHAN_POS_SPD, 
+		[MAXM10S_MEAS_SPD].type = X_SENSOR_CHAN_POS_SPD,
+		[MAXM10S_MEAS_SPD].dataType = isInt,
+		[MAXM10S_MEAS_SPD].data.int32Val = 0,
+        // Fix type
+		[MAXM10S_MEAS_FIX].name = JSON_ID_SENSOR_CHAN_POS_FIX, 
+		[MAXM10S_MEAS_FIX].type = X_SENSOR_CHAN_POS_FIX,
+		[MAXM10S_MEAS_FIX].dataType = isInt,
+		[MAXM10S_MEAS_FIX].data.int32Val = 0,
+        // Satellites used
+		[MAXM10S_MEAS_SV].name = JSON_ID_SENSOR_CHAN_POS_SV, 
+		[MAXM10S_MEAS_SV].type = X_SENSOR_CHAN_POS_SV,
+		[MAXM10S_MEAS_SV].dataType = isInt,
+		[MAXM10S_MEAS_SV].data.int32Val = 0,
+        // Heading of motion (deg x1e5)
+		[MAXM10S_MEAS_HDG].name = JSON_ID_SENSOR_CHAN_POS_HDG, 
+		[MAXM10S_MEAS_HDG].type = X_SENSOR_CHAN_POS_HDG,
+		[MAXM10S_MEAS_HDG].dataType = isInt,
+		[MAXM10S_MEAS_HDG].data.int32Val = 0
 	}
 };
 
@@ -252,8 +709,21 @@ static void gnssPosCallback(uDeviceHandle_t devHandle,
     //LOG_DBG("errCode: %d", errorCode);
     // if a valid position fix is obtained
     if( (errorCode == 0) && (positionRequestStatus_t == REQ_STAT_PENDING ) ){
-        gLatitudeX1e7 = latitudeX1e7;
-        gLongitudeX1e7 = longitudeX1e7;
+        xPosMaxM10Fix_t fix;
+        fix.latitudeX1e7 = latitudeX1e7;
+        fix.longitudeX1e7 = longitudeX1e7;
+        fix.altitudeMillimetres = altitudeMillimetres;
+        fix.hAccMillimetres = radiusMillimetres;
+        fix.speedMillimetresPerSecond = speedMillimetresPerSecond;
+        // heading and fix type are not reported by ubxlib position request,
+        // altitude is only available with a 3D fix (INT_MIN otherwise)
+        fix.headingX1e5 = INT32_MIN;
+        fix.fixType = ( altitudeMillimetres != INT32_MIN ) ? 3 : 2;
+        fix.svs = (uint8_t) svs;
+        fix.timestamp = k_uptime_get();
+        fix.isValid = true;
+        maxM10LatestFixSet( &fix );
+        maxM10FixTimingUpdate( fix.timestamp );
         positionRequestStatus_t = REQ_STAT_OBTAINED;
         k_sem_give( &RequestCompleteSemaphore );
     }
@@ -262,6 +732,19 @@ static void gnssPosCallback(uDeviceHandle_t devHandle,
 
 
 
+static void maxM10UartEventCallback(int32_t uartHandle, uint32_t eventBitmask, void *pParameters)
+{
+    ARG_UNUSED(uartHandle);
+    ARG_UNUSED(pParameters);
+
+    if( eventBitmask & U_PORT_UART_EVENT_BITMASK_DATA_RECEIVED ){
+        k_sem_give( &StreamDataSemaphore );
+    }
+    return;
+}
+
+
+
 /* ----------------------------------------------------------------
  * PUBLIC FUNCTIONS
  * -------------------------------------------------------------- */
@@ -441,6 +924,12 @@ err_code xPosMaxM10Init(void){
 
     uGnssSetUbxMessagePrint(gGnssHandle, false);
 
+    // receiver has just been powered up, feed it with any saved assistance data
+    if( gAssistPending ){
+        maxM10AssistRestore();
+        gAssistPending = false;
+    }
+
     LOG_INF("Initialized\r\n");
     gMaxStatus.isUbxInit = true;
 
@@ -468,6 +957,7 @@ err_code xPosMaxM10SetUpdatePeriod(uint32_t milliseconds){
     }
 
     gMaxStatus.updatePeriod = milliseconds;
+    maxM10PowerModeReapply();
     return X_ERR_SUCCESS;
 }
 
@@ -498,137 +988,521 @@ err_code MaxM10S_setTimeoutPeriod(uint32_t milliseconds){
     }
 
     gMaxStatus.timeoutPeriod = milliseconds;
+    maxM10PowerModeReapply();
 
     return X_ERR_SUCCESS;
 }
 
 
 
-xPosMaxM10Status_t xPosMaxM10GetModuleStatus(void){
-	return gMaxStatus;
-}
-
-
+err_code xPosMaxM10SetMode(xPosMaxM10Mode_t mode){
 
-void xPosMaxM10Disable(void){
+    err_code err = X_ERR_SUCCESS;
 
     if( !xSensIsChangeAllowed() ){
-		    LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
-		    return; //todo: return error code?
+		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+		return X_ERR_INVALID_STATE;
 	}
 
-    gMaxStatus.isEnabled = false;
+    if( mode == gMaxStatus.mode ){
+        return X_ERR_SUCCESS;
+    }
 
-    if( positionRequestStatus_t != REQ_STAT_COMPLETED ){
-        //thread suspends itself
-        k_sem_give( &RequestCompleteSemaphore );
+    gMaxStatus.mode = mode;
+
+    // if the module is not enabled the mode takes effect when it is enabled
+    if( gMaxStatus.isEnabled ){
+
+        if( mode == MAXM10S_MODE_STREAM ){
+            // terminate current request and wait for it to close, before configuring the stream
+            if( positionRequestStatus_t != REQ_STAT_COMPLETED ){
+                LOG_INF("Terminate current position request");
+                k_sem_give( &RequestCompleteSemaphore );
+            }
+            while( gubxlibGnssRequestActive ){
+                k_sleep(K_MSEC(10));
+            }
+
+            err = maxM10StreamStart();
+            if( err != X_ERR_SUCCESS ){
+                gMaxStatus.mode = MAXM10S_MODE_REQUEST;
+                return err;
+            }
+        }
+        else{
+            maxM10StreamStop();
+        }
     }
-    
-	k_thread_suspend( maxM10PositionRequestStartThread_id );
-    LOG_INF( "%sMAXM10 suspended%s \r\n", LOG_CLRCODE_RED, LOG_CLRCODE_DEFAULT );
-} 
 
+    LOG_INF("MaxM10S mode set to: %s \r\n", (mode == MAXM10S_MODE_STREAM) ? "stream" : "request" );
+    return X_ERR_SUCCESS;
+}
 
 
-err_code xPosMaxM10Enable(void){
+
+err_code xPosMaxM10SetAccuracyThreshold(uint32_t millimetres){
 
     if( !xSensIsChangeAllowed() ){
-		    LOG_ERR( "Cannot change setting when Sensor Aggregation function is active\r\n" );
-		    return X_ERR_INVALID_STATE; 
+		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+		return X_ERR_INVALID_STATE;
 	}
 
-    if( ! gMaxStatus.isUbxInit ){
-        err_code ret = xPosMaxM10Init();
-        if( ret != X_ERR_SUCCESS ){
-            return ret;
-        }
-    } 
-
-	k_thread_resume( maxM10PositionRequestStartThread_id );
-    k_thread_resume( maxM10PositionRequestCompleteThread_id );
-    LOG_INF( "%sMAXM10 started%s \r\n", LOG_CLRCODE_GREEN, LOG_CLRCODE_DEFAULT );
-	gMaxStatus.isEnabled = true;
-
+    gMaxStatus.accuracyThreshold = millimetres;
     return X_ERR_SUCCESS;
-	
 }
 
 
 
-void xPosMaxM10Deinit(){
-
-    xPosMaxM10Disable();
-    uGnssDeinit();  
-    LOG_INF("MaxM10S Deinitialized\r\n");
-    uPortUartClose( gUartHandle );
-    gMaxStatus.isUbxInit = false;
+void xPosMaxM10GetLastFix(xPosMaxM10Fix_t *pFix){
+    maxM10LatestFixGet( pFix );
 }
 
 
 
-void xPosMaxM10PowerOn(void){
+err_code xPosMaxM10SetPowerMode(xPosMaxM10PowerMode_t mode){
 
     if( !xSensIsChangeAllowed() ){
 		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
-		return;
+		return X_ERR_INVALID_STATE;
 	}
 
-    max10EnablePinAssert();
-    max10SafeBootPinDeassert();
-    max10BackupSupplyPinDeassert();
+    if( mode > MAXM10S_PM_AUTO ){
+        return X_ERR_INVALID_PARAMETER;
+    }
 
-    LOG_INF("MaxM10S Powered on\r\n");
+    gMaxStatus.powerMode = mode;
 
-    gMaxStatus.isPowered = true;
+    // restart sampling to apply the new power mode
+    if( gMaxStatus.isEnabled ){
+        xPosMaxM10Disable();
+        return xPosMaxM10Enable();
+    }
 
+    return X_ERR_SUCCESS;
 }
 
 
 
-void xPosMaxM10PowerOff(void){
+err_code xPosMaxM10AssistSave(void){
+
+    err_code err;
+    bool wasEnabled = gMaxStatus.isEnabled;
 
     if( !xSensIsChangeAllowed() ){
 		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
-		return;
+		return X_ERR_INVALID_STATE;
 	}
 
-    if( gMaxStatus.isUbxInit ){
-        xPosMaxM10Deinit();
+    if( !gMaxStatus.isUbxInit ){
+        return X_ERR_INVALID_STATE;
     }
-    max10EnablePinDeassert();
-    LOG_INF("MaxM10S Powered off\r\n");
-    gMaxStatus.isPowered = false;
-}
-
 
+    // the UART should not be used by anyone else during the dump
+    if( wasEnabled ){
+        xPosMaxM10Disable();
+    }
 
-void xPosMaxM10EnablePublish(bool enable){
+    err = maxM10AssistSave();
 
-    if( !xSensIsChangeAllowed() ){
-		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
-		return;
-	}
+    if( wasEnabled ){
+        xPosMaxM10Enable();
+    }
 
-	gMaxStatus.isPublishEnabled = enable;
-	if( gMaxStatus.isPublishEnabled ){
-		LOG_INF("%sMAXM10 publish enabled%s \r\n",LOG_CLRCODE_GREEN, LOG_CLRCODE_DEFAULT);
-	}
-	else{
-		LOG_INF("%sMAXM10 publish disabled%s \r\n",LOG_CLRCODE_RED, LOG_CLRCODE_DEFAULT);
-	}
+    return err;
 }
 
 
 
-xSensStatus_t xPosMaxM10GetSensorStatus(void){
+err_code xPosMaxM10AssistClear(void){
 
-    xSensStatus_t retStatus;
-    retStatus.sensorType = maxm10_t;
-    retStatus.isReady = gMaxStatus.isUbxInit;
-    retStatus.isEnabled = gMaxStatus.isEnabled;
-    retStatus.isPublishEnabled = gMaxStatus.isPublishEnabled;
-    retStatus.updatePeriod = gMaxStatus.updatePeriod;
-    return retStatus;
+    // files may not exist, nothing to report in that case
+    if( xStorageFileExists( maxm10s_dbd_fname ) ){
+        xStorageDeleteFile( maxm10s_dbd_fname );
+    }
+    if( xStorageFileExists( maxm10s_lastpos_fname ) ){
+        xStorageDeleteFile( maxm10s_lastpos_fname );
+    }
+    gAssistSavedCrc = 0;
+    gAssistSavedFix.isValid = false;
+    LOG_INF("MaxM10S assistance data cleared\r\n");
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+xPosMaxM10FixStats_t xPosMaxM10GetFixStats(void){
+
+    xPosMaxM10FixStats_t stats;
+
+    stats.activePowerMode = gActivePowerMode;
+    stats.assistApplied = gAssistApplied;
+    stats.assistedTtffMs = gFixTiming.assistedTtffMs;
+    stats.unassistedTtffMs = gFixTiming.unassistedTtffMs;
+    stats.ttffMs = gFixTiming.firstFixObtained ? gFixTiming.ttffMs : 0;
+    stats.lastTtfMs = gFixTiming.lastTtfMs;
+    stats.fixNum = gFixTiming.fixNum;
+    stats.avgTtfMs = ( gFixTiming.fixNum > 0 ) ? (uint32_t)( gFixTiming.sumTtfMs / gFixTiming.fixNum ) : 0;
+
+    // In full power and cyclic tracking the receiver stays on for the whole update period
+    // (cyclic tracking reduces the current, not the on-time). In on/off mode the receiver 
+    // switches off right after it obtains a fix, so its on-time is about the time to fix.
+    if( gActivePowerMode == MAXM10S_PM_ONOFF ){
+        stats.estOnTimePerFixMs = ( stats.fixNum > 0 ) ? stats.avgTtfMs : stats.ttffMs;
+    }
+    else{
+        stats.estOnTimePerFixMs = gMaxStatus.updatePeriod;
+    }
+
+    return stats;
+}
+
+
+
+err_code xPosMaxM10TrackEnable(bool enable){
+
+    if( !xSensIsChangeAllowed() ){
+		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+		return X_ERR_INVALID_STATE;
+	}
+
+    k_sem_take( &TrackAccessSemaphore, K_FOREVER );
+
+    // do not lose the fixes already buffered
+    if( gTrack.isEnabled && !enable ){
+        maxM10TrackFlushLocked();
+    }
+    else if( !gTrack.isEnabled && enable ){
+        gTrackNum = 0;
+        gTrack.fixesIn = 0;
+        gTrack.pointsSent = 0;
+        gTrack.maxDeviation2 = 0;
+        gTrack.lastFlush = k_uptime_get();
+    }
+    gTrack.isEnabled = enable;
+
+    k_sem_give( &TrackAccessSemaphore );
+
+    if( enable ){
+        LOG_INF("%sMAXM10 track buffer enabled%s \r\n",LOG_CLRCODE_GREEN, LOG_CLRCODE_DEFAULT);
+    }
+    else{
+        LOG_INF("%sMAXM10 track buffer disabled%s \r\n",LOG_CLRCODE_RED, LOG_CLRCODE_DEFAULT);
+    }
+    return X_ERR_SUCCESS;
+}
+
+
+
+err_code xPosMaxM10TrackSetTolerance(uint32_t metres){
+
+    if( !xSensIsChangeAllowed() ){
+		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+		return X_ERR_INVALID_STATE;
+	}
+
+    gTrack.toleranceMetres = metres;
+    return X_ERR_SUCCESS;
+}
+
+
+
+err_code xPosMaxM10TrackSetFlushPeriod(uint32_t milliseconds){
+
+    if( !xSensIsChangeAllowed() ){
+		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+		return X_ERR_INVALID_STATE;
+	}
+
+    gTrack.flushPeriod = milliseconds;
+    return X_ERR_SUCCESS;
+}
+
+
+
+err_code xPosMaxM10TrackFlush(void){
+
+    err_code err;
+
+    k_sem_take( &TrackAccessSemaphore, K_FOREVER );
+    err = maxM10TrackFlushLocked();
+    k_sem_give( &TrackAccessSemaphore );
+
+    return err;
+}
+
+
+
+xPosMaxM10TrackStats_t xPosMaxM10GetTrackStats(void){
+
+    xPosMaxM10TrackStats_t stats;
+
+    stats.isEnabled = gTrack.isEnabled;
+    stats.toleranceMetres = gTrack.toleranceMetres;
+    stats.flushPeriod = gTrack.flushPeriod;
+    stats.bufferedNum = gTrackNum;
+    stats.fixesIn = gTrack.fixesIn;
+    stats.pointsSent = gTrack.pointsSent;
+    stats.maxDeviationCm = (uint32_t)( sqrtf( gTrack.maxDeviation2 ) * 100 );
+
+    return stats;
+}
+
+
+
+err_code xPosMaxM10ReplayRecord(uint32_t seconds){
+
+    if( !xSensIsChangeAllowed() ){
+		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+		return X_ERR_INVALID_STATE;
+	}
+
+    // in request mode the UART is read by ubxlib, only the stream can be recorded
+    if( !gStreamActive ){
+        LOG_ERR("MAXM10S should be enabled in stream mode to record its output\r\n");
+        return X_ERR_INVALID_STATE;
+    }
+
+    if( gReplay.isActive || gReplay.isRecording ){
+        return X_ERR_INVALID_STATE;
+    }
+
+    gReplayBufLen = 0;
+    gReplay.recordEnd = k_uptime_get() + (int64_t) seconds * 1000;
+    gReplay.isRecording = true;
+    LOG_INF("Recording MAXM10S output for %d s\r\n", seconds);
+
+    // the recording is saved by the record thread when complete
+    k_sem_give( &RecordStartSemaphore );
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+err_code xPosMaxM10ReplayStart(uint32_t speed){
+
+    int32_t ret;
+
+    if( !xSensIsChangeAllowed() ){
+		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+		return X_ERR_INVALID_STATE;
+	}
+
+    // the recording is fed to the stream parser, in request mode the UART is read by ubxlib
+    if( !gStreamActive ){
+        LOG_ERR("MAXM10S should be enabled in stream mode to replay a recording\r\n");
+        return X_ERR_INVALID_STATE;
+    }
+
+    if( gReplay.isActive || gReplay.isRecording ){
+        return X_ERR_INVALID_STATE;
+    }
+
+    ret = xStorageReadFile( gReplayBuf, maxm10s_replay_fname, sizeof(gReplayBuf) );
+    if( ret <= 0 ){
+        LOG_ERR("No MAXM10S recording in flash\r\n");
+        return X_ERR_NOT_FOUND;
+    }
+    gReplayBufLen = ret;
+
+    gReplay.speed = speed;
+    gReplay.iTowValid = false;
+    gReplay.pausedTicks = 0;
+    gReplay.bytesNum = 0;
+    gReplay.framesNum = 0;
+    gReplay.fixesNum = 0;
+    gReplay.parseTimeUs = 0;
+    gReplay.isActive = true;
+
+    LOG_INF("Replaying MAXM10S recording: %d bytes\r\n", gReplayBufLen);
+    // the stream thread replays the recording
+    k_sem_give( &StreamDataSemaphore );
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+void xPosMaxM10ReplayStop(void){
+
+    // the stream thread completes the replay at the next chunk
+    gReplay.isActive = false;
+}
+
+
+
+xPosMaxM10ReplayStats_t xPosMaxM10GetReplayStats(void){
+
+    xPosMaxM10ReplayStats_t stats;
+
+    stats.isActive = gReplay.isActive;
+    stats.isRecording = gReplay.isRecording;
+    stats.speed = gReplay.speed;
+    stats.recordingSize = gReplayBufLen;
+    stats.bytesNum = gReplay.bytesNum;
+    stats.framesNum = gReplay.framesNum;
+    stats.fixesNum = gReplay.fixesNum;
+    stats.parseTimeUs = gReplay.parseTimeUs;
+
+    return stats;
+}
+
+
+
+xPosMaxM10Status_t xPosMaxM10GetModuleStatus(void){
+	return gMaxStatus;
+}
+
+
+
+void xPosMaxM10Disable(void){
+
+    if( !xSensIsChangeAllowed() ){
+		    LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+		    return; //todo: return error code?
+	}
+
+    gMaxStatus.isEnabled = false;
+
+    if( positionRequestStatus_t != REQ_STAT_COMPLETED ){
+        //thread suspends itself
+        k_sem_give( &RequestCompleteSemaphore );
+    }
+
+    if( gStreamActive ){
+        maxM10StreamStop();
+    }
+    
+	k_thread_suspend( maxM10PositionRequestStartThread_id );
+    LOG_INF( "%sMAXM10 suspended%s \r\n", LOG_CLRCODE_RED, LOG_CLRCODE_DEFAULT );
+} 
+
+
+
+err_code xPosMaxM10Enable(void){
+
+    if( !xSensIsChangeAllowed() ){
+		    LOG_ERR( "Cannot change setting when Sensor Aggregation function is active\r\n" );
+		    return X_ERR_INVALID_STATE; 
+	}
+
+    if( ! gMaxStatus.isUbxInit ){
+        err_code ret = xPosMaxM10Init();
+        if( ret != X_ERR_SUCCESS ){
+            return ret;
+        }
+    } 
+
+    // power mode depends on update/timeout period, so it is (re)configured every time
+    if( maxM10PowerModeConfig() != X_ERR_SUCCESS ){
+        LOG_WRN("Continue with full power mode\r\n");
+    }
+
+    gFixTiming.searchStart = k_uptime_get();
+    gFixTiming.firstFixObtained = false;
+
+    if( gMaxStatus.mode == MAXM10S_MODE_STREAM ){
+        err_code ret = maxM10StreamStart();
+        if( ret != X_ERR_SUCCESS ){
+            return ret;
+        }
+    }
+
+	k_thread_resume( maxM10PositionRequestStartThread_id );
+    k_thread_resume( maxM10PositionRequestCompleteThread_id );
+    LOG_INF( "%sMAXM10 started%s \r\n", LOG_CLRCODE_GREEN, LOG_CLRCODE_DEFAULT );
+	gMaxStatus.isEnabled = true;
+
+    return X_ERR_SUCCESS;
+	
+}
+
+
+
+void xPosMaxM10Deinit(){
+
+    xPosMaxM10Disable();
+    uGnssDeinit();  
+    LOG_INF("MaxM10S Deinitialized\r\n");
+    uPortUartClose( gUartHandle );
+    gMaxStatus.isUbxInit = false;
+}
+
+
+
+void xPosMaxM10PowerOn(void){
+
+    if( !xSensIsChangeAllowed() ){
+		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+		return;
+	}
+
+    max10EnablePinAssert();
+    max10SafeBootPinDeassert();
+    max10BackupSupplyPinDeassert();
+
+    LOG_INF("MaxM10S Powered on\r\n");
+
+    gMaxStatus.isPowered = true;
+    gPowerOnTime = k_uptime_get();
+    gAssistPending = true;
+    gAssistApplied = false;
+    gFixTiming.afterPowerUp = true;
+
+}
+
+
+
+void xPosMaxM10PowerOff(void){
+
+    if( !xSensIsChangeAllowed() ){
+		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+		return;
+	}
+
+    if( gMaxStatus.isUbxInit ){
+        // keep the navigation database to speed up the next power up
+        if( maxM10AssistSaveNeeded() ){
+            xPosMaxM10Disable();
+            maxM10AssistSave();
+        }
+        xPosMaxM10Deinit();
+    }
+    max10EnablePinDeassert();
+    LOG_INF("MaxM10S Powered off\r\n");
+    gMaxStatus.isPowered = false;
+}
+
+
+
+void xPosMaxM10EnablePublish(bool enable){
+
+    if( !xSensIsChangeAllowed() ){
+		LOG_ERR("Cannot change setting when Sensor Aggregation function is active\r\n");
+		return;
+	}
+
+	gMaxStatus.isPublishEnabled = enable;
+	if( gMaxStatus.isPublishEnabled ){
+		LOG_INF("%sMAXM10 publish enabled%s \r\n",LOG_CLRCODE_GREEN, LOG_CLRCODE_DEFAULT);
+	}
+	else{
+		LOG_INF("%sMAXM10 publish disabled%s \r\n",LOG_CLRCODE_RED, LOG_CLRCODE_DEFAULT);
+	}
+}
+
+
+
+xSensStatus_t xPosMaxM10GetSensorStatus(void){
+
+    xSensStatus_t retStatus;
+    retStatus.sensorType = maxm10_t;
+    retStatus.isReady = gMaxStatus.isUbxInit;
+    retStatus.isEnabled = gMaxStatus.isEnabled;
+    retStatus.isPublishEnabled = gMaxStatus.isPublishEnabled;
+    retStatus.updatePeriod = gMaxStatus.updatePeriod;
+    return retStatus;
 
 }
 
@@ -638,119 +1512,1183 @@ xSensStatus_t xPosMaxM10GetSensorStatus(void){
  * -------------------------------------------------------------- */
 
 
-static void maxM10ErrorHandle(void){
-    xLedBlink( ERROR_LEDCOL, ERROR_LED_DELAY_ON, ERROR_LED_DELAY_OFF, ERROR_LED_BLINKS );
+static void maxM10ErrorHandle(void){
+    xLedBlink( ERROR_LEDCOL, ERROR_LED_DELAY_ON, ERROR_LED_DELAY_OFF, ERROR_LED_BLINKS );
+}
+
+
+
+static void maxM10PreparePositionPacket(const xPosMaxM10Fix_t *pFix){
+
+    // worst case: 42 chars prefix, 2x "-214.7483647" (any int32 x1e7), ',', '\n', null
+    char str[72];
+
+    if( snprintf( str, sizeof(str), "GNSS Position: https://maps.google.com/?q=%3.7f,%3.7f\n",
+            ((double) pFix->latitudeX1e7) / 10000000,
+            ((double) pFix->longitudeX1e7) / 10000000) < sizeof(str) ){
+        LOG_INF("%s",str);
+    }
+    LOG_DBG("Fix: %d  Svs: %d  hAcc: %d mm", pFix->fixType, pFix->svs, pFix->hAccMillimetres);
+
+    // check if the fix is accurate enough to be published
+    if( ( gMaxStatus.accuracyThreshold > 0 ) && 
+        ( (uint32_t) pFix->hAccMillimetres > gMaxStatus.accuracyThreshold ) ){
+        LOG_WRN("Position accuracy %d mm worse than threshold %d mm\r\n", pFix->hAccMillimetres, gMaxStatus.accuracyThreshold);
+        MaxM10Pack.error = dataErrLowAccuracy;
+        return;
+    }
+
+    // prepare data to send
+    MaxM10Pack.error = dataErrOk;
+    MaxM10Pack.meas[MAXM10S_MEAS_LAT].data.doubleVal = ((double) pFix->latitudeX1e7) / 10000000;
+    MaxM10Pack.meas[MAXM10S_MEAS_LON].data.doubleVal = ((double) pFix->longitudeX1e7) / 10000000;
+    MaxM10Pack.meas[MAXM10S_MEAS_LAT_X1E7].data.int32Val = pFix->latitudeX1e7;
+    MaxM10Pack.meas[MAXM10S_MEAS_LON_X1E7].data.int32Val = pFix->longitudeX1e7;
+    MaxM10Pack.meas[MAXM10S_MEAS_HACC].data.int32Val = pFix->hAccMillimetres;
+    MaxM10Pack.meas[MAXM10S_MEAS_SPD].data.int32Val = pFix->speedMillimetresPerSecond;
+    MaxM10Pack.meas[MAXM10S_MEAS_FIX].data.int32Val = pFix->fixType;
+    MaxM10Pack.meas[MAXM10S_MEAS_SV].data.int32Val = pFix->svs;
+    MaxM10Pack.meas[MAXM10S_MEAS_ALT].data.int32Val = pFix->altitudeMillimetres;
+    MaxM10Pack.meas[MAXM10S_MEAS_HDG].data.int32Val = pFix->headingX1e5;
+
+    // leave out altitude/heading when not available
+    if( pFix->altitudeMillimetres == INT32_MIN ){
+        MaxM10Pack.measurementsNum = MAXM10S_MEAS_ALT;
+    }
+    else if( pFix->headingX1e5 == INT32_MIN ){
+        MaxM10Pack.measurementsNum = MAXM10S_MEAS_HDG;
+    }
+    else{
+        MaxM10Pack.measurementsNum = MAXM10S_MEAS_HDG + 1;
+    }
+}
+
+
+
+static void maxM10Publish(void){
+
+    xPosMaxM10Fix_t fix;
+
+    if( !gMaxStatus.isPublishEnabled ){
+        return;
+    }
+
+    maxM10LatestFixGet( &fix );
+
+    // In Sensor Aggregation mode all sensors should report in every sampling
+    // cycle, so geofencing and track buffering do not apply
+    if( xSensorAggregationGetMode() == xSensAggModeDisabled ){
+
+        if( xPosGeofenceIsEnabled() && ( MaxM10Pack.error == dataErrOk ) ){
+            xPosGeofenceProcessFix( &fix );
+        }
+
+        // the track replaces the single fix messages
+        if( gTrack.isEnabled ){
+            if( MaxM10Pack.error == dataErrOk ){
+                maxM10TrackAppend( &fix );
+            }
+            if( k_uptime_get() - gTrack.lastFlush >= gTrack.flushPeriod ){
+                xPosMaxM10TrackFlush();
+            }
+            return;
+        }
+
+        if( xPosGeofenceIsEnabled() && !xPosGeofenceHeartbeatDue() ){
+            return;
+        }
+    }
+
+    xDataSend(MaxM10Pack);
+}
+
+
+
+static void maxM10TrackAppend(const xPosMaxM10Fix_t *pFix){
+
+    maxM10TrackPoint_t *pLast;
+    float dx, dy, tolerance;
+
+    k_sem_take( &TrackAccessSemaphore, K_FOREVER );
+
+    gTrack.fixesIn++;
+
+    // dead-band: a fix close to the previous one adds nothing to the track (stationary)
+    if( gTrackNum > 0 ){
+        pLast = &gTrackBuf[ ( gTrackHead + gTrackNum - 1 ) % MAXM10S_TRACK_BUF_SIZE ];
+        dy = (float)( (int64_t) pFix->latitudeX1e7 - pLast->latX1e7 ) * MAXM10S_TRACK_M_PER_1E7DEG;
+        dx = (float)( (int64_t) pFix->longitudeX1e7 - pLast->lonX1e7 ) * MAXM10S_TRACK_M_PER_1E7DEG *
+             cosf( (float) pLast->latX1e7 / 10000000 * MAXM10S_DEG_TO_RAD );
+        tolerance = (float) gTrack.toleranceMetres;
+        if( dx * dx + dy * dy < tolerance * tolerance ){
+            gTrack.maxDeviation2 = MAX( gTrack.maxDeviation2, dx * dx + dy * dy );
+            k_sem_give( &TrackAccessSemaphore );
+            return;
+        }
+    }
+
+    if( gTrackNum == MAXM10S_TRACK_BUF_SIZE ){
+        maxM10TrackFlushLocked();
+    }
+    // should not happen, unless the track could not be published: drop oldest
+    if( gTrackNum == MAXM10S_TRACK_BUF_SIZE ){
+        gTrackHead = ( gTrackHead + 1 ) % MAXM10S_TRACK_BUF_SIZE;
+        gTrackNum--;
+    }
+
+    gTrackBuf[ ( gTrackHead + gTrackNum ) % MAXM10S_TRACK_BUF_SIZE ] = (maxM10TrackPoint_t){
+        .latX1e7 = pFix->latitudeX1e7,
+        .lonX1e7 = pFix->longitudeX1e7,
+        .timestamp = pFix->timestamp
+    };
+    gTrackNum++;
+
+    k_sem_give( &TrackAccessSemaphore );
+}
+
+
+
+static uint16_t maxM10TrackSimplify(void){
+
+    // local flat projection (metres) relative to the first point
+    static float x[MAXM10S_TRACK_BUF_SIZE], y[MAXM10S_TRACK_BUF_SIZE];
+    static struct{ uint16_t start, end; }stack[MAXM10S_TRACK_BUF_SIZE];
+    const maxM10TrackPoint_t *pFirst = &gTrackBuf[gTrackHead];
+    const maxM10TrackPoint_t *pPoint;
+    float cosLat = cosf( (float) pFirst->latX1e7 / 10000000 * MAXM10S_DEG_TO_RAD );
+    float tolerance2 = (float) gTrack.toleranceMetres * gTrack.toleranceMetres;
+    float dx, dy, len2, cross, dist2, maxDist2;
+    uint16_t stackNum = 0, keptNum = 0;
+    uint16_t start, end, maxIndex;
+
+    for( uint16_t i = 0; i < gTrackNum; i++ ){
+        pPoint = &gTrackBuf[ ( gTrackHead + i ) % MAXM10S_TRACK_BUF_SIZE ];
+        y[i] = (float)( (int64_t) pPoint->latX1e7 - pFirst->latX1e7 ) * MAXM10S_TRACK_M_PER_1E7DEG;
+        x[i] = (float)( (int64_t) pPoint->lonX1e7 - pFirst->lonX1e7 ) * MAXM10S_TRACK_M_PER_1E7DEG * cosLat;
+        gTrackKeep[i] = false;
+    }
+
+    gTrackKeep[0] = true;
+    gTrackKeep[gTrackNum - 1] = true;
+    stack[stackNum].start = 0;
+    stack[stackNum++].end = gTrackNum - 1;
+
+    // Douglas-Peucker, without recursion: keep the point farthest from the segment
+    // start-end if it deviates more than the tolerance and examine both halves
+    while( stackNum > 0 ){
+
+        stackNum--;
+        start = stack[stackNum].start;
+        end = stack[stackNum].end;
+        if( end <= start + 1 ){
+            continue;
+        }
+
+        dx = x[end] - x[start];
+        dy = y[end] - y[start];
+        len2 = dx * dx + dy * dy;
+        maxDist2 = 0;
+        maxIndex = start;
+
+        for( uint16_t i = start + 1; i < end; i++ ){
+            if( len2 > 0 ){
+                cross = dx * ( y[i] - y[start] ) - dy * ( x[i] - x[start] );
+                dist2 = cross * cross / len2;
+            }
+            else{
+                dist2 = ( x[i] - x[start] ) * ( x[i] - x[start] ) + ( y[i] - y[start] ) * ( y[i] - y[start] );
+            }
+            if( dist2 > maxDist2 ){
+                maxDist2 = dist2;
+                maxIndex = i;
+            }
+        }
+
+        if( maxDist2 > tolerance2 ){
+            gTrackKeep[maxIndex] = true;
+            stack[stackNum].start = start;
+            stack[stackNum++].end = maxIndex;
+            stack[stackNum].start = maxIndex;
+            stack[stackNum++].end = end;
+        }
+        else{
+            // the points between start and end are dropped, keep the error bound achieved
+            gTrack.maxDeviation2 = MAX( gTrack.maxDeviation2, maxDist2 );
+        }
+    }
+
+    for( uint16_t i = 0; i < gTrackNum; i++ ){
+        keptNum += gTrackKeep[i] ? 1 : 0;
+    }
+    return keptNum;
+}
+
+
+
+static size_t maxM10PolylineAppend(char *pBuf, size_t len, size_t maxLen, int32_t value){
+
+    // zig-zag encoding of the sign, then 5-bit chunks, least significant first
+    uint32_t v = ( value < 0 ) ? ~( (uint32_t) value << 1 ) : ( (uint32_t) value << 1 );
+    char c;
+
+    do{
+        c = (char)( ( v >= 0x20 ) ? ( ( 0x20 | ( v & 0x1F ) ) + 63 ) : ( v + 63 ) );
+        v >>= 5;
+
+        // backslash is a valid polyline character, escape it for JSON
+        if( c == '\\' ){
+            if( len + 2 > maxLen ){
+                return 0;
+            }
+            pBuf[len++] = '\\';
+        }
+        if( len + 1 > maxLen ){
+            return 0;
+        }
+        pBuf[len++] = c;
+    }while( ( c - 63 ) & 0x20 );
+
+    return len;
+}
+
+
+
+static err_code maxM10TrackFlushLocked(void){
+
+    xDataPacket_t trackPack = {
+        .error = dataErrOk,
+        .sensorType = maxm10_t,
+        .name = JSON_ID_SENSOR_MAXM10,
+        .measurementsNum = 3,
+        //measurements
+        .meas ={
+            // Track polyline
+            [0].name = JSON_ID_SENSOR_CHAN_POS_TRK,
+            [0].type = X_SENSOR_CHAN_POS_TRK,
+            [0].dataType = isString,
+            [0].data.strVal = gTrackPolyline,
+            // Number of points
+            [1].name = JSON_ID_SENSOR_CHAN_POS_NP,
+            [1].type = X_SENSOR_CHAN_POS_NP,
+            [1].dataType = isInt,
+            // Time span
+            [2].name = JSON_ID_SENSOR_CHAN_POS_DUR,
+            [2].type = X_SENSOR_CHAN_POS_DUR,
+            [2].dataType = isInt
+        }
+    };
+    const maxM10TrackPoint_t *pPoint;
+    int32_t lat, lon, prevLat = 0, prevLon = 0;
+    size_t len = 0, newLen;
+    uint16_t keptNum, pointsNum = 0;
+    uint16_t lastPublished = 0;
+    uint16_t consumed = gTrackNum;
+    int64_t firstTime = gTrackBuf[gTrackHead].timestamp;
+    int64_t lastTime = firstTime;
+
+    gTrack.lastFlush = k_uptime_get();
+
+    if( gTrackNum == 0 ){
+        return X_ERR_SUCCESS;
+    }
+
+    keptNum = maxM10TrackSimplify();
+
+    for( uint16_t i = 0; i < gTrackNum; i++ ){
+
+        if( !gTrackKeep[i] ){
+            continue;
+        }
+
+        pPoint = &gTrackBuf[ ( gTrackHead + i ) % MAXM10S_TRACK_BUF_SIZE ];
+
+        // polyline precision is 1e-5 degrees, values are the differences from the previous point
+        lat = ( pPoint->latX1e7 >= 0 ) ? ( pPoint->latX1e7 + 50 ) / 100 : ( pPoint->latX1e7 - 50 ) / 100;
+        lon = ( pPoint->lonX1e7 >= 0 ) ? ( pPoint->lonX1e7 + 50 ) / 100 : ( pPoint->lonX1e7 - 50 ) / 100;
+
+        newLen = maxM10PolylineAppend( gTrackPolyline, len, MAXM10S_TRACK_POLYLINE_MAXLEN, lat - prevLat );
+        if( newLen > 0 ){
+            newLen = maxM10PolylineAppend( gTrackPolyline, newLen, MAXM10S_TRACK_POLYLINE_MAXLEN, lon - prevLon );
+        }
+
+        // polyline full: the rest is published with the next track, starting from
+        // the last point published so that the tracks connect
+        if( newLen == 0 ){
+            consumed = lastPublished;
+            break;
+        }
+
+        len = newLen;
+        prevLat = lat;
+        prevLon = lon;
+        lastTime = pPoint->timestamp;
+        lastPublished = i;
+        pointsNum++;
+    }
+    gTrackPolyline[len] = '\0';
+
+    trackPack.meas[1].data.int32Val = pointsNum;
+    trackPack.meas[2].data.int32Val = (int32_t)( ( lastTime - firstTime ) / 1000 );
+
+    LOG_INF("Track: %d fixes buffered, %d points after simplification, %d points published\r\n", 
+            gTrackNum, keptNum, pointsNum);
+
+    xDataSend(trackPack);
+
+    gTrack.pointsSent += pointsNum;
+    gTrackHead = ( gTrackHead + consumed ) % MAXM10S_TRACK_BUF_SIZE;
+    gTrackNum -= consumed;
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+void maxM10PositionRequestCompleteThread(void){
+    
+    while(1){
+        k_sem_take( &RequestCompleteSemaphore, K_FOREVER );
+        k_timer_stop( &timeoutTimer );
+
+        // did not obtain position yet, therefore another request or timeout has happened
+        if( positionRequestStatus_t != REQ_STAT_OBTAINED  ){
+            LOG_DBG("No Position Obtained");
+            MaxM10Pack.error = dataErrFetchTimeout;
+        }
+        else{ 
+            xPosMaxM10Fix_t fix;
+            maxM10LatestFixGet( &fix );
+            maxM10PreparePositionPacket( &fix );
+        }
+
+        //send data
+        maxM10Publish();
+
+        // set the enum before uGnssPosGetStop, otherwise sometimes the start request is called before this is set...
+        // leading to a "New Position Request while previous pending: complete previous" situation, 
+        // probably because uGnssPosGetStop may take some time and yield
+        positionRequestStatus_t = REQ_STAT_COMPLETED; 
+        if( gubxlibGnssRequestActive ){
+            uGnssPosGetStop( gGnssHandle );
+        }
+        gubxlibGnssRequestActive = false;
+
+        // check if needs to be suspended
+        if( gMaxStatus.isEnabled == false){
+            k_thread_suspend(maxM10PositionRequestCompleteThread_id);
+        }
+    }
+}
+
+
+
+void maxM10PositionRequestStartThread(void)
+{
+    int32_t err;
+    
+	while(1){
+
+        if( ! gMaxStatus.isUbxInit ){
+            LOG_WRN("Max not initialized \r\n");
+            MaxM10Pack.error = dataErrNotInit;
+            //xPosMaxM10Disable();
+            //todo: Handling?
+        }
+
+        // In streaming mode no request is needed, just publish the latest fix
+        if( gMaxStatus.mode == MAXM10S_MODE_STREAM ){
+
+            xPosMaxM10Fix_t fix;
+            maxM10LatestFixGet( &fix );
+
+            if( !fix.isValid || 
+                ( (gMaxStatus.timeoutPeriod > 0) && 
+                  (k_uptime_get() - fix.timestamp > gMaxStatus.timeoutPeriod) ) ){
+
+                LOG_DBG("No Position Obtained");
+                MaxM10Pack.error = dataErrFetchTimeout;
+            }
+            else{
+                maxM10PreparePositionPacket( &fix );
+            }
+
+            maxM10Publish();
+
+            k_sleep(K_MSEC(gMaxStatus.updatePeriod));
+            continue;
+        }
+
+        if( positionRequestStatus_t != REQ_STAT_COMPLETED ){
+            
+            LOG_WRN("New Position Request while previous pending: complete previous\r\n");
+            // force previous request to complete
+            k_sem_give( &RequestCompleteSemaphore );
+        }
+
+        //wait for previous request to close
+        while( gubxlibGnssRequestActive ){
+            // no active request should exist at this point, however sometimes we may need to wait a bit
+            // for the request to close
+            k_yield();
+        }
+
+        err = uGnssPosGetStart( gGnssHandle, gnssPosCallback);
+
+        if ( err == 0 ) {
+
+            LOG_DBG("Position Start Request\r\n");
+            gFixTiming.requestStart = k_uptime_get();
+            positionRequestStatus_t = REQ_STAT_PENDING;
+            gubxlibGnssRequestActive = true;
+            
+            // set a timeout period for this request
+            if( gMaxStatus.timeoutPeriod >0 ){
+                k_timer_start(&timeoutTimer, K_MSEC(gMaxStatus.timeoutPeriod), K_NO_WAIT );
+            }
+        }
+        else{
+            LOG_ERR("Position Start Request Error: %d  Abort this request\r\n", err);
+            MaxM10Pack.error = dataErrFetchFail;
+            maxM10Publish();
+            // try again at next sampling period
+        }
+    
+        k_sleep(K_MSEC(gMaxStatus.updatePeriod));
+	}
+
+}
+
+
+
+void maxM10PositionTimeoutHandler(struct k_timer *dummy){
+
+    LOG_WRN("Position Request Timeout");
+    // force previous request to complete
+    k_sem_give( &RequestCompleteSemaphore );
+
+}
+
+
+
+static size_t maxM10CfgValAppend(char *pBuf, uint32_t key, uint32_t value, size_t valueSize){
+
+    size_t len = 0;
+
+    // key and value are little endian
+    for( size_t i = 0; i < 4; i++ ){
+        pBuf[len++] = (char)( (key >> (8*i)) & 0xFF );
+    }
+    for( size_t i = 0; i < valueSize; i++ ){
+        pBuf[len++] = (char)( (value >> (8*i)) & 0xFF );
+    }
+    return len;
+}
+
+
+
+static err_code maxM10CfgValSet(const char *pKeyValues, size_t len){
+
+    char body[4 + MAXM10S_CFG_VALSET_MAX_LEN];
+    char msg[sizeof(body) + U_UBX_PROTOCOL_OVERHEAD_LENGTH_BYTES];
+    char response[U_UBX_PROTOCOL_OVERHEAD_LENGTH_BYTES + 2];
+    int32_t msgClass, msgId;
+    int32_t ret;
+
+    if( len > MAXM10S_CFG_VALSET_MAX_LEN ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    body[0] = 0x00;  // version
+    body[1] = 0x01;  // layers: RAM only, so a power cycle restores the defaults
+    body[2] = 0x00;
+    body[3] = 0x00;
+    memcpy( &body[4], pKeyValues, len );
+
+    ret = uUbxProtocolEncode( UBX_CLASS_CFG, UBX_ID_CFG_VALSET, body, 4 + len, msg );
+    if( ret < 0 ){
+        return ret;
+    }
+
+    ret = uGnssUtilUbxTransparentSendReceive( gGnssHandle, msg, ret, response, sizeof(response) );
+    if( ret < 0 ){
+        return ret;
+    }
+
+    // UBX-ACK-NAK: configuration rejected
+    if( ( uUbxProtocolDecode( response, ret, &msgClass, &msgId, NULL, 0, NULL ) >= 0 ) &&
+        ( msgClass == 0x05 ) && ( msgId == 0x00 ) ){
+        return X_ERR_INVALID_STATE;
+    }
+
+    return X_ERR_SUCCESS;
 }
 
 
 
-void maxM10PositionRequestCompleteThread(void){
+static err_code maxM10StreamConfig(bool enable){
 
-    char str[60];
-    
+    char keyValues[MAXM10S_CFG_VALSET_MAX_LEN];
+    size_t len = 0;
+
+    if( enable ){
+        len += maxM10CfgValAppend( &keyValues[len], UBX_CFG_KEY_RATE_MEAS, MAXM10S_STREAM_NAV_RATE_MS, 2 );
+    }
+    len += maxM10CfgValAppend( &keyValues[len], UBX_CFG_KEY_MSGOUT_UBX_NAV_PVT_UART1, enable ? 1 : 0, 1 );
+    // NMEA output is not needed while streaming, it only loads the UART
+    len += maxM10CfgValAppend( &keyValues[len], UBX_CFG_KEY_UART1OUTPROT_NMEA, enable ? 0 : 1, 1 );
+
+    return maxM10CfgValSet( keyValues, len );
+}
+
+
+
+static void maxM10LatestFixSet(const xPosMaxM10Fix_t *pFix){
+
+    k_sem_take( &LatestFixAccessSemaphore, K_FOREVER );
+    gLatestFix = *pFix;
+    k_sem_give( &LatestFixAccessSemaphore );
+}
+
+
+
+static void maxM10LatestFixGet(xPosMaxM10Fix_t *pFix){
+
+    k_sem_take( &LatestFixAccessSemaphore, K_FOREVER );
+    *pFix = gLatestFix;
+    k_sem_give( &LatestFixAccessSemaphore );
+}
+
+
+
+static void maxM10FixTimingUpdate(int64_t now){
+
+    if( !gFixTiming.firstFixObtained ){
+        gFixTiming.ttffMs = (uint32_t)( now - gFixTiming.searchStart );
+        gFixTiming.firstFixObtained = true;
+        LOG_INF("Time to first fix: %d ms\r\n", gFixTiming.ttffMs);
+
+        if( gFixTiming.afterPowerUp ){
+            if( gAssistApplied ){
+                gFixTiming.assistedTtffMs = gFixTiming.ttffMs;
+            }
+            else{
+                gFixTiming.unassistedTtffMs = gFixTiming.ttffMs;
+            }
+            gFixTiming.afterPowerUp = false;
+        }
+    }
+
+    // per fix timing is only known when the fix is requested
+    if( gMaxStatus.mode == MAXM10S_MODE_REQUEST ){
+        gFixTiming.lastTtfMs = (uint32_t)( now - gFixTiming.requestStart );
+        gFixTiming.sumTtfMs += gFixTiming.lastTtfMs;
+        gFixTiming.fixNum++;
+    }
+}
+
+
+
+static void maxM10DbdFrameHandler(const char *pFrame, size_t frameLen){
+
+    int32_t msgClass, msgId;
+
+    // keep only valid UBX-MGA-DBD messages, in raw form so they can be sent back as they are
+    if( ( uUbxProtocolDecode( pFrame, frameLen, &msgClass, &msgId, NULL, 0, NULL ) < 0 ) ||
+        ( msgClass != UBX_CLASS_MGA ) || ( msgId != UBX_ID_MGA_DBD ) ){
+        return;
+    }
+
+    gAssistLastFrameTime = k_uptime_get();
+
+    if( gAssistBufLen + frameLen > sizeof(gAssistBuf) ){
+        LOG_WRN("Navigation database does not fit in buffer, message dropped\r\n");
+        return;
+    }
+
+    memcpy( &gAssistBuf[gAssistBufLen], pFrame, frameLen );
+    gAssistBufLen += frameLen;
+}
+
+
+
+static bool maxM10AssistSaveNeeded(void){
+
+    xPosMaxM10Fix_t fix;
+
+    maxM10LatestFixGet( &fix );
+
+    // nothing new to keep if no fix has been obtained since the last dump
+    if( !fix.isValid || ( fix.timestamp <= gAssistSaveTime ) ){
+        return false;
+    }
+
+    if( !gAssistSavedFix.isValid ||
+        ( fix.latitudeX1e7 != gAssistSavedFix.latitudeX1e7 ) ||
+        ( fix.longitudeX1e7 != gAssistSavedFix.longitudeX1e7 ) ){
+        return true;
+    }
+
+    return ( gAssistSaveTime == 0 ) || ( k_uptime_get() - gAssistSaveTime >= MAXM10S_ASSIST_SAVE_INTERVAL_MS );
+}
+
+
+
+static err_code maxM10AssistSave(void){
+
+    char msg[U_UBX_PROTOCOL_OVERHEAD_LENGTH_BYTES];
+    int32_t readNum;
+    uint32_t crc;
+    err_code err;
+    xPosMaxM10Fix_t fix;
+    int64_t deadline = k_uptime_get() + MAXM10S_ASSIST_DUMP_MAX_MS;
+    bool isComplete = false;
+
+    maxM10LatestFixGet( &fix );
+
+    // nothing useful to keep if no fix has been obtained
+    if( !fix.isValid ){
+        return X_ERR_INVALID_STATE;
+    }
+
+    // wait for any position request to close
+    while( gubxlibGnssRequestActive ){
+        if( k_uptime_get() >= deadline ){
+            LOG_WRN("Position request still active, navigation database not saved\r\n");
+            return X_ERR_TIMEOUT;
+        }
+        k_sleep(K_MSEC(10));
+    }
+
+    if( !gAssistSavedFix.isValid ||
+        ( fix.latitudeX1e7 != gAssistSavedFix.latitudeX1e7 ) ||
+        ( fix.longitudeX1e7 != gAssistSavedFix.longitudeX1e7 ) ){
+        err = xStorageSaveFile( &fix, maxm10s_lastpos_fname, sizeof(fix) );
+        if( err < 0 ){
+            LOG_ERR("Could not save last position: %d\r\n", err);
+        }
+        else{
+            gAssistSavedFix = fix;
+        }
+    }
+
+    // poll the navigation database: UBX-MGA-DBD without payload
+    uUbxProtocolEncode( UBX_CLASS_MGA, UBX_ID_MGA_DBD, NULL, 0, msg );
+
+    gStreamBufLen = 0;
+    gAssistBufLen = 0;
+    gAssistLastFrameTime = k_uptime_get();
+
+    if( uPortUartWrite( gUartHandle, msg, sizeof(msg) ) != sizeof(msg) ){
+        LOG_ERR("Could not poll navigation database\r\n");
+        return X_ERR_UNKNOWN;
+    }
+
+    // the database is sent as a series of UBX-MGA-DBD messages, collect them
+    // until no more are received. The dump delays power off, so it is bounded
+    while( k_uptime_get() < deadline ){
+        if( k_uptime_get() - gAssistLastFrameTime >= 
+            ( ( gAssistBufLen == 0 ) ? MAXM10S_DBD_FIRST_MS : MAXM10S_DBD_IDLE_MS ) ){
+            isComplete = true;
+            break;
+        }
+        readNum = uPortUartRead( gUartHandle, &gStreamBuf[gStreamBufLen], sizeof(gStreamBuf) - gStreamBufLen );
+        if( readNum > 0 ){
+            gStreamBufLen += readNum;
+            maxM10UbxParse( gStreamBuf, &gStreamBufLen, sizeof(gStreamBuf), maxM10DbdFrameHandler );
+        }
+        else{
+            k_sleep(K_MSEC(20));
+        }
+    }
+
+    // a partial database is not saved, the one in flash (if any) is kept
+    if( !isComplete ){
+        LOG_WRN("Navigation database dump not complete in %d ms, not saved\r\n", MAXM10S_ASSIST_DUMP_MAX_MS);
+        return X_ERR_TIMEOUT;
+    }
+
+    gAssistSaveTime = k_uptime_get();
+
+    if( gAssistBufLen == 0 ){
+        LOG_WRN("No navigation database received\r\n");
+        return X_ERR_NOT_FOUND;
+    }
+
+    // spare the flash if the database did not change since it was saved
+    crc = crc32_ieee( (uint8_t*)gAssistBuf, gAssistBufLen );
+    if( crc == gAssistSavedCrc ){
+        LOG_DBG("Navigation database unchanged, not saved\r\n");
+        return X_ERR_SUCCESS;
+    }
+
+    // littlefs does not truncate when writing a smaller file, so remove the old one first
+    if( xStorageFileExists( maxm10s_dbd_fname ) ){
+        xStorageDeleteFile( maxm10s_dbd_fname );
+    }
+    err = xStorageSaveFile( gAssistBuf, maxm10s_dbd_fname, gAssistBufLen );
+    if( err < 0 ){
+        LOG_ERR("Could not save navigation database: %d\r\n", err);
+        gAssistSavedCrc = 0;
+        return err;
+    }
+    gAssistSavedCrc = crc;
+
+    LOG_INF("Navigation database saved: %d bytes\r\n", gAssistBufLen);
+    return X_ERR_SUCCESS;
+}
+
+
+
+static err_code maxM10AssistRestore(void){
+
+    char keyValues[MAXM10S_CFG_VALSET_MAX_LEN];
+    char body[UBX_MGA_INI_POS_LLH_BODY_LEN];
+    char msg[UBX_MGA_INI_POS_LLH_BODY_LEN + U_UBX_PROTOCOL_OVERHEAD_LENGTH_BYTES];
+    xPosMaxM10Fix_t lastFix;
+    uint32_t val;
+    size_t frameLen;
+    int32_t ret;
+    int32_t timeoutMs;
+    err_code err;
+
+    gAssistApplied = false;
+
+    // AssistNow Autonomous: the receiver predicts orbits from the broadcast ephemeris,
+    // these predictions are part of the navigation database.
+    // The receiver may still be booting: the configuration is sent with a short
+    // response timeout until the receiver answers (ACK or NAK), for up to
+    // MAXM10S_BOOT_TIME_MS from power up. No time is spent if it is already running
+    ret = maxM10CfgValAppend( keyValues, UBX_CFG_KEY_ANA_USE_ANA, 1, 1 );
+    timeoutMs = uGnssGetTimeout( gGnssHandle );
+    uGnssSetTimeout( gGnssHandle, MAXM10S_BOOT_POLL_TIMEOUT_MS );
     while(1){
-        k_sem_take( &RequestCompleteSemaphore, K_FOREVER );
-        k_timer_stop( &timeoutTimer );
+        err = maxM10CfgValSet( keyValues, ret );
+        if( ( err == X_ERR_SUCCESS ) || ( err == X_ERR_INVALID_STATE ) ||
+            ( k_uptime_get() - gPowerOnTime >= MAXM10S_BOOT_TIME_MS ) ){
+            break;
+        }
+        k_sleep(K_MSEC(10));
+    }
+    uGnssSetTimeout( gGnssHandle, timeoutMs );
 
-        // did not obtain position yet, therefore another request or timeout has happened
-        if( positionRequestStatus_t != REQ_STAT_OBTAINED  ){
-            LOG_DBG("No Position Obtained");
-            MaxM10Pack.error = dataErrFetchTimeout;
+    if( err != X_ERR_SUCCESS ){
+        LOG_WRN("Could not enable AssistNow Autonomous\r\n");
+    }
+
+    // last known position: UBX-MGA-INI-POS_LLH
+    // (nothing saved yet on first boot, which is not an error)
+    ret = xStorageFileExists( maxm10s_lastpos_fname ) ? 
+          xStorageReadFile( &lastFix, maxm10s_lastpos_fname, sizeof(lastFix) ) : 0;
+    if( ( ret == sizeof(lastFix) ) && lastFix.isValid ){
+        gAssistSavedFix = lastFix;
+
+        memset( body, 0, sizeof(body) );
+        body[0] = UBX_MGA_INI_POS_LLH_TYPE;
+        val = uUbxProtocolUint32Encode( (uint32_t) lastFix.latitudeX1e7 );
+        memcpy( &body[4], &val, 4 );
+        val = uUbxProtocolUint32Encode( (uint32_t) lastFix.longitudeX1e7 );
+        memcpy( &body[8], &val, 4 );
+        // altitude in cm
+        val = uUbxProtocolUint32Encode( (uint32_t)( ( lastFix.altitudeMillimetres == INT32_MIN ) ? 0 : lastFix.altitudeMillimetres / 10 ) );
+        memcpy( &body[12], &val, 4 );
+        // the device may have moved while off, so a large position accuracy is given (cm)
+        val = uUbxProtocolUint32Encode( MAXM10S_ASSIST_POS_ACC_M * 100 );
+        memcpy( &body[16], &val, 4 );
+
+        ret = uUbxProtocolEncode( UBX_CLASS_MGA, UBX_ID_MGA_INI, body, sizeof(body), msg );
+        if( ( ret > 0 ) && ( uPortUartWrite( gUartHandle, msg, ret ) == ret ) ){
+            gAssistApplied = true;
         }
-        else{ 
-            sprintf( str, "GNSS Position: https://maps.google.com/?q=%3.7f,%3.7f\n",
-                ((double) gLatitudeX1e7) / 10000000,
-               ((double) gLongitudeX1e7) / 10000000); 
-            LOG_INF("%s",str);
+    }
+
+    // navigation database: the file holds complete UBX-MGA-DBD messages
+    ret = xStorageFileExists( maxm10s_dbd_fname ) ? 
+          xStorageReadFile( gAssistBuf, maxm10s_dbd_fname, sizeof(gAssistBuf) ) : 0;
+    if( ret > 0 ){
+        gAssistBufLen = ret;
+        gAssistSavedCrc = crc32_ieee( (uint8_t*)gAssistBuf, gAssistBufLen );
+
+        for( size_t pos = 0; pos + 6 <= gAssistBufLen; pos += frameLen ){
+
+            frameLen = U_UBX_PROTOCOL_OVERHEAD_LENGTH_BYTES + 
+                       ( (uint8_t)gAssistBuf[pos+4] | ( (uint8_t)gAssistBuf[pos+5] << 8 ) );
+            if( pos + frameLen > gAssistBufLen ){
+                break;
+            }
 
-            // prepare data to send
-            MaxM10Pack.error = dataErrOk;
-		    MaxM10Pack.meas[0].data.doubleVal = ((double) gLatitudeX1e7) / 10000000;
-		    MaxM10Pack.meas[1].data.doubleVal = ((double) gLongitudeX1e7) / 10000000;
+            uPortUartWrite( gUartHandle, &gAssistBuf[pos], frameLen );
+            k_sleep(K_MSEC(MAXM10S_DBD_FRAME_DELAY_MS));
         }
 
-        //send data
-		if( gMaxStatus.isPublishEnabled ){			
-			xDataSend(MaxM10Pack);
-		}
+        gAssistApplied = true;
+        LOG_INF("Navigation database restored: %d bytes\r\n", gAssistBufLen);
+    }
 
-        // set the enum before uGnssPosGetStop, otherwise sometimes the start request is called before this is set...
-        // leading to a "New Position Request while previous pending: complete previous" situation, 
-        // probably because uGnssPosGetStop may take some time and yield
-        positionRequestStatus_t = REQ_STAT_COMPLETED; 
-        uGnssPosGetStop( gGnssHandle );
-        gubxlibGnssRequestActive = false;
+    return X_ERR_SUCCESS;
+}
 
-        // check if needs to be suspended
-        if( gMaxStatus.isEnabled == false){
-            k_thread_suspend(maxM10PositionRequestCompleteThread_id);
+
+
+static xPosMaxM10PowerMode_t maxM10ResolvePowerMode(void){
+
+    if( gMaxStatus.powerMode != MAXM10S_PM_AUTO ){
+        return gMaxStatus.powerMode;
+    }
+
+    // Short update periods: the receiver keeps tracking with reduced power.
+    // Long update periods: the receiver is switched off between fixes
+    if( gMaxStatus.updatePeriod < MAXM10S_PM_ONOFF_MIN_PERIOD_MS ){
+        return MAXM10S_PM_CYCLIC;
+    }
+    return MAXM10S_PM_ONOFF;
+}
+
+
+
+static err_code maxM10PowerModeConfig(void){
+
+    char keyValues[MAXM10S_CFG_VALSET_MAX_LEN];
+    size_t len = 0;
+    uint32_t maxAcqTime;
+    err_code err;
+
+    gActivePowerMode = maxM10ResolvePowerMode();
+
+    switch( gActivePowerMode ){
+
+        case MAXM10S_PM_CYCLIC:
+            len += maxM10CfgValAppend( &keyValues[len], UBX_CFG_KEY_PM_OPERATEMODE, UBX_PM_OPERATEMODE_PSMCT, 1 );
+            break;
+
+        case MAXM10S_PM_ONOFF:
+            // wake up once per update period, stay on until a fix is obtained (up to the timeout period)
+            // and switch off right after
+            maxAcqTime = gMaxStatus.timeoutPeriod / 1000;
+            if( maxAcqTime > 255 ){
+                maxAcqTime = 255;
+            }
+            len += maxM10CfgValAppend( &keyValues[len], UBX_CFG_KEY_PM_OPERATEMODE, UBX_PM_OPERATEMODE_PSMOO, 1 );
+            len += maxM10CfgValAppend( &keyValues[len], UBX_CFG_KEY_PM_POSUPDATEPERIOD, gMaxStatus.updatePeriod, 4 );
+            len += maxM10CfgValAppend( &keyValues[len], UBX_CFG_KEY_PM_ONTIME, 0, 2 );
+            len += maxM10CfgValAppend( &keyValues[len], UBX_CFG_KEY_PM_MAXACQTIME, maxAcqTime, 1 );
+            len += maxM10CfgValAppend( &keyValues[len], UBX_CFG_KEY_PM_WAITTIMEFIX, 1, 1 );
+            len += maxM10CfgValAppend( &keyValues[len], UBX_CFG_KEY_PM_UPDATEEPH, 1, 1 );
+            break;
+
+        case MAXM10S_PM_FULL:
+        default:
+            len += maxM10CfgValAppend( &keyValues[len], UBX_CFG_KEY_PM_OPERATEMODE, UBX_PM_OPERATEMODE_FULL, 1 );
+            break;
+    }
+
+    err = maxM10CfgValSet( keyValues, len );
+    if( err != X_ERR_SUCCESS ){
+        LOG_ERR("Could not configure power mode. Err: %d\r\n", err);
+        gActivePowerMode = MAXM10S_PM_FULL;
+        return err;
+    }
+
+    LOG_INF("Power mode: %s\r\n", gPowerModeStr[ gActivePowerMode ] );
+    return X_ERR_SUCCESS;
+}
+
+
+
+static void maxM10PowerModeReapply(void){
+
+    // applied when enabled otherwise
+    if( !gMaxStatus.isEnabled || !gMaxStatus.isUbxInit ){
+        return;
+    }
+
+    if( maxM10PowerModeConfig() != X_ERR_SUCCESS ){
+        LOG_WRN("Continue with full power mode\r\n");
+    }
+}
+
+
+
+static err_code maxM10StreamStart(void){
+
+    err_code err;
+
+    if( gStreamActive ){
+        return X_ERR_SUCCESS;
+    }
+
+    err = maxM10StreamConfig(true);
+    if( err != X_ERR_SUCCESS ){
+        LOG_ERR("Could not configure NAV-PVT stream. Err: %d\r\n", err);
+        maxM10ErrorHandle();
+        return err;
+    }
+
+    gStreamBufLen = 0;
+    gStreamActive = true;
+
+    // from now on MaxM10 output is parsed by maxM10StreamThread
+    err = uPortUartEventCallbackSet( gUartHandle, U_PORT_UART_EVENT_BITMASK_DATA_RECEIVED,
+                                     maxM10UartEventCallback, NULL,
+                                     MAXM10S_STREAM_CB_STACK_SIZE, U_CFG_OS_APP_TASK_PRIORITY );
+    if( err != X_ERR_SUCCESS ){
+        LOG_ERR("Could not set GNSS Uart callback. Err: %d\r\n", err);
+        gStreamActive = false;
+        maxM10StreamConfig(false);
+        maxM10ErrorHandle();
+        return err;
+    }
+
+    LOG_INF("NAV-PVT stream started\r\n");
+    return X_ERR_SUCCESS;
+}
+
+
+
+static void maxM10StreamStop(void){
+
+    if( !gStreamActive ){
+        return;
+    }
+
+    gStreamActive = false;
+    uPortUartEventCallbackRemove( gUartHandle );
+
+    // ubxlib reads the UART again from now on
+    if( maxM10StreamConfig(false) != X_ERR_SUCCESS ){
+        LOG_WRN("Could not stop NAV-PVT stream \r\n");
+    }
+
+    LOG_INF("NAV-PVT stream stopped\r\n");
+}
+
+
+
+static void maxM10UbxParse( char *pBuf, size_t *pBufLen, size_t bufSize,
+                            void (*pFrameHandler)(const char *pFrame, size_t frameLen) ){
+
+    size_t start = 0;
+    size_t frameLen;
+
+    while( start + 1 < *pBufLen ){
+
+        // look for UBX sync chars
+        if( ( pBuf[start] != (char)0xB5 ) || ( pBuf[start+1] != (char)0x62 ) ){
+            start++;
+            continue;
+        }
+
+        // wait for the header to be received
+        if( *pBufLen - start < 6 ){
+            break;
+        }
+
+        frameLen = U_UBX_PROTOCOL_OVERHEAD_LENGTH_BYTES + 
+                   ( (uint8_t)pBuf[start+4] | ( (uint8_t)pBuf[start+5] << 8 ) );
+
+        // not a message we can hold, skip sync chars
+        if( frameLen > bufSize ){
+            start += 2;
+            continue;
+        }
+
+        // wait for the rest of the message
+        if( *pBufLen - start < frameLen ){
+            break;
+        }
+
+        pFrameHandler( &pBuf[start], frameLen );
+        start += frameLen;
+    }
+
+    // discard parsed bytes
+    *pBufLen -= start;
+    memmove( pBuf, &pBuf[start], *pBufLen );
+}
+
+
+
+static bool maxM10NavPvtDecode(const char *pFrame, size_t frameLen){
+
+    char body[UBX_NAV_PVT_BODY_LEN];
+    int32_t msgClass, msgId;
+    int32_t bodyLen;
+    uint8_t fixType, flags;
+
+    bodyLen = uUbxProtocolDecode( pFrame, frameLen, &msgClass, &msgId, body, sizeof(body), NULL );
+
+    if( ( bodyLen != UBX_NAV_PVT_BODY_LEN ) || ( msgClass != UBX_CLASS_NAV ) || ( msgId != UBX_ID_NAV_PVT ) ){
+        return false;
+    }
+
+    fixType = (uint8_t) body[20];
+    flags = (uint8_t) body[21];
+
+    // gnssFixOK and 2D/3D/GNSS+DR fix
+    if( ( flags & 0x01 ) && ( fixType >= 2 ) && ( fixType <= 4 ) ){
+        xPosMaxM10Fix_t fix;
+        fix.fixType = fixType;
+        fix.svs = (uint8_t) body[23];
+        fix.longitudeX1e7 = (int32_t) uUbxProtocolUint32Decode( &body[24] );
+        fix.latitudeX1e7 = (int32_t) uUbxProtocolUint32Decode( &body[28] );
+        fix.altitudeMillimetres = (int32_t) uUbxProtocolUint32Decode( &body[36] );
+        fix.hAccMillimetres = (int32_t) uUbxProtocolUint32Decode( &body[40] );
+        fix.speedMillimetresPerSecond = (int32_t) uUbxProtocolUint32Decode( &body[60] );
+        fix.headingX1e5 = (int32_t) uUbxProtocolUint32Decode( &body[64] );
+        fix.timestamp = k_uptime_get();
+        fix.isValid = true;
+        maxM10LatestFixSet( &fix );
+        maxM10FixTimingUpdate( fix.timestamp );
+        return true;
+    }
+
+    return false;
+}
+
+
+
+static void maxM10NavPvtFrameHandler(const char *pFrame, size_t frameLen){
+
+    // the replayed output goes through the same decoding as the live output
+    if( gReplay.isActive ){
+        maxM10ReplayPace( pFrame, frameLen );
+    }
+
+    if( maxM10NavPvtDecode( pFrame, frameLen ) && gReplay.isActive ){
+        gReplay.fixesNum++;
+    }
+}
+
+
+
+static void maxM10ReplayPace(const char *pFrame, size_t frameLen){
+
+    int32_t msgClass, msgId;
+    uint32_t iTow;
+    int64_t pauseStart;
+
+    gReplay.framesNum++;
+
+    if( ( uUbxProtocolDecode( pFrame, frameLen, &msgClass, &msgId, NULL, 0, NULL ) < 0 ) ||
+        ( msgClass != UBX_CLASS_NAV ) || ( msgId != UBX_ID_NAV_PVT ) ){
+        return;
+    }
+
+    // pace the replay by the time of week of the navigation solutions (first field
+    // of the payload), a week rollover just restarts pacing
+    iTow = uUbxProtocolUint32Decode( &pFrame[6] );
+    if( ( gReplay.speed > 0 ) && gReplay.iTowValid && ( iTow > gReplay.lastITow ) ){
+        pauseStart = k_uptime_ticks();
+        k_sleep(K_MSEC( ( iTow - gReplay.lastITow ) / gReplay.speed ));
+        gReplay.pausedTicks += k_uptime_ticks() - pauseStart;
+    }
+    gReplay.lastITow = iTow;
+    gReplay.iTowValid = true;
+}
+
+
+
+static void maxM10StreamReplay(void){
+
+    char drain[MAXM10S_REPLAY_CHUNK_SIZE];
+    size_t pos, chunk;
+    int64_t startTicks = k_uptime_ticks();
+
+    // bytes of the live output not parsed yet are dropped, the replay starts clean
+    gStreamBufLen = 0;
+
+    // feed the recording to the parser in chunks, the way it is read from the UART
+    for( pos = 0; gReplay.isActive && gStreamActive && ( pos < gReplayBufLen ); pos += chunk ){
+
+        // MaxM10 output received meanwhile is read but not used
+        while( uPortUartRead( gUartHandle, drain, sizeof(drain) ) > 0 ){
         }
+
+        chunk = MIN( MAXM10S_REPLAY_CHUNK_SIZE, gReplayBufLen - pos );
+        chunk = MIN( chunk, sizeof(gStreamBuf) - gStreamBufLen );
+
+        memcpy( &gStreamBuf[gStreamBufLen], &gReplayBuf[pos], chunk );
+        gStreamBufLen += chunk;
+        gReplay.bytesNum += chunk;
+
+        maxM10UbxParse( gStreamBuf, &gStreamBufLen, sizeof(gStreamBuf), maxM10NavPvtFrameHandler );
+
+        // let the rest of the system run when replaying as fast as possible
+        k_yield();
     }
-}
 
+    gStreamBufLen = 0;
+    gReplay.parseTimeUs = (uint32_t) k_ticks_to_us_floor64( k_uptime_ticks() - startTicks - gReplay.pausedTicks );
+    gReplay.isActive = false;
 
+    LOG_INF("Replay complete: %d bytes, %d UBX messages, %d fixes, parse time: %d us\r\n",
+            gReplay.bytesNum, gReplay.framesNum, gReplay.fixesNum, gReplay.parseTimeUs);
+}
 
-void maxM10PositionRequestStartThread(void)
-{
-    int32_t err;
-    
-	while(1){
 
-        if( ! gMaxStatus.isUbxInit ){
-            LOG_WRN("Max not initialized \r\n");
-            MaxM10Pack.error = dataErrNotInit;
-            //xPosMaxM10Disable();
-            //todo: Handling?
-        }
 
-        if( positionRequestStatus_t != REQ_STAT_COMPLETED ){
-            
-            LOG_WRN("New Position Request while previous pending: complete previous\r\n");
-            // force previous request to complete
-            k_sem_give( &RequestCompleteSemaphore );
-        }
+void maxM10StreamThread(void){
 
-        //wait for previous request to close
-        while( gubxlibGnssRequestActive ){
-            // no active request should exist at this point, however sometimes we may need to wait a bit
-            // for the request to close
-            k_yield();
-        }
+    int32_t readNum;
 
-        err = uGnssPosGetStart( gGnssHandle, gnssPosCallback);
-        if ( err == 0 ) {
+    while(1){
+        k_sem_take( &StreamDataSemaphore, K_FOREVER );
 
-            LOG_DBG("Position Start Request\r\n");
-            positionRequestStatus_t = REQ_STAT_PENDING;
-            gubxlibGnssRequestActive = true;
-            
-            // set a timeout period for this request
-            if( gMaxStatus.timeoutPeriod >0 ){
-                k_timer_start(&timeoutTimer, K_MSEC(gMaxStatus.timeoutPeriod), K_NO_WAIT );
-            }
+        // while replaying, the recording is parsed instead of the MaxM10 output
+        if( gReplay.isActive ){
+            maxM10StreamReplay();
+            continue;
         }
-        else{
-            LOG_ERR("Position Start Request Error: %d  Abort this request\r\n", err);
-            MaxM10Pack.error = dataErrFetchFail;
-            if( gMaxStatus.isPublishEnabled ){
-                xDataSend(MaxM10Pack);
+
+        // read everything available in the uart buffer
+        do{
+            if( !gStreamActive || gReplay.isActive ){
+                break;
             }
-            // try again at next sampling period
-        }
-    
-        k_sleep(K_MSEC(gMaxStatus.updatePeriod));
-	}
 
+            readNum = uPortUartRead( gUartHandle, &gStreamBuf[gStreamBufLen], sizeof(gStreamBuf) - gStreamBufLen );
+            if( readNum > 0 ){
+
+                if( gReplay.isRecording ){
+                    size_t recNum = MIN( (size_t) readNum, sizeof(gReplayBuf) - gReplayBufLen );
+                    memcpy( &gReplayBuf[gReplayBufLen], &gStreamBuf[gStreamBufLen], recNum );
+                    gReplayBufLen += recNum;
+                }
+
+                gStreamBufLen += readNum;
+                maxM10UbxParse( gStreamBuf, &gStreamBufLen, sizeof(gStreamBuf), maxM10NavPvtFrameHandler );
+            }
+        }while( readNum > 0 );
+    }
 }
 
 
 
-void maxM10PositionTimeoutHandler(struct k_timer *dummy){
+void maxM10RecordThread(void){
 
-    LOG_WRN("Position Request Timeout");
-    // force previous request to complete
-    k_sem_give( &RequestCompleteSemaphore );
+    err_code err;
+
+    while(1){
+        k_sem_take( &RecordStartSemaphore, K_FOREVER );
 
+        // the stream thread records, until the time is up or the buffer is full
+        while( gStreamActive && ( k_uptime_get() < gReplay.recordEnd ) && 
+               ( gReplayBufLen < sizeof(gReplayBuf) ) ){
+            k_sleep(K_MSEC(100));
+        }
+        gReplay.isRecording = false;
+
+        // littlefs does not truncate when writing a smaller file, so remove the old one first
+        if( xStorageFileExists( maxm10s_replay_fname ) ){
+            xStorageDeleteFile( maxm10s_replay_fname );
+        }
+        err = xStorageSaveFile( gReplayBuf, maxm10s_replay_fname, gReplayBufLen );
+        if( err < 0 ){
+            LOG_ERR("Could not save recording: %d\r\n", err);
+            continue;
+        }
+
+        LOG_INF("Recording saved: %d bytes\r\n", gReplayBufLen);
+    }
 }
 
 
@@ -816,4 +2754,316 @@ void xPosMaxM10TimeoutPeriodCmd(const struct shell *shell, size_t argc, char **a
 
 
 		return;
-}
\ No newline at end of file
+}
+
+
+
+void xPosMaxM10SetModeCmd(const struct shell *shell, size_t argc, char **argv){
+
+        err_code err;
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");  
+            return;
+        }
+
+		if( strcmp(argv[1], "request") == 0 ){
+			err = xPosMaxM10SetMode(MAXM10S_MODE_REQUEST);
+		}
+		
+		else if( strcmp(argv[1], "stream") == 0 ){
+			err = xPosMaxM10SetMode(MAXM10S_MODE_STREAM);
+        }
+
+        else{
+            shell_print(shell, "Invalid parameter (request/stream)\r\n");  
+            return;
+		}
+
+        if( err != X_ERR_SUCCESS ){
+            shell_print(shell, "%sCould not set MaxM10S mode: %d %s\r\n",LOG_CLRCODE_RED, err, LOG_CLRCODE_DEFAULT );
+        }
+
+		return;
+}
+
+
+
+void xPosMaxM10AccuracyThresholdCmd(const struct shell *shell, size_t argc, char **argv){
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");  
+            return;
+        }
+
+        if( xPosMaxM10SetAccuracyThreshold( atoi(argv[1]) ) == X_ERR_SUCCESS ){
+		    shell_print(shell, "MaxM10S Accuracy Threshold Set to %d mm", gMaxStatus.accuracyThreshold);
+        }
+
+		return;
+}
+
+
+
+void xPosMaxM10SetPowerModeCmd(const struct shell *shell, size_t argc, char **argv){
+
+        err_code err = X_ERR_INVALID_PARAMETER;
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");  
+            return;
+        }
+
+        for( int mode = MAXM10S_PM_FULL; mode <= MAXM10S_PM_AUTO; mode++ ){
+            if( strcmp(argv[1], gPowerModeStr[mode]) == 0 ){
+                err = xPosMaxM10SetPowerMode( (xPosMaxM10PowerMode_t)mode );
+                break;
+            }
+        }
+
+        if( err == X_ERR_INVALID_PARAMETER ){
+            shell_print(shell, "Invalid parameter (full/cyclic/onoff/auto)\r\n");
+        }
+        else if( err != X_ERR_SUCCESS ){
+            shell_print(shell, "%sCould not set MaxM10S power mode: %d %s\r\n",LOG_CLRCODE_RED, err, LOG_CLRCODE_DEFAULT );
+        }
+        else{
+            shell_print(shell, "MaxM10S Power Mode Set to %s", gPowerModeStr[ gMaxStatus.powerMode ]);
+        }
+
+		return;
+}
+
+
+
+void xPosMaxM10FixStatsCmd(const struct shell *shell, size_t argc, char **argv){
+
+        ARG_UNUSED(argc);
+        ARG_UNUSED(argv);
+
+        xPosMaxM10FixStats_t stats = xPosMaxM10GetFixStats();
+
+        shell_print(shell, "\r\n\
+MAXM10S Fix Statistics -----------------\r\n\
+        - Active Power Mode: %s\r\n\
+        - Time to first fix: %d ms\r\n\
+        - Requests with fix: %d\r\n\
+        - Last time to fix: %d ms\r\n\
+        - Average time to fix: %d ms\r\n\
+        - Estimated receiver on-time per fix: %d ms\r\n\
+        - Assistance data applied at power up: %s\r\n\
+        - Last TTFF after power up with assistance: %d ms\r\n\
+        - Last TTFF after power up without assistance: %d ms\r\n",
+        gPowerModeStr[ stats.activePowerMode ],
+        stats.ttffMs, stats.fixNum, stats.lastTtfMs, stats.avgTtfMs,
+        stats.estOnTimePerFixMs,
+        stats.assistApplied ? "Yes" : "No",
+        stats.assistedTtffMs, stats.unassistedTtffMs);
+
+		return;
+}
+
+
+
+void xPosMaxM10AssistCmd(const struct shell *shell, size_t argc, char **argv){
+
+        err_code err;
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");  
+            return;
+        }
+
+		if( strcmp(argv[1], "save") == 0 ){
+			err = xPosMaxM10AssistSave();
+            if( err != X_ERR_SUCCESS ){
+                shell_print(shell, "%sCould not save assistance data: %d %s\r\n",LOG_CLRCODE_RED, err, LOG_CLRCODE_DEFAULT );
+            }
+		}
+		
+		else if( strcmp(argv[1], "clear") == 0 ){
+			xPosMaxM10AssistClear();
+        }
+
+        else{
+            shell_print(shell, "Invalid parameter (save/clear)\r\n");  
+		}
+
+		return;
+}
+
+
+
+void xPosMaxM10TrackEnableCmd(const struct shell *shell, size_t argc, char **argv){
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");  
+            return;
+        }
+
+		if( strcmp(argv[1], "on") == 0 ){
+			xPosMaxM10TrackEnable(true);
+		}
+		
+		else if( strcmp(argv[1], "off") == 0 ){
+			xPosMaxM10TrackEnable(false);
+        }
+
+        else{
+            shell_print(shell, "Invalid parameter (on/off)\r\n");  
+		}
+
+		return;
+}
+
+
+
+void xPosMaxM10TrackToleranceCmd(const struct shell *shell, size_t argc, char **argv){
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");  
+            return;
+        }
+
+        if( xPosMaxM10TrackSetTolerance( atoi(argv[1]) ) == X_ERR_SUCCESS ){
+		    shell_print(shell, "MaxM10S Track Tolerance Set to %d m", gTrack.toleranceMetres);
+        }
+
+		return;
+}
+
+
+
+void xPosMaxM10TrackPeriodCmd(const struct shell *shell, size_t argc, char **argv){
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");  
+            return;
+        }
+
+        if( xPosMaxM10TrackSetFlushPeriod( atoi(argv[1]) ) == X_ERR_SUCCESS ){
+		    shell_print(shell, "MaxM10S Track Period Set to %d ms", gTrack.flushPeriod);
+        }
+
+		return;
+}
+
+
+
+void xPosMaxM10TrackFlushCmd(const struct shell *shell, size_t argc, char **argv){
+
+        ARG_UNUSED(argc);
+        ARG_UNUSED(argv);
+
+        xPosMaxM10TrackFlush();
+
+		return;
+}
+
+
+
+void xPosMaxM10TrackStatsCmd(const struct shell *shell, size_t argc, char **argv){
+
+        ARG_UNUSED(argc);
+        ARG_UNUSED(argv);
+
+        xPosMaxM10TrackStats_t stats = xPosMaxM10GetTrackStats();
+        // published points vs fixes obtained, for the fixes already published
+        uint32_t fixesOut = stats.fixesIn - stats.bufferedNum;
+
+        shell_print(shell, "\r\n\
+MAXM10S Track --------------------------\r\n\
+        - Track buffer: %s\r\n\
+        - Tolerance: %d m\r\n\
+        - Period: %d ms\r\n\
+        - Fixes buffered now: %d\r\n\
+        - Fixes obtained: %d\r\n\
+        - Points published: %d\r\n\
+        - Point reduction: %d %%\r\n\
+        - Max deviation of dropped fixes: %d.%02d m\r\n",
+        stats.isEnabled ? "Enabled" : "Disabled",
+        stats.toleranceMetres, stats.flushPeriod, stats.bufferedNum,
+        stats.fixesIn, stats.pointsSent,
+        ( fixesOut > stats.pointsSent ) ? (int)( 100 - ( 100 * (uint64_t) stats.pointsSent ) / fixesOut ) : 0,
+        stats.maxDeviationCm / 100, stats.maxDeviationCm % 100);
+
+		return;
+}
+
+
+
+void xPosMaxM10ReplayRecordCmd(const struct shell *shell, size_t argc, char **argv){
+
+        err_code err;
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");  
+            return;
+        }
+
+        err = xPosMaxM10ReplayRecord( atoi(argv[1]) );
+        if( err != X_ERR_SUCCESS ){
+            shell_print(shell, "%sCould not record MAXM10S output: %d%s\r\n",LOG_CLRCODE_RED, err, LOG_CLRCODE_DEFAULT );
+        }
+
+		return;
+}
+
+
+
+void xPosMaxM10ReplayStartCmd(const struct shell *shell, size_t argc, char **argv){
+
+        err_code err;
+
+        if(argc!=2){
+            shell_print(shell, "Invalid number of parameters\r\n");  
+            return;
+        }
+
+        err = xPosMaxM10ReplayStart( atoi(argv[1]) );
+        if( err != X_ERR_SUCCESS ){
+            shell_print(shell, "%sCould not start replay: %d%s\r\n",LOG_CLRCODE_RED, err, LOG_CLRCODE_DEFAULT );
+        }
+
+		return;
+}
+
+
+
+void xPosMaxM10ReplayStopCmd(const struct shell *shell, size_t argc, char **argv){
+
+        ARG_UNUSED(shell);
+        ARG_UNUSED(argc);
+        ARG_UNUSED(argv);
+
+        xPosMaxM10ReplayStop();
+
+		return;
+}
+
+
+
+void xPosMaxM10ReplayStatsCmd(const struct shell *shell, size_t argc, char **argv){
+
+        ARG_UNUSED(argc);
+        ARG_UNUSED(argv);
+
+        xPosMaxM10ReplayStats_t stats = xPosMaxM10GetReplayStats();
+
+        shell_print(shell, "\r\n\
+MAXM10S Replay -------------------------\r\n\
+        - Status: %s\r\n\
+        - Speed: %d (0 = max)\r\n\
+        - Recording size: %d bytes\r\n\
+        - Bytes replayed: %d\r\n\
+        - UBX messages: %d\r\n\
+        - Fixes: %d\r\n\
+        - Parse time: %d us\r\n\
+        - Throughput: %d bytes/s\r\n",
+        stats.isActive ? "Replaying" : ( stats.isRecording ? "Recording" : "Idle" ),
+        stats.speed, stats.recordingSize, stats.bytesNum, stats.framesNum, stats.fixesNum,
+        stats.parseTimeUs,
+        ( stats.parseTimeUs > 0 ) ? (int)( ( 1000000 * (uint64_t) stats.bytesNum ) / stats.parseTimeUs ) : 0);
+
+		return;
+}
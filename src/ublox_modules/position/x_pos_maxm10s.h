@@ -50,6 +50,87 @@
  * TYPE DEFINITIONS
  * -------------------------------------------------------------- */
 
+/** Enum describing how position is obtained from MaxM10S.
+ */
+typedef enum{
+    MAXM10S_MODE_REQUEST = 0,   /**< A position request is started (and stopped) via ubxlib 
+                                     every update period (default mode) */
+    MAXM10S_MODE_STREAM         /**< MaxM10S outputs UBX-NAV-PVT periodically, which is parsed
+                                     continuously. The latest fix is published every update period */
+}xPosMaxM10Mode_t;
+
+
+/** Enum describing the power mode of MaxM10S receiver (UBX-CFG-PM).
+ */
+typedef enum{
+    MAXM10S_PM_FULL = 0,   /**< Receiver always fully on (default) */
+    MAXM10S_PM_CYCLIC,     /**< Cyclic tracking: receiver keeps tracking with reduced power */
+    MAXM10S_PM_ONOFF,      /**< On/Off: receiver wakes up once per update period, obtains a fix
+                                (within the timeout period) and switches off */
+    MAXM10S_PM_AUTO        /**< Cyclic tracking or On/Off is selected based on the update period */
+}xPosMaxM10PowerMode_t;
+
+
+/** Struct type that holds time to fix statistics and the estimated receiver on-time.
+ */
+typedef struct{
+    xPosMaxM10PowerMode_t activePowerMode;  /**< Power mode configured in the receiver (auto resolved) */
+    uint32_t ttffMs;                        /**< Time to first fix since the module was enabled (0: no fix yet) */
+    uint32_t lastTtfMs;                     /**< Time to fix of the last position request (request mode) */
+    uint32_t avgTtfMs;                      /**< Average time to fix of position requests (request mode) */
+    uint32_t fixNum;                        /**< Number of position requests that obtained a fix */
+    uint32_t estOnTimePerFixMs;             /**< Estimated receiver on-time per fix */
+    bool assistApplied;                     /**< Assistance data were fed to the receiver at the last power up */
+    uint32_t assistedTtffMs;                /**< Last time to first fix after power up with assistance data (0: none yet) */
+    uint32_t unassistedTtffMs;              /**< Last time to first fix after power up without assistance data (0: none yet) */
+}xPosMaxM10FixStats_t;
+
+
+/** Struct type that holds a navigation solution (position fix) obtained from MaxM10S.
+ * All values are kept in the integer scaling they are reported by the module.
+ */
+typedef struct{
+    bool isValid;                       /**< A valid fix has been obtained */
+    int64_t timestamp;                  /**< Uptime (ms) when the fix was obtained */
+    int32_t latitudeX1e7;               /**< Latitude in degrees x1e7 */
+    int32_t longitudeX1e7;              /**< Longitude in degrees x1e7 */
+    int32_t altitudeMillimetres;        /**< Altitude above mean sea level, INT32_MIN if not available */
+    int32_t hAccMillimetres;            /**< Horizontal accuracy estimate (radius) */
+    int32_t speedMillimetresPerSecond;  /**< Ground speed */
+    int32_t headingX1e5;                /**< Heading of motion in degrees x1e5, INT32_MIN if not available */
+    uint8_t fixType;                    /**< 2 = 2D fix, 3 = 3D fix, 4 = GNSS + dead reckoning */
+    uint8_t svs;                        /**< Number of satellites used in the solution */
+}xPosMaxM10Fix_t;
+
+
+/** Struct type that holds the track buffer settings and statistics.
+ */
+typedef struct{
+    bool isEnabled;             /**< Fixes are buffered and published as a simplified track */
+    uint32_t toleranceMetres;   /**< Max deviation of the published track from the buffered fixes */
+    uint32_t flushPeriod;       /**< Period (ms) in which the track is published */
+    uint16_t bufferedNum;       /**< Points currently in the track buffer */
+    uint32_t fixesIn;           /**< Fixes given to the track buffer since it was enabled */
+    uint32_t pointsSent;        /**< Track points published since it was enabled */
+    uint32_t maxDeviationCm;    /**< Max distance of a dropped fix from the published track (cm),
+                                     should stay within toleranceMetres */
+}xPosMaxM10TrackStats_t;
+
+
+/** Struct type that holds the replay status and statistics.
+ */
+typedef struct{
+    bool isActive;              /**< A recording is being replayed */
+    bool isRecording;           /**< MaxM10 output is being recorded */
+    uint32_t speed;             /**< Replay speed: 1 = real time, N = N times faster, 0 = as fast as possible */
+    uint32_t recordingSize;     /**< Size of the recording (bytes) */
+    uint32_t bytesNum;          /**< Bytes replayed */
+    uint32_t framesNum;         /**< UBX messages found in the replayed bytes */
+    uint32_t fixesNum;          /**< Position fixes obtained from the replayed bytes */
+    uint32_t parseTimeUs;       /**< Time spent in parsing (excluding the real time pacing) */
+}xPosMaxM10ReplayStats_t;
+
+
 /** Struct type that describes MaxM10S status.
  */
 typedef struct{
@@ -63,6 +144,10 @@ typedef struct{
     uint32_t timeoutPeriod;      /**< Timeout period for MaxM10 to respond with a position fix, since it is requested
                                     Timeout period should not be higher than updatePeriod*/
     xSerialCommOption_t com;    /**< Indicates which MaxM10 Uart Com is active: UART to USB or UART connected to NORA-B1*/
+    xPosMaxM10Mode_t mode;      /**< Position acquisition mode: per sample request or continuous streaming */
+    uint32_t accuracyThreshold; /**< Fixes with horizontal accuracy worse than this (in mm) are not published,
+                                     an accuracy error is reported instead. Zero disables the check */
+    xPosMaxM10PowerMode_t powerMode; /**< Receiver power mode setting */
 }xPosMaxM10Status_t;
 
 
@@ -191,6 +276,175 @@ void xPosMaxM10Disable(void);
 
 
 
+/** Sets the way position is obtained from MaxM10S (see xPosMaxM10Mode_t).
+ * In MAXM10S_MODE_STREAM the module is configured to output UBX-NAV-PVT every
+ * MAXM10S_STREAM_NAV_RATE_MS and the latest fix is published every update period. 
+ * If the latest fix is older than the timeout period, a timeout error is reported instead.
+ * If MaxM10 is enabled the new mode takes effect immediately, else it takes effect
+ * when the module is enabled.
+ * Cannot be accessed when the main Sensor Aggregation function is active. 
+ *
+ * @param mode    the requested position acquisition mode.
+ * @return        zero on success else negative error code.
+ */
+err_code xPosMaxM10SetMode(xPosMaxM10Mode_t mode);
+
+
+
+/** Sets the horizontal accuracy threshold of position fixes. A fix with a 
+ * horizontal accuracy estimate worse than this threshold is not published, 
+ * an accuracy error (dataErrLowAccuracy) is reported instead.
+ *
+ * @param millimetres  the accuracy threshold in mm. Zero disables the check.
+ * @return             zero on success else negative error code.
+ */
+err_code xPosMaxM10SetAccuracyThreshold(uint32_t millimetres);
+
+
+
+/** Sets the power mode of MaxM10S receiver. The power mode is configured in the
+ * receiver (RAM) every time the module is enabled, based on the update and timeout
+ * period. If the module is enabled, sampling is restarted to apply the new mode.
+ * In MAXM10S_PM_AUTO mode, cyclic tracking is used for update periods shorter than
+ * MAXM10S_PM_ONOFF_MIN_PERIOD_MS and On/Off operation for longer ones.
+ *
+ * @param mode    the requested power mode.
+ * @return        zero on success else negative error code.
+ */
+err_code xPosMaxM10SetPowerMode(xPosMaxM10PowerMode_t mode);
+
+
+
+/** Saves the MaxM10S navigation database (UBX-MGA-DBD) and the last position fix
+ * in NORA-B1 flash. These are fed back to MaxM10S the next time it is powered up
+ * to shorten the time to first fix. This is also done automatically by
+ * xPosMaxM10PowerOff. If MaxM10S is enabled, sampling is paused during the save.
+ *
+ * @return        zero on success else negative error code.
+ */
+err_code xPosMaxM10AssistSave(void);
+
+
+
+/** Deletes any MaxM10S assistance data (navigation database, last position)
+ * saved in NORA-B1 flash.
+ *
+ * @return        zero on success else negative error code.
+ */
+err_code xPosMaxM10AssistClear(void);
+
+
+
+/** Returns the time to fix statistics of MaxM10S and the estimated receiver on-time
+ * per fix for the active power mode.
+ *
+ * @return        a structure containing the statistics.
+ */
+xPosMaxM10FixStats_t xPosMaxM10GetFixStats(void);
+
+
+
+/** Returns the last valid position fix obtained from MaxM10S (in any mode).
+ *
+ * @param pFix    [Output] the last position fix. If no fix has been obtained 
+ *                yet, pFix->isValid is false.
+ */
+void xPosMaxM10GetLastFix(xPosMaxM10Fix_t *pFix);
+
+
+
+/** Enables/disables the track buffer. When enabled (and Sensor Aggregation function
+ * is not active), fixes are not published one by one. They are kept in a ring buffer
+ * instead, dropping fixes within the tolerance of the previous one (stationary), and
+ * every flush period the buffer is simplified (Douglas-Peucker) and published as one
+ * encoded polyline. Disabling publishes any buffered fixes.
+ * Cannot be changed while the Main Sensor Aggregation Function is active.
+ *
+ * @param enable  [true] = enables track buffer, [false] = disables track buffer
+ * @return        zero on success else negative error code.
+ */
+err_code xPosMaxM10TrackEnable(bool enable);
+
+
+
+/** Sets the tolerance of the track simplification: the published track does not
+ * deviate more than this from the fixes obtained.
+ *
+ * @param metres  Tolerance in metres.
+ * @return        zero on success else negative error code.
+ */
+err_code xPosMaxM10TrackSetTolerance(uint32_t metres);
+
+
+
+/** Sets the period in which the track is published. The track is also published
+ * when the track buffer is full.
+ *
+ * @param milliseconds  Flush period.
+ * @return              zero on success else negative error code.
+ */
+err_code xPosMaxM10TrackSetFlushPeriod(uint32_t milliseconds);
+
+
+
+/** Publishes the buffered fixes as a track now.
+ *
+ * @return        zero on success else negative error code.
+ */
+err_code xPosMaxM10TrackFlush(void);
+
+
+
+/** Returns the track buffer settings and statistics.
+ *
+ * @return        a structure containing the track settings and statistics.
+ */
+xPosMaxM10TrackStats_t xPosMaxM10GetTrackStats(void);
+
+
+
+/** Records the output of MaxM10 (as received from the UART) in NORA-B1 flash,
+ * to be replayed later by xPosMaxM10ReplayStart. MaxM10 should be in stream mode.
+ * Returns immediately: the recording is saved by a worker thread when complete
+ * (see xPosMaxM10GetReplayStats).
+ *
+ * @param seconds  Recording duration. Recording also stops when MAXM10S_REPLAY_BUF_SIZE
+ *                 bytes have been recorded.
+ * @return         zero on success else negative error code.
+ */
+err_code xPosMaxM10ReplayRecord(uint32_t seconds);
+
+
+
+/** Replays the recording saved in flash: the stream thread feeds the recorded
+ * bytes to the same parser and UBX-NAV-PVT decoding as the MaxM10 output, which is
+ * read but not used meanwhile. The fixes replayed are published as the latest fix.
+ * MaxM10 should be in stream mode (in request mode the UART is read by ubxlib, so
+ * a recording cannot be fed to it). Recorded messages other than UBX (e.g. NMEA)
+ * are skipped by the parser, as in stream mode.
+ *
+ * @param speed    1: real time (as paced by the UBX-NAV-PVT time of week), N: N times faster,
+ *                 0: as fast as possible (parser throughput).
+ * @return         zero on success else negative error code.
+ */
+err_code xPosMaxM10ReplayStart(uint32_t speed);
+
+
+
+/** Stops an active replay. MaxM10 output is used again.
+ */
+void xPosMaxM10ReplayStop(void);
+
+
+
+/** Returns the replay status and statistics of the last replay.
+ *
+ * @return        a structure containing the replay status and statistics.
+ */
+xPosMaxM10ReplayStats_t xPosMaxM10GetReplayStats(void);
+
+
+
 /** Enables/Disables the publish of position to MQTT(SN). In order for
  * the position to be actually published, an MQTT(SN) connection should be active
  * via the MQTT module.
@@ -257,6 +511,165 @@ void xPosMaxM10UpdatePeriodCmd(const struct shell *shell, size_t argc, char **ar
 void xPosMaxM10TimeoutPeriodCmd(const struct shell *shell, size_t argc, char **argv);
 
 
+/** This function is intented only to be used as a command executed by the shell.
+ * It sets the position acquisition mode of the module using the string
+ * parameters "request", "stream"
+ * Shell Command Example: modules MAXM10S set_mode stream
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10SetModeCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It sets the horizontal accuracy threshold (in mm) above which position fixes
+ * are not published. Zero disables the check.
+ * Shell Command Example: modules MAXM10S set_accuracy 5000
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10AccuracyThresholdCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It sets the receiver power mode using the string parameters "full", "cyclic",
+ * "onoff", "auto"
+ * Shell Command Example: modules MAXM10S set_power_mode auto
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10SetPowerModeCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It types the time to fix statistics and the estimated receiver on-time per fix.
+ * Shell Command Example: modules MAXM10S fix_stats
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10FixStatsCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It saves/clears the MaxM10S assistance data in NORA-B1 flash using the string
+ * parameters "save", "clear"
+ * Shell Command Example: modules MAXM10S assist save
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10AssistCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It enables/disables the track buffer using the string parameters "on", "off"
+ * Shell Command Example: modules MAXM10S track enable on
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10TrackEnableCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It sets the track simplification tolerance in metres
+ * Shell Command Example: modules MAXM10S track set_tolerance 10
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10TrackToleranceCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It sets the track publish period in milliseconds
+ * Shell Command Example: modules MAXM10S track set_period 600000
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10TrackPeriodCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It publishes the buffered track now
+ * Shell Command Example: modules MAXM10S track flush
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10TrackFlushCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It types the track settings and statistics (point reduction)
+ * Shell Command Example: modules MAXM10S track stats
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10TrackStatsCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It records the MaxM10S output in flash for the given duration in seconds
+ * Shell Command Example: modules MAXM10S replay record 60
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10ReplayRecordCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It replays the recording in flash at the given speed (1 = real time, 0 = max)
+ * Shell Command Example: modules MAXM10S replay start 10
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10ReplayStartCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It stops an active replay
+ * Shell Command Example: modules MAXM10S replay stop
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10ReplayStopCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It types the replay status and statistics (parser throughput)
+ * Shell Command Example: modules MAXM10S replay stats
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command.
+ * @param argv   the array including the parameters themselves.
+ */
+void xPosMaxM10ReplayStatsCmd(const struct shell *shell, size_t argc, char **argv);
+
+
 
 
 #endif // X_POS_MAXM10S_H__
\ No newline at end of file
@@ -0,0 +1,509 @@
+/*
+ * Copyright 2022 u-blox Ltd
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ * @brief This file contains the implementation of the WiFi connection
+ * state machine used in Sensor Aggregation use case (XPLR-IOT-1)
+ */
+
+#include "x_wifi_conn.h"
+
+#include <zephyr.h>
+#include <logging/log.h>
+#include <random/rand32.h>  //sys_rand32_get
+
+#include "ubxlib.h"
+
+#include "x_logging.h"
+#include "x_system_conf.h"
+#include "x_module_common.h"
+#include "x_wifi_ninaW156.h"
+#include "x_wifi_mqtt.h"
+
+
+/* ----------------------------------------------------------------
+ * TYPE DEFINITIONS
+ * -------------------------------------------------------------- */
+
+/** Message posted to the state machine queue */
+typedef struct{
+    xWifiConnEvent_t event;
+    xWifiConnState_t target;    /**< WIFI_CONN_EVT_REQUEST only */
+    err_code err;               /**< WIFI_CONN_EVT_ERROR only */
+}wifiConnMsg_t;
+
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTION DECLARATION
+ * -------------------------------------------------------------- */
+
+/** State machine thread. Handles the events posted to the queue */
+void xWifiConnThread(void);
+
+/** Returns the current connection state, as reported by NINA and MQTT modules */
+static xWifiConnState_t wifiConnGetState(void);
+
+/** Starts the next bring-up step, or completes the request if the
+ * requested state has been reached */
+static void wifiConnAdvance(void);
+
+/** Completes the active request with the given result */
+static void wifiConnComplete(err_code err);
+
+/** Schedules the next reconnection attempt after the current backoff delay
+ * (randomized) and doubles the backoff */
+static void wifiConnScheduleReconnect(void);
+
+/** Starts a reconnection attempt: closes the disconnected MQTT client and
+ * brings the connection up again */
+static void wifiConnReconnect(void);
+
+/** Reconnection timer expiry. Posts WIFI_CONN_EVT_RECONNECT */
+static void wifiConnReconnectTimerCb(struct k_timer *timer);
+
+
+/* ----------------------------------------------------------------
+ * ZEPHYR RELATED DEFINITIONS/DECLARATIONS
+ * -------------------------------------------------------------- */
+
+LOG_MODULE_REGISTER(LOGMOD_NAME_WIFI_CONN, LOG_LEVEL_DBG);
+
+// Events posted to the state machine
+K_MSGQ_DEFINE(xWifiConnMsgq, sizeof(wifiConnMsg_t), WIFI_CONN_QUEUE_SIZE, 4);
+
+// Given when a request completes
+K_SEM_DEFINE(xWifiConnDone_semaphore, 0, 1);
+
+// Reconnection backoff
+K_TIMER_DEFINE(xWifiConnReconnectTimer, wifiConnReconnectTimerCb, NULL);
+
+K_THREAD_DEFINE(xWifiConnThreadID, WIFI_CONN_STACK_SIZE, xWifiConnThread, NULL, NULL, NULL,
+		WIFI_CONN_PRIORITY, 0, 0);
+
+
+/* ----------------------------------------------------------------
+ * GLOBALS
+ * -------------------------------------------------------------- */
+
+/** State machine status */
+static struct{
+    bool isPending;                 /**< A request is in progress */
+    xWifiConnState_t target;        /**< State requested */
+    int stepFrom;                   /**< State from which the running step was started, -1 if none */
+    err_code lastResult;
+    bool isTiming;                  /**< Bring-up timing in progress (until first publish) */
+    int64_t requestTime;            /**< Uptime (ms) of the bring-up request */
+    bool isSupervised;              /**< MQTT connection supervised (reconnect on broker drop) */
+    bool isReconnecting;            /**< Broker connection lost, reconnection in progress */
+    uint32_t backoffMs;             /**< Delay before the next reconnection attempt (before jitter) */
+    int64_t downTime;               /**< Uptime (ms) of the broker drop */
+}gConn = { .isPending = false, .stepFrom = -1, .lastResult = X_ERR_SUCCESS, .isTiming = false,
+           .isSupervised = false, .isReconnecting = false, .backoffMs = MQTT_RECONNECT_BACKOFF_MIN_MS };
+
+/** Timing of the last bring-up and reconnection statistics */
+static xWifiConnStats_t gConnStats = {0};
+
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTION IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+static xWifiConnState_t wifiConnGetState(void){
+
+    xWifiNinaStatus_t nina_status = xWifiNinaGetModuleStatus();
+    xClientStatusStruct_t mqtt_status = xWifiMqttClientGetStatus();
+
+    if( mqtt_status.status == ClientConnected ){
+        return WIFI_CONN_STATE_MQTT_CONNECTED;
+    }
+    if( mqtt_status.status == ClientOpen ){
+        return WIFI_CONN_STATE_MQTT_OPEN;
+    }
+    if( nina_status.isConnected ){
+        return WIFI_CONN_STATE_NETWORK_UP;
+    }
+    if( nina_status.uStatus >= uDeviceOpened ){
+        return WIFI_CONN_STATE_INITIALIZED;
+    }
+    return WIFI_CONN_STATE_OFF;
+}
+
+
+
+static void wifiConnComplete(err_code err){
+
+    gConn.isPending = false;
+    gConn.stepFrom = -1;
+    gConn.lastResult = err;
+    gConnStats.lastResult = err;
+
+    if( err != X_ERR_SUCCESS ){
+        gConn.isTiming = false;
+        LOG_ERR("WiFi bring-up failed: %d\r\n", err);
+    }
+    // supervise the broker connection from now on
+    else if( gConn.target == WIFI_CONN_STATE_MQTT_CONNECTED ){
+        gConn.isSupervised = true;
+    }
+
+    k_sem_give( &xWifiConnDone_semaphore );
+}
+
+
+
+static void wifiConnScheduleReconnect(void){
+
+    // randomize between half and the full backoff, so that devices dropped
+    // by the same broker outage do not reconnect all at once
+    uint32_t half = gConn.backoffMs / 2;
+    uint32_t delay = half + ( sys_rand32_get() % ( half + 1 ) );
+
+    LOG_INF("MQTT reconnection in %d ms\r\n", delay);
+    k_timer_start( &xWifiConnReconnectTimer, K_MSEC(delay), K_NO_WAIT );
+
+    gConn.backoffMs *= 2;
+    if( gConn.backoffMs > MQTT_RECONNECT_BACKOFF_MAX_MS ){
+        gConn.backoffMs = MQTT_RECONNECT_BACKOFF_MAX_MS;
+    }
+}
+
+
+
+static void wifiConnReconnect(void){
+
+    // a user request is in progress, it brings the connection up anyway
+    if( gConn.isPending ){
+        return;
+    }
+
+    gConnStats.reconnectAttempts++;
+    LOG_INF("MQTT reconnection attempt %d\r\n", gConnStats.reconnectAttempts);
+
+    // closes the client if the broker connection has been lost, so that it
+    // can be opened again (from the state reached by the other steps)
+    if( xWifiMqttClientConnected() ){
+        // connection has been restored in the meantime
+        xWifiConnPostEvent( WIFI_CONN_EVT_MQTT_CONNECTED, X_ERR_SUCCESS );
+        return;
+    }
+
+    gConn.target = WIFI_CONN_STATE_MQTT_CONNECTED;
+    gConn.isPending = true;
+    gConn.stepFrom = -1;
+}
+
+
+
+static void wifiConnReconnectTimerCb(struct k_timer *timer){
+
+    xWifiConnPostEvent( WIFI_CONN_EVT_RECONNECT, X_ERR_SUCCESS );
+}
+
+
+
+static void wifiConnAdvance(void){
+
+    xWifiConnState_t state = wifiConnGetState();
+
+    gConnStats.state = state;
+
+    if( !gConn.isPending ){
+        return;
+    }
+
+    if( state >= gConn.target ){
+        wifiConnComplete( X_ERR_SUCCESS );
+        return;
+    }
+
+    // the step for this state is already running, wait for its event
+    if( gConn.stepFrom == (int)state ){
+        return;
+    }
+    gConn.stepFrom = state;
+
+    switch( state ){
+        case WIFI_CONN_STATE_OFF:
+            xWifiNinaInit();
+            break;
+
+        case WIFI_CONN_STATE_INITIALIZED:
+            xWifiNinaConnectStep();
+            break;
+
+        case WIFI_CONN_STATE_NETWORK_UP:
+            xWifiMqttClientOpenStep();
+            break;
+
+        case WIFI_CONN_STATE_MQTT_OPEN:
+            xWifiMqttClientConnectStep();
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+
+void xWifiConnThread(void){
+
+    wifiConnMsg_t msg;
+    uint32_t elapsed;
+
+    // needed to avoid thread overflows when using ubxlib functions within a thread
+    k_thread_system_pool_assign(k_current_get());
+
+    while(1){
+
+        k_msgq_get( &xWifiConnMsgq, &msg, K_FOREVER );
+
+        elapsed = gConn.isTiming ? (uint32_t)( k_uptime_get() - gConn.requestTime ) : 0;
+
+        switch( msg.event ){
+
+            case WIFI_CONN_EVT_REQUEST:
+                gConn.target = msg.target;
+                gConn.isPending = true;
+                gConn.stepFrom = -1;
+
+                // start timing a new bring-up
+                if( wifiConnGetState() < msg.target ){
+                    gConn.requestTime = k_uptime_get();
+                    gConn.isTiming = true;
+                    gConnStats.poweredMs = 0;
+                    gConnStats.initializedMs = 0;
+                    gConnStats.networkUpMs = 0;
+                    gConnStats.mqttOpenMs = 0;
+                    gConnStats.mqttConnectedMs = 0;
+                    gConnStats.firstPublishMs = 0;
+                }
+                break;
+
+            case WIFI_CONN_EVT_POWERED:
+                gConnStats.poweredMs = elapsed;
+                break;
+
+            case WIFI_CONN_EVT_INITIALIZED:
+                gConnStats.initializedMs = elapsed;
+                break;
+
+            case WIFI_CONN_EVT_NETWORK_UP:
+                gConnStats.networkUpMs = elapsed;
+                break;
+
+            case WIFI_CONN_EVT_MQTT_OPEN:
+                gConnStats.mqttOpenMs = elapsed;
+                break;
+
+            case WIFI_CONN_EVT_MQTT_CONNECTED:
+                gConnStats.mqttConnectedMs = elapsed;
+                if( gConn.isTiming ){
+                    LOG_INF("MQTT connected %d ms after request\r\n", elapsed);
+                }
+                if( gConn.isReconnecting ){
+                    gConn.isReconnecting = false;
+                    gConn.backoffMs = MQTT_RECONNECT_BACKOFF_MIN_MS;
+                    gConnStats.reconnectCount++;
+                    gConnStats.lastDowntimeMs = (uint32_t)( k_uptime_get() - gConn.downTime );
+                    gConnStats.totalDowntimeMs += gConnStats.lastDowntimeMs;
+                    LOG_INF("MQTT reconnected after %d ms\r\n", gConnStats.lastDowntimeMs);
+                }
+                break;
+
+            case WIFI_CONN_EVT_MQTT_DISCONNECTED:
+                LOG_WRN("MQTT client disconnected\r\n");
+                // drops reported while already reconnecting (also caused by
+                // closing the client) are ignored
+                if( gConn.isSupervised && !gConn.isReconnecting ){
+                    gConn.isReconnecting = true;
+                    gConn.downTime = k_uptime_get();
+                    gConn.backoffMs = MQTT_RECONNECT_BACKOFF_MIN_MS;
+                    wifiConnScheduleReconnect();
+                }
+                // ubxlib does not clear the client status on a drop: closes the
+                // disconnected client, so that it is not reported as connected
+                xWifiMqttClientCloseStep();
+                break;
+
+            case WIFI_CONN_EVT_RECONNECT:
+                if( gConn.isSupervised && gConn.isReconnecting ){
+                    wifiConnReconnect();
+                }
+                break;
+
+            case WIFI_CONN_EVT_NETWORK_DOWN:
+            case WIFI_CONN_EVT_DEINITIALIZED:
+                break;
+
+            case WIFI_CONN_EVT_ERROR:
+                if( gConn.isPending ){
+                    wifiConnComplete( msg.err );
+                }
+                // reconnection attempt failed, try again later
+                if( gConn.isSupervised && gConn.isReconnecting ){
+                    wifiConnScheduleReconnect();
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        wifiConnAdvance();
+    }
+}
+
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTION IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+void xWifiConnRequest(xWifiConnState_t target){
+
+    wifiConnMsg_t msg = { .event = WIFI_CONN_EVT_REQUEST, .target = target, .err = X_ERR_SUCCESS };
+
+    k_sem_reset( &xWifiConnDone_semaphore );
+
+    if( k_msgq_put( &xWifiConnMsgq, &msg, K_NO_WAIT ) != 0 ){
+        LOG_ERR("WiFi connection queue full, request dropped\r\n");
+        gConn.lastResult = X_ERR_BUFFER_OVERFLOW;
+        k_sem_give( &xWifiConnDone_semaphore );
+    }
+}
+
+
+
+err_code xWifiConnWait(k_timeout_t timeout){
+
+    if( k_sem_take( &xWifiConnDone_semaphore, timeout ) != 0 ){
+        return U_ERROR_COMMON_TIMEOUT;
+    }
+    return gConn.lastResult;
+}
+
+
+
+void xWifiConnPostEvent(xWifiConnEvent_t event, err_code err){
+
+    wifiConnMsg_t msg = { .event = event, .target = WIFI_CONN_STATE_OFF, .err = err };
+
+    // may be called from callbacks, never block
+    if( k_msgq_put( &xWifiConnMsgq, &msg, K_NO_WAIT ) != 0 ){
+        LOG_ERR("WiFi connection queue full, event %d dropped\r\n", event);
+    }
+}
+
+
+
+void xWifiConnPublished(void){
+
+    if( !gConn.isTiming ){
+        return;
+    }
+
+    gConn.isTiming = false;
+    gConnStats.firstPublishMs = (uint32_t)( k_uptime_get() - gConn.requestTime );
+    LOG_INF("Time to first publish: %d ms\r\n", gConnStats.firstPublishMs);
+}
+
+
+
+void xWifiConnStopSupervision(void){
+
+    k_timer_stop( &xWifiConnReconnectTimer );
+
+    if( gConn.isReconnecting ){
+        gConnStats.lastDowntimeMs = (uint32_t)( k_uptime_get() - gConn.downTime );
+        gConnStats.totalDowntimeMs += gConnStats.lastDowntimeMs;
+        LOG_INF("MQTT reconnection abandoned\r\n");
+    }
+
+    gConn.isSupervised = false;
+    gConn.isReconnecting = false;
+    gConn.backoffMs = MQTT_RECONNECT_BACKOFF_MIN_MS;
+
+    xWifiMqttBacklogClear();
+}
+
+
+
+bool xWifiConnIsReconnecting(void){
+
+    return gConn.isReconnecting;
+}
+
+
+
+xWifiConnStats_t xWifiConnGetStats(void){
+
+    gConnStats.state = wifiConnGetState();
+    gConnStats.isReconnecting = gConn.isReconnecting;
+
+    xWifiConnStats_t stats = gConnStats;
+
+    // include the disconnection in progress
+    if( gConn.isReconnecting ){
+        stats.lastDowntimeMs = (uint32_t)( k_uptime_get() - gConn.downTime );
+        stats.totalDowntimeMs += stats.lastDowntimeMs;
+    }
+
+    return stats;
+}
+
+
+/* ----------------------------------------------------------------
+ * SHELL COMMANDS IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+void xWifiConnStatsCmd(const struct shell *shell, size_t argc, char **argv){
+
+    const char *const stateStr[]={
+        [WIFI_CONN_STATE_OFF] = "Off",
+        [WIFI_CONN_STATE_INITIALIZED] = "Initialized",
+        [WIFI_CONN_STATE_NETWORK_UP] = "Network up",
+        [WIFI_CONN_STATE_MQTT_OPEN] = "MQTT open",
+        [WIFI_CONN_STATE_MQTT_CONNECTED] = "MQTT connected"
+    };
+
+    xWifiConnStats_t stats = xWifiConnGetStats();
+
+    shell_print(shell, "\r\n\
+WiFi connection ------------------------\r\n\
+        - State: %s\r\n\
+        - Last request result: %d\r\n\
+Last bring-up (ms since request) -------\r\n\
+        - Powered: %d\r\n\
+        - Initialized: %d\r\n\
+        - Network up: %d\r\n\
+        - MQTT open: %d\r\n\
+        - MQTT connected: %d\r\n\
+        - First publish: %d\r\n\
+MQTT reconnection ----------------------\r\n\
+        - Reconnecting: %s\r\n\
+        - Reconnections: %d (attempts: %d)\r\n\
+        - Last downtime (ms): %d\r\n\
+        - Total downtime (ms): %d\r\n",
+        stateStr[stats.state], stats.lastResult,
+        stats.poweredMs, stats.initializedMs, stats.networkUpMs,
+        stats.mqttOpenMs, stats.mqttConnectedMs, stats.firstPublishMs,
+        stats.isReconnecting ? "yes" : "no",
+        stats.reconnectCount, stats.reconnectAttempts,
+        stats.lastDowntimeMs, stats.totalDowntimeMs);
+
+    return;
+}
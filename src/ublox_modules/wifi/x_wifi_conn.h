@@ -0,0 +1,194 @@
+/*
+ * Copyright 2022 u-blox Ltd
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef X_WIFI_CONN_H__
+#define  X_WIFI_CONN_H__
+
+/** @file
+ * @brief This file contains the API of the WiFi connection state machine
+ * in XPLR-IOT-1 device.
+ *
+ * The bring-up of a WiFi MQTT connection consists of consecutive steps,
+ * each one performed by a thread of x_wifi_ninaW156 or x_wifi_mqtt modules:
+ *
+ * NINA-W156 init (power up, ubxlib device open) -> WiFi network up ->
+ * MQTT client open -> MQTT client connected
+ *
+ * The state machine starts each step as soon as the previous one has completed:
+ * the step threads post an event to the state machine queue when they complete
+ * (or fail), instead of being polled.
+ *
+ * Usage:
+ * - xWifiConnRequest() with the state that should be reached
+ *   (xWifiNinaConnect(), xWifiMqttClientOpen() and xWifiMqttClientConnect() use it)
+ * - xWifiConnWait() to wait for the request to complete, if needed
+ *
+ * The time of each step and the time to first publish since the bring-up
+ * request are measured (see xWifiConnGetStats()).
+ *
+ * Once the MQTT client has been connected by a request, the connection is
+ * supervised: if the broker connection drops, the client is closed and the
+ * connection is brought up again after a jittered exponential backoff
+ * (MQTT_RECONNECT_BACKOFF_MIN_MS up to MQTT_RECONNECT_BACKOFF_MAX_MS), until
+ * it succeeds or xWifiConnStopSupervision() is called (closing the MQTT client,
+ * disconnecting from the network or deinitializing NINA-W156 do so).
+ * Messages published while reconnecting are kept in the MQTT backlog
+ * (see xWifiMqttClientPublish()).
+ */
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr.h>
+#include <shell/shell.h> //for shell command functions
+
+#include "x_errno.h"  //includes error types
+
+
+/* ----------------------------------------------------------------
+ * TYPE DEFINITIONS
+ * -------------------------------------------------------------- */
+
+/** States of the WiFi connection, in bring-up order */
+typedef enum{
+    WIFI_CONN_STATE_OFF = 0,          /**< WiFi device not opened */
+    WIFI_CONN_STATE_INITIALIZED,      /**< WiFi device opened (ubxlib) */
+    WIFI_CONN_STATE_NETWORK_UP,       /**< Connected to the WiFi network */
+    WIFI_CONN_STATE_MQTT_OPEN,        /**< MQTT client open */
+    WIFI_CONN_STATE_MQTT_CONNECTED    /**< MQTT client connected to the broker */
+}xWifiConnState_t;
+
+
+/** Events posted to the WiFi connection state machine */
+typedef enum{
+    WIFI_CONN_EVT_REQUEST = 0,        /**< A state has been requested (xWifiConnRequest) */
+    WIFI_CONN_EVT_POWERED,            /**< NINA-W156 powered up */
+    WIFI_CONN_EVT_INITIALIZED,        /**< WiFi device opened */
+    WIFI_CONN_EVT_NETWORK_UP,         /**< Connected to the WiFi network */
+    WIFI_CONN_EVT_MQTT_OPEN,          /**< MQTT client opened */
+    WIFI_CONN_EVT_MQTT_CONNECTED,     /**< MQTT client connected to the broker */
+    WIFI_CONN_EVT_MQTT_DISCONNECTED,  /**< MQTT client disconnected from the broker */
+    WIFI_CONN_EVT_NETWORK_DOWN,       /**< Disconnected from the WiFi network */
+    WIFI_CONN_EVT_DEINITIALIZED,      /**< WiFi device deinitialized */
+    WIFI_CONN_EVT_RECONNECT,          /**< Reconnection backoff expired */
+    WIFI_CONN_EVT_ERROR               /**< A step failed */
+}xWifiConnEvent_t;
+
+
+/** Bring-up timing and reconnection statistics. Step times are in ms since
+ * the last bring-up request, zero if the step has not been performed.
+ * Reconnection statistics are counted since boot */
+typedef struct{
+    xWifiConnState_t state;       /**< Current connection state */
+    err_code lastResult;          /**< Result of the last request */
+    uint32_t poweredMs;           /**< NINA-W156 powered up */
+    uint32_t initializedMs;       /**< WiFi device opened */
+    uint32_t networkUpMs;         /**< Connected to the WiFi network */
+    uint32_t mqttOpenMs;          /**< MQTT client open */
+    uint32_t mqttConnectedMs;     /**< MQTT client connected */
+    uint32_t firstPublishMs;      /**< First message published after connection (time to first publish) */
+    bool isReconnecting;          /**< Broker connection lost, reconnection in progress */
+    uint32_t reconnectCount;      /**< Successful reconnections */
+    uint32_t reconnectAttempts;   /**< Reconnection attempts (including successful ones) */
+    uint32_t lastDowntimeMs;      /**< Duration of the last (or current) broker disconnection */
+    uint32_t totalDowntimeMs;     /**< Total time disconnected from the broker (current disconnection included) */
+}xWifiConnStats_t;
+
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+/** Requests the WiFi connection to be brought up to the given state. The steps
+ * needed are performed one after the other. A new request replaces any request
+ * still in progress. Lower states than the current are not applied (use the
+ * disconnect/close functions of the related module).
+ *
+ * The result can be waited with xWifiConnWait().
+ *
+ * @param target  The state to reach.
+ */
+void xWifiConnRequest(xWifiConnState_t target);
+
+
+/** Waits for the last request to complete (state reached or a step failed).
+ *
+ * @param timeout  Max time to wait.
+ * @return         zero on success else negative error code (error of the step
+ *                 that failed or U_ERROR_COMMON_TIMEOUT).
+ */
+err_code xWifiConnWait(k_timeout_t timeout);
+
+
+/** Posts an event to the state machine. Used by the modules performing the
+ * bring-up steps (and their ubxlib callbacks) to report completion. Can be
+ * used from callbacks, it does not block.
+ *
+ * @param event  The event.
+ * @param err    Error code (WIFI_CONN_EVT_ERROR only).
+ */
+void xWifiConnPostEvent(xWifiConnEvent_t event, err_code err);
+
+
+/** Reports that a message has been published, to measure the time to first
+ * publish after a bring-up request.
+ */
+void xWifiConnPublished(void);
+
+
+/** Stops the supervision of the MQTT connection: a broker drop is no more
+ * followed by a reconnection, a reconnection in progress is abandoned and
+ * the MQTT backlog is discarded. Supervision starts again the next time a
+ * request to connect the MQTT client completes.
+ */
+void xWifiConnStopSupervision(void);
+
+
+/** Is a reconnection to the MQTT broker in progress (after a broker drop).
+ *
+ * @return   True while reconnecting, else False.
+ */
+bool xWifiConnIsReconnecting(void);
+
+
+/** Returns the connection state, the timing of the last bring-up and the
+ * reconnection statistics.
+ *
+ * @return   a structure containing the state, timing and statistics.
+ */
+xWifiConnStats_t xWifiConnGetStats(void);
+
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS IMPLEMENTING SHELL-COMMANDS
+ * -------------------------------------------------------------- */
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * Types the WiFi connection state, the timing of the last bring-up and
+ * the reconnection statistics
+ * Shell Command Example: modules MQTT conn_stats
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   Not used
+ * @param argv   Not used
+ */
+void xWifiConnStatsCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+
+#endif   //X_WIFI_CONN_H__
@@ -24,27 +24,31 @@
 #include <zephyr.h>
 #include <logging/log.h>
 #include <stdlib.h>  //atoi
+#include <string.h>  //strlen, memcpy
 
 #include "ubxlib.h"
 
 #include "x_module_common.h"
 #include "x_wifi_ninaW156.h"
+#include "x_wifi_conn.h"
 #include "x_logging.h"
 #include "x_system_conf.h"
 #include "x_storage.h"
 #include "x_led.h"
+#include "x_data_handle.h"  // asynchronous publish
+#include "x_remote_config.h"
 
 
 /* ----------------------------------------------------------------
  * STATIC FUNCTION DECLARATION
  * -------------------------------------------------------------- */
 
-/** Thread called by xWifiMqttClientOpen(). Performs all necessary operations
+/** Thread called by xWifiMqttClientOpenStep(). Performs all necessary operations
  * to open an MQTT Client Session
 */
 void xWifiMqttClientOpenThread(void);
 
-/** Thread called by xWifiMqttClientConnect(). Performs all necessary operations
+/** Thread called by xWifiMqttClientConnectStep(). Performs all necessary operations
  * to connect to the MQTT Broker
 */
 void xWifiMqttClientConnectThread(void);
@@ -54,20 +58,60 @@ void xWifiMqttClientConnectThread(void);
 */
 static void xWifiMqttClientDisconnect(void);
 
+/** Disconnects and closes the client, without stopping the supervision of the
+ * connection (used when the client should be reopened)
+*/
+static void mqttClientClose(void);
+
+/** Publishes through the client, if still connected. The client lock is
+ * held during the publish, so that the client cannot be closed meanwhile.
+ * Reports a broker drop to the connection state machine
+*/
+static err_code mqttClientPublish(const char *pTopicNameStr, const char *pMessage, size_t messageSizeBytes, uint8_t qos, bool retain);
+
+/** Puts a message at the end of the backlog. If the backlog is full, the
+ * oldest message is dropped
+*/
+static void mqttBacklogPut(const char *pTopicNameStr, const char *pMessage, size_t messageSizeBytes, uint8_t qos, bool retain);
+
+/** Publishes the messages of the backlog in order, while the client is
+ * connected. Does nothing if a flush is already in progress
+*/
+static void mqttBacklogFlush(void);
+
 /** Handle error happening in a thread
 */
 static void mqttErrorHandle( err_code err );
 
-/** MQTT Subription Callback. To be used when messages are received.
- * In this application it does nothing, just for example
+/** MQTT Subription Callback. Called when messages are received in the
+ * remote configuration topic (the only one subscribed), which are read and
+ * executed by the remote configuration thread (x_remote_config.h)
 */
 static void mqttSubscribeCb(int32_t unreadMsgCount, void *cbParam);
 
-/** Disconnect from MQTT Broker callback. In this implementation it
- * does nothing, just for example
+/** Disconnect from MQTT Broker callback. Reports the disconnection to the
+ * WiFi connection state machine
 */
 static void mqttDisconnectCb(int32_t errorCode, void *pParam);
 
+/** Completion callback of messages published by xWifiMqttSendCmd
+*/
+static void mqttSendCmdCb(err_code result, uint32_t latencyMs, void *pParam);
+
+
+/* ----------------------------------------------------------------
+ * TYPE DEFINITIONS
+ * -------------------------------------------------------------- */
+
+/** A message kept in the backlog */
+typedef struct{
+    char topic[ MQTT_BACKLOG_TOPIC_MAXLEN + 1 ];
+    char message[ MQTT_BACKLOG_MSG_MAXLEN ];
+    size_t messageSizeBytes;
+    uint8_t qos;
+    bool retain;
+}mqttBacklogMsg_t;
+
 
 /* ----------------------------------------------------------------
  * ZEPHYR RELATED DEFINITIONS/DECLARATIONS
@@ -79,6 +123,12 @@ LOG_MODULE_REGISTER(LOGMOD_NAME_WIFI_MQTT, LOG_LEVEL_DBG);
 K_SEM_DEFINE(xWifiMqttClientOpen_semaphore, 0, 1);
 K_SEM_DEFINE(xWifiMqttClientConnect_semaphore, 0, 1);
 
+// Protects the backlog
+K_MUTEX_DEFINE(xWifiMqttBacklog_mutex);
+
+// Protects the client context: it is not closed while in use by another thread
+K_MUTEX_DEFINE(xWifiMqttClient_mutex);
+
 //Threads definition
 K_THREAD_DEFINE(xWifiMqttClientConnectThreadID, MQTT_STACK_SIZE, xWifiMqttClientConnectThread, NULL, NULL, NULL,
 		MQTT_PRIORITY, 0, 0);
@@ -112,6 +162,21 @@ static char gpMqttPasswordStr[ MQTT_PASSWORD_MAXLEN + 1 ] = {0};
 /** A copy of the active (open) MQTT client configuration */
 uMqttClientConnection_t gMqttActiveConfigCopy={0};
 
+/** Messages published while reconnecting (circular buffer, oldest at head) */
+static struct{
+    mqttBacklogMsg_t msgs[ MQTT_BACKLOG_MSG_NUM ];
+    uint8_t head;
+    uint8_t count;
+    bool isFlushing;
+    bool isEnabled;     /**< Messages are kept while reconnecting (see xWifiMqttBacklogEnable) */
+}gBacklog = { .head = 0, .count = 0, .isFlushing = false, .isEnabled = true };
+
+/** Message taken from the backlog and being published by mqttBacklogFlush() */
+static mqttBacklogMsg_t gBacklogFlushMsg;
+
+/** Backlog statistics */
+static xWifiMqttBacklogStats_t gBacklogStats = {0};
+
 
 
 /* ----------------------------------------------------------------
@@ -119,13 +184,32 @@ uMqttClientConnection_t gMqttActiveConfigCopy={0};
  * -------------------------------------------------------------- */
 
 static void mqttSubscribeCb(int32_t unreadMsgCount, void *cbParam){
-    //do nothing
+    // called by ubxlib, do not use ubxlib from here
+    if( unreadMsgCount > 0 ){
+        xRemoteConfigNotify( MqttClient );
+    }
 }
 
 
 
 static void mqttDisconnectCb(int32_t errorCode, void *pParam){
-    //do nothing
+    // called by ubxlib, do not use ubxlib from here
+    xWifiConnPostEvent( WIFI_CONN_EVT_MQTT_DISCONNECTED, X_ERR_SUCCESS );
+}
+
+
+
+static void mqttSendCmdCb(err_code result, uint32_t latencyMs, void *pParam){
+
+    if( result == X_ERR_QUEUED ){
+        LOG_WRN("Not connected, kept in MQTT backlog: published after the reconnection\r\n");
+        return;
+    }
+    if( result != X_ERR_SUCCESS ){
+        LOG_ERR("MQTT publish failed: %d\r\n", result );
+        return;
+    }
+    LOG_INF("Published in %d ms\r\n", latencyMs );
 }
 
 
@@ -134,10 +218,132 @@ static void mqttDisconnectCb(int32_t errorCode, void *pParam){
  * -------------------------------------------------------------- */
 
 
+static err_code mqttClientPublish(const char *pTopicNameStr, const char *pMessage, size_t messageSizeBytes, uint8_t qos, bool retain){
+
+    err_code err;
+    bool isDropped = false;
+
+    k_mutex_lock( &xWifiMqttClient_mutex, K_FOREVER );
+
+    // the client may have been closed since the caller checked
+    if( gMqttStatus.status != ClientConnected ){
+        k_mutex_unlock( &xWifiMqttClient_mutex );
+        return X_ERR_INVALID_STATE;
+    }
+
+    err = uMqttClientPublish( gMqttClientCtx, pTopicNameStr, pMessage, messageSizeBytes, (uMqttQos_t)qos, retain );
+    if( err != X_ERR_SUCCESS ){
+        isDropped = !uMqttClientIsConnected( gMqttClientCtx );
+    }
+
+    k_mutex_unlock( &xWifiMqttClient_mutex );
+
+    if( isDropped ){
+        xWifiConnPostEvent( WIFI_CONN_EVT_MQTT_DISCONNECTED, X_ERR_SUCCESS );
+        return X_ERR_INVALID_STATE;
+    }
+    return err;
+}
+
+
+
+static void mqttBacklogPut(const char *pTopicNameStr, const char *pMessage, size_t messageSizeBytes, uint8_t qos, bool retain){
+
+    if( ( strlen( pTopicNameStr ) > MQTT_BACKLOG_TOPIC_MAXLEN ) || ( messageSizeBytes > MQTT_BACKLOG_MSG_MAXLEN ) ){
+        LOG_WRN("Message too long for the MQTT backlog, dropped\r\n");
+        gBacklogStats.dropped++;
+        return;
+    }
+
+    k_mutex_lock( &xWifiMqttBacklog_mutex, K_FOREVER );
+
+    // backlog full, drop the oldest message
+    if( gBacklog.count == MQTT_BACKLOG_MSG_NUM ){
+        gBacklog.head = ( gBacklog.head + 1 ) % MQTT_BACKLOG_MSG_NUM;
+        gBacklog.count--;
+        gBacklogStats.dropped++;
+        LOG_WRN("MQTT backlog full, oldest message dropped\r\n");
+    }
+
+    mqttBacklogMsg_t *pMsg = &gBacklog.msgs[ ( gBacklog.head + gBacklog.count ) % MQTT_BACKLOG_MSG_NUM ];
+    strcpy( pMsg->topic, pTopicNameStr );
+    memcpy( pMsg->message, pMessage, messageSizeBytes );
+    pMsg->messageSizeBytes = messageSizeBytes;
+    pMsg->qos = qos;
+    pMsg->retain = retain;
+
+    gBacklog.count++;
+    gBacklogStats.queued++;
+
+    k_mutex_unlock( &xWifiMqttBacklog_mutex );
+}
+
+
+
+static void mqttBacklogFlush(void){
+
+    err_code err;
+
+    k_mutex_lock( &xWifiMqttBacklog_mutex, K_FOREVER );
+    if( gBacklog.isFlushing || ( gBacklog.count == 0 ) ){
+        k_mutex_unlock( &xWifiMqttBacklog_mutex );
+        return;
+    }
+    gBacklog.isFlushing = true;
+    uint8_t pending = gBacklog.count;
+    k_mutex_unlock( &xWifiMqttBacklog_mutex );
+
+    LOG_INF("Publishing %d messages from MQTT backlog\r\n", pending);
+
+    while( ( gMqttStatus.status == ClientConnected ) && !xWifiConnIsReconnecting() ){
+
+        // take the oldest message, new messages can be added meanwhile
+        k_mutex_lock( &xWifiMqttBacklog_mutex, K_FOREVER );
+        if( gBacklog.count == 0 ){
+            k_mutex_unlock( &xWifiMqttBacklog_mutex );
+            break;
+        }
+        gBacklogFlushMsg = gBacklog.msgs[ gBacklog.head ];
+        gBacklog.head = ( gBacklog.head + 1 ) % MQTT_BACKLOG_MSG_NUM;
+        gBacklog.count--;
+        k_mutex_unlock( &xWifiMqttBacklog_mutex );
+
+        err = mqttClientPublish( gBacklogFlushMsg.topic, gBacklogFlushMsg.message,
+                                 gBacklogFlushMsg.messageSizeBytes, gBacklogFlushMsg.qos, gBacklogFlushMsg.retain );
+
+        if( err != X_ERR_SUCCESS ){
+            LOG_WRN("Backlog publish failed: %d\r\n", err);
+
+            // put the message back in front, it is published first next time
+            k_mutex_lock( &xWifiMqttBacklog_mutex, K_FOREVER );
+            if( gBacklog.count < MQTT_BACKLOG_MSG_NUM ){
+                gBacklog.head = ( gBacklog.head + MQTT_BACKLOG_MSG_NUM - 1 ) % MQTT_BACKLOG_MSG_NUM;
+                gBacklog.msgs[ gBacklog.head ] = gBacklogFlushMsg;
+                gBacklog.count++;
+            }
+            else{
+                gBacklogStats.dropped++;
+            }
+            k_mutex_unlock( &xWifiMqttBacklog_mutex );
+            break;
+        }
+
+        gBacklogStats.flushed++;
+        xWifiConnPublished();
+    }
+
+    k_mutex_lock( &xWifiMqttBacklog_mutex, K_FOREVER );
+    gBacklog.isFlushing = false;
+    k_mutex_unlock( &xWifiMqttBacklog_mutex );
+}
+
+
+
 static void mqttErrorHandle( err_code err ){
 
     gLastOperationResult = err;
     xLedBlink( ERROR_LEDCOL, ERROR_LED_DELAY_ON, ERROR_LED_DELAY_OFF, ERROR_LED_BLINKS);
+    xWifiConnPostEvent( WIFI_CONN_EVT_ERROR, err );
 }
 
 
@@ -146,7 +352,7 @@ void xWifiMqttClientOpenThread(void){
 
     while(1){
 
-        // Semaphore given by xWifiMqttClientOpen()
+        // Semaphore given by xWifiMqttClientOpenStep()
         k_sem_take( &xWifiMqttClientOpen_semaphore, K_FOREVER );
 
         LOG_DBG("Open MQTT client request \r\n");
@@ -154,25 +360,11 @@ void xWifiMqttClientOpenThread(void){
         gLastOperationResult = X_ERR_SUCCESS;
         xWifiNinaStatus_t nina_status = xWifiNinaGetModuleStatus();
 
-        // If not connected to WiFi network, try to connect before opening client
+        // the connection state machine connects to the WiFi network before this step
         if( nina_status.isConnected == false ){
-
-            LOG_WRN("Not connected to a WiFi Network, trying to connect now\r\n");
-            xWifiNinaConnect();
-
-            // wait until connected or error while trying to connect happens
-            while( ( nina_status.isConnected == false ) && (gLastOperationResult == X_ERR_SUCCESS ) ){
-                    k_sleep(K_MSEC(1000));
-                    nina_status = xWifiNinaGetModuleStatus();
-                    gLastOperationResult = xWifiNinaGetLastOperationResult();
-                    //ubxlib contains timeouts by itself, no need to add one
-            }
-
-            //if error happens
-            if( gLastOperationResult != X_ERR_SUCCESS ){
-                LOG_ERR("Error Code from WiFi Connection Request: %d - Abort MQTT Client open", gLastOperationResult);
-                continue;
-            }
+            LOG_ERR("Not connected to a WiFi Network - Abort MQTT Client open\r\n");
+            mqttErrorHandle( X_ERR_INVALID_STATE );
+            continue;
         }
 
         //start optical indication for Mqtt opening
@@ -186,8 +378,10 @@ void xWifiMqttClientOpenThread(void){
         }
 
         // Open Mqtt client and check for errors
+        k_mutex_lock( &xWifiMqttClient_mutex, K_FOREVER );
         gMqttClientCtx = pUMqttClientOpen( xWifiNinaGetHandle(), NULL);
         if( gMqttClientCtx == NULL ){
+            k_mutex_unlock( &xWifiMqttClient_mutex );
             err_code err = uMqttClientOpenResetLastError();
             LOG_ERR("pUMqttClientOpen err: %d", err );
             mqttErrorHandle( err ); 
@@ -195,10 +389,12 @@ void xWifiMqttClientOpenThread(void){
         }
 
         // Client is open
-        xLedOff();
         gMqttStatus.status = ClientOpen;
+        k_mutex_unlock( &xWifiMqttClient_mutex );
+        xLedOff();
         LOG_INF("MQTT client opened \r\n");
         gLastOperationResult = X_ERR_SUCCESS;
+        xWifiConnPostEvent( WIFI_CONN_EVT_MQTT_OPEN, X_ERR_SUCCESS );
 
     }
 }
@@ -207,12 +403,14 @@ void xWifiMqttClientOpenThread(void){
 
 void xWifiMqttClientConnectThread(void){
 
+    int64_t connectStart;
+
     // needed to avoid thread overflows when using ubxlib functions within a thread
     k_thread_system_pool_assign(k_current_get());
 
     while(1){
 
-        // Semaphore given by xWifiMqttClientConnect 
+        // Semaphore given by xWifiMqttClientConnectStep()
         k_sem_take( &xWifiMqttClientConnect_semaphore, K_FOREVER );
 
         LOG_DBG("Connect to MQTT client requested\r\n");
@@ -238,24 +436,15 @@ void xWifiMqttClientConnectThread(void){
         if( gMqttStatus.status == ClientConnected ){
             LOG_INF("Already connected \r\n");
             gLastOperationResult = X_ERR_SUCCESS;
+            xWifiConnPostEvent( WIFI_CONN_EVT_MQTT_CONNECTED, X_ERR_SUCCESS );
             continue;
         }
 
-        // If an MQTT client is not open, open one now
+        // the connection state machine opens the client before this step
         if( gMqttStatus.status < ClientOpen ){
-            LOG_WRN("No open MQTT client. Opening MQTT client now\r\n");
-            xWifiMqttClientOpen();
-            
-            // wait for client to be opened and check for errors 
-            while( ( gMqttStatus.status < ClientOpen ) && ( gLastOperationResult == X_ERR_SUCCESS ) ){
-                k_sleep(K_MSEC(1000));
-            }
-            
-            // if error while opening client
-            if(gLastOperationResult!=X_ERR_SUCCESS){
-                LOG_ERR("Error Code from MQTT open client request: %d - Aborting MQTT Connection \r\n", gLastOperationResult);
-                continue;
-            }
+            LOG_ERR("No open MQTT client - Aborting MQTT Connection \r\n");
+            mqttErrorHandle( X_ERR_INVALID_STATE );
+            continue;
         }
 
         //start optical indication for MQTT connection
@@ -275,47 +464,75 @@ void xWifiMqttClientConnectThread(void){
 
         LOG_INF("MQTT connecting\r\n");
 
+        // the client is not closed by another thread while connecting
+        k_mutex_lock( &xWifiMqttClient_mutex, K_FOREVER );
+
+        if( gMqttStatus.status < ClientOpen ){
+            k_mutex_unlock( &xWifiMqttClient_mutex );
+            LOG_ERR("MQTT client closed - Aborting MQTT Connection \r\n");
+            mqttErrorHandle( X_ERR_INVALID_STATE );
+            continue;
+        }
+
         // Connect to MQTT broker and check for errors
         gLastOperationResult = uMqttClientConnect(gMqttClientCtx, &mqttConnection);
         if( gLastOperationResult != X_ERR_SUCCESS ){
+            k_mutex_unlock( &xWifiMqttClient_mutex );
             LOG_ERR("uMqttClientConnect failed\r\n");
             mqttErrorHandle( gLastOperationResult );
             continue;
         } 
 
-        // setup a Subscription callback -- Not used in the application, just for example
+        // setup a Subscription callback (remote configuration commands)
         gLastOperationResult = uMqttClientSetMessageCallback(gMqttClientCtx, mqttSubscribeCb, (void *)gMqttClientCtx);
         if( gLastOperationResult != X_ERR_SUCCESS ){
+            k_mutex_unlock( &xWifiMqttClient_mutex );
             LOG_ERR("uMqttClientSetMessageCallback failed\r\n");
             mqttErrorHandle( gLastOperationResult );
             continue;
         } 
 
-        // setup an MQTT disconnection callback. Does nothing in this implementation
+        // setup an MQTT disconnection callback. Reports broker drops to the connection state machine
         gLastOperationResult = uMqttClientSetDisconnectCallback(gMqttClientCtx, mqttDisconnectCb, (void *)gMqttClientCtx);
         if( gLastOperationResult != X_ERR_SUCCESS ){
+            k_mutex_unlock( &xWifiMqttClient_mutex );
             LOG_ERR("uMqttClientSetDisconnectCallback failed\r\n");
             mqttErrorHandle( gLastOperationResult );
             continue;
         }
 
-        // wait for connection to be established
-        while( gMqttStatus.status != ClientConnected ){
-            
-            // if connection is established
-            if( uMqttClientIsConnected(gMqttClientCtx) ){
-                gMqttStatus.status = ClientConnected;
-                xLedOff();
-            }
-
-            k_sleep(K_MSEC(1000));
+        // wait for connection to be established. ubxlib has no connection callback,
+        // so check often to go on with the next step as soon as possible
+        connectStart = k_uptime_get();
+        while( !uMqttClientIsConnected(gMqttClientCtx) && 
+               ( k_uptime_get() - connectStart < MQTT_CONNECT_TIMEOUT_MS ) ){
+            k_sleep(K_MSEC(MQTT_CONNECT_POLL_MS));
+        }
 
-            //printk(".");
+        if( !uMqttClientIsConnected(gMqttClientCtx) ){
+            k_mutex_unlock( &xWifiMqttClient_mutex );
+            LOG_ERR("MQTT connection timeout\r\n");
+            mqttErrorHandle( U_ERROR_COMMON_TIMEOUT );
+            continue;
         }
 
+        gMqttStatus.status = ClientConnected;
+        xLedOff();
         LOG_INF("MQTT connected\r\n");
 
+        // subscribe to the remote configuration commands, again after each
+        // (re)connection. The client can still publish if this fails
+        int32_t qos = uMqttClientSubscribe( gMqttClientCtx, TOPIC_NAME_CONFIG_CMD, U_MQTT_QOS_AT_LEAST_ONCE );
+        k_mutex_unlock( &xWifiMqttClient_mutex );
+        if( qos < 0 ){
+            LOG_WRN("Could not subscribe to %s: %d\r\n", TOPIC_NAME_CONFIG_CMD, qos);
+        }
+
         gLastOperationResult = X_ERR_SUCCESS;
+        xWifiConnPostEvent( WIFI_CONN_EVT_MQTT_CONNECTED, X_ERR_SUCCESS );
+
+        // publish messages kept while reconnecting
+        mqttBacklogFlush();
         
     }
 }
@@ -328,12 +545,18 @@ void xWifiMqttClientConnectThread(void){
 
 bool xWifiMqttClientConnected(void){
 
+    bool isConnected;
+
     // the xWifiMqttClientConnect should have been performed
     // succesfully to be in a connected status
     if( gMqttStatus.status == ClientConnected ){
 
         // check if still connected
-        if( uMqttClientIsConnected(gMqttClientCtx) ){
+        k_mutex_lock( &xWifiMqttClient_mutex, K_FOREVER );
+        isConnected = ( gMqttStatus.status == ClientConnected ) && uMqttClientIsConnected(gMqttClientCtx);
+        k_mutex_unlock( &xWifiMqttClient_mutex );
+
+        if( isConnected ){
             return true;
         }
         else{
@@ -345,7 +568,7 @@ bool xWifiMqttClientConnected(void){
             * 
             * * if the disconnection happened from the broker part, it may not work
             */
-            xWifiMqttClientClose(); 
+            mqttClientClose(); 
             return false;
         }
     }
@@ -384,6 +607,32 @@ static void xWifiMqttClientDisconnect(void){
 
 void xWifiMqttClientClose(void){
 
+    // closed by the user, do not reconnect
+    xWifiConnStopSupervision();
+    mqttClientClose();
+}
+
+
+
+void xWifiMqttClientCloseStep(void){
+
+    bool isDropped;
+
+    k_mutex_lock( &xWifiMqttClient_mutex, K_FOREVER );
+    isDropped = ( gMqttStatus.status == ClientConnected ) && !uMqttClientIsConnected( gMqttClientCtx );
+    if( isDropped ){
+        mqttClientClose();
+    }
+    k_mutex_unlock( &xWifiMqttClient_mutex );
+}
+
+
+
+static void mqttClientClose(void){
+
+    // waits for a publish in progress, the lock is recursive
+    k_mutex_lock( &xWifiMqttClient_mutex, K_FOREVER );
+
     LOG_INF("MQTT Client Close Request \r\n");
 
     // if connected to MQTT Broker disconnect before closing the client
@@ -398,6 +647,7 @@ void xWifiMqttClientClose(void){
         gMqttStatus.status = ClientClosed;    
     }
 
+    k_mutex_unlock( &xWifiMqttClient_mutex );
     LOG_INF("MQTT Client Closed\r\n");
 }
 
@@ -411,27 +661,68 @@ xClientStatusStruct_t xWifiMqttClientGetStatus(void){
 
 err_code xWifiMqttClientPublish(const char *pTopicNameStr, const char *pMessage, size_t messageSizeBytes, uint8_t qos, bool retain){
     
+    k_mutex_lock( &xWifiMqttBacklog_mutex, K_FOREVER );
+    bool isBacklogged = ( gBacklog.count > 0 );
+    bool useBacklog = gBacklog.isEnabled;
+    k_mutex_unlock( &xWifiMqttBacklog_mutex );
+
+    // while reconnecting, or behind older pending messages, keep the message
+    if( ( useBacklog && xWifiConnIsReconnecting() ) || ( ( gMqttStatus.status == ClientConnected ) && isBacklogged ) ){
+        mqttBacklogPut( pTopicNameStr, pMessage, messageSizeBytes, qos, retain );
+        mqttBacklogFlush();
+        return X_ERR_QUEUED;
+    }
+
     // Should be connected to publish
-    if( gMqttStatus.status < ClientConnected){
+    if( ( gMqttStatus.status < ClientConnected ) || xWifiConnIsReconnecting() ){
             LOG_WRN("MQTT not connected\r\n");  
             return X_ERR_INVALID_STATE;  
     }
 
-    uMqttQos_t qos_var = qos;
-    return uMqttClientPublish(gMqttClientCtx, pTopicNameStr, pMessage, messageSizeBytes, qos_var, retain);
+    err_code err = mqttClientPublish( pTopicNameStr, pMessage, messageSizeBytes, qos, retain );
+    if( err == X_ERR_SUCCESS ){
+        xWifiConnPublished();
+    }
+
+    // broker drop (or close) not reported yet, keep the message for the reconnection
+    else if( err == X_ERR_INVALID_STATE ){
+        if( useBacklog ){
+            LOG_WRN("MQTT broker connection lost, message kept in backlog\r\n");
+            mqttBacklogPut( pTopicNameStr, pMessage, messageSizeBytes, qos, retain );
+            return X_ERR_QUEUED;
+        }
+    }
+
+    return err;
 }
 
 
 
 void xWifiMqttClientConnect(void){
 
-    k_sem_give( &xWifiMqttClientConnect_semaphore );
+    gLastOperationResult = X_ERR_SUCCESS;
+    xWifiConnRequest( WIFI_CONN_STATE_MQTT_CONNECTED );
 }
 
 
 
 void xWifiMqttClientOpen(void){
 
+    gLastOperationResult = X_ERR_SUCCESS;
+    xWifiConnRequest( WIFI_CONN_STATE_MQTT_OPEN );
+}
+
+
+
+void xWifiMqttClientConnectStep(void){
+
+    k_sem_give( &xWifiMqttClientConnect_semaphore );
+}
+
+
+
+void xWifiMqttClientOpenStep(void){
+
     k_sem_give( &xWifiMqttClientOpen_semaphore );
 }
 
@@ -443,6 +734,81 @@ err_code xWifiMqttGetLastOperationResult(void){
 }
 
 
+
+err_code xWifiMqttMessageRead(char *pMessage, size_t *pMessageSizeBytes){
+
+    char topic[ MQTT_BACKLOG_TOPIC_MAXLEN + 1 ];
+    uMqttQos_t qos;
+    err_code err;
+
+    k_mutex_lock( &xWifiMqttClient_mutex, K_FOREVER );
+
+    if( gMqttStatus.status != ClientConnected ){
+        err = X_ERR_INVALID_STATE;
+    }
+    else if( uMqttClientGetUnread( gMqttClientCtx ) <= 0 ){
+        err = X_ERR_NOT_FOUND;
+    }
+    else{
+        // only the remote configuration topic is subscribed, the topic is not needed
+        err = uMqttClientMessageRead( gMqttClientCtx, topic, sizeof(topic), pMessage, pMessageSizeBytes, &qos );
+    }
+
+    k_mutex_unlock( &xWifiMqttClient_mutex );
+    return err;
+}
+
+
+
+xWifiMqttBacklogStats_t xWifiMqttGetBacklogStats(void){
+
+    k_mutex_lock( &xWifiMqttBacklog_mutex, K_FOREVER );
+    xWifiMqttBacklogStats_t stats = gBacklogStats;
+    stats.pending = gBacklog.count;
+    k_mutex_unlock( &xWifiMqttBacklog_mutex );
+    return stats;
+}
+
+
+
+bool xWifiMqttClientIsConnected(void){
+
+    bool isConnected;
+
+    k_mutex_lock( &xWifiMqttClient_mutex, K_FOREVER );
+    isConnected = ( gMqttStatus.status == ClientConnected ) && !xWifiConnIsReconnecting() &&
+                  uMqttClientIsConnected( gMqttClientCtx );
+    k_mutex_unlock( &xWifiMqttClient_mutex );
+
+    return isConnected;
+}
+
+
+
+void xWifiMqttBacklogEnable(bool enable){
+
+    k_mutex_lock( &xWifiMqttBacklog_mutex, K_FOREVER );
+    gBacklog.isEnabled = enable;
+    k_mutex_unlock( &xWifiMqttBacklog_mutex );
+}
+
+
+
+void xWifiMqttBacklogClear(void){
+
+    k_mutex_lock( &xWifiMqttBacklog_mutex, K_FOREVER );
+
+    if( gBacklog.count > 0 ){
+        LOG_WRN("%d messages in MQTT backlog discarded\r\n", gBacklog.count);
+        gBacklogStats.dropped += gBacklog.count;
+    }
+    gBacklog.head = 0;
+    gBacklog.count = 0;
+
+    k_mutex_unlock( &xWifiMqttBacklog_mutex );
+}
+
+
 /* ----------------------------------------------------------------
  * SHELL COMMANDS IMPLEMENTATION
  * -------------------------------------------------------------- */
@@ -573,6 +939,18 @@ void xWifiMqttClientStatusCmd(const struct shell *shell, size_t argc, char **arg
     else if(gMqttStatus.status >= ClientOpen){
         shell_print(shell, "Client open\r\n");
     }
+
+    // reconnection and backlog statistics
+    xWifiConnStats_t conn_stats = xWifiConnGetStats();
+    xWifiMqttBacklogStats_t backlog_stats = xWifiMqttGetBacklogStats();
+
+    if( conn_stats.isReconnecting ){
+        shell_print(shell, "Reconnecting to broker (disconnected for %d ms)\r\n", conn_stats.lastDowntimeMs);
+    }
+    shell_print(shell, "Reconnections: %d \r\nTotal downtime: %d ms \r\nBacklog: %d pending, %d queued, %d flushed, %d dropped \r\n",
+                        conn_stats.reconnectCount, conn_stats.totalDowntimeMs,
+                        backlog_stats.pending, backlog_stats.queued,
+                        backlog_stats.flushed, backlog_stats.dropped );
     
     return;
 }
@@ -620,14 +998,28 @@ void xWifiMqttSendCmd(const struct shell *shell, size_t argc, char **argv){
             if( !xWifiMqttClientConnected() ){
                 shell_error(shell, "MQTT client has been disconnected, abort action\r\n" );
             }
-    
-            // Publish (send) the message
-            int32_t err = uMqttClientPublish(gMqttClientCtx, argv[1], argv[2], strlen(argv[2]), qos, 0);
-            if(err != 0){
-                shell_error(shell, "uMqttClientPublish failed: %d\r\n", err );
+
+            size_t len = strlen( argv[2] );
+            if( len > DATA_MSG_MAX_LEN ){
+                shell_error(shell, "Message too long\r\n" );
+                return;
+            }
+
+            xDataPublishBuf_t *pBuf = xDataPublishBufAlloc( K_NO_WAIT );
+            if( pBuf == NULL ){
+                shell_error(shell, "Publish queue full, try again\r\n" );
+                return;
+            }
+            memcpy( xDataPublishBufGetData( pBuf ), argv[2], len );
+
+            // Publish (send) the message, the result is logged when published
+            xDataPublishDest_t dest = { .client = MqttClient, .pTopicNameStr = argv[1] };
+            err_code err = xDataPublishAsync( pBuf, len, &dest, (uint8_t)qos, mqttSendCmdCb, NULL );
+            if(err != X_ERR_SUCCESS){
+                shell_error(shell, "Publish failed: %d\r\n", err );
             }
             else{
-                shell_print(shell, "Published\r\n" );
+                shell_print(shell, "Queued\r\n" );
             }
         }
 
@@ -59,6 +59,14 @@
  * To disconnect use:
  * xWifiMqttClientClose() function
  * 
+ * If the broker connection drops, the WiFi connection state machine
+ * (x_wifi_conn.h) reconnects the client. Messages published meanwhile are kept
+ * in a bounded RAM backlog (MQTT_BACKLOG_MSG_NUM messages, oldest dropped) and
+ * are published in order after the reconnection.
+ * 
+ * When connected, the client subscribes to the remote configuration topic
+ * (TOPIC_NAME_CONFIG_CMD), see x_remote_config.h.
+ * 
  */
 
 
@@ -85,6 +93,19 @@
 #define MQTT_PORT           1883  
 
 
+/* ----------------------------------------------------------------
+ * TYPE DEFINITIONS
+ * -------------------------------------------------------------- */
+
+/** Statistics of the publish backlog kept while reconnecting. Counted since boot */
+typedef struct{
+    uint32_t pending;      /**< Messages currently in the backlog */
+    uint32_t queued;       /**< Messages put in the backlog */
+    uint32_t flushed;      /**< Messages published from the backlog */
+    uint32_t dropped;      /**< Messages dropped (backlog full, message too long, client closed) */
+}xWifiMqttBacklogStats_t;
+
+
 /* ----------------------------------------------------------------
  * FUNCTIONS
  * -------------------------------------------------------------- */
@@ -94,12 +115,11 @@
  * Sensor Aggregation Use Case.
  * 
  * Prerequisites: Connection to WiFi should have been established.
- * If not, the function tries to establish this connection using internal
- * calls to the necessary functions. WiFi network credentials needed
- * in this case.
+ * If not, the WiFi connection state machine (x_wifi_conn.h) establishes this
+ * connection first. WiFi network credentials needed in this case.
  * 
- * The operation result can be seen by using xWifiMqttGetLastOperationResult()
- * after this function is called.
+ * The operation result can be waited with xWifiConnWait() after this
+ * function is called.
  */
 void xWifiMqttClientOpen(void);
 
@@ -111,15 +131,34 @@ void xWifiMqttClientOpen(void);
  * shell command (terminal) at least one time (this command also saves
  * configuration in memory). xStorageSaveMqttConfig() function can also
  * be used (same effect as the shell command)
- * - xWifiMqttClientOpen() should have been called. If not it is called with
- * an internal call within this function
+ * - xWifiMqttClientOpen() should have been called. If not, the WiFi connection
+ * state machine (x_wifi_conn.h) performs all steps needed first
  * 
- * The operation result can be seen by using xWifiMqttGetLastOperationResult()
- * after this function is called.
+ * The operation result can be waited with xWifiConnWait() after this
+ * function is called.
  */
 void xWifiMqttClientConnect(void);
 
 
+/** Enables the MQTT client open thread. Used by the WiFi connection state
+ * machine, WiFi should be connected. Use xWifiMqttClientOpen() instead.
+ */
+void xWifiMqttClientOpenStep(void);
+
+
+/** Enables the MQTT client connect thread. Used by the WiFi connection state
+ * machine, the client should be open. Use xWifiMqttClientConnect() instead.
+ */
+void xWifiMqttClientConnectStep(void);
+
+
+/** Closes the client if the broker connection has been lost, without
+ * stopping the connection supervision. Used by the WiFi connection state
+ * machine when a broker drop is reported. Waits for a publish in progress.
+ */
+void xWifiMqttClientCloseStep(void);
+
+
 /** Is the active MQTT client connected to broker.
  * 
  * Side-Effects:
@@ -153,6 +192,15 @@ xClientStatusStruct_t xWifiMqttClientGetStatus(void);
  * Prerequisites: Need to Connect the Client to the Broker. Won't
  * be done automatically with internal calls.
  *
+ * While the client reconnects after a broker drop (or older messages are
+ * still pending) the message is kept in the backlog and published later,
+ * in order. If the backlog is full the oldest message is dropped.
+ * A message kept in the backlog has not been published yet, so
+ * X_ERR_QUEUED is returned instead of success.
+ *
+ * Blocks until ubxlib completes the publish, so publishes are not
+ * pipelined: a single message is in flight at a time (stop-and-wait).
+ *
  * @param pTopicNameStr    String that contains the Topic to which the
  *                         message will be published.
  * @param pMessage         String that contains the message itself.
@@ -161,7 +209,8 @@ xClientStatusStruct_t xWifiMqttClientGetStatus(void);
  * @param retain           if true the message will be kept by the broker
  *                         across MQTT disconnects/ connects, else it will be cleared
  * 
- * @return        zero on success else negative error code.
+ * @return        zero on success, X_ERR_QUEUED if kept in the backlog, else
+ *                negative error code.
  */
 err_code xWifiMqttClientPublish(const char *pTopicNameStr, const char *pMessage, size_t messageSizeBytes, uint8_t qos, bool retain);
 
@@ -175,6 +224,50 @@ err_code xWifiMqttClientPublish(const char *pTopicNameStr, const char *pMessage,
 err_code xWifiMqttGetLastOperationResult(void);
 
 
+/** Read a message received in a subscribed topic (the remote configuration
+ * topic). Used by the remote configuration thread (x_remote_config.h).
+ * 
+ * @param pMessage                 Buffer for the message (not terminated).
+ * @param[in,out] pMessageSizeBytes Size of the buffer, then the message size.
+ * 
+ * @return        zero on success, X_ERR_NOT_FOUND if no message is unread,
+ *                else negative error code.
+ */
+err_code xWifiMqttMessageRead(char *pMessage, size_t *pMessageSizeBytes);
+
+
+/** Get the statistics of the publish backlog.
+ * 
+ * @return        The statistics in xWifiMqttBacklogStats_t.
+ */
+xWifiMqttBacklogStats_t xWifiMqttGetBacklogStats(void);
+
+
+/** Checks whether the client is connected to the broker and can publish now:
+ * connected, not reconnecting and the broker connection still up in ubxlib.
+ * Unlike xWifiMqttClientConnected(), a dropped client is not closed.
+ * 
+ * @return        True if a publish would be sent now, else False.
+ */
+bool xWifiMqttClientIsConnected(void);
+
+
+/** Enables/disables keeping messages in the backlog while reconnecting. While
+ * disabled, xWifiMqttClientPublish() fails instead, so that the caller can keep
+ * the message itself (see xDataHoldOnFailure). Messages already in the backlog
+ * are still published in order. Enabled by default.
+ * 
+ * @param enable   True to keep messages in the backlog.
+ */
+void xWifiMqttBacklogEnable(bool enable);
+
+
+/** Discard all messages pending in the backlog (counted as dropped).
+ * Used when the connection is no more supervised (see xWifiConnStopSupervision()).
+ */
+void xWifiMqttBacklogClear(void);
+
+
 /** Delete any saved Mqtt configuration
  * 
  * @return        zero on success else negative error code.
@@ -209,7 +302,8 @@ void xWifiMqttTypeConfigCmd(const struct shell *shell, size_t argc, char **argv)
 
 
 /** This function is intented only to be used as a command executed by the shell.
- * Types the MQTT Client Status (Open, Closed, Connected)
+ * Types the MQTT Client Status (Open, Closed, Connected), the reconnection
+ * and the backlog statistics
  *
  * @param shell  the shell instance from which the command is given.
  * @param argc   Not used
@@ -219,7 +313,8 @@ void xWifiMqttClientStatusCmd(const struct shell *shell, size_t argc, char **arg
 
 
 /** This function is intented only to be used as a command executed by the shell.
- * Sends a message to MQTT broker, utilizing xWifiMqttClientPublish(). Retain option
+ * Sends a message to MQTT broker asynchronously, utilizing xDataPublishAsync()
+ * (x_data_handle.h): the result is logged when published. Retain option
  * is not used in this command implementation. 
  *
  * @param shell  the shell instance from which the command is given.
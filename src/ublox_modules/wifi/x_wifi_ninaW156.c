@@ -43,12 +43,12 @@
  * Generally, xWifiNinaConnect() is enough to connect to the network and
  * xWifiNinaPowerOff() is enough to disconnect, deinitialize and power down
  * the module. 
- * Each function can call the previous ones needed to perform its operation.
  * 
- * In order to do that, some functions may need to wait for previous ones to
- * complete their operations. That is why threads are used, to ensure a smooth
- * workflow. Most functions call the corresponding threads eg. xWifiNinaInit()
- * calls xWifiNinaInitThread() using a semaphore.
+ * Each operation is performed by a thread, eg. xWifiNinaInit() calls 
+ * xWifiNinaInitThread() using a semaphore. The threads report their completion
+ * to the WiFi connection state machine (x_wifi_conn.h), which chains the
+ * steps needed: xWifiNinaConnect() requests the network up state from the
+ * state machine, which initializes the module first if necessary.
  * 
  */
 
@@ -56,6 +56,7 @@
 #include "x_wifi_ninaW156.h"
 
 #include <zephyr.h>
+#include <stdlib.h>
 #include <hal/nrf_gpio.h>
 #include <logging/log.h>
 
@@ -65,6 +66,7 @@
 #include "x_storage.h"
 #include "x_system_conf.h"
 #include "x_wifi_mqtt.h"   // to control automatic disconnections/connections
+#include "x_wifi_conn.h"
 #include "x_led.h"
 #include "x_cell_saraR5.h"
 #include "x_pin_conf.h"
@@ -83,7 +85,7 @@ void xWifiNinaInitThread(void);
 /** Thread called by xWifiNinaDeinit to deinitialize the NINA module */
 void xWifiNinaDeinitThread(void);
 
-/** Thread called by xWifiNinaConnect to connect the NINA module to a network */
+/** Thread called by xWifiNinaConnectStep to connect the NINA module to a network */
 void xWifiNinaConnectThread(void);
 
 /** Thread called by xWifiPowerOff to deinitialize and power off the NINA module */
@@ -117,6 +119,85 @@ static void NinaErrorHandle(err_code err_code);
 static void uWifiScanResultCallback(uDeviceHandle_t devHandle, uWifiScanResult_t *pResult);
 
 
+/** Restores the scan results heap property (weakest network at the root) from
+ * the given position downwards.
+ *
+ * @param heapNum  The number of results in the heap.
+ * @param pos      The position of the result that may be stronger than its children.
+ */
+static void NinaScanHeapSiftDown( uint8_t heapNum, uint8_t pos );
+
+
+/** Restores the scan results heap property from the given position upwards.
+ *
+ * @param pos      The position of the result that may be weaker than its parent.
+ */
+static void NinaScanHeapSiftUp( uint8_t pos );
+
+
+/** Brings up the WiFi network with the pending credentials (uNetworkInterfaceUp)
+ * 
+ * @return        zero on success else negative error code.
+ */
+static err_code NinaNetworkUp(void);
+
+
+/** Reads a status value of the connected access point (AT+UWSSTAT) or of
+ * the station network interface (AT+UNSTAT) as a string.
+ * 
+ * @param netStatus  true for AT+UNSTAT, false for AT+UWSSTAT.
+ * @param statusId   The status id to read.
+ * @param pStr       Buffer for the value.
+ * @param maxLen     Size of the buffer.
+ * @return           zero on success else negative error code.
+ */
+static err_code NinaReadStatus( bool netStatus, int32_t statusId, char *pStr, size_t maxLen );
+
+
+/** Reads the channels scanned on connection (AT+UWCL?), which depend on the
+ * regulatory domain the module is configured for.
+ * 
+ * @param pChannels    [Output] The channel list.
+ * @param maxNum       Max channels pChannels can hold.
+ * @return             the number of channels read on success else negative error code.
+ */
+static int32_t NinaGetChannelList( int32_t *pChannels, size_t maxNum );
+
+
+/** Sets the channels scanned on connection (AT+UWCL).
+ * 
+ * @param pChannels  The channel list.
+ * @param num        Number of channels in the list.
+ * @return           zero on success else negative error code.
+ */
+static err_code NinaSetChannelList( const int32_t *pChannels, size_t num );
+
+
+/** Sets the IPv4 configuration of the station (AT+UWSC).
+ * 
+ * @param useCached  true to use the cached configuration as a static one,
+ *                   false to use DHCP.
+ * @return           zero on success else negative error code.
+ */
+static err_code NinaSetIpConfig( bool useCached );
+
+
+/** Loads the cached access point parameters from flash (if not already loaded).
+ * 
+ * @param pSsid  The SSID the parameters should refer to.
+ * @return       true if valid parameters are cached for this SSID, else false.
+ */
+static bool NinaFastConnCacheRead( const char *pSsid );
+
+
+/** Reads the parameters of the connected access point and saves them in
+ * flash (only if they changed since the last save).
+ * 
+ * @param usedFast  true if the connection used the cached parameters.
+ */
+static void NinaFastConnCacheSave( bool usedFast );
+
+
 /* ----------------------------------------------------------------
  * ZEPHYR RELATED DEFINITIONS/DECLARATIONS
  * -------------------------------------------------------------- */
@@ -178,15 +259,51 @@ static uDeviceHandle_t gDevHandle = NULL;
 
 /** Structure to hold the networks found from a WiFi network Scan command
  * It has a max number of results it can hold. If results are more, then the 
- * additional results are not saved and bool maxResultsExceeded is  set to true
+ * weakest results are not saved and bool maxResultsExceeded is  set to true.
+ * While scanning the buffer is a min-heap on RSSI (the weakest network at index 0
+ * is the one replaced when full), when the scan completes it is sorted by
+ * descending RSSI.
 */
 struct {
-    uWifiScanResult_t networks[WIFI_SCAN_RESULTS_BUF_SIZE];  /**< Buffer which holds the results */  
+    xWifiNinaScanResult_t networks[WIFI_SCAN_RESULTS_BUF_SIZE];  /**< Buffer which holds the results */  
     uint8_t networksNum;                                     /**< Number of networks found on a scan action */
     bool maxResultsExceeded;                                 /**< True if results were more than the structure can hold */
 } gScannedNetworks;
 
 
+/** Parameters of the last access point connected, as saved in flash */
+typedef struct{
+    char ssid[ WIFI_MAX_SSID_LEN ];
+    char bssid[ WIFI_BSSID_STR_LEN ];
+    int32_t channel;
+    char ip[ WIFI_IPV4_STR_LEN ];         /**< Empty if IP configuration could not be read */
+    char mask[ WIFI_IPV4_STR_LEN ];
+    char gateway[ WIFI_IPV4_STR_LEN ];
+    char dns[ WIFI_IPV4_STR_LEN ];
+}ninaFastConnCache_t;
+
+static ninaFastConnCache_t gFastConnCache;
+
+/** Fast reconnection settings and statistics */
+static xWifiNinaFastConnStats_t gFastConnStats = {
+    .enabled = WIFI_FAST_CONN_DEFAULT,
+    .reuseIp = WIFI_FAST_CONN_REUSE_IP_DEFAULT
+};
+
+/** True while the station is configured with a static (cached) IP */
+static bool gStaticIpSet = false;
+
+/** Uptime (ms) the cached IP configuration was obtained with DHCP, negative if
+ *  not obtained since boot: its age is then unknown and it is not reused */
+static int64_t gDhcpLeaseMs = -1;
+
+/** Fast connections failed in a row, the cache is deleted after WIFI_FAST_CONN_MAX_FAILURES */
+static uint32_t gFastConnFailures = 0;
+
+/** Channel list of the module, saved while a fast connection scans a single channel */
+static int32_t gSavedChannels[ WIFI_CHANNEL_LIST_MAX_NUM ];
+
+
 
 /* ----------------------------------------------------------------
  * CALLBACK FUNCTION IMPLEMENTATION
@@ -204,15 +321,42 @@ static void uWifiScanResultCallback(uDeviceHandle_t devHandle, uWifiScanResult_t
         return;
     }
 
-    // if maximum number of results has been reached, discard the result
-    if( gScannedNetworks.networksNum == WIFI_SCAN_RESULTS_BUF_SIZE ){
-        gScannedNetworks.maxResultsExceeded = true;
-        return;
+    xWifiNinaScanResult_t result;
+    xWifiNinaScanResult_t *pNetworks = gScannedNetworks.networks;
+
+    // keep only the fields used by the application
+    memset( &result, 0, sizeof(result) );
+    strncpy( result.ssid, pResult->ssid, sizeof(result.ssid) - 1 );
+    memcpy( result.bssid, pResult->bssid, sizeof(result.bssid) );
+    result.rssi = (int8_t)pResult->rssi;
+    result.channel = (uint8_t)pResult->channel;
+    result.authSuiteBitmask = (uint8_t)pResult->authSuiteBitmask;
+
+    // the same SSID is reported by each access point (and band), keep the strongest
+    for( uint8_t x = 0; x < gScannedNetworks.networksNum; x++ ){
+        if( strcmp( pNetworks[x].ssid, result.ssid ) == 0 ){
+            if( result.rssi > pNetworks[x].rssi ){
+                pNetworks[x] = result;
+                NinaScanHeapSiftDown( gScannedNetworks.networksNum, x );
+            }
+            return;
+        }
     }
-    
+
     // add the found network to the list of found networks
-    gScannedNetworks.networks[ gScannedNetworks.networksNum++ ] = *pResult;
+    if( gScannedNetworks.networksNum < WIFI_SCAN_RESULTS_BUF_SIZE ){
+        pNetworks[ gScannedNetworks.networksNum ] = result;
+        NinaScanHeapSiftUp( gScannedNetworks.networksNum );
+        gScannedNetworks.networksNum++;
+        return;
+    }
 
+    // if maximum number of results has been reached, the weakest result is discarded
+    gScannedNetworks.maxResultsExceeded = true;
+    if( result.rssi > pNetworks[0].rssi ){
+        pNetworks[0] = result;
+        NinaScanHeapSiftDown( gScannedNetworks.networksNum, 0 );
+    }
 }
 
 
@@ -221,11 +365,330 @@ static void uWifiScanResultCallback(uDeviceHandle_t devHandle, uWifiScanResult_t
  * -------------------------------------------------------------- */
 
 
+static void NinaScanHeapSiftDown( uint8_t heapNum, uint8_t pos ){
+
+    xWifiNinaScanResult_t *pNetworks = gScannedNetworks.networks;
+    xWifiNinaScanResult_t tmp;
+    uint16_t child;
+
+    // move the result down while a child is weaker
+    while( ( child = 2 * pos + 1 ) < heapNum ){
+        if( ( child + 1 < heapNum ) && ( pNetworks[child + 1].rssi < pNetworks[child].rssi ) ){
+            child++;
+        }
+        if( pNetworks[pos].rssi <= pNetworks[child].rssi ){
+            break;
+        }
+        tmp = pNetworks[pos];
+        pNetworks[pos] = pNetworks[child];
+        pNetworks[child] = tmp;
+        pos = child;
+    }
+}
+
+
+
+static void NinaScanHeapSiftUp( uint8_t pos ){
+
+    xWifiNinaScanResult_t *pNetworks = gScannedNetworks.networks;
+    xWifiNinaScanResult_t tmp;
+    uint8_t parent;
+
+    // move the result up while weaker than its parent
+    while( pos > 0 ){
+        parent = ( pos - 1 ) / 2;
+        if( pNetworks[parent].rssi <= pNetworks[pos].rssi ){
+            break;
+        }
+        tmp = pNetworks[pos];
+        pNetworks[pos] = pNetworks[parent];
+        pNetworks[parent] = tmp;
+        pos = parent;
+    }
+}
+
+
+
 static void NinaErrorHandle(err_code err_code){
 
     // sets the global Operation Result and blinks red led to indicate error
     gLastOperationResult = err_code;
     xLedBlink( ERROR_LEDCOL, ERROR_LED_DELAY_ON, ERROR_LED_DELAY_OFF, ERROR_LED_BLINKS);
+    xWifiConnPostEvent( WIFI_CONN_EVT_ERROR, err_code );
+}
+
+
+
+static err_code NinaNetworkUp(void){
+
+    // Connection to Wifi network configuration- if open Network
+    static const uNetworkCfgWifi_t  wifiConfigOpen = {
+        .type = U_NETWORK_TYPE_WIFI,
+        .pSsid = gWiFiCredentialsPending.SSIDstr,
+        .authentication = 1, //2 /* WPA/WPA2/WPA3 - see wifi/api/u_wifi_net.h */,
+        .pPassPhrase = NULL
+    };
+
+    // Connection to Wifi network configuration- if Network requires password
+    static const uNetworkCfgWifi_t  wifiConfig = {
+        .type = U_NETWORK_TYPE_WIFI,
+        .pSsid = gWiFiCredentialsPending.SSIDstr,
+        .authentication = 2, //2 /* WPA/WPA2/WPA3 - see wifi/api/u_wifi_net.h */,
+        .pPassPhrase = gWiFiCredentialsPending.PSWstr
+    };
+
+    err_code ret;
+
+    // open
+    if(gWiFiCredentialsPending.sec_type == 1){
+        if( ( ret = uNetworkInterfaceUp( gDevHandle, U_NETWORK_TYPE_WIFI, &wifiConfigOpen ) ) == X_ERR_SUCCESS ){
+            // If connected to network succesfully, keep a copy of the network used
+            strcpy( gWiFiCredentialsAdded.SSIDstr, wifiConfigOpen.pSsid );
+            gWiFiCredentialsAdded.sec_type = 1;    
+        }
+    }
+    // password protected
+    else{
+        if( ( ret = uNetworkInterfaceUp( gDevHandle, U_NETWORK_TYPE_WIFI, &wifiConfig ) ) == X_ERR_SUCCESS ){
+            // If connected to network succesfully, keep a copy of the network used
+            strcpy( gWiFiCredentialsAdded.SSIDstr, wifiConfig.pSsid );
+            strcpy( gWiFiCredentialsAdded.PSWstr, wifiConfig.pPassPhrase );
+            gWiFiCredentialsAdded.sec_type = 2;
+        }
+    }
+
+    return ret;
+}
+
+
+
+static err_code NinaReadStatus( bool netStatus, int32_t statusId, char *pStr, size_t maxLen ){
+
+    int32_t ret;
+    uAtClientHandle_t pAtHandle;
+
+    ret = uWifiAtClientHandleGet( gDevHandle, &pAtHandle );
+    if( ret < 0 ){
+        return ret;
+    }
+
+    pStr[0] = 0;
+
+    // +UNSTAT:<interface_id>,<status_id>,<value> or +UWSSTAT:<status_id>,<value>
+    uAtClientLock(pAtHandle);
+    if( netStatus ){
+        uAtClientCommandStart(pAtHandle, "AT+UNSTAT=");
+        uAtClientWriteInt(pAtHandle, WIFI_STA_INTERFACE_ID);
+        uAtClientWriteInt(pAtHandle, statusId);
+        uAtClientCommandStop(pAtHandle);
+        uAtClientResponseStart(pAtHandle, "+UNSTAT:");
+        uAtClientReadInt(pAtHandle);
+    }
+    else{
+        uAtClientCommandStart(pAtHandle, "AT+UWSSTAT=");
+        uAtClientWriteInt(pAtHandle, statusId);
+        uAtClientCommandStop(pAtHandle);
+        uAtClientResponseStart(pAtHandle, "+UWSSTAT:");
+    }
+    uAtClientReadInt(pAtHandle);
+    uAtClientReadString(pAtHandle, pStr, maxLen, false);
+    uAtClientResponseStop(pAtHandle);
+    ret = uAtClientUnlock(pAtHandle);
+
+    if( ret < 0 ){
+        return ret;
+    }
+
+    if( strlen( pStr ) == 0 ){
+        return X_ERR_NOT_FOUND;
+    }
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+static int32_t NinaGetChannelList( int32_t *pChannels, size_t maxNum ){
+
+    int32_t ret;
+    int32_t channel;
+    size_t num = 0;
+    uAtClientHandle_t pAtHandle;
+
+    ret = uWifiAtClientHandleGet( gDevHandle, &pAtHandle );
+    if( ret < 0 ){
+        return ret;
+    }
+
+    // +UWCL:<channel>,<channel>,...
+    uAtClientLock(pAtHandle);
+    uAtClientCommandStart(pAtHandle, "AT+UWCL?");
+    uAtClientCommandStop(pAtHandle);
+    uAtClientResponseStart(pAtHandle, "+UWCL:");
+    // negative when there are no more channels in the response
+    while( ( num < maxNum ) && ( ( channel = uAtClientReadInt(pAtHandle) ) > 0 ) ){
+        pChannels[ num++ ] = channel;
+    }
+    uAtClientResponseStop(pAtHandle);
+    ret = uAtClientUnlock(pAtHandle);
+
+    if( ret < 0 ){
+        return ret;
+    }
+    if( num == 0 ){
+        return X_ERR_NOT_FOUND;
+    }
+
+    return (int32_t)num;
+}
+
+
+
+static err_code NinaSetChannelList( const int32_t *pChannels, size_t num ){
+
+    int32_t ret;
+    uAtClientHandle_t pAtHandle;
+
+    ret = uWifiAtClientHandleGet( gDevHandle, &pAtHandle );
+    if( ret < 0 ){
+        return ret;
+    }
+
+    uAtClientLock(pAtHandle);
+    uAtClientCommandStart(pAtHandle, "AT+UWCL=");
+    for( size_t x = 0; x < num; x++ ){
+        uAtClientWriteInt(pAtHandle, pChannels[x]);
+    }
+    uAtClientCommandStopReadResponse(pAtHandle);
+
+    return uAtClientUnlock(pAtHandle);
+}
+
+
+
+static err_code NinaSetIpConfig( bool useCached ){
+
+    const struct {
+        int32_t tag;
+        const char *pValue;
+    } staticIp[] = {
+        { WIFI_IPV4_ID_ADDR, gFastConnCache.ip },
+        { WIFI_IPV4_ID_MASK, gFastConnCache.mask },
+        { WIFI_IPV4_ID_GATEWAY, gFastConnCache.gateway },
+        { WIFI_IPV4_ID_DNS, gFastConnCache.dns }
+    };
+
+    int32_t ret;
+    uAtClientHandle_t pAtHandle;
+
+    ret = uWifiAtClientHandleGet( gDevHandle, &pAtHandle );
+    if( ret < 0 ){
+        return ret;
+    }
+
+    uAtClientLock(pAtHandle);
+
+    uAtClientCommandStart(pAtHandle, "AT+UWSC=");
+    uAtClientWriteInt(pAtHandle, WIFI_STA_CONFIG_ID);
+    uAtClientWriteInt(pAtHandle, WIFI_IPV4_ID_MODE);
+    uAtClientWriteInt(pAtHandle, useCached ? WIFI_IPV4_MODE_STATIC : WIFI_IPV4_MODE_DHCP);
+    uAtClientCommandStopReadResponse(pAtHandle);
+
+    if( useCached ){
+        for( size_t x = 0; x < ARRAY_SIZE(staticIp); x++ ){
+            uAtClientCommandStart(pAtHandle, "AT+UWSC=");
+            uAtClientWriteInt(pAtHandle, WIFI_STA_CONFIG_ID);
+            uAtClientWriteInt(pAtHandle, staticIp[x].tag);
+            uAtClientWriteString(pAtHandle, staticIp[x].pValue, false);
+            uAtClientCommandStopReadResponse(pAtHandle);
+        }
+    }
+
+    ret = uAtClientUnlock(pAtHandle);
+    if( ret < 0 ){
+        return ret;
+    }
+
+    gStaticIpSet = useCached;
+    return X_ERR_SUCCESS;
+}
+
+
+
+static bool NinaFastConnCacheRead( const char *pSsid ){
+
+    err_code ret;
+
+    if( !gFastConnStats.cacheSaved ){
+        memset( &gFastConnCache, 0, sizeof(gFastConnCache) );
+        ret = xStorageReadFile( &gFastConnCache, wifi_fast_conn_fname, sizeof(gFastConnCache) );
+        if( ret != sizeof(gFastConnCache) ){
+            memset( &gFastConnCache, 0, sizeof(gFastConnCache) );
+            return false;
+        }
+
+        // make sure strings are terminated, whatever was read from flash
+        gFastConnCache.ssid[ sizeof(gFastConnCache.ssid) - 1 ] = 0;
+        gFastConnCache.bssid[ sizeof(gFastConnCache.bssid) - 1 ] = 0;
+        gFastConnCache.ip[ sizeof(gFastConnCache.ip) - 1 ] = 0;
+        gFastConnCache.mask[ sizeof(gFastConnCache.mask) - 1 ] = 0;
+        gFastConnCache.gateway[ sizeof(gFastConnCache.gateway) - 1 ] = 0;
+        gFastConnCache.dns[ sizeof(gFastConnCache.dns) - 1 ] = 0;
+        gFastConnStats.cacheSaved = true;
+    }
+
+    // parameters of another network are of no use
+    return ( strcmp( gFastConnCache.ssid, pSsid ) == 0 ) && ( gFastConnCache.channel > 0 );
+}
+
+
+
+static void NinaFastConnCacheSave( bool usedFast ){
+
+    ninaFastConnCache_t cache;
+    char channelStr[ 8 ];
+    err_code ret;
+
+    // zeroed so that it can be compared with the saved one as a whole
+    memset( &cache, 0, sizeof(cache) );
+    strncpy( cache.ssid, gWiFiCredentialsAdded.SSIDstr, sizeof(cache.ssid) - 1 );
+
+    ret = NinaReadStatus( false, WIFI_STATUS_ID_BSSID, cache.bssid, sizeof(cache.bssid) );
+    if( ret == X_ERR_SUCCESS ){
+        ret = NinaReadStatus( false, WIFI_STATUS_ID_CHANNEL, channelStr, sizeof(channelStr) );
+    }
+    if( ret != X_ERR_SUCCESS ){
+        LOG_WRN("Could not read access point parameters: %d \r\n", ret);
+        return;
+    }
+    cache.channel = atoi( channelStr );
+
+    // the IP configuration is optional, only used if reuse is enabled
+    if( ( NinaReadStatus( true, WIFI_IPV4_ID_ADDR, cache.ip, sizeof(cache.ip) ) != X_ERR_SUCCESS ) ||
+        ( NinaReadStatus( true, WIFI_IPV4_ID_MASK, cache.mask, sizeof(cache.mask) ) != X_ERR_SUCCESS ) ||
+        ( NinaReadStatus( true, WIFI_IPV4_ID_GATEWAY, cache.gateway, sizeof(cache.gateway) ) != X_ERR_SUCCESS ) ||
+        ( NinaReadStatus( true, WIFI_IPV4_ID_DNS, cache.dns, sizeof(cache.dns) ) != X_ERR_SUCCESS ) ){
+        cache.ip[0] = cache.mask[0] = cache.gateway[0] = cache.dns[0] = 0;
+    }
+
+    if( usedFast && ( strcmp( cache.bssid, gFastConnCache.bssid ) != 0 ) ){
+        gFastConnStats.apChanged++;
+    }
+
+    // spare the flash, duty cycled connections usually end up to the same access point
+    if( gFastConnStats.cacheSaved && ( memcmp( &cache, &gFastConnCache, sizeof(cache) ) == 0 ) ){
+        return;
+    }
+
+    gFastConnCache = cache;
+    ret = xStorageSaveFile( &gFastConnCache, wifi_fast_conn_fname, sizeof(gFastConnCache) );
+    gFastConnStats.cacheSaved = ( ret >= 0 );
+    if( ret < 0 ){
+        LOG_WRN("Could not save access point parameters: %d \r\n", ret);
+        return;
+    }
+
+    LOG_INF("Access point cached: BSSID %s, channel %d \r\n", cache.bssid, cache.channel);
 }
 
 
@@ -308,6 +771,7 @@ void xWifiNinaInitThread(void){
         if( gNinaStatus.uStatus == uDeviceOpened ){
             LOG_INF("Already Initialized\r\n");
             gLastOperationResult = X_ERR_SUCCESS;
+            xWifiConnPostEvent( WIFI_CONN_EVT_INITIALIZED, X_ERR_SUCCESS );
             continue;
         }
 
@@ -379,6 +843,7 @@ void xWifiNinaInitThread(void){
 
         //stop configuration Led indication
         xLedOff();
+        xWifiConnPostEvent( WIFI_CONN_EVT_INITIALIZED, X_ERR_SUCCESS );
     }
 }
 
@@ -393,16 +858,15 @@ void xWifiNinaDeinitThread(void){
 
         LOG_INF("NINA deinit request\r\n");
 
-        xCommonUPortDeinit();
-        while( xCommonUPortIsInit() ){
-            k_sleep(K_MSEC(500));
-        }
+        // closes the device (and deinitializes ubxlib port unless kept alive)
+        xCommonUPortRelease();
 
         // Invalidate credentials used
         NinaResetCredentials( &gWiFiCredentialsAdded );
 
         LOG_INF("Module Deinitialized\r\n");
         gNinaStatus.uStatus = uPortNotInitialized;
+        xWifiConnPostEvent( WIFI_CONN_EVT_DEINITIALIZED, X_ERR_SUCCESS );
     }
 }
 
@@ -417,7 +881,7 @@ void xWifiNinaConnectThread(void){
 
     while(1){
 
-        // Semaphore given by xWifiNinaConnect()
+        // Semaphore given by xWifiNinaConnectStep()
         k_sem_take( &xWifiNinaConnect_semaphore, K_FOREVER );
 
         LOG_DBG("WiFi Connection request \r\n");
@@ -429,27 +893,15 @@ void xWifiNinaConnectThread(void){
         if( gNinaStatus.isConnected ){
             LOG_INF("Already connected \r\n");
             gLastOperationResult = X_ERR_SUCCESS;
+            xWifiConnPostEvent( WIFI_CONN_EVT_NETWORK_UP, X_ERR_SUCCESS );
             continue;
         }
 
-        // if xWifiNinaInit() has not been called before, it is called now.
+        // the connection state machine initializes the module before this step
         if( gNinaStatus.uStatus < uDeviceOpened ){
-            
-            LOG_WRN("No valid WiFi device opened. Configuring and opening device now\r\n");
-     
-            // Configure and add a WiFi device
-            xWifiNinaInit();
-            
-            while( ( gNinaStatus.uStatus < uDeviceOpened ) && ( gLastOperationResult == X_ERR_SUCCESS ) ){
-                k_sleep(K_MSEC(1000));
-                //ubxlib contains timeouts by itself
-            }
-            
-            //check if the cofiguration was successful in order to proceed
-            if( gLastOperationResult != X_ERR_SUCCESS ){
-                LOG_ERR("Error Code from NINA W156 configuration request: %d - Abort WiFi connection request\r\n", gLastOperationResult);
-                continue;
-            }
+            LOG_ERR("No valid WiFi device opened. Abort WiFi connection request\r\n");
+            NinaErrorHandle( X_ERR_INVALID_STATE );
+            continue;
         } 
 
         // set up led indication
@@ -487,40 +939,92 @@ void xWifiNinaConnectThread(void){
             continue;
         }
 
-        // Connection to Wifi network configuration- if open Network
-        static const uNetworkCfgWifi_t  wifiConfigOpen = {
-            .type = U_NETWORK_TYPE_WIFI,
-            .pSsid = gWiFiCredentialsPending.SSIDstr,
-            .authentication = 1, //2 /* WPA/WPA2/WPA3 - see wifi/api/u_wifi_net.h */,
-            .pPassPhrase = NULL
-        };
-
-        // Connection to Wifi network configuration- if Network requires password
-        static const uNetworkCfgWifi_t  wifiConfig = {
-            .type = U_NETWORK_TYPE_WIFI,
-            .pSsid = gWiFiCredentialsPending.SSIDstr,
-            .authentication = 2, //2 /* WPA/WPA2/WPA3 - see wifi/api/u_wifi_net.h */,
-            .pPassPhrase = gWiFiCredentialsPending.PSWstr
-        };
-
         // Connnect to network (open or protected with password)
         LOG_INF("Bring-up WiFi\r\n");
 
-        // open
-        if(gWiFiCredentialsPending.sec_type == 1){
-            if( ( ret = uNetworkInterfaceUp( gDevHandle, U_NETWORK_TYPE_WIFI, &wifiConfigOpen ) ) == X_ERR_SUCCESS ){
-                // If connected to network succesfully, keep a copy of the network used
-                strcpy( gWiFiCredentialsAdded.SSIDstr, wifiConfigOpen.pSsid );
-                gWiFiCredentialsAdded.sec_type = 1;    
+        // Try first to associate with the last access point connected: only its
+        // channel is scanned (and DHCP is skipped if the cached IP is reused)
+        bool fast = gFastConnStats.enabled && NinaFastConnCacheRead( gWiFiCredentialsPending.SSIDstr );
+        bool fastIp = fast && gFastConnStats.reuseIp && ( strlen( gFastConnCache.ip ) > 0 );
+        int64_t start;
+
+        // the lease may have been reassigned by now, renew it with DHCP
+        if( fastIp && ( ( gDhcpLeaseMs < 0 ) ||
+                        ( k_uptime_get() - gDhcpLeaseMs > WIFI_FAST_CONN_IP_MAX_AGE_MS ) ) ){
+            LOG_INF("Cached IP lease expired or of unknown age, DHCP \r\n");
+            fastIp = false;
+        }
+
+        // the channel list is restored as it was after a fast connection, it
+        // depends on the regulatory domain
+        int32_t savedNum = 0;
+        if( fast ){
+            savedNum = NinaGetChannelList( gSavedChannels, ARRAY_SIZE(gSavedChannels) );
+            if( savedNum <= 0 ){
+                LOG_WRN("Channel list not read: %d, full connect \r\n", savedNum);
+                fast = false;
+                fastIp = false;
             }
         }
-        // password protected
-        else{
-            if( ( ret = uNetworkInterfaceUp( gDevHandle, U_NETWORK_TYPE_WIFI, &wifiConfig ) ) == X_ERR_SUCCESS ){
-                // If connected to network succesfully, keep a copy of the network used
-                strcpy( gWiFiCredentialsAdded.SSIDstr, wifiConfig.pSsid );
-                strcpy( gWiFiCredentialsAdded.PSWstr, wifiConfig.pPassPhrase );
-                gWiFiCredentialsAdded.sec_type = 2;
+
+        if( fast ){
+            LOG_INF("Fast connect: BSSID %s, channel %d%s \r\n", gFastConnCache.bssid,
+                    gFastConnCache.channel, fastIp ? ", cached IP" : "");
+
+            ret = NinaSetChannelList( &gFastConnCache.channel, 1 );
+            if( ( ret == X_ERR_SUCCESS ) && ( fastIp || gStaticIpSet ) ){
+                ret = NinaSetIpConfig( fastIp );
+            }
+
+            start = k_uptime_get();
+            if( ret == X_ERR_SUCCESS ){
+                ret = NinaNetworkUp();
+            }
+
+            // scan all channels again for the next scan or full connection
+            NinaSetChannelList( gSavedChannels, savedNum );
+
+            if( ret == X_ERR_SUCCESS ){
+                gFastConnFailures = 0;
+                gFastConnStats.fastOk++;
+                gFastConnStats.lastFastMs = (int32_t)( k_uptime_get() - start );
+                if( gFastConnStats.lastFullMs > 0 ){
+                    gFastConnStats.lastSavedMs = gFastConnStats.lastFullMs - gFastConnStats.lastFastMs;
+                }
+                LOG_INF("Fast connect took %d ms (saved %d ms) \r\n", gFastConnStats.lastFastMs,
+                        gFastConnStats.lastSavedMs);
+            }
+            else{
+                // access point moved to another channel, lease reassigned etc.
+                LOG_WRN("Fast connect failed: %d, full connect \r\n", ret);
+                gFastConnStats.fastFailed++;
+                uNetworkInterfaceDown( gDevHandle, U_NETWORK_TYPE_WIFI );
+
+                // a single failure may be transient (access point busy, beacon
+                // missed), the full connection refreshes the cache anyway
+                if( ++gFastConnFailures >= WIFI_FAST_CONN_MAX_FAILURES ){
+                    xWifiNinaFastConnClear();
+                    gFastConnFailures = 0;
+                }
+
+                // the cached IP is not reused until DHCP assigns one again
+                gDhcpLeaseMs = -1;
+                fast = false;
+            }
+        }
+
+        if( !fast ){
+            if( gStaticIpSet ){
+                NinaSetIpConfig( false );
+            }
+
+            start = k_uptime_get();
+            ret = NinaNetworkUp();
+
+            if( ret == X_ERR_SUCCESS ){
+                gFastConnStats.fullConnects++;
+                gFastConnStats.lastFullMs = (int32_t)( k_uptime_get() - start );
+                LOG_INF("Full connect took %d ms \r\n", gFastConnStats.lastFullMs);
             }
         }
 
@@ -532,10 +1036,18 @@ void xWifiNinaConnectThread(void){
             continue;
         }
 
+        // the IP configuration cached below is a new lease
+        if( !gStaticIpSet ){
+            gDhcpLeaseMs = k_uptime_get();
+        }
+
+        NinaFastConnCacheSave( fast );
+
         gNinaStatus.isConnected = true;
         LOG_INF("WiFi Connected\r\n");
         xLedOff();
         gLastOperationResult = X_ERR_SUCCESS;
+        xWifiConnPostEvent( WIFI_CONN_EVT_NETWORK_UP, X_ERR_SUCCESS );
     }
 }
 
@@ -694,6 +1206,7 @@ void xWifiNinaPowerOn(void)
 
     gNinaStatus.isPowered = true;
     LOG_INF("Module powered Up\r\n");
+    xWifiConnPostEvent( WIFI_CONN_EVT_POWERED, X_ERR_SUCCESS );
 
 }
 
@@ -728,6 +1241,9 @@ void xWifiNinaDisconnect(void){
 
     LOG_INF("NINA-W156 Disconnection Request \r\n");
 
+    // disconnected by the user, do not reconnect MQTT
+    xWifiConnStopSupervision();
+
     if( gNinaStatus.isConnected == false ){
         LOG_INF("Already Disconnected\r\n");    
         return;
@@ -753,6 +1269,7 @@ void xWifiNinaDisconnect(void){
     xLedOff(); //stop indication
     gNinaStatus.isConnected = false;
     LOG_INF("Disconnected\r\n");
+    xWifiConnPostEvent( WIFI_CONN_EVT_NETWORK_DOWN, X_ERR_SUCCESS );
     return;
 }
 
@@ -764,6 +1281,9 @@ err_code xWifiNinaDeleteNetworkConfig( void ){
 
     NinaResetCredentials( &gWiFiCredentialsPending );
 
+    // cached access point parameters refer to the deleted network
+    xWifiNinaFastConnClear();
+
     rc = xStorageDeleteFile( wifi_cred_psw_fname ); 		
     if(rc != 0 ){
         if( rc == ERR_STORAGE_FILE_NOT_FOUND ){
@@ -899,6 +1419,14 @@ err_code xWifiNinaScan( uint16_t *foundNetsNum ){
 
     ret = uWifiStationScan( gDevHandle, NULL, uWifiScanResultCallback);
     if( ret == U_ERROR_COMMON_SUCCESS ){
+        // heap sort: the weakest result is moved to the end each time,
+        // leaving the results sorted by descending RSSI
+        for( uint8_t last = gScannedNetworks.networksNum; last > 1; last-- ){
+            xWifiNinaScanResult_t tmp = gScannedNetworks.networks[0];
+            gScannedNetworks.networks[0] = gScannedNetworks.networks[last - 1];
+            gScannedNetworks.networks[last - 1] = tmp;
+            NinaScanHeapSiftDown( last - 1, 0 );
+        }
         *foundNetsNum = gScannedNetworks.networksNum;
     }
     
@@ -908,7 +1436,7 @@ err_code xWifiNinaScan( uint16_t *foundNetsNum ){
 
 
 
-err_code xWifiNinaGetScanResult( uint16_t reqResultNum, uWifiScanResult_t *result ){
+err_code xWifiNinaGetScanResult( uint16_t reqResultNum, xWifiNinaScanResult_t *result ){
 
     // check parameters
     if( reqResultNum == 0 ){
@@ -944,10 +1472,11 @@ void xWifiNinaTypeLastScanResults( void ){
     // %*s in shell print is like %20s, but instead of 20 the * points to
     // U_WIFI_SSID_SIZE. It is used for alligned printing
     for( uint8_t x = 0; x < gScannedNetworks.networksNum; x++ ){
-        LOG_INF( "%3d: SSID: %*s  Rssi: %d", x+1,
+        LOG_INF( "%3d: SSID: %*s  Rssi: %d  Channel: %d", x+1,
                   U_WIFI_SSID_SIZE,
                   gScannedNetworks.networks[x].ssid,
-                  gScannedNetworks.networks[x].rssi );
+                  gScannedNetworks.networks[x].rssi,
+                  gScannedNetworks.networks[x].channel );
     }
 }
 
@@ -958,6 +1487,81 @@ bool xWifiNinaIsScanMaxReached(void){
 
 
 
+err_code xWifiNinaGetRssi( int32_t *pRssiDbm ){
+
+    int32_t ret;
+    int32_t rssi;
+    uAtClientHandle_t pAtHandle;
+
+    if( !gNinaStatus.isConnected || ( gNinaStatus.uStatus < uDeviceOpened ) ){
+        return X_ERR_INVALID_STATE;
+    }
+
+    ret = uWifiAtClientHandleGet( gDevHandle, &pAtHandle );
+    if( ret < 0 ){
+        return ret;
+    }
+
+    // status id 6: RSSI of the connected network
+    uAtClientLock(pAtHandle);
+    uAtClientCommandStart(pAtHandle, "AT+UWSSTAT=");
+    uAtClientWriteInt(pAtHandle, WIFI_STATUS_ID_RSSI);
+    uAtClientCommandStop(pAtHandle);
+    uAtClientResponseStart(pAtHandle, "+UWSSTAT:");
+    uAtClientReadInt(pAtHandle);
+    rssi = uAtClientReadInt(pAtHandle);
+    uAtClientResponseStop(pAtHandle);
+    ret = uAtClientUnlock(pAtHandle);
+
+    if( ret < 0 ){
+        return ret;
+    }
+
+    // reported when not available
+    if( rssi == WIFI_RSSI_NOT_AVAILABLE ){
+        return X_ERR_INVALID_STATE;
+    }
+
+    *pRssiDbm = rssi;
+    return X_ERR_SUCCESS;
+}
+
+
+
+void xWifiNinaFastConnEnable( bool enable, bool reuseIp ){
+    gFastConnStats.enabled = enable;
+    gFastConnStats.reuseIp = enable && reuseIp;
+    LOG_INF("WiFi fast connection %s%s \r\n", enable ? "enabled" : "disabled",
+            gFastConnStats.reuseIp ? " (reuse IP)" : "");
+}
+
+
+
+err_code xWifiNinaFastConnClear( void ){
+
+    err_code ret;
+
+    memset( &gFastConnCache, 0, sizeof(gFastConnCache) );
+    gFastConnStats.cacheSaved = false;
+
+    ret = xStorageDeleteFile( wifi_fast_conn_fname );
+    // not an error if nothing has been cached yet
+    if( ret == ERR_STORAGE_FILE_NOT_FOUND ){
+        ret = X_ERR_SUCCESS;
+    }
+
+    LOG_INF("WiFi fast connection cache cleared \r\n");
+    return ret;
+}
+
+
+
+xWifiNinaFastConnStats_t xWifiNinaGetFastConnStats( void ){
+    return gFastConnStats;
+}
+
+
+
 uDeviceHandle_t xWifiNinaGetHandle(void){
     return gDevHandle;
 }
@@ -977,12 +1581,21 @@ void xWifiNinaInit(void){
 
 
 void xWifiNinaConnect(void){
+    gLastOperationResult = X_ERR_SUCCESS;
+    xWifiConnRequest( WIFI_CONN_STATE_NETWORK_UP );
+}
+
+
+
+void xWifiNinaConnectStep(void){
     k_sem_give( &xWifiNinaConnect_semaphore );
 }
 
 
 
 void xWifiNinaDeinit(void){
+    // the MQTT client goes down with the device, do not reconnect
+    xWifiConnStopSupervision();
     k_sem_give( &xWifiNinaDeinit_sempahore );
 }
 
@@ -1148,13 +1761,79 @@ void xWifiNinaScanCmd(const struct shell *shell, size_t argc, char **argv){
     // %*s in shell print is like %20s, but instead of 20 the * points to
     // U_WIFI_SSID_SIZE. It is used for alligned printing
     for( uint8_t x = 0; x < gScannedNetworks.networksNum; x++ ){
-        shell_print( shell,"%3d: SSID: %*s  Rssi: %d", x+1,
+        shell_print( shell,"%3d: SSID: %*s  Rssi: %d  Channel: %d", x+1,
                      U_WIFI_SSID_SIZE,
                      gScannedNetworks.networks[x].ssid,
-                     gScannedNetworks.networks[x].rssi );
+                     gScannedNetworks.networks[x].rssi,
+                     gScannedNetworks.networks[x].channel );
     }
 
     shell_print( shell, "\r\n.....End of results.....\r\n" );
 
     return;
 }
+
+
+
+void xWifiNinaFastConnCmd(const struct shell *shell, size_t argc, char **argv){
+
+    err_code err;
+
+    if( argc > 2 ){
+        shell_print(shell, "Invalid number of parameters\r\n");  
+        return;
+    }
+
+    if( argc == 2 ){
+
+        if( strcmp(argv[1], "on") == 0 ){
+            xWifiNinaFastConnEnable( true, false );
+        }
+
+        else if( strcmp(argv[1], "ip") == 0 ){
+            xWifiNinaFastConnEnable( true, true );
+        }
+
+        else if( strcmp(argv[1], "off") == 0 ){
+            xWifiNinaFastConnEnable( false, false );
+        }
+
+        else if( strcmp(argv[1], "clear") == 0 ){
+            err = xWifiNinaFastConnClear();
+            if( err != X_ERR_SUCCESS ){
+                shell_print(shell, "%sCould not clear WiFi fast connection cache: %d %s\r\n",LOG_CLRCODE_RED, err, LOG_CLRCODE_DEFAULT );
+            }
+        }
+
+        else{
+            shell_print(shell, "Invalid parameter (on/off/ip/clear)\r\n");  
+        }
+
+        return;
+    }
+
+    // load the cache from flash if not loaded yet, the SSID does not matter here
+    NinaFastConnCacheRead( "" );
+
+    shell_print(shell, "\r\n\
+WiFi fast connection -------------------\r\n\
+        - Enabled: %s (reuse IP: %s)\r\n\
+        - Cached: %s\r\n\
+        - SSID: %s, BSSID: %s, Channel: %d\r\n\
+        - IP: %s, Mask: %s, Gateway: %s, DNS: %s\r\n\
+Connections (since boot) ---------------\r\n\
+        - Fast: %d (failed: %d, access point changed: %d)\r\n\
+        - Full: %d\r\n\
+        - Last fast association (ms): %d\r\n\
+        - Last full association (ms): %d\r\n\
+        - Saved by last fast association (ms): %d\r\n",
+        gFastConnStats.enabled ? "yes" : "no", gFastConnStats.reuseIp ? "yes" : "no",
+        gFastConnStats.cacheSaved ? "yes" : "no",
+        gFastConnCache.ssid, gFastConnCache.bssid, gFastConnCache.channel,
+        gFastConnCache.ip, gFastConnCache.mask, gFastConnCache.gateway, gFastConnCache.dns,
+        gFastConnStats.fastOk, gFastConnStats.fastFailed, gFastConnStats.apChanged,
+        gFastConnStats.fullConnects,
+        gFastConnStats.lastFastMs, gFastConnStats.lastFullMs, gFastConnStats.lastSavedMs);
+
+    return;
+}
@@ -64,8 +64,37 @@
 #define WIFI_MIN_PSW_LEN   1
 
 /** Scan result max buffer size (how many scanned networks results can be
- *  hold in the buffer) */
-#define WIFI_SCAN_RESULTS_BUF_SIZE  50
+ *  hold in the buffer). When more networks are found, the strongest ones are kept.
+ *  Should not exceed 255 */
+#define WIFI_SCAN_RESULTS_BUF_SIZE  72
+
+/** AT+UWSSTAT status id of the connected network RSSI and the value reported
+ *  when not available */
+#define WIFI_STATUS_ID_RSSI       6
+#define WIFI_RSSI_NOT_AVAILABLE   -32768
+
+/** AT+UWSSTAT status ids of the connected access point BSSID and channel */
+#define WIFI_STATUS_ID_BSSID      1
+#define WIFI_STATUS_ID_CHANNEL    2
+
+/** Length of a BSSID string as reported by the module (12 hex digits) and
+ *  of an IPv4 address string, including the terminating character */
+#define WIFI_BSSID_STR_LEN        13
+#define WIFI_IPV4_STR_LEN         16
+
+/** AT+UWSC station configuration id (the one used by ubxlib) and
+ *  AT+UNSTAT network interface id of the station */
+#define WIFI_STA_CONFIG_ID        0
+#define WIFI_STA_INTERFACE_ID     0
+
+/** IPv4 parameter tags of AT+UWSC, also used as AT+UNSTAT status ids */
+#define WIFI_IPV4_ID_MODE         100   /**< AT+UWSC only: 1 = static, 2 = DHCP */
+#define WIFI_IPV4_ID_ADDR         101
+#define WIFI_IPV4_ID_MASK         102
+#define WIFI_IPV4_ID_GATEWAY      103
+#define WIFI_IPV4_ID_DNS          104
+#define WIFI_IPV4_MODE_STATIC     1
+#define WIFI_IPV4_MODE_DHCP       2
 
 
 /* ----------------------------------------------------------------
@@ -94,6 +123,38 @@ typedef struct{
 
 
 
+/** Struct type to hold a WiFi scan result. Only the fields used by the application
+ * are kept from uWifiScanResult_t, so that more results fit in the scan buffer.
+ */
+typedef struct{
+    char ssid[ U_WIFI_SSID_SIZE ];         /**< String containing the network SSID */
+    uint8_t bssid[ U_WIFI_BSSID_SIZE ];    /**< BSSID of the strongest access point found for the SSID */
+    int8_t rssi;                           /**< RSSI in dBm */
+    uint8_t channel;                       /**< Channel of the strongest access point */
+    uint8_t authSuiteBitmask;              /**< Security, as reported in uWifiScanResult_t */
+}xWifiNinaScanResult_t;
+
+
+
+/** Statistics of the fast reconnection, which uses the parameters of the last
+ * access point connected (see xWifiNinaFastConnEnable()). Counted since boot,
+ * association times are in ms.
+ */
+typedef struct{
+    bool     enabled;       /**< Cached access point parameters are used on connect */
+    bool     reuseIp;       /**< The cached IP configuration is also reused (no DHCP) */
+    bool     cacheSaved;    /**< Parameters of the last connected access point are cached */
+    uint32_t fastOk;        /**< Connections using the cached parameters */
+    uint32_t fastFailed;    /**< Fast connections failed (fell back to a full connection) */
+    uint32_t fullConnects;  /**< Connections scanning all channels */
+    uint32_t apChanged;     /**< Fast connections that ended up to another access point (BSSID) */
+    int32_t  lastFastMs;    /**< Association time of the last fast connection */
+    int32_t  lastFullMs;    /**< Association time of the last full connection */
+    int32_t  lastSavedMs;   /**< Association time saved by the last fast connection (vs the last full one) */
+}xWifiNinaFastConnStats_t;
+
+
+
 /* ----------------------------------------------------------------
  * FUNCTIONS - HARDWARE CONTROL
  * -------------------------------------------------------------- */
@@ -175,12 +236,20 @@ void xWifiNinaInit(void);
 void xWifiNinaDeinit(void);
 
 
-/** Enables the NINA connection thread, which connects NINA to the configured WiFi Network.
- *  If not already initialized it also calls xWiFiNinaInit() internally.
+/** Connects NINA to the configured WiFi Network, by requesting the network up state
+ *  from the WiFi connection state machine (x_wifi_conn.h). If not already initialized
+ *  the module is initialized first.
  */
 void xWifiNinaConnect(void);
 
 
+/** Enables the NINA connection thread, which connects NINA to the configured WiFi Network.
+ *  Used by the WiFi connection state machine. The module should be initialized, use
+ *  xWifiNinaConnect() instead.
+ */
+void xWifiNinaConnectStep(void);
+
+
 /** Disconnects NINA from configured WiFi network.
  */
 void xWifiNinaDisconnect(void);
@@ -226,6 +295,9 @@ void xWifiNinaDeviceClose(void);
  * first.
  * The actual SSIDs found can be retrieved by using the 
  * xWifiNinaGetNextScanResult() function.
+ * Each SSID is reported once (with its strongest access point) and the results
+ * are sorted by descending RSSI. If more than WIFI_SCAN_RESULTS_BUF_SIZE SSIDs
+ * are found, the weakest ones are discarded.
  *
  * @param[out] foundNetsNum  [out]The number of SSIDs found during the scan.
  * 
@@ -251,7 +323,7 @@ err_code xWifiNinaScan( uint16_t *foundNetsNum );
  * 
  * @return                       zero on success else negative error code.
  */
-err_code xWifiNinaGetScanResult( uint16_t reqResultNum, uWifiScanResult_t *result );
+err_code xWifiNinaGetScanResult( uint16_t reqResultNum, xWifiNinaScanResult_t *result );
 
 
 /** Types the results from the last xWifiNinaScan() function execution.
@@ -261,14 +333,54 @@ void xWifiNinaTypeLastScanResults( void );
 
 
 /** Should be used after a xWifiNinaScan() operation. If the results found are more
- * than the Scan results buffer can hold, this returns true. In this case not
- * all scan results can be obtained from xWifiNinaTypeLastScanResults() or
+ * than the Scan results buffer can hold, this returns true. In this case the weakest
+ * scan results cannot be obtained from xWifiNinaTypeLastScanResults() or
  * xWifiNinaGetScanResult().
  * 
  * @return false if all results can be obtained. True otherwise
  */
 bool xWifiNinaIsScanMaxReached(void);
 
+
+/** Reads the RSSI of the network the module is connected to (AT+UWSSTAT).
+ * 
+ * @param[out] pRssiDbm  The RSSI in dBm.
+ * 
+ * @return        zero on success else negative error code.
+ */
+err_code xWifiNinaGetRssi( int32_t *pRssiDbm );
+
+
+/** Enable/disable the fast reconnection. After each successful connection
+ * the BSSID and channel of the access point (and its IP configuration) are
+ * saved in flash. When enabled, the next connection to the same SSID only
+ * scans the cached channel, falling back to a full connection if this fails.
+ * The cache is deleted after WIFI_FAST_CONN_MAX_FAILURES fast connections
+ * failed in a row. Enabled by default (WIFI_FAST_CONN_DEFAULT).
+ *
+ * @param enable   true to use the cached parameters, false to always scan all channels.
+ * @param reuseIp  true to also reuse the cached IP configuration as a static one
+ *                 (skips DHCP). Only a lease obtained with DHCP since boot and
+ *                 younger than WIFI_FAST_CONN_IP_MAX_AGE_MS is reused, else DHCP
+ *                 is used and the lease renewed.
+ */
+void xWifiNinaFastConnEnable( bool enable, bool reuseIp );
+
+
+/** Delete the cached access point parameters. The next connection scans
+ * all channels.
+ *
+ * @return        zero on success else negative error code.
+ */
+err_code xWifiNinaFastConnClear( void );
+
+
+/** Get the statistics of the fast reconnection.
+ * 
+ * @return        The statistics in xWifiNinaFastConnStats_t.
+ */
+xWifiNinaFastConnStats_t xWifiNinaGetFastConnStats( void );
+
 /* ----------------------------------------------------------------
  * FILE FUNCTIONS
  * -------------------------------------------------------------- */
@@ -373,5 +485,18 @@ void xWifiNinaTypeNetworkParamsCmd(const struct shell *shell, size_t argc, char
 void xWifiNinaScanCmd(const struct shell *shell, size_t argc, char **argv);
 
 
+/** This function is intented only to be used as a command executed by the shell.
+ * Without parameters it types the cached access point parameters and the fast
+ * reconnection statistics. With a parameter it enables (on), disables (off) the
+ * fast reconnection, enables it reusing the cached IP configuration (ip) or 
+ * deletes the cache (clear).
+ * 
+ * @param shell  the shell instance from which the command is given (and to which the command types).
+ * @param argc   the number of parameters given along with the command (0 or 1).
+ * @param argv   the array including the parameters themselves (on/off/ip/clear).
+ */
+void xWifiNinaFastConnCmd(const struct shell *shell, size_t argc, char **argv);
+
+
 
 #endif  //X_WIFI_NINAW156_H__
\ No newline at end of file
@@ -29,6 +29,7 @@
 #include <hal/nrf_uarte.h>
 #include <logging/log.h>
 #include <logging/log_ctrl.h> //log_process
+#include <string.h> //strcmp
 
 // Ubxlib related
 //#include "u_port.h"
@@ -58,6 +59,11 @@
 void xCommonUPortDeinitThread(void);
 
 
+/** Closes the device handles and deinitializes the port (unless kept alive)
+*/
+static void commonUPortRelease(void);
+
+
 /* ----------------------------------------------------------------
  * ZEPHYR RELATED DEFINITIONS/DECLARATIONS
  * -------------------------------------------------------------- */
@@ -67,6 +73,10 @@ LOG_MODULE_REGISTER( LOGMOD_NAME_UBLMOD_COMMON, LOG_LEVEL_DBG );
 
 // Semaphore definition
 K_SEM_DEFINE(xCommonUPortDeinit_semaphore, 0, 1);
+K_SEM_DEFINE(xCommonUPortReleased_semaphore, 0, 1);
+
+// Serializes xCommonUPortRelease callers
+K_MUTEX_DEFINE(xCommonUPortRelease_mutex);
 
 // Thread definition
 K_THREAD_DEFINE(xCommonUPortDeinitThreadId, C210_UPORT_STACK_SIZE, xCommonUPortDeinitThread, NULL, NULL, NULL,
@@ -83,6 +93,16 @@ K_THREAD_DEFINE(xCommonUPortDeinitThreadId, C210_UPORT_STACK_SIZE, xCommonUPortD
 static bool gubxlibPortInitialized = false;
 
 
+/** Keep ubxlib port initialized when releasing (only close device handles)
+*/
+static bool gKeepAlive = C210_UPORT_KEEP_ALIVE_DEFAULT;
+
+
+/** Release statistics
+*/
+static xCommonUPortStats_t gUPortStats = {0};
+
+
 /** Signals which module (SARA or NINA) is configured in the common UART
  * peripheral. Default is none 
 */
@@ -129,85 +149,117 @@ void xCommonUPortDeinitThread(void){
 
         LOG_INF("uPort Deinitialize request \r\n");
 
-        // no need to do something
-        if( !gubxlibPortInitialized ){
-            //operation_result =  success
-            continue;     
-        } 
+        commonUPortRelease();
 
-        // get Max module status and close 
-        xPosMaxM10Status_t maxM10status = xPosMaxM10GetModuleStatus();
-        if( maxM10status.isUbxInit){
-            xPosMaxM10Deinit();
-        }
+        // signal xCommonUPortRelease
+        k_sem_give( &xCommonUPortReleased_semaphore );
+    }
+}
 
-        // get WiFi network initialization status and close if necessary
-        // also handle mqtt client
-        xWifiNinaStatus_t ninaStatus = xWifiNinaGetModuleStatus();
 
-        if( ninaStatus.uStatus >= uDeviceApiInitialized ){
-            xWifiNinaDeviceClose();
-        }
 
-        // get Cellular network initialization status and close (SARA)
-        // if necessary. Also handles MQTT-SN client
-        xCellSaraStatus_t saraStatus = xCellSaraGetModuleStatus();
+static void commonUPortRelease(void){
+
+    // no need to do something
+    if( !gubxlibPortInitialized ){
+        //operation_result =  success
+        return;     
+    } 
+
+    int64_t start = k_uptime_get();
+
+    // get Max module status and close 
+    xPosMaxM10Status_t maxM10status = xPosMaxM10GetModuleStatus();
+    if( maxM10status.isUbxInit){
+        xPosMaxM10Deinit();
+    }
+
+    // get WiFi network initialization status and close if necessary
+    // also handle mqtt client
+    xWifiNinaStatus_t ninaStatus = xWifiNinaGetModuleStatus();
+
+    if( ninaStatus.uStatus >= uDeviceApiInitialized ){
+        xWifiNinaDeviceClose();
+    }
+
+    // get Cellular network initialization status and close (SARA)
+    // if necessary. Also handles MQTT-SN client
+    xCellSaraStatus_t saraStatus = xCellSaraGetModuleStatus();
 
-        if( saraStatus.uStatus >= uDeviceApiInitialized ){
-            xCellSaraDeviceClose();
+    if( saraStatus.uStatus >= uDeviceApiInitialized ){
+        xCellSaraDeviceClose();
 
-            while( ( saraStatus.uStatus >= uDeviceApiInitialized ) ){   
-                k_sleep(K_MSEC(1000));
-                saraStatus = xCellSaraGetModuleStatus();
-                //we do not check errors here
-                //operation_result = xCellSaraGetLastOperationResult();
-            }
+        // the device is normally closed on return, poll only if needed
+        saraStatus = xCellSaraGetModuleStatus();
+        while( ( saraStatus.uStatus >= uDeviceApiInitialized ) ){   
+            k_sleep(K_MSEC(1000));
+            saraStatus = xCellSaraGetModuleStatus();
+            //we do not check errors here
+            //operation_result = xCellSaraGetLastOperationResult();
         }
+    }
 
-        // port deinit optical indication
-        //  both cell and wifi have the same color in deactivation
-        xLedFade(WIFI_DEACTIVATING_LEDCOL,WIFI_ACTIVATING_LED_DELAY_ON, WIFI_ACTIVATING_LED_DELAY_ON, 0);
+    gUPortStats.releases++;
 
-        //give time for pending logging messages (if any)
-        k_sleep(K_MSEC(1000));
+    // keep-alive: devices are closed, the port (and shell) stays as is
+    if( gKeepAlive ){
+        gUPortStats.lastReleaseMs = (uint32_t)( k_uptime_get() - start );
+        if( gUPortStats.lastReleaseMs > gUPortStats.maxReleaseMs ){
+            gUPortStats.maxReleaseMs = gUPortStats.lastReleaseMs;
+        }
+        LOG_INF("Devices closed, port kept initialized (%d ms)\r\n", gUPortStats.lastReleaseMs);
+        return;
+    }
 
-        // Process any pending logs from sensor modules prior to disabling
-        // (this could cause problems in very fast sampling rates? < 100ms )
+    // port deinit optical indication
+    //  both cell and wifi have the same color in deactivation
+    xLedFade(WIFI_DEACTIVATING_LEDCOL,WIFI_ACTIVATING_LED_DELAY_ON, WIFI_ACTIVATING_LED_DELAY_ON, 0);
+
+    //give time for pending logging messages (if any)
+    k_sleep(K_MSEC(1000));
+
+    // Process any pending logs from sensor modules prior to disabling
+    // (this could cause problems in very fast sampling rates? < 100ms )
 	    while( log_process(false) ){
 	    	;
 	    }
 
-        // save logger state (in order to restore it after shell is deinitialized
-        // and then reinitialized). If is not done, logger state resets to default settings
-        xLogSaveState();
+    // save logger state (in order to restore it after shell is deinitialized
+    // and then reinitialized). If is not done, logger state resets to default settings
+    xLogSaveState();
 
-        // shell is uninitialized before uPort deinitialization. If uPortDeinit
-        // is called with shell enabled, the console uart input crashes.
+    // shell is uninitialized before uPort deinitialization. If uPortDeinit
+    // is called with shell enabled, the console uart input crashes.
 	    xShellDeinit();
+
+    // wait for shell to deinitialize
+
+    //this does not work...
+    //while( !xShellDeinitIsComplete() ){
+        //wait
+    //}
+    // a wait is used instead
+    k_sleep(K_MSEC(1000));
+
+    // finally close uPort
+    uPortDeinit();
     
-        // wait for shell to deinitialize
-
-        //this does not work...
-        //while( !xShellDeinitIsComplete() ){
-            //wait
-        //}
-        // a wait is used instead
-        k_sleep(K_MSEC(1000));
-
-        // finally close uPort
-        uPortDeinit();
-        
-        // reinitilize shell and restore logger settings
-        xShellReinitTrigger();
+    // reinitilize shell and restore logger settings
+    xShellReinitTrigger();
 	    k_sleep(K_MSEC(1000));
 	    xLogRestoreState();
 
-        LOG_INF("Port DeInitialized\r\n");
-        xLedOff();
-        gubxlibPortInitialized = false;
-        
-        //operation_result =  SUCCESS
+    gUPortStats.portDeinits++;
+    gUPortStats.lastReleaseMs = (uint32_t)( k_uptime_get() - start );
+    if( gUPortStats.lastReleaseMs > gUPortStats.maxReleaseMs ){
+        gUPortStats.maxReleaseMs = gUPortStats.lastReleaseMs;
     }
+
+    LOG_INF("Port DeInitialized (%d ms)\r\n", gUPortStats.lastReleaseMs);
+    xLedOff();
+    gubxlibPortInitialized = false;
+    
+    //operation_result =  SUCCESS
 }
 
 
@@ -228,6 +280,31 @@ void xCommonUPortDeinit(void){
 
 
 
+void xCommonUPortRelease(void){
+
+    k_mutex_lock( &xCommonUPortRelease_mutex, K_FOREVER );
+
+    k_sem_reset( &xCommonUPortReleased_semaphore );
+    xCommonUPortDeinit();
+    k_sem_take( &xCommonUPortReleased_semaphore, K_FOREVER );
+
+    k_mutex_unlock( &xCommonUPortRelease_mutex );
+}
+
+
+
+void xCommonUPortKeepAlive(bool keep){
+    gKeepAlive = keep;
+}
+
+
+
+xCommonUPortStats_t xCommonUPortGetStats(void){
+    return gUPortStats;
+}
+
+
+
 void xCommonUartCfg(xCommonUart_t type){
 
     UARTE_PSEL_Type pins;
@@ -242,6 +319,9 @@ void xCommonUartCfg(xCommonUart_t type){
         return;
     }
 
+    // switched live: no device should be using the common uart at this point
+    LOG_DBG("Common uart switched to %s \r\n", ( type == COMMON_UART_SARA ) ? "SARA" : "NINA");
+
     nrf_uarte_disable(NRF_UARTE2_S);
     
     // Set up TX and RX pins.
@@ -292,3 +372,43 @@ err_code xCommonUPortInit(void){
 
 
 
+/* ----------------------------------------------------------------
+ * SHELL COMMANDS IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+void xCommonUPortKeepAliveCmd(const struct shell *shell, size_t argc, char **argv){
+
+    if( argc != 2 ){
+        shell_print(shell, "Please provide <on/off> \r\n");
+        return;
+    }
+
+    if( strcmp( argv[1], "on" ) == 0 ){
+        xCommonUPortKeepAlive(true);
+    }
+    else if( strcmp( argv[1], "off" ) == 0 ){
+        xCommonUPortKeepAlive(false);
+    }
+    else{
+        shell_error(shell, "Parameter should be on/off \r\n");
+        return;
+    }
+
+    shell_print(shell, "uPort keep-alive %s \r\n", gKeepAlive ? "on" : "off");
+}
+
+
+
+void xCommonUPortStatusCmd(const struct shell *shell, size_t argc, char **argv){
+
+    shell_print(shell, "\r\n\
+uPort --------------------------------\r\n\
+        - Initialized: %s\r\n\
+        - Keep-alive: %s\r\n\
+        - Releases: %d (port deinitialized: %d)\r\n\
+        - Release time: last %d ms, max %d ms\r\n",
+        gubxlibPortInitialized ? "Yes" : "No",
+        gKeepAlive ? "on" : "off",
+        gUPortStats.releases, gUPortStats.portDeinits,
+        gUPortStats.lastReleaseMs, gUPortStats.maxReleaseMs);
+}
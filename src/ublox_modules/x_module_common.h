@@ -24,11 +24,18 @@
  * Common functions refer to setting up ubxlib to be used by Zephyr and nRF SDK and
  * setting up the common Uart shared by SARA-R5 and NINA-W156. Only one of those modules
  * can occupy the Uart at a time and this configuration can change at runtime.
+ * 
+ * Changing between SARA-R5 and NINA-W156 normally deinitializes the whole ubxlib port
+ * (which also needs the shell to be deinitialized and reinitialized). In keep-alive
+ * mode (see xCommonUPortKeepAlive) the port stays initialized and only the device
+ * handles are closed, so the other module can be opened right away after the common
+ * Uart is switched.
  */
 
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <shell/shell.h> //for shell command functions
 #include "x_errno.h"
 
 
@@ -102,6 +109,17 @@ typedef struct{
 
 
 
+/** Statistics of ubxlib port releases (see xCommonUPortRelease). Counted since boot
+*/
+typedef struct{
+    uint32_t releases;       /**< Times devices have been closed (port deinitialized or kept) */
+    uint32_t portDeinits;    /**< Times the port has actually been deinitialized */
+    uint32_t lastReleaseMs;  /**< Duration of the last release */
+    uint32_t maxReleaseMs;   /**< Max duration of a release */
+}xCommonUPortStats_t;
+
+
+
 /* ----------------------------------------------------------------
  * FUNCTIONS
  * -------------------------------------------------------------- */
@@ -141,6 +159,33 @@ void xCommonUPortDeinit(void);
 
 
 
+ /** Closes all ublox device handles (MAXM10S, NINA-W156, SARA-R5) and,
+ * unless keep-alive mode is on, deinitializes ubxlib port (see xCommonUPortDeinit).
+ * Blocks until this is complete, to be called from a thread.
+ */
+void xCommonUPortRelease(void);
+
+
+
+/** Enables/disables keep-alive mode. When on, xCommonUPortDeinit and 
+ * xCommonUPortRelease only close the device handles and ubxlib port stays
+ * initialized. Turning it off does not deinitialize a port kept alive, this
+ * happens on the next release.
+ * 
+ * @param keep  True to keep ubxlib port initialized.
+*/
+void xCommonUPortKeepAlive(bool keep);
+
+
+
+/** Get the statistics of ubxlib port releases.
+ * 
+ * @return        The statistics in xCommonUPortStats_t.
+*/
+xCommonUPortStats_t xCommonUPortGetStats(void);
+
+
+
 /** Checks if ubxlib is initialized. 
  * Can be initialized with xCommonUPortInit
  * Can be deinitialized with xCommonUPortDeinit
@@ -151,4 +196,30 @@ bool xCommonUPortIsInit();
 
 
 
+/* ----------------------------------------------------------------
+ * FUNCTIONS IMPLEMENTING SHELL-COMMANDS
+ * -------------------------------------------------------------- */
+
+/** This function is intented only to be used as a command executed by the shell.
+ * Implements "modules uport keep_alive <on/off>" using xCommonUPortKeepAlive()
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command (should be 1).
+ * @param argv   the array including the parameters themselves (on/off).
+ */
+void xCommonUPortKeepAliveCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * Types ubxlib port status, keep-alive mode and release statistics
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   Not used
+ * @param argv   Not used
+ */
+void xCommonUPortStatusCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+
 #endif   //X_MODULE_COMMON_H__
\ No newline at end of file
@@ -0,0 +1,466 @@
+/*
+ * Copyright 2022 u-blox Ltd
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ * @brief This file contains the implementation of the remote configuration
+ * of XPLR-IOT-1 (commands received via MQTT/MQTT-SN subscription).
+ */
+
+#include "x_remote_config.h"
+
+// Zephyr-SDK related
+#include <zephyr.h>
+#include <stdlib.h>  //strtoul
+#include <string.h>  //strcmp
+#include <logging/log.h>
+
+// Application related
+#include "x_logging.h"
+#include "x_system_conf.h"
+#include "x_data_handle.h"
+#include "x_wifi_mqtt.h"
+#include "x_cell_mqttsn.h"
+#include "x_sensor_aggregation_function.h"
+#include "x_sens_common_types.h"
+#include "x_pos_geofence.h"
+
+
+/* ----------------------------------------------------------------
+ * DEFINITIONS
+ * -------------------------------------------------------------- */
+
+/** Max number of tokens in a command (request id, command, parameters) */
+#define REMOTE_CONFIG_MAX_ARGS   4
+
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTION DECLARATION
+ * -------------------------------------------------------------- */
+
+/** Thread reading and executing the commands received by the clients */
+void xRemoteConfigThread(void);
+
+/** Parses an unsigned integer parameter.
+ *
+ * @param pStr        The parameter string.
+ * @param[out] pValue The value.
+ * @return            true if the whole string is a valid number, false otherwise.
+ */
+static bool remoteConfigParseUint(const char *pStr, uint32_t *pValue);
+
+/** Finds a sensor by name ("all": max_sensors_num_t).
+ *
+ * @param pName       The sensor name, as in the JSON messages.
+ * @param[out] pType  The sensor type.
+ * @return            true if found, false otherwise.
+ */
+static bool remoteConfigGetSensor(const char *pName, xSensType_t *pType);
+
+/** Counts the result of a command in the statistics */
+static void remoteConfigCount(uint32_t reqId, err_code result);
+
+/** Command implementations. argv[0] is the command name */
+static err_code remoteConfigPeriod(size_t argc, char **argv);
+static err_code remoteConfigRate(size_t argc, char **argv);
+static err_code remoteConfigPublish(size_t argc, char **argv);
+static err_code remoteConfigEncoding(size_t argc, char **argv);
+static err_code remoteConfigQos(size_t argc, char **argv);
+static err_code remoteConfigFence(size_t argc, char **argv);
+
+
+/* ----------------------------------------------------------------
+ * ZEPHYR RELATED DEFINITIONS/DECLARATIONS
+ * -------------------------------------------------------------- */
+
+LOG_MODULE_REGISTER(LOGMOD_NAME_REMOTE_CONFIG, LOG_LEVEL_DBG);
+
+// Given by xRemoteConfigNotify
+K_SEM_DEFINE(xRemoteConfig_semaphore, 0, 1);
+
+K_THREAD_DEFINE(xRemoteConfigThreadId, REMOTE_CONFIG_STACK_SIZE, xRemoteConfigThread, NULL, NULL, NULL,
+		REMOTE_CONFIG_PRIORITY, 0, 0);
+
+
+/* ----------------------------------------------------------------
+ * GLOBALS
+ * -------------------------------------------------------------- */
+
+/** Clients with messages to read (bit per xClientType_t) */
+static atomic_t gPendingClients = ATOMIC_INIT(0);
+
+/** Remote configuration settings and statistics */
+static xRemoteConfigStats_t gStats = { .enabled = REMOTE_CONFIG_DEFAULT };
+
+/** Sensors that can be configured, named as in the JSON messages */
+static const struct{
+    const char *pName;
+    xSensType_t type;
+}gSensors[] = {
+    { JSON_ID_SENSOR_BME280,   bme280_t },
+    { JSON_ID_SENSOR_LIS2DH12, lis2dh12_t },
+    { JSON_ID_SENSOR_LIS3MDL,  lis3mdl_t },
+    { JSON_ID_SENSOR_ICG20330, icg20330_t },
+    { JSON_ID_SENSOR_LTR303,   ltr303_t },
+    { JSON_ID_SENSOR_BATTERY,  battery_gauge_t },
+    { JSON_ID_SENSOR_MAXM10,   maxm10_t },
+    { "all",                   max_sensors_num_t }
+};
+
+/** Commands */
+static const struct{
+    const char *pName;
+    err_code (*pExec)(size_t argc, char **argv);
+}gCommands[] = {
+    { "period",   remoteConfigPeriod },
+    { "rate",     remoteConfigRate },
+    { "publish",  remoteConfigPublish },
+    { "encoding", remoteConfigEncoding },
+    { "qos",      remoteConfigQos },
+    { "fence",    remoteConfigFence }
+};
+
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTION IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+static bool remoteConfigParseUint(const char *pStr, uint32_t *pValue){
+
+    char *pEnd;
+
+    if( ( *pStr < '0' ) || ( *pStr > '9' ) ){
+        return false;
+    }
+
+    *pValue = (uint32_t)strtoul( pStr, &pEnd, 10 );
+    return ( *pEnd == 0 );
+}
+
+
+
+static bool remoteConfigGetSensor(const char *pName, xSensType_t *pType){
+
+    for( size_t x = 0; x < ARRAY_SIZE(gSensors); x++ ){
+        if( strcmp( pName, gSensors[x].pName ) == 0 ){
+            *pType = gSensors[x].type;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+
+static void remoteConfigCount(uint32_t reqId, err_code result){
+
+    gStats.received++;
+    if( result == X_ERR_SUCCESS ){
+        gStats.succeeded++;
+    }
+    else{
+        gStats.failed++;
+    }
+    gStats.lastReqId = reqId;
+    gStats.lastResult = result;
+}
+
+
+
+static err_code remoteConfigPeriod(size_t argc, char **argv){
+
+    uint32_t period;
+
+    if( ( argc != 2 ) || !remoteConfigParseUint( argv[1], &period ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    // validated and applied to all sensors, or not at all
+    return xSensorAggregationSetUpdatePeriod( period );
+}
+
+
+
+static err_code remoteConfigRate(size_t argc, char **argv){
+
+    uint32_t period;
+    xSensType_t type;
+
+    if( ( argc != 3 ) || !remoteConfigParseUint( argv[2], &period ) ||
+        !remoteConfigGetSensor( argv[1], &type ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    return xSensorAggregationSetSensorRate( type, period );
+}
+
+
+
+static err_code remoteConfigPublish(size_t argc, char **argv){
+
+    bool enable;
+    xSensType_t type;
+
+    if( ( argc != 3 ) || !remoteConfigGetSensor( argv[1], &type ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    if( strcmp( argv[2], "on" ) == 0 ){
+        enable = true;
+    }
+    else if( strcmp( argv[2], "off" ) == 0 ){
+        enable = false;
+    }
+    else{
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    return xSensorAggregationSetSensorPublish( type, enable );
+}
+
+
+
+static err_code remoteConfigEncoding(size_t argc, char **argv){
+
+    xClientType_t type;
+    xDataEncoding_t encoding;
+
+    if( argc != 3 ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    if( strcmp( argv[1], "mqtt" ) == 0 ){
+        type = MqttClient;
+    }
+    else if( strcmp( argv[1], "mqttsn" ) == 0 ){
+        type = MqttSNClient;
+    }
+    else{
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    encoding = xDataGetEncodingByName( argv[2] );
+    if( encoding == dataEncodingNum ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    return xDataSetEncoding( type, encoding );
+}
+
+
+
+static err_code remoteConfigQos(size_t argc, char **argv){
+
+    xDataTopicClass_t topicClass;
+    uint32_t qos;
+
+    if( ( argc != 3 ) || !remoteConfigParseUint( argv[2], &qos ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    topicClass = xDataGetTopicClassByName( argv[1] );
+    if( ( topicClass == dataTopicClassNum ) || ( qos > DATA_QOS_MAX ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    return xDataSetQos( topicClass, (uint8_t)qos );
+}
+
+
+
+static err_code remoteConfigFence(size_t argc, char **argv){
+
+    // the definition has no spaces, it is a single parameter
+    if( argc != 2 ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    return xPosGeofenceDefine( argv[1] );
+}
+
+
+
+void xRemoteConfigThread(void){
+
+    // one more character than the longest command, to detect longer ones
+    char message[ REMOTE_CONFIG_MSG_MAXLEN + 2 ];
+    size_t messageSize;
+    uint32_t reqId;
+    err_code err;
+
+    // needed to avoid thread overflows when using ubxlib functions within a thread
+    k_thread_system_pool_assign(k_current_get());
+
+    while(1){
+
+        // Semaphore given by xRemoteConfigNotify()
+        k_sem_take( &xRemoteConfig_semaphore, K_FOREVER );
+
+        for( xClientType_t client = MqttClient; client <= MqttSNClient; client++ ){
+
+            if( !atomic_test_and_clear_bit( &gPendingClients, client ) ){
+                continue;
+            }
+
+            // read all messages received meanwhile
+            while(1){
+                messageSize = REMOTE_CONFIG_MSG_MAXLEN + 1;
+                if( client == MqttClient ){
+                    err = xWifiMqttMessageRead( message, &messageSize );
+                }
+                else{
+                    err = xCellMqttSnMessageRead( message, &messageSize );
+                }
+
+                if( err != X_ERR_SUCCESS ){
+                    break;
+                }
+
+                // a truncated command could still be valid, it is not executed
+                if( messageSize > REMOTE_CONFIG_MSG_MAXLEN ){
+                    message[ REMOTE_CONFIG_MSG_MAXLEN ] = 0;
+                    reqId = (uint32_t)strtoul( message, NULL, 10 );
+                    err = X_ERR_BUFFER_OVERFLOW;
+                    remoteConfigCount( reqId, err );
+                    LOG_WRN("Command %d longer than %d characters, rejected \r\n", reqId, REMOTE_CONFIG_MSG_MAXLEN);
+                    xDataSendConfigResponse( reqId, err );
+                    continue;
+                }
+
+                message[ messageSize ] = 0;
+                LOG_INF("Command received: %s \r\n", message);
+
+                err = xRemoteConfigExecute( message, &reqId );
+                if( err == X_ERR_SUCCESS ){
+                    LOG_INF("Command %d executed \r\n", reqId);
+                }
+                else{
+                    LOG_WRN("Command %d failed: %d \r\n", reqId, err);
+                }
+
+                xDataSendConfigResponse( reqId, err );
+            }
+        }
+    }
+}
+
+
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTION IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+void xRemoteConfigNotify(xClientType_t client){
+
+    // do not use ubxlib from here, may be called from a ubxlib callback
+    atomic_set_bit( &gPendingClients, client );
+    k_sem_give( &xRemoteConfig_semaphore );
+}
+
+
+
+err_code xRemoteConfigExecute(char *pCmdStr, uint32_t *pReqId){
+
+    char *argv[ REMOTE_CONFIG_MAX_ARGS ];
+    size_t argc = 0;
+    char *pSave;
+    char *pToken;
+    err_code err = X_ERR_INVALID_PARAMETER;
+
+    *pReqId = 0;
+
+    pToken = strtok_r( pCmdStr, " \r\n", &pSave );
+    while( ( pToken != NULL ) && ( argc < REMOTE_CONFIG_MAX_ARGS ) ){
+        argv[ argc++ ] = pToken;
+        pToken = strtok_r( NULL, " \r\n", &pSave );
+    }
+
+    // request id and command at least, no extra tokens
+    if( ( argc >= 2 ) && ( pToken == NULL ) && remoteConfigParseUint( argv[0], pReqId ) ){
+
+        if( !gStats.enabled ){
+            err = X_ERR_INVALID_STATE;
+        }
+        else{
+            for( size_t x = 0; x < ARRAY_SIZE(gCommands); x++ ){
+                if( strcmp( argv[1], gCommands[x].pName ) == 0 ){
+                    // the command gets its name as argv[0], like shell commands
+                    err = gCommands[x].pExec( argc - 1, &argv[1] );
+                    break;
+                }
+            }
+        }
+    }
+
+    remoteConfigCount( *pReqId, err );
+
+    return err;
+}
+
+
+
+void xRemoteConfigEnable(bool enable){
+    gStats.enabled = enable;
+    LOG_INF("Remote configuration %s \r\n", enable ? "enabled" : "disabled");
+}
+
+
+
+xRemoteConfigStats_t xRemoteConfigGetStats(void){
+    return gStats;
+}
+
+
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS IMPLEMENTING SHELL-COMMANDS
+ * -------------------------------------------------------------- */
+
+void xRemoteConfigCmd(const struct shell *shell, size_t argc, char **argv){
+
+    if( argc > 2 ){
+        shell_print(shell, "Invalid number of parameters\r\n");
+        return;
+    }
+
+    if( argc == 2 ){
+        if( strcmp(argv[1], "on") == 0 ){
+            xRemoteConfigEnable(true);
+        }
+        else if( strcmp(argv[1], "off") == 0 ){
+            xRemoteConfigEnable(false);
+        }
+        else{
+            shell_print(shell, "Invalid parameter (on/off)\r\n");
+        }
+        return;
+    }
+
+    shell_print(shell, "\r\n\
+Remote configuration -------------------\r\n\
+        - Enabled: %s\r\n\
+        - Command topic: %s\r\n\
+        - Response topic: %s\r\n\
+        - Commands received: %d (succeeded: %d, failed: %d)\r\n\
+        - Last command: request id %d, result %d\r\n",
+        gStats.enabled ? "yes" : "no",
+        TOPIC_NAME_CONFIG_CMD, TOPIC_NAME_CONFIG_RSP,
+        gStats.received, gStats.succeeded, gStats.failed,
+        gStats.lastReqId, gStats.lastResult);
+
+    return;
+}
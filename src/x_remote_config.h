@@ -0,0 +1,128 @@
+/*
+ * Copyright 2022 u-blox Ltd
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef X_REMOTE_CONFIG_H__
+#define  X_REMOTE_CONFIG_H__
+
+
+/** @file
+ * @brief This file contains the API of the remote configuration of XPLR-IOT-1.
+ *
+ * When connected, the MQTT client (WiFi) and the MQTT-SN client (cellular, MQTT
+ * Flex plan only, MQTT Anywhere cannot subscribe) subscribe to TOPIC_NAME_CONFIG_CMD
+ * (x_data_handle.h). Each message received there is a command, executed with the
+ * same APIs the shell commands use:
+ *
+ * <request id> <command> [parameters]   (space separated text), eg: "17 rate BME280 5000"
+ *
+ * - period <ms>                    Sensor aggregation period (xSensorAggregationSetUpdatePeriod)
+ * - rate <sensor/all> <ms>         Sensor sampling period (xSensorAggregationSetSensorRate)
+ * - publish <sensor/all> <on/off>  Sensor publish (xSensorAggregationSetSensorPublish)
+ * - encoding <mqtt/mqttsn> <base64/raw>   Message encoding per client (xDataSetEncoding)
+ * - qos <class> <QoS>              Quality of Service of a topic class (xDataSetQos)
+ * - fence <definition>             Geofence definition, eg. "c,1,47.285,8.565,200" (xPosGeofenceDefine)
+ *
+ * sensor: BME280, LIS2DH12, LIS3MDL, ICG20330, LTR303, BATTERY, MAXM10 (as in
+ * the JSON messages)
+ *
+ * Each command is acknowledged with its request id and result on
+ * TOPIC_NAME_CONFIG_RSP (see xDataSendConfigResponse()), once it has been
+ * applied. Commands longer than REMOTE_CONFIG_MSG_MAXLEN are not executed
+ * (X_ERR_BUFFER_OVERFLOW). While the Sensor Aggregation function is active,
+ * sensor settings are applied after a start/stop transition in progress and
+ * "rate" sets multiples of the aggregation period (rate divisors).
+ */
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <shell/shell.h>
+
+#include "x_errno.h"
+#include "x_module_common.h"
+
+
+/* ----------------------------------------------------------------
+ * TYPE DEFINITIONS
+ * -------------------------------------------------------------- */
+
+/** Remote configuration statistics. Counted since boot */
+typedef struct{
+    bool     enabled;       /**< Commands received are executed */
+    uint32_t received;      /**< Commands received */
+    uint32_t succeeded;     /**< Commands executed successfully */
+    uint32_t failed;        /**< Commands rejected or failed */
+    uint32_t lastReqId;     /**< Request id of the last command */
+    err_code lastResult;    /**< Result of the last command */
+}xRemoteConfigStats_t;
+
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+/** Notifies that messages have been received in the remote configuration
+ * topic. Called by the client message callbacks (may be called from ubxlib
+ * callback context), the messages are read and executed by the remote
+ * configuration thread.
+ *
+ * @param client  MqttClient (WiFi) or MqttSNClient (cellular).
+ */
+void xRemoteConfigNotify(xClientType_t client);
+
+
+/** Executes a remote configuration command.
+ *
+ * @param pCmdStr     The command string (modified while parsed).
+ * @param[out] pReqId The request id of the command (0 if it could not be parsed).
+ * @return            zero on success else negative error code.
+ */
+err_code xRemoteConfigExecute(char *pCmdStr, uint32_t *pReqId);
+
+
+/** Enable/disable the execution of remote configuration commands. When disabled
+ * the commands received are rejected (X_ERR_INVALID_STATE). Enabled by default
+ * (REMOTE_CONFIG_DEFAULT).
+ *
+ * @param enable  true to execute commands, false to reject them.
+ */
+void xRemoteConfigEnable(bool enable);
+
+
+/** Get the remote configuration statistics.
+ *
+ * @return        The statistics in xRemoteConfigStats_t.
+ */
+xRemoteConfigStats_t xRemoteConfigGetStats(void);
+
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS IMPLEMENTING SHELL-COMMANDS
+ * -------------------------------------------------------------- */
+
+/** This function is intented only to be used as a command executed by the shell.
+ * Without parameters types the remote configuration statistics. With on/off
+ * enables/disables the execution of remote configuration commands.
+ *
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command (0 or 1).
+ * @param argv   the array including the parameters themselves (on/off).
+ */
+void xRemoteConfigCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+#endif    //X_REMOTE_CONFIG_H__
@@ -24,13 +24,15 @@
 
 // Zephyr-SDK related
 #include <zephyr.h>
-#include <stdlib.h>  //atoi
+#include <stdlib.h>  //atoi, strtoul
+#include <string.h>  //strcmp
 #include <logging/log.h>
 
 // Application Related
 #include "x_wifi_ninaW156.h"
 #include "x_cell_saraR5.h"
 #include "x_wifi_mqtt.h"
+#include "x_wifi_conn.h"
 #include "x_cell_mqttsn.h"
 #include "x_pos_maxm10s.h"
 #include "x_logging.h"
@@ -40,30 +42,152 @@
 #include "x_led.h"
 
 
+/* ----------------------------------------------------------------
+ * DEFINITIONS
+ * -------------------------------------------------------------- */
+
+/** Max time (seconds) accepted by the shell commands, so that it fits in
+ * milliseconds as a signed 32 bit value */
+#define SENS_AGG_CMD_MAX_SECONDS    ( INT32_MAX / 1000 )
+
+
+/* ----------------------------------------------------------------
+ * TYPE DEFINITIONS
+ * -------------------------------------------------------------- */
+
+/** States of the functionality state machine */
+typedef enum{
+    sensAggStateIdle,         /**< Functionality disabled */
+    sensAggStateStarting,     /**< Sensors and link being set up */
+    sensAggStateRunning,      /**< Running in gCurrentMode */
+    sensAggStateStopping      /**< Link and sensors being shut down */
+}sensAggState_t;
+
+/** Requests posted to the state machine queue */
+typedef enum{
+    sensAggEvtStart,
+    sensAggEvtStop
+}sensAggEvent_t;
+
+/** Message posted to the state machine queue */
+typedef struct{
+    sensAggEvent_t event;
+    xSensorAggregationMode_t mode;   /**< Transport the request refers to */
+    int64_t requestTime;             /**< Uptime (ms) the request was posted */
+}sensAggMsg_t;
+
+
 /* ----------------------------------------------------------------
  * STATIC FUNCTION DECLARATION
  * -------------------------------------------------------------- */
 
-/** Thread called by xSensorAggregationStartWifi to perform the necessary
- * operations */
-void xSensorAggregationStartWifiThread(void);
+/** State machine thread. Handles the start/stop requests posted by
+ * xSensorAggregationStartWifi() etc, one at a time */
+void xSensorAggregationThread(void);
+
+/** Posts a start/stop request to the state machine */
+static void SensorAggregationPost(sensAggEvent_t event, xSensorAggregationMode_t mode);
+
+/** Sets the state of the state machine */
+static void SensorAggregationSetState(sensAggState_t state);
+
+/** Handles a start request. Stops the functionality first if it runs over
+ * the other transport. Returns false if no transition was needed */
+static bool SensorAggregationStart(xSensorAggregationMode_t mode, int64_t requestTime);
+
+/** Handles a stop request. Returns false if no transition was needed
+ * (functionality running over the other transport) */
+static bool SensorAggregationStop(xSensorAggregationMode_t mode);
 
-/** Thread called by xSensorAggregationStopWifi to perform the necessary
- * operations */
-void xSensorAggregationStopWifiThread(void);
+/** Shuts down failover, duty-cycled transport, the link and the sensors and
+ * disables the functionality. Also used when a start fails */
+static void SensorAggregationTeardown(xSensorAggregationMode_t mode);
 
-/** Thread called by xSensorAggregationStartCell to perform the necessary
- * operations */
-void xSensorAggregationStartCellThread(void);
+/** Records the latency of a transition, from the request to the new state */
+static void SensorAggregationTransitionDone(int64_t requestTime);
 
-/** Thread called by xSensorAggregationStopCell to perform the necessary
- * operations */
-void xSensorAggregationStopCellThread(void);
+/** Takes the state machine lock for a configuration change, waiting for a
+ * transition in progress (SENS_AGG_CONFIG_TIMEOUT_MS max). Meanwhile the state
+ * is idle or running, and sensor settings can be changed while running */
+static err_code SensorAggregationConfigLock(void);
+
+/** Ends a configuration change started with SensorAggregationConfigLock() */
+static void SensorAggregationConfigUnlock(void);
+
+
+/** Thread bringing the link up to publish the batch in duty-cycled
+ * transport mode */
+void xSensorAggregationDutyCycleThread(void);
+
+
+/** Thread monitoring the link health, failing over to the other transport
+ * and back */
+void xSensorAggregationFailoverThread(void);
+
+
+/** Thread sampling the link quality periodically and publishing it as a
+ * diagnostics message, while the link is up (not in duty-cycled transport mode) */
+void xSensorAggregationLinkQualityThread(void);
 
 
 /** Handle error happening in a thread */
 static void SensorAggregationErrorHandle(err_code err_code);
 
+/** Powers up and connects the module of the given mode up to MQTT(-SN)
+ * and waits for the connection (SENS_AGG_LINK_TIMEOUT_MS max) */
+static err_code SensorAggregationLinkUp(xSensorAggregationMode_t mode);
+
+/** Disconnects, deinitializes and powers off the module of the given mode */
+static void SensorAggregationLinkDown(xSensorAggregationMode_t mode);
+
+/** Starts/stops duty-cycled transport when the functionality starts/stops */
+static void SensorAggregationDutyCycleStart(void);
+static void SensorAggregationDutyCycleStop(void);
+
+/** Starts/stops failover when the functionality starts/stops. Stop returns
+ * true if failover was running (the active link may differ from the stopped mode) */
+static void SensorAggregationFailoverStart(xSensorAggregationMode_t mode);
+static bool SensorAggregationFailoverStop(void);
+
+/** Switches the link to the given transport, keeping sensors sampling.
+ * If the new link cannot be brought up, the previous one is restored. */
+static void SensorAggregationSwitchLink(xSensorAggregationMode_t to);
+
+/** Is the link of the current mode connected (MQTT or MQTT-SN) */
+static bool SensorAggregationLinkIsUp(void);
+
+/** Reads the link quality of the given mode (WiFi RSSI or cellular RSSI/RSRP/RSRQ/SINR) */
+static err_code SensorAggregationLinkQualitySample(xSensorAggregationMode_t mode);
+
+/** Publishes the last link quality sample as a diagnostics message */
+static void SensorAggregationLinkQualityPublish(void);
+
+/** Is the last link quality sample below the thresholds of its transport */
+static bool SensorAggregationLinkQualityIsPoor(void);
+
+/** Samples the link quality of a link brought up for a non-urgent batch flush and
+ * decides whether the flush is deferred (poor quality and SENS_AGG_LINK_MAX_DEFER_MS
+ * not expired since the flush was first deferred) */
+static bool SensorAggregationFlushDefer(xSensorAggregationMode_t mode);
+
+/** Records the latency of a mode switch (WiFi <-> Cell) started at the given
+ * uptime (ms), when the function is running in the new mode */
+static void SensorAggregationModeSwitchDone(int64_t start);
+
+/** Derives the SARA-R5 PSM/eDRX timers from the sampling period */
+static void SensorAggregationPowerSavingTimers(uint32_t periodMs, xCellSaraPowerSaving_t *pTimers);
+
+/** Parses a shell command parameter as an unsigned decimal number, up to
+ * maxValue. Returns false if the parameter is not a number or out of range */
+static bool SensorAggregationParseUint(const char *pStr, uint32_t maxValue, uint32_t *pValue);
+
+/** Sets the sampling period of each sensor: the update period multiplied by
+ * the rate divisor of the sensor */
+static err_code SensorAggregationSetSensorPeriods(uint32_t periodMs);
+
+/** Latency bound expiry, brings the link up */
+static void SensorAggregationLatencyTimerCb(struct k_timer *timer);
+
 
 /* ----------------------------------------------------------------
  * ZEPHYR RELATED DEFINITIONS/DECLARATIONS
@@ -71,24 +195,39 @@ static void SensorAggregationErrorHandle(err_code err_code);
 
 LOG_MODULE_REGISTER(SENSOR_AGGREGATION_LOGMOD_NAME, LOG_LEVEL_DBG);
 
+// Start/stop requests posted to the state machine
+K_MSGQ_DEFINE(xSensorAggregationMsgq, sizeof(sensAggMsg_t), SENS_AGG_QUEUE_SIZE, 4);
+
 // Semaphore definition
-K_SEM_DEFINE(xSensorAggregationStartWifi_semaphore, 0, 1);
-K_SEM_DEFINE(xSensorAggregationStopWifi_semaphore, 0, 1);
-K_SEM_DEFINE(xSensorAggregationStartCell_semaphore, 0, 1);
-K_SEM_DEFINE(xSensorAggregationStopCell_semaphore, 0, 1);
+K_SEM_DEFINE(xSensorAggregationFlush_semaphore, 0, 1);
+K_SEM_DEFINE(xSensorAggregationFailover_semaphore, 0, 1);
+
+// Held while the link is switched, a stop request waits for the switch
+K_MUTEX_DEFINE(xSensorAggregationFailover_mutex);
+
+// Held by the state machine while handling a request, and by configuration
+// changes, which are so applied between transitions
+K_MUTEX_DEFINE(xSensorAggregationState_mutex);
+
+// Held while the duty-cycled transport running/link state is checked and changed,
+// so a stop cannot miss a cycle that is bringing the link up
+K_MUTEX_DEFINE(xSensorAggregationDutyCycle_mutex);
+
+// Duty-cycled transport latency bound
+K_TIMER_DEFINE(xSensorAggregationLatencyTimer, SensorAggregationLatencyTimerCb, NULL);
 
 
 // Threads definition
-K_THREAD_DEFINE(xSensorAggregationStartWifiThreadId, SENS_AGG_STACK_SIZE, xSensorAggregationStartWifiThread, NULL, NULL, NULL,
+K_THREAD_DEFINE(xSensorAggregationThreadId, SENS_AGG_STACK_SIZE, xSensorAggregationThread, NULL, NULL, NULL,
 		SENS_AGG_PRIORITY, 0, 0);
 
-K_THREAD_DEFINE(xSensorAggregationStopWifiThreadId, SENS_AGG_STACK_SIZE, xSensorAggregationStopWifiThread, NULL, NULL, NULL,
+K_THREAD_DEFINE(xSensorAggregationDutyCycleThreadId, SENS_AGG_DUTY_STACK_SIZE, xSensorAggregationDutyCycleThread, NULL, NULL, NULL,
 		SENS_AGG_PRIORITY, 0, 0);
 
-K_THREAD_DEFINE(xSensorAggregationStartCellThreadId, SENS_AGG_STACK_SIZE, xSensorAggregationStartCellThread, NULL, NULL, NULL,
+K_THREAD_DEFINE(xSensorAggregationFailoverThreadId, SENS_AGG_FAILOVER_STACK_SIZE, xSensorAggregationFailoverThread, NULL, NULL, NULL,
 		SENS_AGG_PRIORITY, 0, 0);
 
-K_THREAD_DEFINE(xSensorAggregationStopCellThreadId, SENS_AGG_STACK_SIZE, xSensorAggregationStopCellThread, NULL, NULL, NULL,
+K_THREAD_DEFINE(xSensorAggregationLinkQualityThreadId, SENS_AGG_LINK_STACK_SIZE, xSensorAggregationLinkQualityThread, NULL, NULL, NULL,
 		SENS_AGG_PRIORITY, 0, 0);
 
 
@@ -101,6 +240,44 @@ K_THREAD_DEFINE(xSensorAggregationStopCellThreadId, SENS_AGG_STACK_SIZE, xSensor
 */
 static uint32_t gUpdatePeriod = SENS_AGG_DEFAULT_UPDATE_PERIOD_MS;
 
+/** Aggregation profile, gives the rate divisor of each sensor */
+static xSensorAggregationProfile_t gProfile = xSensAggProfileUniform;
+
+/** Rate divisors per profile (custom: set by xSensorAggregationSetRateDivisor) */
+static uint8_t gRateDivisors[ xSensAggProfileNum ][ max_sensors_num_t ] = {
+    [xSensAggProfileUniform] = {
+        [bme280_t] = 1, [battery_gauge_t] = 1, [lis2dh12_t] = 1, [lis3mdl_t] = 1,
+        [ltr303_t] = 1, [icg20330_t] = 1, [maxm10_t] = 1
+    },
+    [xSensAggProfileMultiRate] = {
+        [bme280_t] = SENS_AGG_MULTIRATE_DIV_BME280, [battery_gauge_t] = SENS_AGG_MULTIRATE_DIV_BATTERY,
+        [lis2dh12_t] = 1, [lis3mdl_t] = 1, [ltr303_t] = SENS_AGG_MULTIRATE_DIV_LTR303,
+        [icg20330_t] = 1, [maxm10_t] = SENS_AGG_MULTIRATE_DIV_MAXM10
+    },
+    [xSensAggProfileCustom] = {
+        [bme280_t] = 1, [battery_gauge_t] = 1, [lis2dh12_t] = 1, [lis3mdl_t] = 1,
+        [ltr303_t] = 1, [icg20330_t] = 1, [maxm10_t] = 1
+    }
+};
+
+/** String representation of xSensorAggregationProfile_t (shell commands) */
+static const char *const xSensorAggregationProfile_t_strings[]={
+    [xSensAggProfileUniform] = "uniform",
+    [xSensAggProfileMultiRate] = "multirate",
+    [xSensAggProfileCustom] = "custom"
+};
+
+/** Sensor names, as in the sensor aggregation message */
+static const char *const gSensorNames[]={
+    [bme280_t] = JSON_ID_SENSOR_BME280,
+    [battery_gauge_t] = JSON_ID_SENSOR_BATTERY,
+    [lis2dh12_t] = JSON_ID_SENSOR_LIS2DH12,
+    [lis3mdl_t] = JSON_ID_SENSOR_LIS3MDL,
+    [ltr303_t] = JSON_ID_SENSOR_LTR303,
+    [icg20330_t] = JSON_ID_SENSOR_ICG20330,
+    [maxm10_t] = JSON_ID_SENSOR_MAXM10
+};
+
 /** Holds Sensor Aggregation Mode - default is disabled*/
 xSensorAggregationMode_t gCurrentMode = xSensAggModeDisabled;
 
@@ -110,10 +287,100 @@ xSensorAggregationMode_t gCurrentMode = xSensAggModeDisabled;
 static err_code gLastOperationResult = X_ERR_SUCCESS;
 
 
-/** Flag to signal when it is ok to use start or stop functions/commands
- * see: xSensorAggregationIsLocked description
-*/
-static bool gFunctionIsLocked = false;
+/** State of the state machine, changed only by the state machine thread */
+static sensAggState_t gState = sensAggStateIdle;
+
+
+/** Requests posted and not handled yet (see xSensorAggregationIsLocked) */
+static atomic_t gPendingRequests = ATOMIC_INIT(0);
+
+
+/** A configuration change is being applied (see SensorAggregationConfigLock) */
+static bool gIsConfiguring = false;
+
+
+/** String representation of xSensorAggregationMode_t (logs and shell commands) */
+static const char *const xSensorAggregationMode_t_strings[]={
+    [xSensAggModeDisabled] = "Disabled",
+    [xSensAggModeWifi] = "WiFi mode",
+    [xSensAggModeCell] = "Cell mode"
+};
+
+
+/** String representation of sensAggState_t (logs and shell commands) */
+static const char *const sensAggState_t_strings[]={
+    [sensAggStateIdle] = "Idle",
+    [sensAggStateStarting] = "Starting",
+    [sensAggStateRunning] = "Running",
+    [sensAggStateStopping] = "Stopping"
+};
+
+
+/** Transition (start/stop request until the new state) latency */
+static struct{
+    uint32_t count;
+    uint32_t lastMs;
+    uint32_t maxMs;
+}gTransition = {0};
+
+
+/** Duty-cycled transport settings and statistics */
+static struct{
+    bool isEnabled;            /**< Use duty-cycled transport when the functionality starts */
+    uint32_t batchSize;        /**< Messages kept before the link is brought up */
+    uint32_t maxLatencyMs;     /**< Max time a message is kept before the link is brought up */
+    bool isRunning;            /**< Functionality running in duty-cycled transport mode */
+    bool isLinkUp;             /**< Link brought up to publish a batch */
+    int64_t sessionStart;      /**< Uptime (ms) the functionality started */
+    uint64_t radioOnMs;        /**< Total time the link has been up (powered) */
+    uint32_t cycles;           /**< Times the link has been brought up */
+    uint32_t failures;         /**< Cycles the batch could not be published */
+    uint32_t lastCycleMs;      /**< Duration of the last cycle */
+}gDutyCycle = { .isEnabled = false, .batchSize = SENS_AGG_DUTY_DEFAULT_BATCH,
+                .maxLatencyMs = SENS_AGG_DUTY_DEFAULT_LATENCY_MS, .isRunning = false, .isLinkUp = false };
+
+
+/** Mode switch (start in one mode while the other is active) latency */
+static struct{
+    uint32_t count;
+    uint32_t lastMs;
+    uint32_t maxMs;
+}gModeSwitch = {0};
+
+
+/** Request SARA-R5 PSM/eDRX timers when starting via cellular */
+static bool gCellPowerSaving = false;
+
+
+/** Failover settings, state and statistics */
+static struct{
+    bool isEnabled;                      /**< Use failover when the functionality starts */
+    bool isRunning;                      /**< Functionality running with failover */
+    bool isSwitching;                    /**< Link being switched */
+    xSensorAggregationMode_t preferred;  /**< Transport the functionality started with */
+    uint32_t failures;                   /**< Consecutive failed publishes on the active link */
+    int64_t switchedAt;                  /**< Uptime (ms) of the last switch */
+    uint32_t failovers;                  /**< Switches away from the preferred transport */
+    uint32_t failbacks;                  /**< Switches back to the preferred transport */
+    uint32_t failedSwitches;             /**< Switches reverted, new link could not be brought up */
+    uint32_t lastSwitchMs;               /**< Switchover time: old link down until new link up */
+    uint32_t maxSwitchMs;                /**< Max switchover time */
+}gFailover = { .isEnabled = false, .isRunning = false, .isSwitching = false };
+
+
+/** Link quality samples, flush deferral settings and statistics */
+static struct{
+    bool deferEnabled;                   /**< Defer non-urgent batch flushes while the link quality is poor */
+    uint32_t maxDeferMs;                 /**< Max time a flush is deferred */
+    xSensorAggregationMode_t mode;       /**< Transport of the last sample */
+    xCellSaraLinkQuality_t last;         /**< Last sample (WiFi: only RSSI) */
+    int64_t sampledAt;                   /**< Uptime (ms) of the last sample, 0 if none */
+    int64_t deferredSince;               /**< Uptime (ms) the pending flush was first deferred, 0 if none */
+    uint32_t samples;                    /**< Link quality samples */
+    uint32_t failedSamples;              /**< Link quality could not be read */
+    uint32_t deferrals;                  /**< Flushes deferred */
+    uint32_t forcedFlushes;              /**< Flushes on a poor link, max deferral expired */
+}gLinkQuality = { .deferEnabled = false, .maxDeferMs = SENS_AGG_LINK_MAX_DEFER_MS, .sampledAt = 0, .deferredSince = 0 };
 
 
 /* ----------------------------------------------------------------
@@ -126,335 +393,1456 @@ static void SensorAggregationErrorHandle(err_code err_code){
 }
 
 
-void xSensorAggregationStartWifiThread(void){
-
-    bool lock_function_on_entrance_copy = gFunctionIsLocked;
-
-    while(1){
 
-        //revert lock to its previous state after execution
-        gFunctionIsLocked = lock_function_on_entrance_copy;
+static err_code SensorAggregationLinkUp(xSensorAggregationMode_t mode){
 
-        // Semaphore given by xSensorAggregationStartWifi()
-        k_sem_take( &xSensorAggregationStartWifi_semaphore, K_FOREVER );
+    err_code err = X_ERR_SUCCESS;
 
-        // keep lock previous state
-        lock_function_on_entrance_copy = gFunctionIsLocked;
-        // lock
-        gFunctionIsLocked = true;
+    if( mode == xSensAggModeWifi ){
+        xWifiMqttClientConnect();
+        return xWifiConnWait( K_MSEC( SENS_AGG_LINK_TIMEOUT_MS ) );
+    }
 
-        if( gCurrentMode == xSensAggModeWifi ){
-            LOG_INF("WiFi Sensor Aggregation is already on with period: %d ms \r\n", gUpdatePeriod);
-            continue;
+    xCellMqttSnClientConnect();
+    xClientStatus_t mqttsn_stat = xCellMqttSnClientGetStatus();
+    int64_t start = k_uptime_get();
+
+    //wait for connection and check for errors
+    while( ( mqttsn_stat < ClientConnected ) && ( err == X_ERR_SUCCESS ) ) {
+        k_sleep(K_MSEC(1000));
+        mqttsn_stat = xCellMqttSnClientGetStatus();
+        err = xCellMqttSnGetLastOperationResult();
+        if( k_uptime_get() - start > SENS_AGG_LINK_TIMEOUT_MS ){
+            err = U_ERROR_COMMON_TIMEOUT;
         }
+    }
 
-        if( gCurrentMode == xSensAggModeCell ){
-            //disable cell mode
-            LOG_WRN("Cell Sensor Aggregation is already on with period: %d ms. Disabling now \r\n", gUpdatePeriod);
-            xSensorAggregationStopCell();
-            while( gCurrentMode == xSensAggModeCell ){
-                k_sleep(K_MSEC(1000));
-            }
-        }
+    return err;
+}
 
-        LOG_INF("WiFi Sensor Aggregation starting with period: %d ms \r\n", gUpdatePeriod);
 
-        xDataResetSensorAggregationMsg();
-        xSensDisableAll();
-        xSensPublishNone();
-        gLastOperationResult = xSensSetUpdatePeriodAll( gUpdatePeriod );
-        if( gLastOperationResult != X_ERR_SUCCESS ){
-            LOG_ERR("There was an issue with the update Period. Abort Sensor Aggregation startup\r\n");
-            SensorAggregationErrorHandle(gLastOperationResult);
-            continue;
-        }
 
-        xWifiMqttClientConnect();
-        xClientStatusStruct_t mqtt_stat = xWifiMqttClientGetStatus();
+static void SensorAggregationLinkDown(xSensorAggregationMode_t mode){
 
-        // wait for connection to MQTT and check for errors
-        while( ( mqtt_stat.status < ClientConnected ) && ( gLastOperationResult == X_ERR_SUCCESS ) ) {
-            k_sleep(K_MSEC(1000));
-            mqtt_stat = xWifiMqttClientGetStatus();
-            gLastOperationResult = xWifiMqttGetLastOperationResult();
-        }
+    if( mode == xSensAggModeWifi ){
 
-        if( gLastOperationResult != X_ERR_SUCCESS ){
-            LOG_ERR("Error Code from MQTT Connect Request: %d - aborting sensor aggregation initialization", gLastOperationResult);
-            xSensorAggregationStopWifi();
-            continue;
+        xWifiNinaDeinit(); //also deinitiliazes ubxlib (unless kept alive)
+
+        xWifiNinaStatus_t nina_stat = xWifiNinaGetModuleStatus();
+        //in deinitialization we do not check for errors
+        while( nina_stat.uStatus > uPortNotInitialized ){
+            k_sleep(K_MSEC(SENS_AGG_LINK_POLL_MS));
+            nina_stat = xWifiNinaGetModuleStatus();
         }
-                
-        gCurrentMode = xSensAggModeWifi;
 
-        xSensPublishAll();
-        xSensEnableAll();
+        xWifiNinaPowerOff();
+        return;
+    }
 
-        xLedOn(WIFI_ACTIVATING_LEDCOL);
+    xCellSaraDeinit(); //also deinitiliazes ubxlib (unless kept alive) and powers off
 
+    xCellSaraStatus_t sara_stat = xCellSaraGetModuleStatus();
+    //in deinitialization we do not check for errors
+    while( sara_stat.uStatus > uPortNotInitialized ){
+        k_sleep(K_MSEC(SENS_AGG_LINK_POLL_MS));
+        sara_stat = xCellSaraGetModuleStatus();
     }
 }
 
 
 
-void xSensorAggregationStopWifiThread(void){
+static void SensorAggregationDutyCycleStart(void){
 
-    bool lock_function_on_entrance_copy = gFunctionIsLocked;
+    gDutyCycle.sessionStart = k_uptime_get();
+    gDutyCycle.radioOnMs = 0;
+    gDutyCycle.cycles = 0;
+    gDutyCycle.failures = 0;
+    gDutyCycle.lastCycleMs = 0;
 
-    while(1){
+    xDataBatchEnable(true);
 
-        //revert lock to its previous state after execution
-        gFunctionIsLocked = lock_function_on_entrance_copy;
+    k_mutex_lock( &xSensorAggregationDutyCycle_mutex, K_FOREVER );
+    gDutyCycle.isRunning = true;
+    k_mutex_unlock( &xSensorAggregationDutyCycle_mutex );
 
-        // Semaphore given by xSensorAggregationStopWifi()
-        k_sem_take( &xSensorAggregationStopWifi_semaphore, K_FOREVER );
-        
-        //keep a copy of current lock status and then lock
-        lock_function_on_entrance_copy = gFunctionIsLocked;
-        gFunctionIsLocked = true;
+    LOG_INF("Duty-cycled transport: batch %d messages, latency bound %d ms \r\n",
+            gDutyCycle.batchSize, gDutyCycle.maxLatencyMs);
+}
 
-        LOG_DBG("WiFi Sensor Aggregation stop request \r\n");
 
-        if( gCurrentMode == xSensAggModeCell ){
-            LOG_INF("Cell Sensor Aggregation mode is enabled. Abort Action \r\n");
-            continue;
-        }
 
-        xWifiNinaDeinit(); //also deinitiliazes ubxlib
+static void SensorAggregationDutyCycleStop(void){
 
-        xWifiNinaStatus_t nina_stat = xWifiNinaGetModuleStatus();
-        //in deinitialization we do not check for errors
-        while( nina_stat.uStatus > uPortNotInitialized ){
-            k_sleep(K_MSEC(1000));
-            nina_stat = xWifiNinaGetModuleStatus();
+    k_mutex_lock( &xSensorAggregationDutyCycle_mutex, K_FOREVER );
+    if( !gDutyCycle.isRunning ){
+        k_mutex_unlock( &xSensorAggregationDutyCycle_mutex );
+        return;
+    }
+
+    // no cycle starts after this, and a cycle already started has set isLinkUp
+    gDutyCycle.isRunning = false;
+    k_timer_stop( &xSensorAggregationLatencyTimer );
+    k_mutex_unlock( &xSensorAggregationDutyCycle_mutex );
+
+    // let a batch being published complete
+    while( gDutyCycle.isLinkUp ){
+        k_sleep(K_MSEC(1000));
+    }
+
+    // publish the messages still batched, the link is brought down by the caller
+    if( xDataBatchGetCount() > 0 ){
+        LOG_INF("Duty-cycled transport: link up to publish %d messages before stopping \r\n",
+                xDataBatchGetCount());
+        if( ( SensorAggregationLinkUp( gCurrentMode ) != X_ERR_SUCCESS ) ||
+            ( xDataBatchFlush( K_MSEC( SENS_AGG_LINK_TIMEOUT_MS ) ) != X_ERR_SUCCESS ) ){
+            gDutyCycle.failures++;
         }
+    }
+
+    xDataBatchEnable(false);
+}
 
-        xWifiNinaPowerOff();
 
-        xSensDisableAll();
-        xSensPublishNone();
 
-        // also power off MaxM10 module since it is not used
-        xPosMaxM10PowerOff();
+static void SensorAggregationFailoverStart(xSensorAggregationMode_t mode){
 
-        LOG_INF("WiFi Sensor Aggregation stopped \r\n");
-        gCurrentMode = xSensAggModeDisabled;
+    if( !gFailover.isEnabled || gDutyCycle.isEnabled ){
+        return;
     }
+
+    gFailover.preferred = mode;
+    gFailover.failures = 0;
+    gFailover.switchedAt = k_uptime_get();
+    gFailover.failovers = 0;
+    gFailover.failbacks = 0;
+    gFailover.failedSwitches = 0;
+    gFailover.lastSwitchMs = 0;
+    gFailover.maxSwitchMs = 0;
+
+    xDataHoldOnFailure(true);
+    gFailover.isRunning = true;
 }
 
 
 
-void xSensorAggregationStartCellThread(void){
+static bool SensorAggregationFailoverStop(void){
 
-    bool lock_function_on_entrance_copy = gFunctionIsLocked;
+    // waits for a switch in progress
+    k_mutex_lock( &xSensorAggregationFailover_mutex, K_FOREVER );
+    bool wasRunning = gFailover.isRunning;
+    gFailover.isRunning = false;
+    k_mutex_unlock( &xSensorAggregationFailover_mutex );
 
-    while(1){
-        
-        //revert lock to its previous state after execution
-        gFunctionIsLocked = lock_function_on_entrance_copy;
-        
-        //Semaphore given by xSensorAggregationStartCell()
-        k_sem_take( &xSensorAggregationStartCell_semaphore, K_FOREVER );
-        
-        //keep a copy of current lock status and then lock
-        lock_function_on_entrance_copy = gFunctionIsLocked;
-        gFunctionIsLocked = true;
+    if( wasRunning ){
+        xDataHoldOnFailure(false);
+    }
 
-        if( gCurrentMode == xSensAggModeCell ){
-            LOG_INF("Cell Sensor Aggregation is already on with period: %d ms \r\n", gUpdatePeriod);
-            continue;
-        }
+    return wasRunning;
+}
 
-        if( gCurrentMode == xSensAggModeWifi ){
-            //disable wifi mode
-            LOG_WRN("WiFi Sensor Aggregation is already on with period: %d ms. Disabling now \r\n", gUpdatePeriod);
-            xSensorAggregationStopWifi();
-            while( gCurrentMode == xSensAggModeWifi ){
-                k_sleep(K_MSEC(1000));
-            }
-        }
 
-        LOG_INF("Cell Sensor Aggregation starting with period: %d ms \r\n", gUpdatePeriod);
 
-        xDataResetSensorAggregationMsg();
-        xSensDisableAll();
-        xSensPublishNone();
-        gLastOperationResult = xSensSetUpdatePeriodAll( gUpdatePeriod );
-        if( gLastOperationResult != X_ERR_SUCCESS ){
-            LOG_ERR("There was an issue with the update Period. Abort Sensor Aggregation startup\r\n");
-            SensorAggregationErrorHandle(gLastOperationResult);
-            continue;
-        }
+static bool SensorAggregationLinkIsUp(void){
 
-        xCellMqttSnClientConnect();
-        xClientStatus_t mqttsn_stat = xCellMqttSnClientGetStatus();
-        
-        //wait for connection and check for errors
-        while( ( mqttsn_stat < ClientConnected ) && ( gLastOperationResult == X_ERR_SUCCESS ) ) {
-            k_sleep(K_MSEC(1000));
-            mqttsn_stat = xCellMqttSnClientGetStatus();
-            gLastOperationResult = xCellMqttSnGetLastOperationResult();
-        }
+    if( gCurrentMode == xSensAggModeWifi ){
+        return ( xWifiMqttClientGetStatus().status == ClientConnected );
+    }
+
+    return ( xCellMqttSnClientGetStatus() == ClientConnected );
+}
 
-        if(gLastOperationResult != X_ERR_SUCCESS ){
-                LOG_ERR("Error Code from MQTT-SN Connect Request: %d - aborting sensor aggregation initialization", gLastOperationResult);
-                xSensorAggregationStopCell();
-                continue;
-        }
-        
-        gCurrentMode = xSensAggModeCell;
 
-        xSensPublishAll();
-        xSensEnableAll();
 
-        xLedOn(CELL_ACTIVATING_LEDCOL);
+static err_code SensorAggregationLinkQualitySample(xSensorAggregationMode_t mode){
+
+    err_code err;
+    xCellSaraLinkQuality_t quality = {0};
+
+    if( mode == xSensAggModeWifi ){
+        err = xWifiNinaGetRssi( &quality.rssiDbm );
+    }
+    else{
+        err = xCellSaraGetLinkQuality( &quality );
+    }
 
+    if( err != X_ERR_SUCCESS ){
+        LOG_WRN("Link quality not available: %d \r\n", err);
+        gLinkQuality.failedSamples++;
+        return err;
     }
+
+    gLinkQuality.mode = mode;
+    gLinkQuality.last = quality;
+    gLinkQuality.sampledAt = k_uptime_get();
+    gLinkQuality.samples++;
+
+    return X_ERR_SUCCESS;
 }
 
 
-void xSensorAggregationStopCellThread(void){
 
-    bool lock_function_on_entrance_copy = gFunctionIsLocked;
+static void SensorAggregationLinkQualityPublish(void){
 
-    while(1){
-       
-        //revert lock to its previous state after execution
-        gFunctionIsLocked = lock_function_on_entrance_copy;
+    xDataPacket_t diag = { .error = dataErrOk, .name = JSON_ID_DIAG_LINK, .measurementsNum = 0 };
+    xSensorAggregationMode_t mode = gLinkQuality.mode;
+    xCellSaraLinkQuality_t quality = gLinkQuality.last;
 
-         // Semaphore given by xSensorAggregationStopCell()
-        k_sem_take( &xSensorAggregationStopCell_semaphore, K_FOREVER );
+    // diagnostics message, eg: {"ID":"LINK","mes":[{"nm":"Tr","vl":1},{"nm":"Rssi","vl":-61}]}
+    const struct{ const char *pName; int32_t value; }chans[] = {
+        { JSON_ID_DIAG_CHAN_TRANSPORT, ( mode == xSensAggModeWifi ) ? 1 : 2 },
+        { JSON_ID_DIAG_CHAN_RSSI, quality.rssiDbm },
+        { JSON_ID_DIAG_CHAN_RSRP, quality.rsrpDbm },
+        { JSON_ID_DIAG_CHAN_RSRQ, quality.rsrqDb },
+        { JSON_ID_DIAG_CHAN_SINR, quality.sinrDb }
+    };
+    uint8_t chansNum = ( mode == xSensAggModeWifi ) ? 2 : ARRAY_SIZE( chans );
 
-        // keep current lock status copy and then lock
-        lock_function_on_entrance_copy = gFunctionIsLocked;
-        gFunctionIsLocked = true;
+    for( uint8_t x = 0; x < chansNum; x++ ){
+        strcpy( diag.meas[x].name, chans[x].pName );
+        diag.meas[x].dataType = isInt;
+        diag.meas[x].data.int32Val = chans[x].value;
+    }
+    diag.measurementsNum = chansNum;
 
-        LOG_DBG("Cell Sensor Aggregation stop request \r\n");
+    xDataSendDiagnostics( diag );
+}
 
-        if( gCurrentMode == xSensAggModeWifi ){
-            LOG_INF("Cell Sensor Aggregation mode is enabled. Abort Action \r\n");
-            continue;
-        }
 
-        xCellSaraDeinit(); //also deinitiliazes ubxlib
 
-        xCellSaraStatus_t sara_stat = xCellSaraGetModuleStatus();
-        //in deinitialization we do not check for errors
-        while( sara_stat.uStatus > uPortNotInitialized ){
-            k_sleep(K_MSEC(1000));
-            sara_stat = xCellSaraGetModuleStatus();
-        }
+static bool SensorAggregationLinkQualityIsPoor(void){
 
-        xSensDisableAll();
-        xSensPublishNone();
+    if( gLinkQuality.sampledAt == 0 ){
+        return false;
+    }
 
-        // also power off MaxM10 module since it is not used
-        xPosMaxM10PowerOff();
-        
-        LOG_INF("Cell Sensor Aggregation stopped \r\n");
-        gCurrentMode = xSensAggModeDisabled;
+    if( gLinkQuality.mode == xSensAggModeWifi ){
+        return ( gLinkQuality.last.rssiDbm < SENS_AGG_LINK_MIN_RSSI_DBM );
     }
 
+    return ( ( gLinkQuality.last.rsrpDbm < SENS_AGG_LINK_MIN_RSRP_DBM ) ||
+             ( gLinkQuality.last.rsrqDb < SENS_AGG_LINK_MIN_RSRQ_DB ) );
 }
 
 
-/* ----------------------------------------------------------------
- * PUBLIC FUNCTION IMPLEMENTATION
- * -------------------------------------------------------------- */
 
+static bool SensorAggregationFlushDefer(xSensorAggregationMode_t mode){
 
-void xSensorAggregationStartWifi(void){
-    k_sem_give( &xSensorAggregationStartWifi_semaphore );
-}
+    // if the quality cannot be read, do not hold the batch back
+    if( ( SensorAggregationLinkQualitySample( mode ) != X_ERR_SUCCESS ) || 
+        !SensorAggregationLinkQualityIsPoor() ){
+        gLinkQuality.deferredSince = 0;
+        return false;
+    }
 
+    if( !gLinkQuality.deferEnabled ){
+        return false;
+    }
 
-void xSensorAggregationStopWifi(void){
-    k_sem_give( &xSensorAggregationStopWifi_semaphore );
-}
+    int64_t now = k_uptime_get();
+
+    if( gLinkQuality.deferredSince == 0 ){
+        gLinkQuality.deferredSince = now;
+    }
 
+    if( now - gLinkQuality.deferredSince >= gLinkQuality.maxDeferMs ){
+        LOG_WRN("Link quality poor, max deferral expired: publishing \r\n");
+        gLinkQuality.deferredSince = 0;
+        gLinkQuality.forcedFlushes++;
+        return false;
+    }
 
-void xSensorAggregationStartCell(void){
-    k_sem_give( &xSensorAggregationStartCell_semaphore );
+    gLinkQuality.deferrals++;
+    return true;
 }
 
 
 
-void xSensorAggregationStopCell(void){
-    k_sem_give( &xSensorAggregationStopCell_semaphore );
+void xSensorAggregationLinkQualityThread(void){
+
+    // needed to avoid thread overflows when using ubxlib functions within a thread
+    k_thread_system_pool_assign(k_current_get());
+
+    while(1){
+
+        k_sleep( K_MSEC( SENS_AGG_LINK_SAMPLE_PERIOD_MS ) );
+
+        // in duty-cycled transport mode the link is sampled when brought up
+        if( ( gCurrentMode == xSensAggModeDisabled ) || gDutyCycle.isRunning ||
+            xSensorAggregationIsLocked() || !SensorAggregationLinkIsUp() ){
+            continue;
+        }
+
+        if( SensorAggregationLinkQualitySample( gCurrentMode ) == X_ERR_SUCCESS ){
+            SensorAggregationLinkQualityPublish();
+        }
+    }
 }
 
 
 
-err_code xSensorAggregationSetUpdatePeriod(uint32_t milliseconds){
-    
+static void SensorAggregationSwitchLink(xSensorAggregationMode_t to){
+
     err_code err;
 
-    gUpdatePeriod = milliseconds;
+    k_mutex_lock( &xSensorAggregationFailover_mutex, K_FOREVER );
 
-    // if currrently running, update while active
-    if(gCurrentMode != xSensAggModeDisabled){
-        err = xSensSetUpdatePeriodAll( milliseconds );
-        if( err != X_ERR_SUCCESS ){
-            LOG_ERR("Invalid update period requested for Sensor Aggregation function\r\n");
-            return err; 
+    if( !gFailover.isRunning ){
+        k_mutex_unlock( &xSensorAggregationFailover_mutex );
+        return;
+    }
+
+    gFailover.isSwitching = true;
+    xSensorAggregationMode_t from = gCurrentMode;
+    int64_t start = k_uptime_get();
+
+    LOG_WRN("Switching transport: %s -> %s \r\n",
+            xSensorAggregationMode_t_strings[from], xSensorAggregationMode_t_strings[to]);
+
+    // sensors keep sampling, messages that cannot be published meanwhile are held
+    SensorAggregationLinkDown( from );
+
+    if( to == xSensAggModeCell ){
+        xCellSaraPowerSaving_t timers;
+        SensorAggregationPowerSavingTimers( gUpdatePeriod, &timers );
+        xCellSaraSetPowerSaving( &timers );
+    }
+
+    err = SensorAggregationLinkUp( to );
+    if( err != X_ERR_SUCCESS ){
+        LOG_ERR("%s link not up: %d, restoring %s \r\n", xSensorAggregationMode_t_strings[to], err,
+                xSensorAggregationMode_t_strings[from]);
+        gFailover.failedSwitches++;
+        SensorAggregationLinkDown( to );
+        to = from;
+        err = SensorAggregationLinkUp( to );
+    }
+    else{
+        gFailover.lastSwitchMs = (uint32_t)( k_uptime_get() - start );
+        if( gFailover.lastSwitchMs > gFailover.maxSwitchMs ){
+            gFailover.maxSwitchMs = gFailover.lastSwitchMs;
+        }
+        if( to == gFailover.preferred ){
+            gFailover.failbacks++;
+        }
+        else{
+            gFailover.failovers++;
         }
+        LOG_INF("Transport switched in %d ms \r\n", gFailover.lastSwitchMs);
     }
-    return X_ERR_SUCCESS;
+
+    gCurrentMode = to;
+    gFailover.failures = 0;
+    gFailover.switchedAt = k_uptime_get();
+    xLedOn( ( to == xSensAggModeWifi ) ? WIFI_ACTIVATING_LEDCOL : CELL_ACTIVATING_LEDCOL );
+
+    // publish the messages held during the switch
+    if( err == X_ERR_SUCCESS ){
+        xDataBatchFlush( K_MSEC( SENS_AGG_LINK_TIMEOUT_MS ) );
+    }
+
+    gFailover.isSwitching = false;
+    k_mutex_unlock( &xSensorAggregationFailover_mutex );
 }
 
 
 
-int32_t xSensorAggregationGetUpdatePeriod(void){
+void xSensorAggregationFailoverThread(void){
 
-    return gUpdatePeriod;
+    // needed to avoid thread overflows when using ubxlib functions within a thread
+    k_thread_system_pool_assign(k_current_get());
+
+    while(1){
+
+        // Semaphore given on consecutive publish failures, else periodic check
+        k_sem_take( &xSensorAggregationFailover_semaphore, K_MSEC( SENS_AGG_FAILOVER_CHECK_MS ) );
+
+        if( !gFailover.isRunning || ( gState != sensAggStateRunning ) ){
+            continue;
+        }
+
+        // active link unhealthy, fail over to the other one
+        if( gFailover.failures >= SENS_AGG_FAILOVER_MAX_FAILURES ){
+            SensorAggregationSwitchLink( ( gCurrentMode == xSensAggModeWifi ) ? xSensAggModeCell : xSensAggModeWifi );
+            continue;
+        }
+
+        // on the fallback link, try the preferred one again
+        if( ( gCurrentMode != gFailover.preferred ) &&
+            ( k_uptime_get() - gFailover.switchedAt >= SENS_AGG_FAILBACK_PERIOD_MS ) ){
+            SensorAggregationSwitchLink( gFailover.preferred );
+            continue;
+        }
+
+        // link recovered by itself, publish the held messages
+        if( ( xDataBatchGetCount() > 0 ) && SensorAggregationLinkIsUp() ){
+            xDataBatchFlush( K_MSEC( SENS_AGG_LINK_TIMEOUT_MS ) );
+        }
+    }
 }
 
 
 
-xSensorAggregationMode_t xSensorAggregationGetMode(void){
-    return gCurrentMode;
+static void SensorAggregationModeSwitchDone(int64_t start){
+
+    gModeSwitch.lastMs = (uint32_t)( k_uptime_get() - start );
+    if( gModeSwitch.lastMs > gModeSwitch.maxMs ){
+        gModeSwitch.maxMs = gModeSwitch.lastMs;
+    }
+    gModeSwitch.count++;
+
+    LOG_INF("Mode switched in %d ms \r\n", gModeSwitch.lastMs);
 }
 
 
 
-bool xSensorAggregationIsLocked(void){
-    return gFunctionIsLocked;
+static void SensorAggregationPowerSavingTimers(uint32_t periodMs, xCellSaraPowerSaving_t *pTimers){
+
+    pTimers->psmOn = false;
+    pTimers->eDrxOn = false;
+    pTimers->activeTimeS = 0;
+    pTimers->periodicWakeupS = 0;
+    pTimers->eDrxS = 0;
+    pTimers->pagingWindowS = 0;
+
+    if( !gCellPowerSaving ){
+        return;
+    }
+
+    // long periods: deep sleep between publishes, publishes (uplink) wake the
+    // module and restart the periodic wake-up timer, so it only needs to be
+    // longer than the period
+    if( periodMs >= SARA_PSM_MIN_PERIOD_MS ){
+        pTimers->psmOn = true;
+        pTimers->activeTimeS = SARA_PSM_ACTIVE_TIME_S;
+        pTimers->periodicWakeupS = ( periodMs / 1000 ) * 2;
+        if( pTimers->periodicWakeupS < SARA_PSM_TAU_MIN_S ){
+            pTimers->periodicWakeupS = SARA_PSM_TAU_MIN_S;
+        }
+        return;
+    }
+
+    // short periods: stay registered, paging only once per eDRX cycle. Only
+    // defined cycles can be requested, the longest one up to half the period
+    uint32_t cycleMs = xCellSaraGetEDrxCycleMs( periodMs / 2 );
+    if( cycleMs > 0 ){
+        pTimers->eDrxOn = true;
+        pTimers->eDrxS = cycleMs / 1000;
+        pTimers->pagingWindowS = SARA_EDRX_PAGING_WINDOW_S;
+    }
 }
 
 
-/* ----------------------------------------------------------------
- * SHELL COMMANDS IMPLEMENTATION
- * -------------------------------------------------------------- */
 
+static bool SensorAggregationParseUint(const char *pStr, uint32_t maxValue, uint32_t *pValue){
 
-void xSensorAggregationTypeStatusCmd(const struct shell *shell, size_t argc, char **argv){
-    
-    const char *const xSensorAggregationMode_t_strings[]={
-        [xSensAggModeDisabled] = "Disabled",
-        [xSensAggModeWifi] = "WiFi mode",
-        [xSensAggModeCell] = "Cell mode"
-    };
+    char *pEnd;
+    unsigned long value;
 
-    shell_print(shell, "Sensor Aggregation Function Mode: %s with sampling period: %d ms \r\n",
-     xSensorAggregationMode_t_strings[gCurrentMode], gUpdatePeriod);
+    // strtoul accepts a sign and wraps negative values around
+    if( ( *pStr < '0' ) || ( *pStr > '9' ) ){
+        return false;
+    }
 
-    return;
+    value = strtoul( pStr, &pEnd, 10 );
+    if( ( *pEnd != 0 ) || ( value == 0 ) || ( value > maxValue ) ){
+        return false;
+    }
+
+    *pValue = (uint32_t)value;
+    return true;
 }
 
 
 
-void xSensorAggregationSetUpdatePeriodCmd(const struct shell *shell, size_t argc, char **argv)
-{
+static err_code SensorAggregationSetSensorPeriods(uint32_t periodMs){
 
-		// to do: Can add some sanity checks here on the period***
+    err_code err;
 
-        if( ( xSensorAggregationSetUpdatePeriod( atoi( argv[1]) ) ) == X_ERR_SUCCESS ){
-		    shell_print(shell, "Sensor Aggregation Update Period Set to %d ms", gUpdatePeriod);
-        }
-        else{
-            shell_error(shell, "Sensor Aggregation Could not Update Period");
+    for( xSensType_t x = 0; x < max_sensors_num_t; x++ ){
+        err = xSensSetUpdatePeriod( x, periodMs * gRateDivisors[ gProfile ][ x ] );
+        if( err != X_ERR_SUCCESS ){
+            return err;
         }
-		return;
+    }
+
+    return X_ERR_SUCCESS;
 }
 
 
+
+static void SensorAggregationLatencyTimerCb(struct k_timer *timer){
+
+    k_sem_give( &xSensorAggregationFlush_semaphore );
+}
+
+
+
+void xSensorAggregationDutyCycleThread(void){
+
+    err_code err;
+    uint32_t count;
+    bool deferred;
+
+    // needed to avoid thread overflows when using ubxlib functions within a thread
+    k_thread_system_pool_assign(k_current_get());
+
+    while(1){
+
+        // Semaphore given when the batch is full or the latency bound expires
+        k_sem_take( &xSensorAggregationFlush_semaphore, K_FOREVER );
+
+        k_timer_stop( &xSensorAggregationLatencyTimer );
+
+        // running state checked and link marked up at once, see SensorAggregationDutyCycleStop()
+        k_mutex_lock( &xSensorAggregationDutyCycle_mutex, K_FOREVER );
+        count = xDataBatchGetCount();
+        if( !gDutyCycle.isRunning || ( count == 0 ) ){
+            k_mutex_unlock( &xSensorAggregationDutyCycle_mutex );
+            continue;
+        }
+        gDutyCycle.isLinkUp = true;
+        k_mutex_unlock( &xSensorAggregationDutyCycle_mutex );
+
+        deferred = false;
+        int64_t start = k_uptime_get();
+
+        LOG_INF("Duty-cycled transport: link up to publish %d messages \r\n", count);
+
+        err = SensorAggregationLinkUp( gCurrentMode );
+        if( err == X_ERR_SUCCESS ){
+            // a full batch is always published, else wait for a better link
+            if( count >= gDutyCycle.batchSize ){
+                SensorAggregationLinkQualitySample( gCurrentMode );
+            }
+            else{
+                deferred = SensorAggregationFlushDefer( gCurrentMode );
+            }
+            if( !deferred ){
+                err = xDataBatchFlush( K_MSEC( SENS_AGG_LINK_TIMEOUT_MS ) );
+
+                // the diagnostics message is batched too: sent only after the batch,
+                // so that it does not take the place of sensor messages in the batch
+                // and is not kept for cycles that are deferred
+                if( ( err == X_ERR_SUCCESS ) && ( gLinkQuality.sampledAt >= start ) ){
+                    SensorAggregationLinkQualityPublish();
+                    err = xDataBatchFlush( K_MSEC( SENS_AGG_LINK_TIMEOUT_MS ) );
+                }
+            }
+        }
+        if( err != X_ERR_SUCCESS ){
+            LOG_ERR("Duty-cycled transport: batch not published: %d \r\n", err);
+            gDutyCycle.failures++;
+        }
+
+        SensorAggregationLinkDown( gCurrentMode );
+
+        gDutyCycle.lastCycleMs = (uint32_t)( k_uptime_get() - start );
+        gDutyCycle.radioOnMs += gDutyCycle.lastCycleMs;
+        gDutyCycle.cycles++;
+
+        LOG_INF("Duty-cycled transport: link down after %d ms \r\n", gDutyCycle.lastCycleMs);
+
+        // messages left (publish failed or deferred, or sampled while flushing),
+        // the timer is not restarted once stopped
+        k_mutex_lock( &xSensorAggregationDutyCycle_mutex, K_FOREVER );
+        gDutyCycle.isLinkUp = false;
+        count = xDataBatchGetCount();
+        if( gDutyCycle.isRunning && ( count > 0 ) ){
+            if( deferred && ( count < gDutyCycle.batchSize ) ){
+                LOG_INF("Duty-cycled transport: link quality poor, publish retried in %d ms \r\n", SENS_AGG_LINK_RETRY_MS);
+                k_timer_start( &xSensorAggregationLatencyTimer, K_MSEC( SENS_AGG_LINK_RETRY_MS ), K_NO_WAIT );
+            }
+            else if( count >= gDutyCycle.batchSize ){
+                k_sem_give( &xSensorAggregationFlush_semaphore );
+            }
+            else{
+                k_timer_start( &xSensorAggregationLatencyTimer, K_MSEC( gDutyCycle.maxLatencyMs ), K_NO_WAIT );
+            }
+        }
+        k_mutex_unlock( &xSensorAggregationDutyCycle_mutex );
+    }
+}
+
+
+static void SensorAggregationPost(sensAggEvent_t event, xSensorAggregationMode_t mode){
+
+    sensAggMsg_t msg = { .event = event, .mode = mode, .requestTime = k_uptime_get() };
+
+    // counted before posting, so the functionality is locked until handled
+    atomic_inc( &gPendingRequests );
+
+    if( k_msgq_put( &xSensorAggregationMsgq, &msg, K_NO_WAIT ) != 0 ){
+        LOG_ERR("Sensor Aggregation queue full, request dropped \r\n");
+        atomic_dec( &gPendingRequests );
+    }
+}
+
+
+
+static err_code SensorAggregationConfigLock(void){
+
+    if( k_mutex_lock( &xSensorAggregationState_mutex, K_MSEC( SENS_AGG_CONFIG_TIMEOUT_MS ) ) != 0 ){
+        LOG_WRN("Sensor Aggregation transition in progress, try again \r\n");
+        return X_ERR_TIMEOUT;
+    }
+
+    gIsConfiguring = true;
+    return X_ERR_SUCCESS;
+}
+
+
+
+static void SensorAggregationConfigUnlock(void){
+
+    gIsConfiguring = false;
+    k_mutex_unlock( &xSensorAggregationState_mutex );
+}
+
+
+
+static void SensorAggregationSetState(sensAggState_t state){
+
+    LOG_DBG("State: %s -> %s \r\n", sensAggState_t_strings[gState], sensAggState_t_strings[state]);
+    gState = state;
+}
+
+
+
+static void SensorAggregationTransitionDone(int64_t requestTime){
+
+    gTransition.lastMs = (uint32_t)( k_uptime_get() - requestTime );
+    if( gTransition.lastMs > gTransition.maxMs ){
+        gTransition.maxMs = gTransition.lastMs;
+    }
+    gTransition.count++;
+
+    LOG_INF("Sensor Aggregation %s (%s), %d ms after request \r\n", sensAggState_t_strings[gState],
+            xSensorAggregationMode_t_strings[gCurrentMode], gTransition.lastMs);
+}
+
+
+
+static void SensorAggregationTeardown(xSensorAggregationMode_t mode){
+
+    SensorAggregationSetState( sensAggStateStopping );
+
+    // waits for a link switch in progress, then the active link is known
+    SensorAggregationFailoverStop();
+    SensorAggregationDutyCycleStop();
+
+    // with failover the function started via one transport may run on the other
+    SensorAggregationLinkDown( ( gCurrentMode != xSensAggModeDisabled ) ? gCurrentMode : mode );
+
+    xSensDisableAll();
+    xSensPublishNone();
+
+    // also power off MaxM10 module since it is not used
+    xPosMaxM10PowerOff();
+
+    gCurrentMode = xSensAggModeDisabled;
+    SensorAggregationSetState( sensAggStateIdle );
+}
+
+
+
+static bool SensorAggregationStart(xSensorAggregationMode_t mode, int64_t requestTime){
+
+    err_code err = X_ERR_SUCCESS;
+
+    if( ( gState == sensAggStateRunning ) && ( gCurrentMode == mode ) ){
+        LOG_INF("%s Sensor Aggregation is already on with period: %d ms \r\n",
+                xSensorAggregationMode_t_strings[mode], gUpdatePeriod);
+        return false;
+    }
+
+    // running over the other transport, stop it first
+    bool isSwitch = ( gState == sensAggStateRunning );
+    if( isSwitch ){
+        LOG_WRN("%s Sensor Aggregation is already on with period: %d ms. Disabling now \r\n",
+                xSensorAggregationMode_t_strings[gCurrentMode], gUpdatePeriod);
+        SensorAggregationTeardown( gCurrentMode );
+    }
+
+    SensorAggregationSetState( sensAggStateStarting );
+
+    LOG_INF("%s Sensor Aggregation starting with period: %d ms \r\n",
+            xSensorAggregationMode_t_strings[mode], gUpdatePeriod);
+
+    xDataResetSensorAggregationMsg();
+    xSensDisableAll();
+    xSensPublishNone();
+    gLastOperationResult = SensorAggregationSetSensorPeriods( gUpdatePeriod );
+    if( gLastOperationResult != X_ERR_SUCCESS ){
+        LOG_ERR("There was an issue with the update Period. Abort Sensor Aggregation startup\r\n");
+        SensorAggregationErrorHandle(gLastOperationResult);
+        SensorAggregationSetState( sensAggStateIdle );
+        return true;
+    }
+
+    if( mode == xSensAggModeCell ){
+        // request power saving timers matching the sampling period (applied
+        // when the module registers)
+        xCellSaraPowerSaving_t timers;
+        SensorAggregationPowerSavingTimers( gUpdatePeriod, &timers );
+        xCellSaraSetPowerSaving( &timers );
+    }
+
+    // duty-cycled transport, the link is brought up only to publish batches
+    if( gDutyCycle.isEnabled ){
+        SensorAggregationDutyCycleStart();
+        gCurrentMode = mode;
+        xSensPublishAll();
+        xSensEnableAll();
+    }
+    else{
+
+        // wait for connection to MQTT/MQTT-SN and check for errors (bounded,
+        // a lost state machine event does not block the aggregation thread)
+        err = SensorAggregationLinkUp( mode );
+
+        if( err != X_ERR_SUCCESS ){
+            LOG_ERR("Error Code from %s Connect Request: %d - aborting sensor aggregation initialization",
+                    ( mode == xSensAggModeWifi ) ? "MQTT" : "MQTT-SN", err);
+            gLastOperationResult = err;
+            SensorAggregationTeardown( mode );
+            return true;
+        }
+
+        gCurrentMode = mode;
+        SensorAggregationFailoverStart( mode );
+
+        xSensPublishAll();
+        xSensEnableAll();
+
+        xLedOn( ( mode == xSensAggModeWifi ) ? WIFI_ACTIVATING_LEDCOL : CELL_ACTIVATING_LEDCOL );
+    }
+
+    SensorAggregationSetState( sensAggStateRunning );
+
+    if( isSwitch ){
+        SensorAggregationModeSwitchDone( requestTime );
+    }
+
+    return true;
+}
+
+
+
+static bool SensorAggregationStop(xSensorAggregationMode_t mode){
+
+    LOG_DBG("%s Sensor Aggregation stop request \r\n", xSensorAggregationMode_t_strings[mode]);
+
+    // with failover the function started via this transport may run on the other
+    bool failover = ( gFailover.isRunning && ( gFailover.preferred == mode ) );
+
+    if( ( gState == sensAggStateRunning ) && ( gCurrentMode != mode ) && !failover ){
+        LOG_INF("%s Sensor Aggregation is enabled. Abort Action \r\n", xSensorAggregationMode_t_strings[gCurrentMode]);
+        return false;
+    }
+
+    SensorAggregationTeardown( mode );
+
+    LOG_INF("%s Sensor Aggregation stopped \r\n", xSensorAggregationMode_t_strings[mode]);
+    return true;
+}
+
+
+
+void xSensorAggregationThread(void){
+
+    sensAggMsg_t msg;
+    bool transition;
+
+    while(1){
+
+        // Requests posted by xSensorAggregationStartWifi() etc
+        k_msgq_get( &xSensorAggregationMsgq, &msg, K_FOREVER );
+
+        // configuration changes wait for the transition
+        k_mutex_lock( &xSensorAggregationState_mutex, K_FOREVER );
+
+        if( msg.event == sensAggEvtStart ){
+            transition = SensorAggregationStart( msg.mode, msg.requestTime );
+        }
+        else{
+            transition = SensorAggregationStop( msg.mode );
+        }
+
+        k_mutex_unlock( &xSensorAggregationState_mutex );
+
+        if( transition ){
+            SensorAggregationTransitionDone( msg.requestTime );
+        }
+
+        atomic_dec( &gPendingRequests );
+    }
+}
+
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTION IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+
+void xSensorAggregationStartWifi(void){
+    SensorAggregationPost( sensAggEvtStart, xSensAggModeWifi );
+}
+
+
+void xSensorAggregationStopWifi(void){
+    SensorAggregationPost( sensAggEvtStop, xSensAggModeWifi );
+}
+
+
+void xSensorAggregationStartCell(void){
+    SensorAggregationPost( sensAggEvtStart, xSensAggModeCell );
+}
+
+
+
+void xSensorAggregationStopCell(void){
+    SensorAggregationPost( sensAggEvtStop, xSensAggModeCell );
+}
+
+
+
+err_code xSensorAggregationSetUpdatePeriod(uint32_t milliseconds){
+    
+    err_code err;
+
+    if( ( milliseconds < SENS_AGG_MIN_UPDATE_PERIOD_MS ) || ( milliseconds > SENS_AGG_MAX_UPDATE_PERIOD_MS ) ){
+        LOG_ERR("Sensor Aggregation update period should be %d - %d ms\r\n",
+                SENS_AGG_MIN_UPDATE_PERIOD_MS, SENS_AGG_MAX_UPDATE_PERIOD_MS);
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    err = SensorAggregationConfigLock();
+    if( err != X_ERR_SUCCESS ){
+        return err;
+    }
+
+    // if currrently running, update while active: all sensors or none
+    if( gState == sensAggStateRunning ){
+        err = SensorAggregationSetSensorPeriods( milliseconds );
+        if( err != X_ERR_SUCCESS ){
+            LOG_ERR("Invalid update period requested for Sensor Aggregation function\r\n");
+            SensorAggregationSetSensorPeriods( gUpdatePeriod );
+            SensorAggregationConfigUnlock();
+            return err; 
+        }
+
+        // the message being aggregated refers to the previous period
+        xDataResetSensorAggregationMsg();
+
+        if( gCurrentMode == xSensAggModeCell ){
+            xCellSaraPowerSaving_t timers;
+            SensorAggregationPowerSavingTimers( milliseconds, &timers );
+            xCellSaraSetPowerSaving( &timers );
+        }
+    }
+
+    gUpdatePeriod = milliseconds;
+
+    SensorAggregationConfigUnlock();
+    return X_ERR_SUCCESS;
+}
+
+
+
+err_code xSensorAggregationSetSensorRate(xSensType_t sensorType, uint32_t milliseconds){
+
+    uint8_t savedDivisors[ max_sensors_num_t ];
+    xSensorAggregationProfile_t savedProfile;
+    uint32_t divisor;
+    err_code err;
+
+    if( sensorType > max_sensors_num_t ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    err = SensorAggregationConfigLock();
+    if( err != X_ERR_SUCCESS ){
+        return err;
+    }
+
+    if( gState != sensAggStateRunning ){
+        err = ( sensorType == max_sensors_num_t ) ? xSensSetUpdatePeriodAll( milliseconds ) :
+                                                    xSensSetUpdatePeriod( sensorType, milliseconds );
+        SensorAggregationConfigUnlock();
+        return err;
+    }
+
+    // while running, sensors are sampled every divisor sampling periods
+    divisor = milliseconds / gUpdatePeriod;
+    if( ( ( milliseconds % gUpdatePeriod ) != 0 ) || ( divisor == 0 ) || ( divisor > SENS_AGG_RATE_DIVISOR_MAX ) ){
+        LOG_ERR("Period should be a multiple of the sampling period (%d ms) \r\n", gUpdatePeriod);
+        SensorAggregationConfigUnlock();
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    // custom profile starts from the active one, restored if not applied
+    memcpy( savedDivisors, gRateDivisors[ xSensAggProfileCustom ], max_sensors_num_t );
+    savedProfile = gProfile;
+    if( gProfile != xSensAggProfileCustom ){
+        memcpy( gRateDivisors[ xSensAggProfileCustom ], gRateDivisors[ gProfile ], max_sensors_num_t );
+        gProfile = xSensAggProfileCustom;
+    }
+
+    for( xSensType_t x = 0; x < max_sensors_num_t; x++ ){
+        if( ( sensorType == max_sensors_num_t ) || ( sensorType == x ) ){
+            gRateDivisors[ xSensAggProfileCustom ][ x ] = (uint8_t)divisor;
+        }
+    }
+
+    err = SensorAggregationSetSensorPeriods( gUpdatePeriod );
+    if( err != X_ERR_SUCCESS ){
+        memcpy( gRateDivisors[ xSensAggProfileCustom ], savedDivisors, max_sensors_num_t );
+        gProfile = savedProfile;
+        SensorAggregationSetSensorPeriods( gUpdatePeriod );
+    }
+    else{
+        xDataResetSensorAggregationMsg();
+    }
+
+    SensorAggregationConfigUnlock();
+    return err;
+}
+
+
+
+err_code xSensorAggregationSetSensorPublish(xSensType_t sensorType, bool enable){
+
+    err_code err = X_ERR_SUCCESS;
+
+    if( sensorType > max_sensors_num_t ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    err = SensorAggregationConfigLock();
+    if( err != X_ERR_SUCCESS ){
+        return err;
+    }
+
+    if( sensorType != max_sensors_num_t ){
+        err = xSensEnablePublish( sensorType, enable );
+    }
+    else if( enable ){
+        xSensPublishAll();
+    }
+    else{
+        xSensPublishNone();
+    }
+
+    SensorAggregationConfigUnlock();
+    return err;
+}
+
+
+
+int32_t xSensorAggregationGetUpdatePeriod(void){
+
+    return gUpdatePeriod;
+}
+
+
+
+err_code xSensorAggregationSetProfile(xSensorAggregationProfile_t profile){
+
+    if( gCurrentMode != xSensAggModeDisabled ){
+        LOG_ERR("Disable Sensor Aggregation function before changing profile\r\n");
+        return X_ERR_INVALID_STATE;
+    }
+
+    if( profile >= xSensAggProfileNum ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    gProfile = profile;
+    return X_ERR_SUCCESS;
+}
+
+
+
+err_code xSensorAggregationSetRateDivisor(xSensType_t sensorType, uint32_t divisor){
+
+    if( gCurrentMode != xSensAggModeDisabled ){
+        LOG_ERR("Disable Sensor Aggregation function before changing profile\r\n");
+        return X_ERR_INVALID_STATE;
+    }
+
+    if( ( sensorType >= max_sensors_num_t ) || ( divisor == 0 ) || ( divisor > SENS_AGG_RATE_DIVISOR_MAX ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    // custom profile starts from the active one
+    if( gProfile != xSensAggProfileCustom ){
+        memcpy( gRateDivisors[ xSensAggProfileCustom ], gRateDivisors[ gProfile ], max_sensors_num_t );
+        gProfile = xSensAggProfileCustom;
+    }
+
+    gRateDivisors[ xSensAggProfileCustom ][ sensorType ] = (uint8_t)divisor;
+    return X_ERR_SUCCESS;
+}
+
+
+
+uint32_t xSensorAggregationGetRateDivisor(xSensType_t sensorType){
+
+    if( sensorType >= max_sensors_num_t ){
+        return 1;
+    }
+
+    return gRateDivisors[ gProfile ][ sensorType ];
+}
+
+
+
+xSensorAggregationMode_t xSensorAggregationGetMode(void){
+    return gCurrentMode;
+}
+
+
+
+bool xSensorAggregationIsLocked(void){
+    return ( ( atomic_get( &gPendingRequests ) > 0 ) || gFailover.isSwitching || gIsConfiguring );
+}
+
+
+
+err_code xSensorAggregationSetDutyCycle(bool enable, uint32_t batchSize, uint32_t maxLatencyMs){
+
+    if( gCurrentMode != xSensAggModeDisabled ){
+        LOG_ERR("Disable Sensor Aggregation function before changing transport mode\r\n");
+        return X_ERR_INVALID_STATE;
+    }
+
+    if( ( batchSize == 0 ) || ( batchSize > DATA_BATCH_MAX_MSGS ) || ( maxLatencyMs == 0 ) ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    gDutyCycle.isEnabled = enable;
+    gDutyCycle.batchSize = batchSize;
+    gDutyCycle.maxLatencyMs = maxLatencyMs;
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+err_code xSensorAggregationSetLinkQualityDefer(bool enable, uint32_t maxDeferMs){
+
+    if( maxDeferMs == 0 ){
+        return X_ERR_INVALID_PARAMETER;
+    }
+
+    gLinkQuality.deferEnabled = enable;
+    gLinkQuality.maxDeferMs = maxDeferMs;
+    gLinkQuality.deferredSince = 0;
+
+    return X_ERR_SUCCESS;
+}
+
+
+
+err_code xSensorAggregationSetCellPowerSaving(bool enable){
+
+    if( gCurrentMode != xSensAggModeDisabled ){
+        LOG_ERR("Disable Sensor Aggregation function before changing power saving\r\n");
+        return X_ERR_INVALID_STATE;
+    }
+
+    gCellPowerSaving = enable;
+    return X_ERR_SUCCESS;
+}
+
+
+
+err_code xSensorAggregationSetFailover(bool enable){
+
+    if( gCurrentMode != xSensAggModeDisabled ){
+        LOG_ERR("Disable Sensor Aggregation function before changing failover\r\n");
+        return X_ERR_INVALID_STATE;
+    }
+
+    gFailover.isEnabled = enable;
+    return X_ERR_SUCCESS;
+}
+
+
+
+void xSensorAggregationPublishResult(bool success){
+
+    if( !gFailover.isRunning ){
+        return;
+    }
+
+    if( success ){
+        gFailover.failures = 0;
+        return;
+    }
+
+    if( ++gFailover.failures >= SENS_AGG_FAILOVER_MAX_FAILURES ){
+        k_sem_give( &xSensorAggregationFailover_semaphore );
+    }
+}
+
+
+
+void xSensorAggregationBatchNotify(uint32_t batchCount){
+
+    k_mutex_lock( &xSensorAggregationDutyCycle_mutex, K_FOREVER );
+
+    if( !gDutyCycle.isRunning ){
+        k_mutex_unlock( &xSensorAggregationDutyCycle_mutex );
+        return;
+    }
+
+    // first message of a batch, start the latency bound
+    if( batchCount == 1 ){
+        k_timer_start( &xSensorAggregationLatencyTimer, K_MSEC( gDutyCycle.maxLatencyMs ), K_NO_WAIT );
+    }
+
+    if( batchCount >= gDutyCycle.batchSize ){
+        k_sem_give( &xSensorAggregationFlush_semaphore );
+    }
+
+    k_mutex_unlock( &xSensorAggregationDutyCycle_mutex );
+}
+
+
+/* ----------------------------------------------------------------
+ * SHELL COMMANDS IMPLEMENTATION
+ * -------------------------------------------------------------- */
+
+
+void xSensorAggregationTypeStatusCmd(const struct shell *shell, size_t argc, char **argv){
+
+    shell_print(shell, "Sensor Aggregation Function Mode: %s with sampling period: %d ms \r\n",
+     xSensorAggregationMode_t_strings[gCurrentMode], gUpdatePeriod);
+
+    shell_print(shell, "Aggregation profile: %s \r\n", xSensorAggregationProfile_t_strings[gProfile]);
+
+    shell_print(shell, "State: %s, transitions: %d, latency: last %d ms, max %d ms \r\n",
+     sensAggState_t_strings[gState], gTransition.count, gTransition.lastMs, gTransition.maxMs);
+
+    if( gModeSwitch.count > 0 ){
+        shell_print(shell, "Mode switches: %d, latency: last %d ms, max %d ms \r\n",
+         gModeSwitch.count, gModeSwitch.lastMs, gModeSwitch.maxMs);
+    }
+
+    shell_print(shell, "Duty-cycled transport: %s (batch: %d messages, latency bound: %d ms) \r\n",
+     gDutyCycle.isEnabled ? "on" : "off", gDutyCycle.batchSize, gDutyCycle.maxLatencyMs);
+
+    shell_print(shell, "Failover: %s \r\n", gFailover.isEnabled ? "on" : "off");
+    if( gFailover.isRunning ){
+        shell_print(shell, "\
+        - Preferred transport: %s, active: %s%s\r\n\
+        - Failovers: %d, failbacks: %d, reverted switches: %d\r\n\
+        - Switchover time: last %d ms, max %d ms\r\n\
+        - Held messages: %d\r\n",
+            xSensorAggregationMode_t_strings[gFailover.preferred], xSensorAggregationMode_t_strings[gCurrentMode],
+            gFailover.isSwitching ? " (switching)" : "",
+            gFailover.failovers, gFailover.failbacks, gFailover.failedSwitches,
+            gFailover.lastSwitchMs, gFailover.maxSwitchMs,
+            xDataBatchGetCount());
+    }
+
+    shell_print(shell, "Link quality deferral: %s (max: %d ms) \r\n",
+     gLinkQuality.deferEnabled ? "on" : "off", gLinkQuality.maxDeferMs);
+    if( gLinkQuality.sampledAt != 0 ){
+        xSensorAggregationLinkQualityCmd(shell, 1, argv);
+    }
+
+    shell_print(shell, "Cellular power saving: %s \r\n", gCellPowerSaving ? "on" : "off");
+    if( gCellPowerSaving && ( gCurrentMode == xSensAggModeCell ) ){
+        xCellSaraPowerSavingCmd(shell, argc, argv);
+    }
+
+    if( gDutyCycle.isRunning ){
+
+        uint64_t elapsed = k_uptime_get() - gDutyCycle.sessionStart;
+        uint32_t onPerHour = 0;
+        if( elapsed > 0 ){
+            onPerHour = (uint32_t)( ( gDutyCycle.radioOnMs * 3600 ) / elapsed );
+        }
+
+        shell_print(shell, "\
+        - Batched messages: %d\r\n\
+        - Link cycles: %d (failed: %d), last: %d ms\r\n\
+        - Radio on: %d s of %d s\r\n\
+        - Estimated radio on per hour: %d s\r\n",
+            xDataBatchGetCount(),
+            gDutyCycle.cycles, gDutyCycle.failures, gDutyCycle.lastCycleMs,
+            (uint32_t)( gDutyCycle.radioOnMs / 1000 ), (uint32_t)( elapsed / 1000 ),
+            onPerHour);
+    }
+
+    return;
+}
+
+
+
+void xSensorAggregationSetUpdatePeriodCmd(const struct shell *shell, size_t argc, char **argv)
+{
+
+        if( argc != 2 ){
+            shell_print(shell, "Please provide the period in ms\r\n");
+            return;
+        }
+
+        if( ( xSensorAggregationSetUpdatePeriod( strtoul( argv[1], NULL, 10 ) ) ) == X_ERR_SUCCESS ){
+		    shell_print(shell, "Sensor Aggregation Update Period Set to %d ms", gUpdatePeriod);
+        }
+        else{
+            shell_error(shell, "Sensor Aggregation Could not Update Period");
+        }
+		return;
+}
+
+
+
+void xSensorAggregationProfileCmd(const struct shell *shell, size_t argc, char **argv){
+
+    xSensorAggregationProfile_t profile;
+    xSensType_t sensorType;
+    err_code err;
+
+    if( ( argc != 1 ) && ( argc != 2 ) && ( argc != 4 ) ){
+        shell_print(shell, "Please provide [uniform/multirate/custom] [sensor] [divisor] \r\n");
+        return;
+    }
+
+    if( argc >= 2 ){
+
+        for( profile = 0; profile < xSensAggProfileNum; profile++ ){
+            if( strcmp( argv[1], xSensorAggregationProfile_t_strings[profile] ) == 0 ){
+                break;
+            }
+        }
+
+        if( profile == xSensAggProfileNum ){
+            shell_error(shell, "Profile should be uniform/multirate/custom \r\n");
+            return;
+        }
+
+        if( argc == 2 ){
+            err = xSensorAggregationSetProfile( profile );
+        }
+        // rate divisor of a sensor, custom profile only
+        else{
+            if( profile != xSensAggProfileCustom ){
+                shell_error(shell, "Rate divisors can be set only in the custom profile \r\n");
+                return;
+            }
+
+            for( sensorType = 0; sensorType < max_sensors_num_t; sensorType++ ){
+                if( strcmp( argv[2], gSensorNames[sensorType] ) == 0 ){
+                    break;
+                }
+            }
+
+            err = xSensorAggregationSetRateDivisor( sensorType, atoi( argv[3] ) );
+        }
+
+        if( err == X_ERR_INVALID_STATE ){
+            shell_error(shell, "Disable Sensor Aggregation function first \r\n");
+            return;
+        }
+        if( err != X_ERR_SUCCESS ){
+            shell_error(shell, "Sensor should be BME280/BATTERY/LIS2DH12/LIS3MDL/LTR303/ICG20330/MAXM10 and divisor 1-%d \r\n",
+                        SENS_AGG_RATE_DIVISOR_MAX);
+            return;
+        }
+    }
+
+    shell_print(shell, "Aggregation profile: %s, sampling period: %d ms \r\n",
+                xSensorAggregationProfile_t_strings[gProfile], gUpdatePeriod);
+
+    for( sensorType = 0; sensorType < max_sensors_num_t; sensorType++ ){
+        shell_print(shell, "        - %s: every %d period(s), %d ms \r\n", gSensorNames[sensorType],
+                    gRateDivisors[ gProfile ][ sensorType ],
+                    gUpdatePeriod * gRateDivisors[ gProfile ][ sensorType ]);
+    }
+}
+
+
+
+void xSensorAggregationCellPowerSavingCmd(const struct shell *shell, size_t argc, char **argv){
+
+    bool enable;
+
+    if( argc != 2 ){
+        shell_print(shell, "Please provide <on/off> \r\n");
+        return;
+    }
+
+    if( strcmp( argv[1], "on" ) == 0 ){
+        enable = true;
+    }
+    else if( strcmp( argv[1], "off" ) == 0 ){
+        enable = false;
+    }
+    else{
+        shell_error(shell, "Parameter should be on/off \r\n");
+        return;
+    }
+
+    if( xSensorAggregationSetCellPowerSaving( enable ) != X_ERR_SUCCESS ){
+        shell_error(shell, "Disable Sensor Aggregation function first \r\n");
+        return;
+    }
+
+    xCellSaraPowerSaving_t timers;
+    SensorAggregationPowerSavingTimers( gUpdatePeriod, &timers );
+
+    shell_print(shell, "Cellular power saving %s. With period %d ms will request PSM: %s (active: %d s, periodic: %d s), eDRX: %s (%d s) \r\n",
+                enable ? "on" : "off", gUpdatePeriod,
+                timers.psmOn ? "on" : "off", timers.activeTimeS, timers.periodicWakeupS,
+                timers.eDrxOn ? "on" : "off", timers.eDrxS);
+}
+
+
+
+void xSensorAggregationFailoverCmd(const struct shell *shell, size_t argc, char **argv){
+
+    bool enable;
+
+    if( argc != 2 ){
+        shell_print(shell, "Please provide <on/off> \r\n");
+        return;
+    }
+
+    if( strcmp( argv[1], "on" ) == 0 ){
+        enable = true;
+    }
+    else if( strcmp( argv[1], "off" ) == 0 ){
+        enable = false;
+    }
+    else{
+        shell_error(shell, "Parameter should be on/off \r\n");
+        return;
+    }
+
+    if( xSensorAggregationSetFailover( enable ) != X_ERR_SUCCESS ){
+        shell_error(shell, "Disable Sensor Aggregation function first \r\n");
+        return;
+    }
+
+    shell_print(shell, "Failover %s \r\n", enable ? "on" : "off");
+}
+
+
+
+void xSensorAggregationDutyCycleCmd(const struct shell *shell, size_t argc, char **argv){
+
+    bool enable;
+    uint32_t batchSize = gDutyCycle.batchSize;
+    uint32_t maxLatencyMs = gDutyCycle.maxLatencyMs;
+
+    if( ( argc < 2 ) || ( argc > 4 ) ){
+        shell_print(shell, "Please provide <on/off> [batch size] [latency bound in seconds] \r\n");
+        return;
+    }
+
+    if( strcmp( argv[1], "on" ) == 0 ){
+        enable = true;
+    }
+    else if( strcmp( argv[1], "off" ) == 0 ){
+        enable = false;
+    }
+    else{
+        shell_error(shell, "First parameter should be on/off \r\n");
+        return;
+    }
+
+    if( ( argc >= 3 ) && !SensorAggregationParseUint( argv[2], DATA_BATCH_MAX_MSGS, &batchSize ) ){
+        shell_error(shell, "Batch size should be 1-%d \r\n", DATA_BATCH_MAX_MSGS);
+        return;
+    }
+    if( argc == 4 ){
+        if( !SensorAggregationParseUint( argv[3], SENS_AGG_CMD_MAX_SECONDS, &maxLatencyMs ) ){
+            shell_error(shell, "Latency bound should be 1-%d seconds \r\n", SENS_AGG_CMD_MAX_SECONDS);
+            return;
+        }
+        maxLatencyMs *= 1000;
+    }
+
+    err_code err = xSensorAggregationSetDutyCycle( enable, batchSize, maxLatencyMs );
+    if( err == X_ERR_INVALID_STATE ){
+        shell_error(shell, "Disable Sensor Aggregation function first \r\n");
+        return;
+    }
+    if( err != X_ERR_SUCCESS ){
+        shell_error(shell, "Batch size should be 1-%d and latency bound greater than 0 \r\n", DATA_BATCH_MAX_MSGS);
+        return;
+    }
+
+    shell_print(shell, "Duty-cycled transport %s (batch: %d messages, latency bound: %d ms) \r\n",
+                enable ? "on" : "off", batchSize, maxLatencyMs);
+}
+
+
+
+void xSensorAggregationLinkQualityCmd(const struct shell *shell, size_t argc, char **argv){
+
+    bool enable;
+    uint32_t maxDeferMs = gLinkQuality.maxDeferMs;
+
+    // no parameters: type the last sample and the deferral statistics
+    if( argc == 1 ){
+
+        if( gLinkQuality.sampledAt == 0 ){
+            shell_print(shell, "No link quality sample yet \r\n");
+            return;
+        }
+
+        if( gLinkQuality.mode == xSensAggModeWifi ){
+            shell_print(shell, "        - WiFi RSSI: %d dBm (min %d dBm)\r\n",
+                gLinkQuality.last.rssiDbm, SENS_AGG_LINK_MIN_RSSI_DBM);
+        }
+        else{
+            shell_print(shell, "        - Cell RSSI: %d dBm, RSRP: %d dBm (min %d dBm), RSRQ: %d dB (min %d dB), SINR: %d dB\r\n",
+                gLinkQuality.last.rssiDbm, gLinkQuality.last.rsrpDbm, SENS_AGG_LINK_MIN_RSRP_DBM,
+                gLinkQuality.last.rsrqDb, SENS_AGG_LINK_MIN_RSRQ_DB, gLinkQuality.last.sinrDb);
+        }
+
+        shell_print(shell, "\
+        - Sampled %d s ago, samples: %d (failed: %d)\r\n\
+        - Deferred flushes: %d, published on a poor link: %d\r\n",
+            (uint32_t)( ( k_uptime_get() - gLinkQuality.sampledAt ) / 1000 ),
+            gLinkQuality.samples, gLinkQuality.failedSamples,
+            gLinkQuality.deferrals, gLinkQuality.forcedFlushes);
+        return;
+    }
+
+    if( argc > 3 ){
+        shell_print(shell, "Please provide <on/off> [max deferral in seconds] \r\n");
+        return;
+    }
+
+    if( strcmp( argv[1], "on" ) == 0 ){
+        enable = true;
+    }
+    else if( strcmp( argv[1], "off" ) == 0 ){
+        enable = false;
+    }
+    else{
+        shell_error(shell, "First parameter should be on/off \r\n");
+        return;
+    }
+
+    if( argc == 3 ){
+        if( !SensorAggregationParseUint( argv[2], SENS_AGG_CMD_MAX_SECONDS, &maxDeferMs ) ){
+            shell_error(shell, "Max deferral should be 1-%d seconds \r\n", SENS_AGG_CMD_MAX_SECONDS);
+            return;
+        }
+        maxDeferMs *= 1000;
+    }
+
+    if( xSensorAggregationSetLinkQualityDefer( enable, maxDeferMs ) != X_ERR_SUCCESS ){
+        shell_error(shell, "Max deferral should be greater than 0 \r\n");
+        return;
+    }
+
+    shell_print(shell, "Link quality deferral %s (max: %d ms) \r\n", enable ? "on" : "off", maxDeferMs);
+}
@@ -23,8 +23,49 @@
  * @brief This file contains the API to access the main
  * functionality of Sensor Aggregation Use Case for XPLR-IOT-1.
  * This functionality is to sample all sensors with the same sampling
- * period and then send those data to thingstream portal in a single 
- * message (one message per sampling period)
+ * period (or a multiple of it, see the aggregation profiles below) and then
+ * send those data to thingstream portal in a single message (one message per
+ * sampling period)
+ *
+ * Start/stop requests are queued to a single state machine thread
+ * (Idle -> Starting -> Running -> Stopping -> Idle) and handled one at a
+ * time, so a start over one transport while the functionality runs over the
+ * other stops it first, without polling. The latency of each transition, from
+ * the request until the new state, is reported by the status command.
+ *
+ * In duty-cycled transport mode (see xSensorAggregationSetDutyCycle) sensors
+ * are sampled as usual but messages are kept in a batch (x_data_handle.h) and
+ * the WiFi/cellular module is powered and connected only to publish the batch,
+ * when it is full or its oldest message has waited for the latency bound. The
+ * module is then disconnected and powered off again. When the functionality
+ * stops, the messages still batched are published before the link goes down.
+ *
+ * With failover enabled (see xSensorAggregationSetFailover) the link health is
+ * monitored while the functionality runs: after SENS_AGG_FAILOVER_MAX_FAILURES
+ * consecutive failed publishes it switches to the other transport, keeping
+ * sensors sampling and holding the messages that could not be published
+ * (x_data_handle.h) until the new link is up. It fails back to the preferred
+ * transport (the one started) after SENS_AGG_FAILBACK_PERIOD_MS.
+ *
+ * With cellular power saving enabled (see xSensorAggregationSetCellPowerSaving)
+ * SARA-R5 PSM/eDRX timers are requested from the sampling period when the
+ * cellular functionality starts, so the modem sleeps between publishes.
+ *
+ * While the functionality runs, the link quality (WiFi RSSI, cellular RSSI/RSRP/
+ * RSRQ/SINR) is sampled every SENS_AGG_LINK_SAMPLE_PERIOD_MS (in duty-cycled
+ * transport mode each time the link is brought up) and published as a diagnostics
+ * message (see xDataSendDiagnostics). In duty-cycled transport mode the message is
+ * published right after the batch, and not for deferred flushes. With link quality deferral enabled (see
+ * xSensorAggregationSetLinkQualityDefer) a batch flush triggered by the latency
+ * bound is deferred while the quality is below the SENS_AGG_LINK_MIN_* thresholds,
+ * retried every SENS_AGG_LINK_RETRY_MS, until the max deferral expires. A full
+ * batch is always published.
+ *
+ * Sensors are sampled according to the aggregation profile (see
+ * xSensorAggregationSetProfile): each sensor has a rate divisor N and is sampled
+ * every N sampling periods (epochs). The message of each epoch includes only the
+ * sensors due in this epoch, so slow signals (e.g. battery, pressure) load the
+ * I2C bus and the payload less than fast ones.
  */
 
 
@@ -33,6 +74,7 @@
 #include <shell/shell.h>
 
 #include "x_errno.h"
+#include "x_sens_common_types.h"
 
 
 /* ----------------------------------------------------------------
@@ -57,6 +99,15 @@ typedef enum{
 }xSensorAggregationMode_t;
 
 
+/** Sensor aggregation profiles: the rate divisor of each sensor */
+typedef enum{
+    xSensAggProfileUniform,   /**< All sensors sampled every sampling period (default) */
+    xSensAggProfileMultiRate, /**< Slow signals sampled less often, see SENS_AGG_MULTIRATE_DIV_* */
+    xSensAggProfileCustom,    /**< Rate divisors set with xSensorAggregationSetRateDivisor */
+    xSensAggProfileNum
+}xSensorAggregationProfile_t;
+
+
 /* ----------------------------------------------------------------
  * FUNCTIONS
  * -------------------------------------------------------------- */
@@ -65,10 +116,10 @@ typedef enum{
 /** Start Sensor Aggregation Functionality over WiFi. Performs all
  * necessary operations (sets up WiFi network, connects to MQTT 
  * enables sensors etc)
- * Does so, by calling the appropriate thread
+ * Does so, by posting a request to the state machine thread
  * 
  * If Sensor Aggregation functionality over Cellular is already enabled,
- * Cellular is disabled before enabling WiFi.
+ * Cellular is disabled before enabling WiFi (by the same request).
  * 
  * Possible error Messages are typed in uart console
 */
@@ -78,7 +129,7 @@ void xSensorAggregationStartWifi(void);
 /** Stops Sensor Aggregation Functionality over WiFi. Performs all
  * necessary operations (disconnects WiFi network, disconnects MQTT 
  * disables sensors etc)
- * Does so, by calling the appropriate thread
+ * Does so, by posting a request to the state machine thread
  * 
  * Possible error Messages are typed in uart console
  * 
@@ -91,10 +142,10 @@ void xSensorAggregationStopWifi(void);
 /** Start Sensor Aggregation Functionality over Cellluar. Performs all
  * necessary operations (connects to Cell, connects to MQTT-SN 
  * enables sensors etc)
- * Does so, by calling the appropriate thread
+ * Does so, by posting a request to the state machine thread
  * 
  * If Sensor Aggregation functionality over WiFi is already enabled,
- * WiFi is disabled before enabling Cellular.
+ * WiFi is disabled before enabling Cellular (by the same request).
  * 
  * Possible error Messages are typed in uart console
 */
@@ -104,7 +155,7 @@ void xSensorAggregationStartCell(void);
 /** Stops Sensor Aggregation Functionality over Cellular. Performs all
  * necessary operations (disconnects Cell, disconnects MQTT-SN 
  * disables sensors etc)
- * Does so, by calling the appropriate thread
+ * Does so, by posting a request to the state machine thread
  * 
  * Possible error Messages are typed in uart console
  * 
@@ -115,22 +166,51 @@ void xSensorAggregationStopCell(void);
 
 
 /** When Sensor Aggregatio mode is enabled all sensors are sampled with
- * the same period. There is a default period defined in 
+ * the same period (multiplied by the rate divisor of each sensor, see
+ * xSensorAggregationSetProfile). There is a default period defined in 
  * SENS_AGG_DEFAULT_UPDATE_PERIOD_MS, however the user can change this period
  * by using this function.
  * 
- * Prerequisites: Sensor Aggregation mode should be disabled when this 
- * function is called
+ * If the function is running, the period is applied to all sensors after a
+ * start/stop transition in progress (X_ERR_TIMEOUT if it does not end within
+ * SENS_AGG_CONFIG_TIMEOUT_MS). If a sensor rejects it, the previous period
+ * is restored and nothing changes.
  * 
  * Possible errors in the period parameter are shown in the uart console
  *
- * @param milliseconds  The update period in milliseconds. Some restrictions may apply,
+ * @param milliseconds  The update period in milliseconds (SENS_AGG_MIN_UPDATE_PERIOD_MS
+ *                      up to SENS_AGG_MAX_UPDATE_PERIOD_MS). Some restrictions may apply,
  *                      see xPosMaxM10TimeoutPeriodCmd() description
  * @return              zero on success else negative error code.
  */
 err_code xSensorAggregationSetUpdatePeriod(uint32_t milliseconds);
 
 
+/** Set the sampling period of a sensor. While the function is disabled this
+ * is the same as xSensSetUpdatePeriod(). While it runs, the period should be
+ * a multiple of the sampling period (xSensorAggregationGetUpdatePeriod) and
+ * sets the rate divisor of the sensor in the custom profile, which is selected.
+ * The change is applied like xSensorAggregationSetUpdatePeriod(): after a
+ * transition in progress, and restored if a sensor rejects it.
+ *
+ * @param sensorType    The sensor, max_sensors_num_t for all sensors.
+ * @param milliseconds  The sampling period in milliseconds.
+ * @return              zero on success else negative error code.
+ */
+err_code xSensorAggregationSetSensorRate(xSensType_t sensorType, uint32_t milliseconds);
+
+
+/** Enable/disable publish for the measurements of a sensor (see
+ * xSensEnablePublish), also while the function runs. The change is applied
+ * after a start/stop transition in progress.
+ *
+ * @param sensorType    The sensor, max_sensors_num_t for all sensors.
+ * @param enable        true to publish the measurements, false otherwise.
+ * @return              zero on success else negative error code.
+ */
+err_code xSensorAggregationSetSensorPublish(xSensType_t sensorType, bool enable);
+
+
 /** Get currently set update period of Sensor Aggregation Functionality.
  *
  * @return        The sampling (update) period in ms.
@@ -138,6 +218,40 @@ err_code xSensorAggregationSetUpdatePeriod(uint32_t milliseconds);
 int32_t xSensorAggregationGetUpdatePeriod(void);
 
 
+/** Select the aggregation profile, which gives the rate divisor of each
+ * sensor. A sensor with rate divisor N is sampled every N sampling periods
+ * and included only in the messages of those periods.
+ * 
+ * Prerequisites: Sensor Aggregation mode should be disabled when this 
+ * function is called
+ *
+ * @param profile   The profile.
+ * @return          zero on success else negative error code.
+ */
+err_code xSensorAggregationSetProfile(xSensorAggregationProfile_t profile);
+
+
+/** Set the rate divisor of a sensor in the custom profile and select it
+ * (the divisors of the custom profile start from those of the active profile).
+ * 
+ * Prerequisites: Sensor Aggregation mode should be disabled when this 
+ * function is called
+ *
+ * @param sensorType  The sensor.
+ * @param divisor     Sampled every divisor periods (1 up to SENS_AGG_RATE_DIVISOR_MAX).
+ * @return            zero on success else negative error code.
+ */
+err_code xSensorAggregationSetRateDivisor(xSensType_t sensorType, uint32_t divisor);
+
+
+/** Get the rate divisor of a sensor in the active aggregation profile.
+ *
+ * @param sensorType  The sensor.
+ * @return            The rate divisor (1 for invalid sensors).
+ */
+uint32_t xSensorAggregationGetRateDivisor(xSensType_t sensorType);
+
+
 /** Get Sensor Aggregation Functionality current mode.
  *
  * @return        Current Sensor Aggregation Mode as 
@@ -153,8 +267,9 @@ xSensorAggregationMode_t xSensorAggregationGetMode(void);
  * If that happens, it may lead to unexpected results.
  * 
  * This function informs whether the Sensor Aggregation functionality
- * is locked (in the middle of config, connect etc) and commands like
- * stop or switch mode should not be issued.
+ * is locked (start/stop requests pending or in progress, or link being
+ * switched by failover) and commands like stop or switch mode should
+ * not be issued.
  *
  * @return        True = functionality locked. Do not send new stop 
  *                or start commands.
@@ -163,13 +278,99 @@ xSensorAggregationMode_t xSensorAggregationGetMode(void);
 bool xSensorAggregationIsLocked(void);
 
 
+/** Enables/disables duty-cycled transport mode. Applied the next time
+ * Sensor Aggregation Functionality starts.
+ * 
+ * Prerequisites: Sensor Aggregation mode should be disabled when this 
+ * function is called
+ *
+ * @param enable        True to bring the link up only to publish batches.
+ * @param batchSize     Messages kept before the link is brought up
+ *                      (1 up to DATA_BATCH_MAX_MSGS).
+ * @param maxLatencyMs  Max time a message is kept before the link is brought up.
+ * @return              zero on success else negative error code.
+ */
+err_code xSensorAggregationSetDutyCycle(bool enable, uint32_t batchSize, uint32_t maxLatencyMs);
+
+
+/** Enables/disables deferral of non-urgent batch flushes (latency bound expired,
+ * batch not full) in duty-cycled transport mode while the link quality is below
+ * the thresholds of the transport (SENS_AGG_LINK_MIN_RSSI_DBM for WiFi,
+ * SENS_AGG_LINK_MIN_RSRP_DBM/SENS_AGG_LINK_MIN_RSRQ_DB for cellular). Can be
+ * changed while the functionality runs.
+ *
+ * @param enable      True to defer flushes on a poor link.
+ * @param maxDeferMs  Max time a flush is deferred, then the batch is published
+ *                    regardless of the link quality.
+ * @return            zero on success else negative error code.
+ */
+err_code xSensorAggregationSetLinkQualityDefer(bool enable, uint32_t maxDeferMs);
+
+
+/** Enables/disables SARA-R5 power saving in cellular Sensor Aggregation.
+ * When enabled, PSM/eDRX timers are derived from the sampling period and
+ * requested when the functionality starts via cellular (see x_cell_saraR5.h):
+ * - Periods from SARA_PSM_MIN_PERIOD_MS: PSM with SARA_PSM_ACTIVE_TIME_S active
+ *   time and a periodic wake-up of twice the period (SARA_PSM_TAU_MIN_S min).
+ *   ubxlib wakes the module from deep sleep before the next publish.
+ * - Shorter periods: eDRX with the longest LTE-M cycle up to half the period
+ *   (see xCellSaraGetEDrxCycleMs, not requested when shorter than 5.12 s).
+ * 
+ * Prerequisites: Sensor Aggregation mode should be disabled when this 
+ * function is called
+ *
+ * @param enable  True to request power saving timers.
+ * @return        zero on success else negative error code.
+ */
+err_code xSensorAggregationSetCellPowerSaving(bool enable);
+
+
+/** Enables/disables automatic failover between WiFi and cellular. Applied the
+ * next time Sensor Aggregation Functionality starts (not used in duty-cycled
+ * transport mode). 
+ * 
+ * NINA-W156 and SARA-R5 share the same uart, so only one link can be up at a
+ * time: the preferred link is retried by switching back to it every
+ * SENS_AGG_FAILBACK_PERIOD_MS and, if it is still down, the fallback link is
+ * restored.
+ * 
+ * Prerequisites: Sensor Aggregation mode should be disabled when this 
+ * function is called
+ *
+ * @param enable  True to fail over automatically.
+ * @return        zero on success else negative error code.
+ */
+err_code xSensorAggregationSetFailover(bool enable);
+
+
+/** Called by the data handling module with the result of each publish while
+ * messages are held on failure (failover running). Consecutive failures
+ * trigger the failover.
+ *
+ * @param success  True if the message was published.
+ */
+void xSensorAggregationPublishResult(bool success);
+
+
+/** Called by the data handling module when a message has been added to the
+ * batch. In duty-cycled transport mode it brings the link up when the batch
+ * is full, and starts the latency bound with the first message of a batch.
+ *
+ * @param batchCount  Number of messages in the batch.
+ */
+void xSensorAggregationBatchNotify(uint32_t batchCount);
+
+
 /* ----------------------------------------------------------------
  * FUNCTIONS IMPLEMENTING SHELL-COMMANDS
  * -------------------------------------------------------------- */
 
 /** This function is intented only to be used as a command executed by the shell.
  * It basically types the current xSensorAggregationMode_t mode of the device and
- * the sampling period set for sensor aggregation functionality
+ * the sampling period set for sensor aggregation functionality, the state machine
+ * state and the transition latency. In duty-cycled
+ * transport mode it also types the link cycles and the estimated radio-on time
+ * per hour, with failover the active transport and the switchover times
  *
  * @param shell  the shell instance from which the command is given.
  * @param argc   Not used.
@@ -189,4 +390,66 @@ void xSensorAggregationTypeStatusCmd(const struct shell *shell, size_t argc, cha
 void xSensorAggregationSetUpdatePeriodCmd(const struct shell *shell, size_t argc, char **argv);
 
 
-#endif    //X_SENSOR_AGGREGATION_FUNCTION_H__
\ No newline at end of file
+/** This function is intented only to be used as a command executed by the shell.
+ * It implements the shell command: "functions profile [uniform/multirate/custom]
+ * [sensor] [divisor]" by calling xSensorAggregationSetProfile() or, with a sensor
+ * and divisor, xSensorAggregationSetRateDivisor(). Without parameters it types
+ * the active profile and the rate divisors
+ * 
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command (0, 1 or 3).
+ * @param argv   the array including the parameters themselves (profile, sensor,
+ *               rate divisor).
+ */
+void xSensorAggregationProfileCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It implements the shell command: "functions cell_power_saving <on/off>" 
+ * by calling xSensorAggregationSetCellPowerSaving() and types the timers
+ * that will be requested with the current sampling period
+ * 
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command (should be 1).
+ * @param argv   the array including the parameters themselves (on/off).
+ */
+void xSensorAggregationCellPowerSavingCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It implements the shell command: "functions failover <on/off>" 
+ * by calling xSensorAggregationSetFailover()
+ * 
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command (should be 1).
+ * @param argv   the array including the parameters themselves (on/off).
+ */
+void xSensorAggregationFailoverCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It implements the shell command: "functions duty_cycle <on/off> [batch] [latency_s]" 
+ * by calling xSensorAggregationSetDutyCycle()
+ * 
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command (1 up to 3).
+ * @param argv   the array including the parameters themselves (on/off, batch size,
+ *               latency bound in seconds).
+ */
+void xSensorAggregationDutyCycleCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+/** This function is intented only to be used as a command executed by the shell.
+ * It implements the shell command: "functions link_quality [on/off] [max_defer_s]" 
+ * by calling xSensorAggregationSetLinkQualityDefer(). Without parameters it types
+ * the last link quality sample and the deferral statistics
+ * 
+ * @param shell  the shell instance from which the command is given.
+ * @param argc   the number of parameters given along with the command (0 up to 2).
+ * @param argv   the array including the parameters themselves (on/off, max
+ *               deferral in seconds).
+ */
+void xSensorAggregationLinkQualityCmd(const struct shell *shell, size_t argc, char **argv);
+
+
+#endif    //X_SENSOR_AGGREGATION_FUNCTION_H__